@@ -0,0 +1,197 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_allocator.h"
+
+
+/* Private Functions */
+void *_ptl_malloc_alloc(void *ctx, size_t size);
+void *_ptl_malloc_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size);
+void _ptl_malloc_free(void *ctx, void *ptr, size_t size);
+void *_ptl_counting_alloc(void *ctx, size_t size);
+void *_ptl_counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size);
+void _ptl_counting_free(void *ctx, void *ptr, size_t size);
+void _ptl_counting_add(struct ptl_allocator_stats *stats, long bytes);
+
+
+/* Global Variables */
+
+/* plain malloc, and the default which starts out as it */
+struct ptl_allocator ptl_malloc_allocator = {
+	_ptl_malloc_alloc, _ptl_malloc_realloc, _ptl_malloc_free, NULL
+};
+ptl_allocator_t ptl_default_allocator = &ptl_malloc_allocator;
+
+
+/* the current default */
+ptl_allocator_t ptl_get_default_allocator(){
+	return __atomic_load_n(&ptl_default_allocator, __ATOMIC_ACQUIRE);
+}
+
+
+/* plain malloc, whatever the default is */
+ptl_allocator_t ptl_get_malloc_allocator(){
+	return &ptl_malloc_allocator;
+}
+
+
+/* replace the default, NULL puts malloc back */
+void ptl_set_default_allocator(ptl_allocator_t allocator){
+	if(allocator == NULL){
+		allocator = &ptl_malloc_allocator;
+	}
+
+	__atomic_store_n(&ptl_default_allocator, allocator, __ATOMIC_RELEASE);
+}
+
+
+/* NULL means the default */
+ptl_allocator_t ptl_resolve_allocator(ptl_allocator_t allocator){
+	return (allocator != NULL) ? allocator : ptl_get_default_allocator();
+}
+
+
+/* allocate from 'allocator' */
+void *ptl_alloc(ptl_allocator_t allocator, size_t size){
+	allocator = ptl_resolve_allocator(allocator);
+
+	void *ptr = allocator->alloc(allocator->ctx, size);
+	assert(ptr);
+
+	return ptr;
+}
+
+
+/* allocate from 'allocator' and zero it */
+void *ptl_calloc(ptl_allocator_t allocator, size_t num, size_t size){
+	void *ptr = ptl_alloc(allocator, num * size);
+	memset(ptr, 0, num * size);
+
+	return ptr;
+}
+
+
+/* resize memory from 'allocator' */
+void *ptl_realloc(ptl_allocator_t allocator, void *ptr, size_t old_size, size_t new_size){
+	if(ptr == NULL){ return ptl_alloc(allocator, new_size); }
+
+	allocator = ptl_resolve_allocator(allocator);
+
+	void *new_ptr = allocator->realloc(allocator->ctx, ptr, old_size, new_size);
+	assert(new_ptr);
+
+	return new_ptr;
+}
+
+
+/* give memory back to 'allocator' */
+void ptl_free(ptl_allocator_t allocator, void *ptr, size_t size){
+	if(ptr == NULL){ return; }
+
+	allocator = ptl_resolve_allocator(allocator);
+	allocator->free(allocator->ctx, ptr, size);
+}
+
+
+/* an allocator that counts what goes through 'inner' */
+void ptl_init_counting_allocator(ptl_allocator_t allocator, struct ptl_allocator_stats *stats,
+								 ptl_allocator_t inner){
+	assert(allocator && stats);
+
+	memset(stats, 0, sizeof(struct ptl_allocator_stats));
+	stats->inner = ptl_resolve_allocator(inner);
+
+	allocator->alloc = _ptl_counting_alloc;
+	allocator->realloc = _ptl_counting_realloc;
+	allocator->free = _ptl_counting_free;
+	allocator->ctx = stats;
+}
+
+
+/* Private Functions */
+
+/* malloc */
+void *_ptl_malloc_alloc(void *ctx, size_t size){
+	return malloc(size);
+}
+
+/* realloc */
+void *_ptl_malloc_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size){
+	return realloc(ptr, new_size);
+}
+
+/* free */
+void _ptl_malloc_free(void *ctx, void *ptr, size_t size){
+	free(ptr);
+}
+
+/* counts, then allocates from the inner allocator */
+void *_ptl_counting_alloc(void *ctx, size_t size){
+	struct ptl_allocator_stats *stats = (struct ptl_allocator_stats *)ctx;
+
+	void *ptr = stats->inner->alloc(stats->inner->ctx, size);
+	if(ptr != NULL){
+		__atomic_add_fetch(&(stats->num_allocs), 1, __ATOMIC_RELAXED);
+		_ptl_counting_add(stats, (long)size);
+	}
+
+	return ptr;
+}
+
+/* counts, then reallocates with the inner allocator */
+void *_ptl_counting_realloc(void *ctx, void *ptr, size_t old_size, size_t new_size){
+	struct ptl_allocator_stats *stats = (struct ptl_allocator_stats *)ctx;
+
+	void *new_ptr = stats->inner->realloc(stats->inner->ctx, ptr, old_size, new_size);
+	if(new_ptr != NULL){
+		__atomic_add_fetch(&(stats->num_allocs), 1, __ATOMIC_RELAXED);
+		_ptl_counting_add(stats, (long)new_size - (long)old_size);
+	}
+
+	return new_ptr;
+}
+
+/* counts, then frees with the inner allocator */
+void _ptl_counting_free(void *ctx, void *ptr, size_t size){
+	struct ptl_allocator_stats *stats = (struct ptl_allocator_stats *)ctx;
+
+	stats->inner->free(stats->inner->ctx, ptr, size);
+
+	__atomic_add_fetch(&(stats->num_frees), 1, __ATOMIC_RELAXED);
+	_ptl_counting_add(stats, -(long)size);
+}
+
+/* adds to the bytes in use, raising the peak if it was passed */
+void _ptl_counting_add(struct ptl_allocator_stats *stats, long bytes){
+	long in_use = __atomic_add_fetch(&(stats->bytes_in_use), bytes, __ATOMIC_RELAXED);
+	long peak = __atomic_load_n(&(stats->peak_bytes), __ATOMIC_RELAXED);
+
+	while(in_use > peak){
+		if(__atomic_compare_exchange_n(&(stats->peak_bytes), &peak, in_use,
+									   1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+			break;
+		}
+	}
+}
@@ -0,0 +1,161 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * An allocator is a set of alloc/realloc/free functions plus a context
+ * pointer that is passed to each of them. Every ptl container has a
+ * '_allocator' flavor of its create function; all of the memory the
+ * container needs afterwards comes from that allocator. This is how
+ * container memory is put in an arena, on huge pages or on a NUMA node, or
+ * counted per subsystem (see ptl_init_counting_allocator()).
+ *
+ * Passing a NULL allocator means the process-wide default, which is malloc
+ * unless ptl_set_default_allocator() was called. A container looks up the
+ * default once, when it is created, and keeps using that allocator until it
+ * is destroyed, so changing the default later does not affect it.
+ *
+ * 'free' and 'realloc' are always given the size that was asked for when
+ * the memory was allocated, so an allocator does not need to remember it.
+ */
+
+
+#ifndef __PTL_ALLOCATOR_H__
+#define __PTL_ALLOCATOR_H__
+
+#include <stddef.h>
+
+/* Macros */
+
+/* Like FREE(), but gives the memory back to 'allocator' */
+#define PTL_FREE(allocator,x,size) {if(x) {ptl_free(allocator, x, size); x = NULL;}}
+
+/* Structures */
+struct ptl_allocator {
+	void *(*alloc)(void *ctx, size_t size);		/**< like malloc, NULL if out of memory */
+	void *(*realloc)(void *ctx, void *ptr, size_t old_size, size_t new_size); /**< like realloc */
+	void (*free)(void *ctx, void *ptr, size_t size);	/**< like free */
+	void *ctx;									/**< passed to the functions above */
+};
+
+/* Counts what goes through another allocator */
+struct ptl_allocator_stats {
+	struct ptl_allocator *inner;	/**< allocator that does the work */
+	long num_allocs;				/**< allocations, reallocations included */
+	long num_frees;					/**< frees */
+	long bytes_in_use;				/**< bytes allocated and not yet freed */
+	long peak_bytes;				/**< most bytes in use at one time */
+};
+
+/* Type Definitions */
+typedef struct ptl_allocator *ptl_allocator_t;
+
+
+/* Public Functions */
+
+/**
+ * Gets the process-wide default allocator.
+ *
+ * @return the default allocator, never NULL
+ */
+ptl_allocator_t ptl_get_default_allocator();
+
+/**
+ * Gets the built-in malloc allocator, the default unless
+ * ptl_set_default_allocator() was called. It is valid for the life of the
+ * process.
+ *
+ * @return the malloc allocator, never NULL
+ */
+ptl_allocator_t ptl_get_malloc_allocator();
+
+/**
+ * Sets the process-wide default allocator, used by containers created
+ * from now on with a NULL allocator (or with a create function that does not
+ * take one). Containers that already exist keep theirs. The allocator must
+ * stay valid until every container using it is destroyed.
+ *
+ * @param allocator the new default, NULL to go back to malloc
+ */
+void ptl_set_default_allocator(ptl_allocator_t allocator);
+
+/**
+ * Gets the allocator a container should keep: 'allocator' itself, or the
+ * current default if it is NULL.
+ *
+ * @param allocator allocator passed to a create function
+ * @return the allocator to use, never NULL
+ */
+ptl_allocator_t ptl_resolve_allocator(ptl_allocator_t allocator);
+
+/**
+ * Allocates 'size' bytes from 'allocator'. Running out of memory is treated
+ * the same as a failed malloc elsewhere in this library (an assert).
+ *
+ * @param allocator allocator to use, NULL for the default
+ * @param size number of bytes
+ * @return the memory
+ */
+void *ptl_alloc(ptl_allocator_t allocator, size_t size);
+
+/**
+ * Allocates 'num' zeroed elements of 'size' bytes from 'allocator'.
+ *
+ * @param allocator allocator to use, NULL for the default
+ * @param num number of elements
+ * @param size bytes per element
+ * @return the memory, set to zero
+ */
+void *ptl_calloc(ptl_allocator_t allocator, size_t num, size_t size);
+
+/**
+ * Resizes memory that came from 'allocator'. The contents up to the smaller
+ * of the two sizes are kept.
+ *
+ * @param allocator allocator the memory came from, NULL for the default
+ * @param ptr memory to resize, NULL to allocate
+ * @param old_size size 'ptr' was allocated with
+ * @param new_size size wanted
+ * @return the resized memory, possibly moved
+ */
+void *ptl_realloc(ptl_allocator_t allocator, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Gives memory back to 'allocator'. Does nothing if 'ptr' is NULL.
+ *
+ * @param allocator allocator the memory came from, NULL for the default
+ * @param ptr memory to free
+ * @param size size 'ptr' was allocated with
+ */
+void ptl_free(ptl_allocator_t allocator, void *ptr, size_t size);
+
+/**
+ * Sets up 'allocator' to pass every call on to 'inner', counting the calls
+ * and the bytes in use in 'stats'. The counts are updated atomically, so the
+ * allocator may be shared by threads. 'stats' is zeroed first and must
+ * outlive 'allocator'.
+ *
+ * @param allocator allocator to set up
+ * @param stats where the counts are kept
+ * @param inner allocator that does the work, NULL for the current default
+ */
+void ptl_init_counting_allocator(ptl_allocator_t allocator, struct ptl_allocator_stats *stats,
+								 ptl_allocator_t inner);
+
+#endif
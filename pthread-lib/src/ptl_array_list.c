@@ -29,13 +29,89 @@
 #include <malloc.h>
 #include <assert.h>
 #include <string.h>
+#include "ptl_allocator.h"
 #include "ptl_array_list.h"
 #include "ptl_queue.h"
+#include "ptl_thread_pool.h"
+#include "ptl_task.h"
+#include "ptl_thread_manager.h"
+#include "ptl_parallel.h"
 #include "ptl_util.h"
 
+/* vectorized searches are only built where pointers are 64 bits */
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define PTL_AL_HAVE_SIMD 1
+#endif
+
+/* Structures */
+
+/* One merge, or part of a merge, of a parallel sort round */
+struct ptl_al_merge_part {
+	int a_lo, a_hi;		/**< range of the first sorted run */
+	int b_lo, b_hi;		/**< range of the second sorted run */
+	int out;			/**< where the merged range starts */
+};
+
+/* Shared by all the threads of a parallel sort */
+struct ptl_al_sort_job {
+	void **array;							/**< the list's array */
+	void **src;								/**< sorted runs of this round */
+	void **dst;								/**< where this round merges to */
+	int n;									/**< number of elements */
+	int (*cmp)(const void *, const void *);	/**< compares two elements */
+	int num_threads;						/**< threads working, caller included */
+	int num_chunks;							/**< pieces sorted in the first step, a power of two */
+	int run_chunks;							/**< chunks per sorted run this round */
+	struct ptl_al_merge_part *parts;		/**< merges of this round */
+	int num_parts;							/**< number of 'parts' */
+};
+
 /* Private Functions */
-void _check_capacity(ptl_array_list_t array_list, int size);
+void _check_capacity(ptl_array_list_t array_list, int min_capacity);
+void _free_storage(ptl_array_list_t array_list);
 void _shift_elements(ptl_array_list_t array_list, int index, int num_places);
+void _mark_occupied(ptl_array_list_t array_list, int from, int to);
+void _shift_occupied(ptl_array_list_t array_list, int from, int to, int num_places);
+int _occupied_end(ptl_array_list_t array_list);
+unsigned long _range_mask(int w, int from, int to);
+int _search_length(ptl_array_list_t array_list);
+void _select_search();
+int _find_scalar(void **array, int length, void *value);
+int _find_any_scalar(void **array, int length, void **values, int num_values, int *indexes);
+int _find_any_scalar_from(void **array, int from, int to, void **values, int num_values, int *indexes);
+#ifdef PTL_AL_HAVE_SIMD
+int _find_sse2(void **array, int length, void *value);
+int _find_avx2(void **array, int length, void *value);
+int _find_any_avx2(void **array, int length, void **values, int num_values, int *indexes);
+#endif
+int _sort_prepare(ptl_array_list_t array_list);
+void _sort_range(void **array, int lo, int hi, int (*cmp)(const void *, const void *), int depth);
+void _insertion_sort(void **array, int lo, int hi, int (*cmp)(const void *, const void *));
+void _heap_sort(void **array, int lo, int hi, int (*cmp)(const void *, const void *));
+void _sift_down(void **array, int root, int n, int (*cmp)(const void *, const void *));
+int _sort_depth(int n);
+int _merge_split(void **a, int m, void **b, int n, int k, int (*cmp)(const void *, const void *));
+void _merge(void **a, int m, void **b, int n, void **out, int (*cmp)(const void *, const void *));
+void _sort_plan_round(struct ptl_al_sort_job *job);
+void _sort_chunks(long begin, long end, void *arg);
+void _sort_merge_parts(long begin, long end, void *arg);
+
+/* Global Variables */
+
+/* search functions, picked once from what the cpu supports */
+pthread_once_t ptl_al_search_once = PTHREAD_ONCE_INIT;
+int (*ptl_al_find)(void **, int, void *) = _find_scalar;
+int (*ptl_al_find_any)(void **, int, void **, int, int *) = _find_any_scalar;
+int _find_free(ptl_array_list_t array_list, int from);
+
+/* Defines */
+#define PTL_AL_INSERTION_SORT_CUTOFF 16		/**< ranges this small use insertion sort */
+#define PTL_AL_PARALLEL_SORT_CUTOFF 16384	/**< lists this small are sorted by one thread */
+#define PTL_AL_MIN_MERGE_PART 4096			/**< smallest part of a parallel merge */
+#define PTL_AL_MAX_SORT_THREADS 64
+#define PTL_AL_WORD_BITS ((int)(8 * sizeof(unsigned long)))
+#define PTL_AL_BITMAP_WORDS(capacity) (((capacity) + PTL_AL_WORD_BITS - 1) / PTL_AL_WORD_BITS)
 
 /* creates the array list with an inital size of 10. */
 ptl_array_list_t ptl_al_create_array_list(){
@@ -45,37 +121,87 @@ ptl_array_list_t ptl_al_create_array_list(){
 
 /* creates the array list with an inital size of 'size'. */
 ptl_array_list_t ptl_al_create_array_list_size(int size){
+	return ptl_al_create_array_list_mode(size, PTL_AL_MODE_SPARSE);
+}
+
+
+/* creates the array list with an inital size of 'size' in the given mode. */
+ptl_array_list_t ptl_al_create_array_list_mode(int size, int mode){
+	return ptl_al_create_array_list_allocator(size, mode, NULL);
+}
+
+
+/* creates the array list with all of its memory from 'allocator'. */
+ptl_array_list_t ptl_al_create_array_list_allocator(int size, int mode, ptl_allocator_t allocator){
 	if(size <= 0) { return 0; }
+	if(mode != PTL_AL_MODE_DENSE && mode != PTL_AL_MODE_SPARSE) { return 0; }
 	
-	ptl_array_list_t array_list = (ptl_array_list_t)calloc(1, sizeof(struct ptl_array_list));
-	assert(array_list);
+	allocator = ptl_resolve_allocator(allocator);
+	
+	ptl_array_list_t array_list = (ptl_array_list_t)ptl_calloc(allocator, 1, sizeof(struct ptl_array_list));
+	
+	ptl_al_init_array_list_allocator(array_list, size, mode, allocator);
+	array_list->allocated = 1; // destroy frees the struct too
+	
+	return array_list;
+}
+
+
+/* creates the array list with its elements in the struct */
+ptl_array_list_t ptl_al_create_array_list_small(int mode){
+	return ptl_al_create_array_list_mode(PTL_AL_INLINE_CAPACITY, mode);
+}
+
+
+/* initializes a list in memory the caller owns */
+int ptl_al_init_array_list(ptl_array_list_t array_list, int size, int mode){
+	return ptl_al_init_array_list_allocator(array_list, size, mode, NULL);
+}
+
+
+/* initializes a list in memory the caller owns, allocating from 'allocator' */
+int ptl_al_init_array_list_allocator(ptl_array_list_t array_list, int size, int mode,
+									 ptl_allocator_t allocator){
+	if(array_list == NULL || size <= 0) { return 0; }
+	if(mode != PTL_AL_MODE_DENSE && mode != PTL_AL_MODE_SPARSE) { return 0; }
 	
 	// initialize 
+	array_list->allocator = ptl_resolve_allocator(allocator);
+	array_list->allocated = 0;
 	array_list->capacity = size; // parameter 'size' is 'capacity' in this struct
 	array_list->size = 0; // this is the current size of the array (not the parameter above)
 	array_list->array = NULL;
 	
-	int malloc_size = size * (sizeof(void *)); // size of ptr * capacity (size)
-	array_list->array = (void *)calloc(array_list->capacity, sizeof(void *));
-	assert(array_list->array);
-	array_list->malloc_size = malloc_size; // store the 'real' size of this array
+	if(size <= PTL_AL_INLINE_CAPACITY){
+		// small enough to keep in the struct, no allocation, and all of it is usable
+		memset(array_list->inline_array, 0, sizeof(array_list->inline_array));
+		array_list->array = array_list->inline_array;
+		array_list->capacity = PTL_AL_INLINE_CAPACITY;
+	} else {
+		array_list->array = (void **)ptl_calloc(array_list->allocator, array_list->capacity, sizeof(void *));
+	}
+	array_list->malloc_size = array_list->capacity * (sizeof(void *)); // store the 'real' size of this array
 	
-	return array_list;
+	// only a sparse list needs to know which slots are taken
+	array_list->mode = mode;
+	array_list->occupied = NULL;
+	array_list->inline_occupied = 0;
+	if(mode == PTL_AL_MODE_SPARSE){
+		if(PTL_AL_BITMAP_WORDS(size) == 1){
+			array_list->occupied = &(array_list->inline_occupied);
+		} else {
+			array_list->occupied = (unsigned long *)ptl_calloc(array_list->allocator, 
+										PTL_AL_BITMAP_WORDS(size), sizeof(unsigned long));
+		}
+	}
+	
+	return 1;
 }
 
 
 /* frees all memory allocated in create functions. */
 int ptl_al_destroy_array_list(ptl_array_list_t array_list){
-	if(array_list == NULL) { return 0; }
-	   
-	array_list->capacity = 0;
-	array_list->size = 0;
-	array_list->malloc_size = 0;
-	// if any of the pointers in this array are pointing of any allocated 
-	// memory, then that pointer is lost...
-	FREE(array_list->array);
-	
-	return 1;
+	return ptl_al_destroy_array_list_freefunc(array_list, NULL);
 }
 
 /* frees all memory allocated in create functions and executes the function
@@ -85,22 +211,29 @@ int ptl_al_destroy_array_list_freefunc(ptl_array_list_t array_list, void (*free_
 	   
 	void **ptr = array_list->array;
 	void **i_ptr = NULL;
-	
-	array_list->capacity = 0;
-	array_list->size = 0;
-	array_list->malloc_size = 0;
 
-	// free each element
+	// free each element, a sparse list may have some past 'size'
 	int i = 0;
-	for(i=0; i<array_list->size; i++){
+	for(i=0; free_func != NULL && i<array_list->capacity; i++){
 		i_ptr = ptr + i; // get to element 'i'
 		
-		free_func(*i_ptr); // free it using passed-in function
+		if(*i_ptr != NULL){
+			free_func(*i_ptr); // free it using passed-in function
+		}
 	}
+	// if no free function was given and any of the pointers in this array 
+	// are pointing of any allocated memory, then that pointer is lost...
 	
+	// free entire array (it needs the sizes to give the memory back)
+	_free_storage(array_list);
 	
-	// free entire array
-	FREE(array_list->array);
+	array_list->capacity = 0;
+	array_list->size = 0;
+	array_list->malloc_size = 0;
+	
+	if(array_list->allocated){
+		ptl_free(array_list->allocator, array_list, sizeof(struct ptl_array_list));
+	}
 	
 	return 1;
 }
@@ -115,32 +248,30 @@ int ptl_al_is_empty(ptl_array_list_t array_list){
 int ptl_al_add(ptl_array_list_t array_list, void *value){
 	if(array_list == NULL || value == NULL) { return 0; }
 	
-	// if we have room, then continue, otherwise this funciton will create room
-	_check_capacity(array_list, 0);
-	
-	// put the value in the list
-	void **ptr = array_list->array;
-	ptr += array_list->size; // move to our desired position (end of the list in this case)
-	
-	
-	int c_index = array_list->size - 1; // current index
-	// check if this space is occupied
-	if(*ptr != NULL) { // oops, something is here
-		
-		// go until we find an empty spot or until we reached the end
-		while(*ptr == NULL  &&  c_index < array_list->capacity){
-			c_index++;
+	if(array_list->mode == PTL_AL_MODE_DENSE){
+		// the end of the list is always free, just make sure it exists
+		if(array_list->size >= array_list->capacity){
+			_check_capacity(array_list, array_list->size + 1);
 		}
+		*((array_list->array) + array_list->size) = value;
+		array_list->size++;
 		
-		// check if we hit the end
-		if((c_index + 1) == array_list->capacity){
-			// we need to expand our list
-			_check_capacity (array_list, 1);
-		}
+		return 1;
+	}
+	
+	// find the first empty spot at or past the end of the list
+	int c_index = _find_free(array_list, array_list->size);
+	
+	// check if we hit the end
+	if(c_index < 0){
+		// we need to expand our list, the first new spot is ours
+		c_index = array_list->capacity;
+		_check_capacity (array_list, array_list->capacity + 1);
 	}
 	
 	// either we have room or we just made room, lets put or element in now
 	*((array_list->array) + c_index) = value; // we need to get to the ptr in the list, then assign our ptr there
+	_mark_occupied(array_list, c_index, c_index + 1);
 	
 	array_list->size++; // increase our size
 	
@@ -157,16 +288,26 @@ int ptl_al_add_index(ptl_array_list_t array_list, void *value, int index){
 		   return 0; 
 	   }
 	
-	_check_capacity(array_list, index + 1);
-	
 	void **ptr = (array_list->array) + index;
 	
+	if(array_list->mode == PTL_AL_MODE_DENSE){
+		// a dense list has no holes, everything from 'index' on moves
+		if(index < array_list->size){
+			_shift_elements(array_list, index, 1);
+			array_list->size++; // increase our size
+		}
+		
+		// reuse existing function (it extends 'size' past the end)
+		return ptl_al_set(array_list, value, index);
+	}
+	
 	// check if this 'index' is occupied
 	if(*ptr != NULL){
 		// copy all elements to the right i.e. make some space (and we all rolled over...)
 		_shift_elements(array_list, index, 1);
 	}
 	
+	array_list->size++; // increase our size
 	
 	// reuse existing function
 	return ptl_al_set(array_list, value, index);
@@ -200,6 +341,14 @@ int ptl_al_set(ptl_array_list_t array_list, void *value, int index){
 	ptr += index; // move to our desired position ('index' in this case)
 	*ptr = value; // we need to get to the ptr in the list, then assign our ptr there
 	
+	if(array_list->mode == PTL_AL_MODE_DENSE){
+		// setting past the end makes the list longer (the gap is NULL)
+		if(index >= array_list->size){
+			array_list->size = index + 1;
+		}
+	} else {
+		_mark_occupied(array_list, index, index + 1);
+	}
 	
 	return 1;
 }
@@ -218,8 +367,26 @@ void *ptl_al_remove_index(ptl_array_list_t array_list, int index){
 	
 	*ptr = NULL; // make ptr in array null
 	
+	if(array_list->mode == PTL_AL_MODE_DENSE){
+		// close the gap, the list is one shorter whatever was here
+		if(index < array_list->size){
+			_shift_elements(array_list, index, -1);
+			array_list->size--; // decrease our size
+		}
+		
+		return element;
+	}
+	
+	_mark_occupied(array_list, index, index + 1);
+	
 	// shift elements to the left by 1
-	_shift_elements(array_list, index, -1);
+	if(index < array_list->size){
+		_shift_elements(array_list, index, -1);
+	}
+	
+	if(element != NULL && array_list->size > 0){
+		array_list->size--; // decrease our size
+	}
 	
 	
 	return element;
@@ -252,6 +419,12 @@ void ptl_al_clear(ptl_array_list_t array_list){
 	
 	// set all ptrs to NULL
 	memset(array_list->array, 0, array_list->malloc_size);
+	
+	array_list->size = 0;
+	if(array_list->mode == PTL_AL_MODE_SPARSE){
+		memset(array_list->occupied, 0, 
+			   PTL_AL_BITMAP_WORDS(array_list->capacity) * sizeof(unsigned long));
+	}
 }
 
 
@@ -265,92 +438,806 @@ int ptl_al_contains(ptl_array_list_t array_list, void* value){
 /* go through array, return the index of the element if the element is in the array */
 int ptl_al_index_of(ptl_array_list_t array_list, void* value){
 	if(array_list == NULL || value == NULL) {
+		return -1; 
+    }
+	
+	pthread_once(&ptl_al_search_once, _select_search);
+	
+	return ptl_al_find(array_list->array, _search_length(array_list), value);
+}
+
+
+/* go through array once, looking for several values at the same time */
+int ptl_al_index_of_any(ptl_array_list_t array_list, void **values, int num_values, int *indexes){
+	if(array_list == NULL || values == NULL || indexes == NULL || num_values <= 0) {
 		return 0; 
     }
 	
-	void **ptr = array_list->array;
-	void **i_ptr = NULL;
+	pthread_once(&ptl_al_search_once, _select_search);
 	
-	// search for the element to remove
-	int i = 0;
-	for(i=0; i<array_list->size; i++){
-		i_ptr = ptr + i; // get to element 'i'
+	return ptl_al_find_any(array_list->array, _search_length(array_list), 
+						   values, num_values, indexes);
+}
+
+
+/* make sure there is room for 'capacity' elements */
+int ptl_al_reserve(ptl_array_list_t array_list, int capacity){
+	if(array_list == NULL || capacity < 0) { return 0; }
+	
+	_check_capacity(array_list, capacity);
+	
+	return 1;
+}
+
+
+/* shrink the array to the last occupied position */
+int ptl_al_trim_to_size(ptl_array_list_t array_list){
+	if(array_list == NULL) { return 0; }
+	
+	// elements may have been 'set' past 'size', don't lose them
+	int new_capacity = array_list->capacity;
+	while(new_capacity > array_list->size && 
+		  *((array_list->array) + new_capacity - 1) == NULL){
+		new_capacity--;
+	}
+	if(new_capacity <= 0){
+		new_capacity = 1; // always keep an array to point to
+	}
+	
+	// an array in the struct costs nothing to keep
+	if(array_list->array == array_list->inline_array){
+		return 1;
+	}
+	
+	if(new_capacity < array_list->capacity){
+		int malloc_size = new_capacity * (sizeof(void *));
+		void **new_array = (void **)ptl_realloc(array_list->allocator, array_list->array, 
+												array_list->malloc_size, malloc_size);
+		int old_capacity = array_list->capacity;
 		
-		// does this ptr's address match the ptr's address passed in?
-		if(*i_ptr == value){
-			return i; // return 'index' if found
+		array_list->capacity = new_capacity;
+		array_list->malloc_size = malloc_size;
+		array_list->array = new_array;
+		
+		if(array_list->mode == PTL_AL_MODE_SPARSE){
+			if(array_list->occupied != &(array_list->inline_occupied)){
+				unsigned long *new_occupied = (unsigned long *)ptl_realloc(array_list->allocator, 
+										array_list->occupied, 
+										PTL_AL_BITMAP_WORDS(old_capacity) * sizeof(unsigned long),
+										PTL_AL_BITMAP_WORDS(new_capacity) * sizeof(unsigned long));
+				array_list->occupied = new_occupied;
+			}
+			
+			// bits past the new capacity must not be left set
+			_mark_occupied(array_list, new_capacity, 
+						   PTL_AL_BITMAP_WORDS(new_capacity) * PTL_AL_WORD_BITS);
 		}
 	}
 	
-		
-	// otherwise, return -1
-	return -1;
+	return 1;
+}
+
+
+/* sorts the list in place with an introsort */
+int ptl_al_sort(ptl_array_list_t array_list, int (*cmp)(const void *, const void *)){
+	if(array_list == NULL || cmp == NULL) { return 0; }
+	
+	int n = _sort_prepare(array_list);
+	_sort_range(array_list->array, 0, n, cmp, _sort_depth(n));
+	
+	return 1;
+}
+
+
+/* sorts pieces of the list on several threads, then merges them */
+int ptl_al_parallel_sort(ptl_array_list_t array_list, int (*cmp)(const void *, const void *),
+						 struct ptl_thread_manager *manager){
+	if(array_list == NULL || cmp == NULL) { return 0; }
+	
+	int num_threads = 1;
+	if(manager != NULL && manager->thread_pool != NULL){
+		num_threads = manager->thread_pool->core_pool_size;
+	}
+	if(num_threads > PTL_AL_MAX_SORT_THREADS){
+		num_threads = PTL_AL_MAX_SORT_THREADS;
+	}
+	
+	int n = _sort_prepare(array_list);
+	
+	// not worth starting threads for
+	if(num_threads <= 1 || n < PTL_AL_PARALLEL_SORT_CUTOFF){
+		_sort_range(array_list->array, 0, n, cmp, _sort_depth(n));
+		return 1;
+	}
+	
+	struct ptl_al_sort_job job;
+	memset(&job, 0, sizeof(struct ptl_al_sort_job));
+	
+	job.array = array_list->array;
+	job.n = n;
+	job.cmp = cmp;
+	job.num_threads = num_threads;
+	job.run_chunks = 1;
+	
+	// every round halves the number of runs, so use a power of two
+	int num_rounds = 0;
+	job.num_chunks = 1;
+	while(job.num_chunks < num_threads){
+		job.num_chunks <<= 1;
+		num_rounds++;
+	}
+	
+	// rounds go back and forth between the two arrays, start on the one
+	// that makes the last round land in the list
+	void **tmp = (void **)ptl_alloc(array_list->allocator, n * sizeof(void *));
+	job.src = (num_rounds % 2) ? tmp : job.array;
+	job.dst = (num_rounds % 2) ? job.array : tmp;
+	
+	int max_parts = job.num_chunks + (n / PTL_AL_MIN_MERGE_PART) + 1;
+	job.parts = (struct ptl_al_merge_part *)ptl_calloc(array_list->allocator, max_parts, 
+													   sizeof(struct ptl_al_merge_part));
+	
+	// sort the chunks, then merge pairs of runs until there is one
+	ptl_parallel_for(manager, 0, job.num_chunks, 1, _sort_chunks, &job);
+	
+	while(job.run_chunks < job.num_chunks){
+		_sort_plan_round(&job);
+		ptl_parallel_for(manager, 0, job.num_parts, 1, _sort_merge_parts, &job);
+	}
+	
+	PTL_FREE(array_list->allocator, job.parts, max_parts * sizeof(struct ptl_al_merge_part));
+	PTL_FREE(array_list->allocator, tmp, n * sizeof(void *));
+	
+	return 1;
 }
 
 
 /* check if array needs to be expanded, if so, it expands it */
-void _check_capacity(ptl_array_list_t array_list, int size){
+void _check_capacity(ptl_array_list_t array_list, int min_capacity){
 	assert(array_list);
-	assert(size >= 0);
+	assert(min_capacity >= 0);
 	
-	if( (array_list->size + size) >= array_list->capacity ){ // make the array list bigger
+	if( min_capacity > array_list->capacity ){ // make the array list bigger
 		
-		// calculate new capacity
-		int new_capacity = ((array_list->capacity + size) * 3)/2 + 1;
+		// grow by half again so appends are amortized constant time
+		int new_capacity = array_list->capacity + (array_list->capacity / 2) + 1;
+		if(new_capacity < min_capacity){
+			new_capacity = min_capacity;
+		}
 		
-		// allocate new memory
+		// grow in place if the allocator can, it copies for us if it can't
 		int malloc_size = new_capacity * (sizeof(void *)); 
-		void **new_array = (void *)calloc(new_capacity, sizeof(void*));
-		assert(new_array);
+		void **new_array = NULL;
+		if(array_list->array == array_list->inline_array){
+			// moving out of the struct
+			new_array = (void **)ptl_alloc(array_list->allocator, malloc_size);
+			memcpy(new_array, array_list->array, array_list->malloc_size);
+		} else {
+			new_array = (void **)ptl_realloc(array_list->allocator, array_list->array, 
+											 array_list->malloc_size, malloc_size);
+		}
+		
+		// the new slots must start out empty
+		memset(new_array + array_list->capacity, 0, malloc_size - array_list->malloc_size);
 		
-		// copy elements to the new array using the 'real' size
-		memcpy(new_array, array_list->array, array_list->malloc_size);
-		void *old_array = array_list->array;
+		if(array_list->mode == PTL_AL_MODE_SPARSE){
+			int old_words = PTL_AL_BITMAP_WORDS(array_list->capacity);
+			int new_words = PTL_AL_BITMAP_WORDS(new_capacity);
+			
+			if(new_words > old_words){
+				unsigned long *new_occupied = NULL;
+				if(array_list->occupied == &(array_list->inline_occupied)){
+					new_occupied = (unsigned long *)ptl_alloc(array_list->allocator, 
+											new_words * sizeof(unsigned long));
+					new_occupied[0] = array_list->inline_occupied;
+				} else {
+					new_occupied = (unsigned long *)ptl_realloc(array_list->allocator, array_list->occupied, 
+											old_words * sizeof(unsigned long),
+											new_words * sizeof(unsigned long));
+				}
+				memset(new_occupied + old_words, 0, (new_words - old_words) * sizeof(unsigned long));
+				array_list->occupied = new_occupied;
+			}
+		}
 		
 		// save new capcity and malloc size
 		array_list->capacity = new_capacity;
 		array_list->malloc_size = malloc_size;
 		array_list->array = new_array;
 		// size stays the same
-		
-		// free old memory
-		FREE(old_array);
 	}
 }
 
 
-/* shifts the elements of the array left or right */
+/* frees the array and bitmap, unless they are the ones in the struct */
+void _free_storage(ptl_array_list_t array_list){
+	if(array_list->array == array_list->inline_array){
+		array_list->array = NULL;
+	}
+	if(array_list->occupied == &(array_list->inline_occupied)){
+		array_list->occupied = NULL;
+	}
+	
+	PTL_FREE(array_list->allocator, array_list->array, array_list->malloc_size);
+	PTL_FREE(array_list->allocator, array_list->occupied, 
+			 PTL_AL_BITMAP_WORDS(array_list->capacity) * sizeof(unsigned long));
+}
+
+
+/* shifts the elements from 'index' to the end of the list left or right */
 void _shift_elements(ptl_array_list_t array_list, int index, int num_places){
 	assert(array_list);
 	assert(index >= 0);
 	assert(num_places != 0);
 	
-	// use a temporary array to shift
-	void **temp_array = (void *)calloc(array_list->capacity, sizeof(void *));
-	assert(temp_array);
-	
-	int copy_size = 0;
-	void* start = 0;
+	// the list ends after its last element, which may have been 'set' past 'size'
+	int end = _occupied_end(array_list);
+	if(end <= index){
+		end = index + 1;
+	}
 	
 	if(num_places > 0){ // shift right
-		// index ... size
-		copy_size = (sizeof(void *))*(index-(array_list->size)); 
-		start = (array_list->array)+index;
+		_check_capacity(array_list, end + num_places);
+		
+		// index ... end moves right, the source and destination overlap
+		memmove((array_list->array) + index + num_places,
+				(array_list->array) + index,
+				(sizeof(void *)) * (end - index));
+		memset((array_list->array) + index, 0, (sizeof(void *)) * num_places);
+		
+		_shift_occupied(array_list, index, end, num_places);
 		
 	} else { // (num_places is negative) - shift left
 		int pos_num_places = num_places * -1;
-		// index+1 ... size elements
-		copy_size = (sizeof(void *)) * 
-				((index+pos_num_places)-(array_list->size)); 
+		if(index + pos_num_places > end){
+			pos_num_places = end - index;
+		}
+		
+		// index+num_places ... end moves left onto index
+		memmove((array_list->array) + index,
+				(array_list->array) + index + pos_num_places,
+				(sizeof(void *)) * (end - index - pos_num_places));
+		memset((array_list->array) + end - pos_num_places, 0, 
+			   (sizeof(void *)) * pos_num_places);
+		
+		_shift_occupied(array_list, index + pos_num_places, end, -pos_num_places);
+	}
+}
+
+
+/* sparse lists only: brings the occupied bits for [from, to) in line with 
+   the array. Positions at or past capacity are marked free. */
+void _mark_occupied(ptl_array_list_t array_list, int from, int to){
+	if(array_list->mode != PTL_AL_MODE_SPARSE){ return; }
+	
+	int i = 0;
+	for(i=from; i<to; i++){
+		unsigned long bit = 1UL << (i % PTL_AL_WORD_BITS);
+		
+		if(i < array_list->capacity && *((array_list->array) + i) != NULL){
+			array_list->occupied[i / PTL_AL_WORD_BITS] |= bit;
+		} else {
+			array_list->occupied[i / PTL_AL_WORD_BITS] &= ~bit;
+		}
+	}
+}
+
+
+/* sparse lists only: finds the first empty position at or after 'from' 
+   a word at a time. Returns -1 if every position up to capacity is taken. */
+int _find_free(ptl_array_list_t array_list, int from){
+	if(from >= array_list->capacity){ return -1; }
+	
+	int num_words = PTL_AL_BITMAP_WORDS(array_list->capacity);
+	int w = from / PTL_AL_WORD_BITS;
+	
+	// ignore the bits before 'from' in the first word
+	unsigned long free_bits = ~(array_list->occupied[w]) & 
+							  (~0UL << (from % PTL_AL_WORD_BITS));
+	
+	while(free_bits == 0){
+		w++;
+		if(w >= num_words){ return -1; }
+		free_bits = ~(array_list->occupied[w]);
+	}
+	
+	int index = (w * PTL_AL_WORD_BITS) + __builtin_ctzl(free_bits);
+	
+	return (index < array_list->capacity) ? index : -1;
+}
+
+
+/* sparse lists only: moves the occupied bits for [from, to) by 'num_places'
+   to follow a shift of the array, a word at a time. Vacated bits are 
+   cleared. */
+void _shift_occupied(ptl_array_list_t array_list, int from, int to, int num_places){
+	if(array_list->mode != PTL_AL_MODE_SPARSE || from >= to){ return; }
+	
+	unsigned long *bits = array_list->occupied;
+	int w = 0;
+	
+	if(num_places == 1){
+		// bits land on [from+1, to+1), go high to low so carries are unchanged
+		for(w=to / PTL_AL_WORD_BITS; w >= (from + 1) / PTL_AL_WORD_BITS; w--){
+			unsigned long carry = (w > 0) ? (bits[w - 1] >> (PTL_AL_WORD_BITS - 1)) : 0;
+			unsigned long mask = _range_mask(w, from + 1, to + 1);
+			
+			bits[w] = (bits[w] & ~mask) | (((bits[w] << 1) | carry) & mask);
+		}
+		bits[from / PTL_AL_WORD_BITS] &= ~(1UL << (from % PTL_AL_WORD_BITS));
 		
-		start = (array_list->array)+index+pos_num_places;
+	} else if(num_places == -1){
+		// bits land on [from-1, to-1), go low to high so carries are unchanged
+		int num_words = PTL_AL_BITMAP_WORDS(array_list->capacity);
+		for(w=(from - 1) / PTL_AL_WORD_BITS; w <= (to - 2) / PTL_AL_WORD_BITS; w++){
+			unsigned long carry = (w + 1 < num_words) ? (bits[w + 1] << (PTL_AL_WORD_BITS - 1)) : 0;
+			unsigned long mask = _range_mask(w, from - 1, to - 1);
+			
+			bits[w] = (bits[w] & ~mask) | (((bits[w] >> 1) | carry) & mask);
+		}
+		bits[(to - 1) / PTL_AL_WORD_BITS] &= ~(1UL << ((to - 1) % PTL_AL_WORD_BITS));
+		
+	} else {
+		// rare, just rebuild the bits from the array
+		_mark_occupied(array_list, from + ((num_places < 0) ? num_places : 0), 
+					   to + ((num_places > 0) ? num_places : 0));
+	}
+}
+
+
+/* one past the last element: 'size' for a dense list, the highest occupied 
+   bit for a sparse one (its 'size' does not count elements 'set' past it) */
+int _occupied_end(ptl_array_list_t array_list){
+	if(array_list->mode != PTL_AL_MODE_SPARSE){
+		return array_list->size;
+	}
+	
+	int w = PTL_AL_BITMAP_WORDS(array_list->capacity) - 1;
+	while(w >= 0 && array_list->occupied[w] == 0){
+		w--;
+	}
+	if(w < 0){ return 0; }
+	
+	return (w * PTL_AL_WORD_BITS) + (PTL_AL_WORD_BITS - __builtin_clzl(array_list->occupied[w]));
+}
+
+
+/* bits of word 'w' that fall in positions [from, to) */
+unsigned long _range_mask(int w, int from, int to){
+	int lo = w * PTL_AL_WORD_BITS;
+	int hi = lo + PTL_AL_WORD_BITS;
+	
+	if(from < lo){ from = lo; }
+	if(to > hi){ to = hi; }
+	if(from >= to){ return 0; }
+	
+	unsigned long mask = ~0UL << (from - lo);
+	if(to < hi){
+		mask &= ~(~0UL << (to - lo));
+	}
+	
+	return mask;
+}
+
+
+/* number of positions to search, a sparse 'size' may overstate the list */
+int _search_length(ptl_array_list_t array_list){
+	return (array_list->size < array_list->capacity) ? 
+		array_list->size : array_list->capacity;
+}
+
+
+/* picks the fastest search functions this cpu can run */
+void _select_search(){
+#ifdef PTL_AL_HAVE_SIMD
+	__builtin_cpu_init();
+	
+	if(__builtin_cpu_supports("avx2")){
+		ptl_al_find = _find_avx2;
+		ptl_al_find_any = _find_any_avx2;
+	} else {
+		ptl_al_find = _find_sse2; // every x86_64 cpu has sse2
+	}
+#endif
+}
+
+
+/* one pointer at a time */
+int _find_scalar(void **array, int length, void *value){
+	int i = 0;
+	for(i=0; i<length; i++){
+		// does this ptr's address match the ptr's address passed in?
+		if(array[i] == value){
+			return i; // return 'index' if found
+		}
 	}
-	// copy part to shift into temp array
-	memcpy(temp_array, start, copy_size);
 	
-	// copy from temp back to original array
-	memcpy((array_list->array)+index+num_places, temp_array, copy_size);
+	// otherwise, return -1
+	return -1;
+}
+
+
+/* one pointer at a time, checking each one against every value */
+int _find_any_scalar(void **array, int length, void **values, int num_values, int *indexes){
+	int j = 0;
+	for(j=0; j<num_values; j++){
+		indexes[j] = -1;
+	}
+	
+	return _find_any_scalar_from(array, 0, length, values, num_values, indexes);
+}
+
+
+/* checks positions [from, to) against every value not yet found (index of
+   -1). Returns how many values were found by this call */
+int _find_any_scalar_from(void **array, int from, int to, void **values, int num_values, int *indexes){
+	int num_found = 0;
+	int i = 0;
+	int j = 0;
 	
-	// free temporary memory
-	FREE(temp_array);
+	for(i=from; i<to; i++){
+		for(j=0; j<num_values; j++){
+			if(indexes[j] < 0 && array[i] == values[j] && values[j] != NULL){
+				indexes[j] = i;
+				num_found++;
+			}
+		}
+	}
+	
+	return num_found;
+}
+
+
+#ifdef PTL_AL_HAVE_SIMD
+
+/* four pointers at a time. sse2 has no 64 bit compare, so both 32 bit 
+   halves must match */
+__attribute__((target("sse2")))
+int _find_sse2(void **array, int length, void *value){
+	__m128i needle = _mm_set1_epi64x((long long)value);
+	int i = 0;
+	
+	for(i=0; i + 4 <= length; i += 4){
+		__m128i lo = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(array + i)), needle);
+		__m128i hi = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(array + i + 2)), needle);
+		
+		// AND each 32 bit result with the other half of its pointer
+		lo = _mm_and_si128(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+		hi = _mm_and_si128(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+		
+		int mask = _mm_movemask_pd(_mm_castsi128_pd(lo)) | 
+				  (_mm_movemask_pd(_mm_castsi128_pd(hi)) << 2);
+		if(mask){
+			return i + __builtin_ctz(mask);
+		}
+	}
+	
+	// the last few
+	int index = _find_scalar(array + i, length - i, value);
+	
+	return (index < 0) ? -1 : i + index;
+}
+
+
+/* eight pointers at a time */
+__attribute__((target("avx2")))
+int _find_avx2(void **array, int length, void *value){
+	__m256i needle = _mm256_set1_epi64x((long long)value);
+	int i = 0;
+	
+	for(i=0; i + 8 <= length; i += 8){
+		__m256i lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i *)(array + i)), needle);
+		__m256i hi = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i *)(array + i + 4)), needle);
+		
+		int mask = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) | 
+				  (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+		if(mask){
+			return i + __builtin_ctz(mask);
+		}
+	}
+	
+	// the last few
+	int index = _find_scalar(array + i, length - i, value);
+	
+	return (index < 0) ? -1 : i + index;
+}
+
+
+/* four pointers at a time against every value not yet found. A block 
+   with any match is resolved one pointer at a time */
+__attribute__((target("avx2")))
+int _find_any_avx2(void **array, int length, void **values, int num_values, int *indexes){
+	int num_found = 0;
+	int i = 0;
+	int j = 0;
+	
+	for(j=0; j<num_values; j++){
+		indexes[j] = -1;
+	}
+	
+	for(i=0; i + 4 <= length && num_found < num_values; i += 4){
+		__m256i block = _mm256_loadu_si256((__m256i *)(array + i));
+		__m256i hits = _mm256_setzero_si256();
+		
+		for(j=0; j<num_values; j++){
+			if(indexes[j] < 0){
+				hits = _mm256_or_si256(hits, 
+					_mm256_cmpeq_epi64(block, _mm256_set1_epi64x((long long)values[j])));
+			}
+		}
+		
+		if(!_mm256_testz_si256(hits, hits)){
+			num_found += _find_any_scalar_from(array, i, i + 4, values, num_values, indexes);
+		}
+	}
+	
+	// the last few
+	if(num_found < num_values){
+		num_found += _find_any_scalar_from(array, i, length, values, num_values, indexes);
+	}
+	
+	return num_found;
+}
+
+#endif
+
+
+/* gets the list ready to sort, returns the number of elements. A sparse
+   list has its elements packed to the front */
+int _sort_prepare(ptl_array_list_t array_list){
+	if(array_list->mode == PTL_AL_MODE_DENSE){
+		return array_list->size;
+	}
+	
+	int n = 0;
+	int i = 0;
+	for(i=0; i<array_list->capacity; i++){
+		if(array_list->array[i] != NULL){
+			array_list->array[n++] = array_list->array[i];
+		}
+	}
+	memset(array_list->array + n, 0, (array_list->capacity - n) * sizeof(void *));
+	
+	array_list->size = n;
+	_mark_occupied(array_list, 0, PTL_AL_BITMAP_WORDS(array_list->capacity) * PTL_AL_WORD_BITS);
+	
+	return n;
+}
+
+
+/* introsort of [lo, hi). Quicksort with a median of three pivot, giving up
+   and using heapsort once 'depth' partitions have gone by */
+void _sort_range(void **array, int lo, int hi, int (*cmp)(const void *, const void *), int depth){
+	void *tmp = NULL;
+	
+	while(hi - lo > PTL_AL_INSERTION_SORT_CUTOFF){
+		if(depth-- == 0){
+			_heap_sort(array, lo, hi, cmp);
+			return;
+		}
+		
+		// order the first, middle and last, the middle is the pivot
+		int mid = lo + ((hi - lo) / 2);
+		if(cmp(array + mid, array + lo) < 0){ tmp = array[mid]; array[mid] = array[lo]; array[lo] = tmp; }
+		if(cmp(array + hi - 1, array + mid) < 0){
+			tmp = array[hi - 1]; array[hi - 1] = array[mid]; array[mid] = tmp;
+			if(cmp(array + mid, array + lo) < 0){ tmp = array[mid]; array[mid] = array[lo]; array[lo] = tmp; }
+		}
+		
+		// park the pivot next to the last, the ends stop the scans
+		void *pivot = array[mid];
+		array[mid] = array[hi - 2];
+		array[hi - 2] = pivot;
+		
+		int i = lo;
+		int j = hi - 2;
+		while(1){
+			while(cmp(array + (++i), &pivot) < 0);
+			while(cmp(&pivot, array + (--j)) < 0);
+			if(i >= j){ break; }
+			tmp = array[i]; array[i] = array[j]; array[j] = tmp;
+		}
+		array[hi - 2] = array[i];
+		array[i] = pivot;
+		
+		// recurse on the smaller side, loop on the larger
+		if(i - lo < hi - (i + 1)){
+			_sort_range(array, lo, i, cmp, depth);
+			lo = i + 1;
+		} else {
+			_sort_range(array, i + 1, hi, cmp, depth);
+			hi = i;
+		}
+	}
+	
+	_insertion_sort(array, lo, hi, cmp);
+}
+
+
+/* insertion sort of [lo, hi) */
+void _insertion_sort(void **array, int lo, int hi, int (*cmp)(const void *, const void *)){
+	int i = 0;
+	for(i=lo + 1; i<hi; i++){
+		void *value = array[i];
+		int j = i;
+		
+		while(j > lo && cmp(array + j - 1, &value) > 0){
+			array[j] = array[j - 1];
+			j--;
+		}
+		array[j] = value;
+	}
+}
+
+
+/* heapsort of [lo, hi) */
+void _heap_sort(void **array, int lo, int hi, int (*cmp)(const void *, const void *)){
+	void **base = array + lo;
+	int n = hi - lo;
+	int i = 0;
+	
+	for(i=(n / 2) - 1; i >= 0; i--){
+		_sift_down(base, i, n, cmp);
+	}
+	
+	for(i=n - 1; i > 0; i--){
+		void *tmp = base[0];
+		base[0] = base[i];
+		base[i] = tmp;
+		
+		_sift_down(base, 0, i, cmp);
+	}
+}
+
+
+/* moves 'root' down the max heap of 'n' elements until it is in place */
+void _sift_down(void **array, int root, int n, int (*cmp)(const void *, const void *)){
+	void *value = array[root];
+	
+	while((2 * root) + 1 < n){
+		int child = (2 * root) + 1;
+		if(child + 1 < n && cmp(array + child, array + child + 1) < 0){
+			child++;
+		}
+		if(cmp(&value, array + child) >= 0){
+			break;
+		}
+		array[root] = array[child];
+		root = child;
+	}
+	
+	array[root] = value;
+}
+
+
+/* how many partitions an introsort of 'n' elements may take */
+int _sort_depth(int n){
+	int depth = 0;
+	while(n > 1){
+		n >>= 1;
+		depth += 2;
+	}
+	
+	return depth;
+}
+
+
+/* merging a[0, m) and b[0, n), finds how many of the first 'k' outputs 
+   come from 'a'. Equal elements come from 'a' first */
+int _merge_split(void **a, int m, void **b, int n, int k, int (*cmp)(const void *, const void *)){
+	int lo = (k > n) ? k - n : 0;
+	int hi = (k < m) ? k : m;
+	
+	// the answer is the first 'i' where a[i] would come after b[k-i-1]
+	while(lo < hi){
+		int i = lo + ((hi - lo) / 2);
+		
+		if(cmp(a + i, b + (k - i - 1)) > 0){
+			hi = i;
+		} else {
+			lo = i + 1;
+		}
+	}
+	
+	return lo;
+}
+
+
+/* merges a[0, m) and b[0, n) into 'out'. Equal elements come from 'a' first */
+void _merge(void **a, int m, void **b, int n, void **out, int (*cmp)(const void *, const void *)){
+	int i = 0;
+	int j = 0;
+	
+	while(i < m && j < n){
+		if(cmp(b + j, a + i) < 0){
+			*out++ = b[j++];
+		} else {
+			*out++ = a[i++];
+		}
+	}
+	
+	memcpy(out, a + i, (m - i) * sizeof(void *));
+	memcpy(out + (m - i), b + j, (n - j) * sizeof(void *));
+}
+
+
+/* plans the next round of a parallel sort: pairs of sorted runs are merged,
+   each merge split into parts small enough to spread over every thread */
+void _sort_plan_round(struct ptl_al_sort_job *job){
+	// the last round's output is this round's input
+	if(job->num_parts > 0){
+		void **tmp = job->src;
+		job->src = job->dst;
+		job->dst = tmp;
+	}
+	
+	int part_size = job->n / (2 * job->num_threads);
+	if(part_size < PTL_AL_MIN_MERGE_PART){
+		part_size = PTL_AL_MIN_MERGE_PART;
+	}
+	
+	int width = job->run_chunks;
+	int first = 0;
+	job->num_parts = 0;
+	
+	for(first=0; first<job->num_chunks; first += 2 * width){
+		int a_lo = (int)(((long)first * job->n) / job->num_chunks);
+		int b_lo = (int)(((long)(first + width) * job->n) / job->num_chunks);
+		int b_hi = (int)(((long)(first + (2 * width)) * job->n) / job->num_chunks);
+		int length = b_hi - a_lo;
+		int num_pieces = (length / part_size) + 1;
+		int p = 0;
+		
+		int i0 = 0;
+		int k0 = 0;
+		for(p=1; p<=num_pieces; p++){
+			int k1 = (int)(((long)p * length) / num_pieces);
+			int i1 = _merge_split(job->src + a_lo, b_lo - a_lo, job->src + b_lo, b_hi - b_lo, 
+								  k1, job->cmp);
+			
+			struct ptl_al_merge_part *part = job->parts + job->num_parts++;
+			part->a_lo = a_lo + i0;
+			part->a_hi = a_lo + i1;
+			part->b_lo = b_lo + (k0 - i0);
+			part->b_hi = b_lo + (k1 - i1);
+			part->out = a_lo + k0;
+			
+			i0 = i1;
+			k0 = k1;
+		}
+	}
+	
+	job->run_chunks *= 2;
+}
+
+
+/* sorts chunks [begin, end) of a parallel sort, each on its own */
+void _sort_chunks(long begin, long end, void *arg){
+	struct ptl_al_sort_job *job = (struct ptl_al_sort_job *)arg;
+	long c = 0;
+	
+	for(c=begin; c<end; c++){
+		int lo = (int)((c * job->n) / job->num_chunks);
+		int hi = (int)(((c + 1) * job->n) / job->num_chunks);
+		
+		if(job->src != job->array){
+			memcpy(job->src + lo, job->array + lo, (hi - lo) * sizeof(void *));
+		}
+		_sort_range(job->src, lo, hi, job->cmp, _sort_depth(hi - lo));
+	}
+}
+
+
+/* runs parts [begin, end) of a round of a parallel sort */
+void _sort_merge_parts(long begin, long end, void *arg){
+	struct ptl_al_sort_job *job = (struct ptl_al_sort_job *)arg;
+	long p = 0;
+	
+	for(p=begin; p<end; p++){
+		struct ptl_al_merge_part *part = job->parts + p;
+		
+		_merge(job->src + part->a_lo, part->a_hi - part->a_lo,
+			   job->src + part->b_lo, part->b_hi - part->b_lo,
+			   job->dst + part->out, job->cmp);
+	}
 }
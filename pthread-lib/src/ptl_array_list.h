@@ -22,20 +22,40 @@
  * This "class" is an implementation of an ArrayList (see Javadoc). It is an
  * array of pointers that can point to any memory. It starts with an inital
  * 'size' and grows (and may shrink) as more elements are put in the list.
+ *
+ * A list of up to PTL_AL_INLINE_CAPACITY elements keeps them in the list
+ * struct itself and only moves them to the heap once it grows past that.
+ * The struct can also live on the stack or inside another struct, see
+ * ptl_al_init_array_list().
  */
 
 
 #ifndef __PTL_ARRAY_LIST_H__
 #define __PTL_ARRAY_LIST_H__
 
+#include "ptl_allocator.h"
+
+/* Defines */
+#define PTL_AL_MODE_SPARSE 0	/**< elements may be 'set' anywhere, adds fill holes */
+#define PTL_AL_MODE_DENSE  1	/**< elements are packed from index 0 to 'size' */
+#define PTL_AL_INLINE_CAPACITY 8	/**< elements that fit in the struct itself */
+
 /* Structures */
 struct ptl_array_list {
 	int capacity; 		/**< largest current size */
 	int size;	  		/**< current size */
 	int malloc_size; 	/**< size used in the malloc */
 	void **array;  		/**< array of pointers - elements in the array */
+	int mode;			/**< PTL_AL_MODE_SPARSE or PTL_AL_MODE_DENSE */
+	unsigned long *occupied; /**< sparse only - one bit per non-null element */
+	void *inline_array[PTL_AL_INLINE_CAPACITY]; /**< 'array' until the list outgrows it */
+	unsigned long inline_occupied;	/**< 'occupied' until the list outgrows it */
+	ptl_allocator_t allocator;	/**< where 'array' and 'occupied' (and the struct) come from */
+	int allocated;				/**< 1 if a 'create' function allocated the struct */
 };
 
+struct ptl_thread_manager;
+
 /* Type Definitions */
 typedef struct ptl_array_list *ptl_array_list_t;
 
@@ -60,7 +80,83 @@ ptl_array_list_t ptl_al_create_array_list();
 ptl_array_list_t ptl_al_create_array_list_size(int size);
 
 /**
- * Destroy an array list that was created using a 'create' function.
+ * Creates an array list of 'size' length in the given mode. Lists created
+ * with the other 'create' functions are sparse.
+ *
+ * A dense list is a plain vector: elements are packed from index 0 up to
+ * 'size', an add is a bounds check plus a store, and a remove always closes
+ * the gap. Setting past the end makes the list longer.
+ *
+ * A sparse list allows holes: elements may be 'set' anywhere, and an add
+ * fills the first empty position at or past 'size'. Empty positions are
+ * tracked in a bitmap, so finding one is a scan of words, not pointers.
+ * 
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param starting size of this array list
+ * @param mode PTL_AL_MODE_DENSE or PTL_AL_MODE_SPARSE
+ * @return a fully initialized array list of 'size' length
+ */
+ptl_array_list_t ptl_al_create_array_list_mode(int size, int mode);
+
+/**
+ * Creates an array list like ptl_al_create_array_list_mode(), taking the
+ * struct and all of the memory the list needs later from 'allocator'
+ * (see ptl_allocator.h). The other 'create' functions use the default
+ * allocator.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param starting size of this array list
+ * @param mode PTL_AL_MODE_DENSE or PTL_AL_MODE_SPARSE
+ * @param allocator allocator to use, NULL for the default
+ * @return a fully initialized array list of 'size' length
+ */
+ptl_array_list_t ptl_al_create_array_list_allocator(int size, int mode, ptl_allocator_t allocator);
+
+/**
+ * Creates an array list that starts out with its elements stored inside the
+ * struct (PTL_AL_INLINE_CAPACITY of them), so creating it is a single 
+ * allocation. It moves to the heap only if it grows past that. Any 'create'
+ * with a 'size' of PTL_AL_INLINE_CAPACITY or less does the same.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param mode PTL_AL_MODE_DENSE or PTL_AL_MODE_SPARSE
+ * @return a fully initialized array list
+ */
+ptl_array_list_t ptl_al_create_array_list_small(int mode);
+
+/**
+ * Initializes an array list in memory owned by the caller (on the stack or
+ * inside another struct) instead of allocating one. If 'size' is 
+ * PTL_AL_INLINE_CAPACITY or less, nothing is allocated until the list grows
+ * past that. Call ptl_al_destroy_array_list() when done; it frees only what
+ * the list allocated, never the struct. An initialized list must not be 
+ * copied with memcpy or assignment, since it may point into itself.
+ *
+ * @param array_list memory for the list
+ * @param size starting size of this array list
+ * @param mode PTL_AL_MODE_DENSE or PTL_AL_MODE_SPARSE
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_al_init_array_list(ptl_array_list_t array_list, int size, int mode);
+
+/**
+ * Initializes an array list like ptl_al_init_array_list(), taking any
+ * memory the list needs from 'allocator'.
+ *
+ * @param array_list memory for the list
+ * @param size starting size of this array list
+ * @param mode PTL_AL_MODE_DENSE or PTL_AL_MODE_SPARSE
+ * @param allocator allocator to use, NULL for the default
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_al_init_array_list_allocator(ptl_array_list_t array_list, int size, int mode,
+									 ptl_allocator_t allocator);
+
+/**
+ * Destroy an array list that was created using a 'create' function, freeing
+ * the list itself too. A list set up with an 'init' function only has the
+ * memory it allocated freed.
  *
  * @param array list to be freed
  * @return 1 if successful, 0 otherwise
@@ -68,7 +164,7 @@ ptl_array_list_t ptl_al_create_array_list_size(int size);
 int ptl_al_destroy_array_list(ptl_array_list_t array_list);
 
 /**
- * Destroy an array list that was created using a 'create' function.
+ * Destroy an array list the same way as ptl_al_destroy_array_list().
  * This function flavor will execute the free function passed in as a parameter
  * on each non-null element in the list.
  *
@@ -87,12 +183,13 @@ int ptl_al_destroy_array_list_freefunc(ptl_array_list_t array_list, void (*free_
 int ptl_al_is_empty(ptl_array_list_t array_list);
 
 /**
- * Adds a 'value' to the list at the 'end' of the list. It inserts in the
- * (current size - 1) index. If current size is 4, then the element will 
- * be put in index 3 position. If it is found that the element at the end of
- * the list is occupied, then each position after that is tried until the end
- * of the list. If there is no room from 'size' to 'capacity', then the array
- * list is expanded and the element is put at previous capacity + 1.
+ * Adds a 'value' to the list at the 'end' of the list. It inserts at the
+ * (current size) index. If current size is 4, then the element will 
+ * be put in index 4 position. For a sparse list, if it is found that the 
+ * element at the end of the list is occupied, then the first unoccupied 
+ * position after that is used. If there is no room from 'size' to 'capacity',
+ * then the array list is expanded and the element is put at previous 
+ * capacity. Both cases are amortized constant time.
  *
  * @param array list to add a value
  * @param value to be added to the list
@@ -102,8 +199,9 @@ int ptl_al_add(ptl_array_list_t array_list, void *value);
 
 /**
  * Add the element at 'index'. If the position 'index' is occupied, then
- * all elements past this 'index' are shifted to the right. If this position
- * is unoccupied, then the value is simply inserted.
+ * all elements past this 'index' are shifted to the right (in place, growing
+ * the list if needed). If this position is unoccupied, then the value is 
+ * simply inserted.
  *
  * @param array list to add the value
  * @param value to be added to the list
@@ -135,9 +233,10 @@ void *ptl_al_get(ptl_array_list_t array_list, int index);
 int ptl_al_set(ptl_array_list_t array_list, void *value, int index);
 
 /**
- * Removes the element at position 'index' and returns it. The pointer at
- * position 'index' then become null. If the removal of an index greater than
- * capacity is requested, then NULL is returned.
+ * Removes the element at position 'index' and returns it. The elements
+ * after 'index' are shifted to the left (in place) to fill the hole. If the
+ * removal of an index greater than capacity is requested, then NULL is 
+ * returned.
  *
  * @param array list to remove an element
  * @param 'index' that an element will be removed
@@ -179,7 +278,9 @@ int ptl_al_contains(ptl_array_list_t array_list, void* value);
 /**
  * Finds the index of the 'value'. Searches through the list looking for
  * 'value'. When found, the index of where it was found is returned. If no
- * element was found, then it returns -1.
+ * element was found, then it returns -1. The search compares several 
+ * pointers per instruction (AVX2 or SSE2, picked when first used) where 
+ * the cpu supports it.
  *
  * @param array list to search
  * @param 'value' to find
@@ -187,4 +288,71 @@ int ptl_al_contains(ptl_array_list_t array_list, void* value);
  */
 int ptl_al_index_of(ptl_array_list_t array_list, void* value);
 
+/**
+ * Finds the index of each of 'values' in one pass through the list. For 
+ * each 'values[j]', 'indexes[j]' is set to the first index it was found at, 
+ * or -1 if it is not in the list. Like ptl_al_index_of(), this is 
+ * vectorized where the cpu supports it.
+ *
+ * @param array list to search
+ * @param 'values' to find
+ * @param 'num_values' number of 'values' (and 'indexes')
+ * @param 'indexes' set to where each value was found
+ * @return the number of 'values' found
+ */
+int ptl_al_index_of_any(ptl_array_list_t array_list, void **values, int num_values, int *indexes);
+
+/**
+ * Makes sure the list can hold 'capacity' elements without growing again.
+ * If the list is already large enough, nothing happens.
+ *
+ * @param array list to grow
+ * @param 'capacity' number of elements the list must be able to hold
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_al_reserve(ptl_array_list_t array_list, int capacity);
+
+/**
+ * Shrinks the capacity of the list to its current size, giving the unused
+ * memory back. Elements that were 'set' past the current size are kept.
+ *
+ * @param array list to shrink
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_al_trim_to_size(ptl_array_list_t array_list);
+
+/**
+ * Sorts the list in place using 'cmp', which works the same as it does for
+ * qsort(): it is given pointers to two positions of the array (void **) and
+ * returns less than, equal to or greater than zero. The sort is an introsort
+ * (quicksort that falls back to heapsort if it goes bad) finishing small
+ * ranges with an insertion sort. It is not stable.
+ * 
+ * In a sparse list, the empty positions are moved to the end, so afterwards
+ * the elements are packed from index 0 to 'size'.
+ *
+ * @param array list to sort
+ * @param cmp compares two elements
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_al_sort(ptl_array_list_t array_list, int (*cmp)(const void *, const void *));
+
+/**
+ * Sorts the list like ptl_al_sort(), but splits the work across as many 
+ * threads as the 'manager' pool's core size using ptl_parallel_for(), the 
+ * calling thread being one of them. Pieces of the list are sorted, then they are 
+ * merged in rounds; each merge is split into even parts (by binary search 
+ * for where each part starts in both inputs) so every thread keeps busy 
+ * until the end. Equal elements keep the order they had after the first 
+ * step. Small lists, or a NULL 'manager', are sorted by the calling thread 
+ * alone. It needs a temporary array as large as the list.
+ *
+ * @param array list to sort
+ * @param cmp compares two elements, the same as for qsort()
+ * @param manager thread manager whose pool size sets the number of threads
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_al_parallel_sort(ptl_array_list_t array_list, int (*cmp)(const void *, const void *),
+						 struct ptl_thread_manager *manager);
+
 #endif
@@ -43,6 +43,7 @@ pthread_mutex_t ptl_aq_mutex = PTHREAD_MUTEX_INITIALIZER;
 /* initalize the ptl_q structure for an array queue */
 void ptl_aq_init_queue (ptl_q_t q){
 	assert(q);
+	q->allocator = ptl_resolve_allocator(q->allocator); // NULL in a zeroed queue set up by hand
 	
 	pthread_mutex_lock(&ptl_aq_mutex); // lock
 	
@@ -55,8 +56,7 @@ void ptl_aq_init_queue (ptl_q_t q){
 	// functions is already set
 	
 	// create our finite array with a size of 'capacity'
-	ptl_q_element_t array = (ptl_q_element_t)calloc(q->capacity, sizeof(struct ptl_q_element));
-	assert(array);
+	ptl_q_element_t array = (ptl_q_element_t)ptl_calloc(q->allocator, q->capacity, sizeof(struct ptl_q_element));
 	q->head = q->tail = q->ptr = array;
 	
 	pthread_mutex_unlock(&ptl_aq_mutex); // unlock
@@ -72,9 +72,11 @@ void ptl_aq_destroy_queue(ptl_q_t q){
 	pthread_mutex_lock(&ptl_aq_mutex); // lock
 	
 	strncpy(q->type, "\0", PTL_Q_TYPE_LENGTH);
+	// free our dynamic array memory ('ptr' always points at its beginning)
+	PTL_FREE(q->allocator, q->ptr, q->capacity * sizeof(struct ptl_q_element));
 	q->capacity = 0;
 	q->size = 0;
-	FREE(q->head); // free our dynamic array memory
+	q->head = NULL;
 	q->tail = NULL;
 	
 	pthread_mutex_unlock(&ptl_aq_mutex); // unlock
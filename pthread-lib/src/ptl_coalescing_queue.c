@@ -0,0 +1,353 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include "ptl_queue.h"
+#include "ptl_coalescing_queue.h"
+#include "ptl_util.h"
+
+
+/* Private Functions */
+uint64_t _ptl_kq_hash(unsigned long key);
+struct ptl_kq_slot *_ptl_kq_find(ptl_kq_index_t index, unsigned long key);
+void _ptl_kq_insert(ptl_kq_index_t index, unsigned long key, ptl_q_element_t element);
+void _ptl_kq_remove(ptl_kq_index_t index, unsigned long key);
+void _ptl_kq_grow(ptl_kq_index_t index);
+
+
+/* Global Variables */
+pthread_mutex_t ptl_kq_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* initialize memory needed for this type of queue. */
+void ptl_kq_init_queue(ptl_q_t q){
+	assert(q);
+	q->allocator = ptl_resolve_allocator(q->allocator); // NULL in a zeroed queue set up by hand
+
+	ptl_kq_index_t index = (ptl_kq_index_t)ptl_calloc(q->allocator, 1, sizeof(struct ptl_kq_index));
+
+	index->allocator = q->allocator;
+	index->slots = (struct ptl_kq_slot *)ptl_calloc(index->allocator, PTL_KQ_INITIAL_INDEX_SIZE, 
+													sizeof(struct ptl_kq_slot));
+	index->mask = PTL_KQ_INITIAL_INDEX_SIZE - 1;
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+
+	strncpy(q->type, "coalescing", PTL_Q_TYPE_LENGTH);
+	q->tail = q->head = ptl_q_alloc_element(q, NULL);
+	q->ptr = NULL; // not used
+	q->size = 0;
+	q->data = index;
+
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+}
+
+
+/* free the memory created using this type of list. */
+void ptl_kq_destroy_queue(ptl_q_t q){
+	ptl_kq_clear(q); // clears all
+
+	ptl_kq_index_t index = (ptl_kq_index_t)q->data;
+	PTL_FREE(q->allocator, index->slots, (index->mask + 1) * sizeof(struct ptl_kq_slot));
+	PTL_FREE(q->allocator, q->data, sizeof(struct ptl_kq_index));
+
+	ptl_q_free_element(q, q->head); // remove final piece of memory in queue
+	q->head = q->tail = NULL;
+	// leave destroying of ptl_q_t to the 'interface'
+}
+
+
+/* set the key and merge functions */
+void ptl_kq_set_functions(ptl_q_t q, unsigned long (*key_func)(void *),
+						  void *(*merge_func)(void *, void *)){
+	if(q == NULL){ return; }
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+
+	ptl_kq_index_t index = (ptl_kq_index_t)q->data;
+	index->key_func = key_func;
+	index->merge_func = merge_func;
+
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+}
+
+
+/* number of adds that were merged */
+long ptl_kq_get_merge_count(ptl_q_t q){
+	if(q == NULL){ return 0; }
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+	long merged = ((ptl_kq_index_t)q->data)->merged;
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+
+	return merged;
+}
+
+
+/* add 'value' to the tail of the queue, or merge it with a pending value */
+int ptl_kq_add(ptl_q_t q, void *value){
+	if((q == NULL) || (value == NULL)){ return 0; }
+
+	ptl_kq_index_t index = (ptl_kq_index_t)q->data;
+	unsigned long (*key_func)(void *) = index->key_func;
+	unsigned long key = (key_func != NULL) ? key_func(value) : 0;
+	int added = 1;
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+
+	struct ptl_kq_slot *slot = (key_func != NULL) ? _ptl_kq_find(index, key) : NULL;
+
+	if(slot != NULL){
+		// already pending, merge instead of queueing a duplicate
+		if(index->merge_func != NULL){
+			slot->element->value = index->merge_func(slot->element->value, value);
+		}
+		index->merged++;
+
+	} else if(q->capacity > 0 && q->size >= q->capacity){
+		added = 0; // no room for another key
+
+	} else {
+		ptl_q_element_t element = ptl_q_alloc_element(q, value);
+
+		q->tail = q->tail->next = element;
+		q->size++;
+
+		if(key_func != NULL){
+			_ptl_kq_insert(index, key, element);
+		}
+	}
+
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+
+	return added;
+}
+
+
+/* There is no waiting for this type of queue. */
+int ptl_kq_add_wait(ptl_q_t q, void *value, long timeout){
+	return ptl_kq_add(q, value);
+}
+
+
+/* Removes all of the elements from this queue. */
+void ptl_kq_clear(ptl_q_t q){
+	ptl_kq_clear_freefunc(q, free);
+}
+
+
+/* Removes all of the elements from this queue using the
+   free_func to free memory. */
+void ptl_kq_clear_freefunc(ptl_q_t q, void (*free_func)(void *)){
+	if(q == NULL){ return; }
+
+	ptl_kq_index_t index = (ptl_kq_index_t)q->data;
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+
+	// detach the whole chain and forget every pending key
+	ptl_q_element_t element = q->head->next;
+	q->head->next = NULL;
+	q->tail = q->head;
+	q->size = 0;
+
+	memset(index->slots, 0, sizeof(struct ptl_kq_slot) * (index->mask + 1));
+	index->used = 0;
+
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+
+	ptl_q_element_t next = NULL;
+	while(element != NULL){
+		next = element->next;
+		free_func(element->value);
+		ptl_q_free_element(q, element);
+		element = next;
+	}
+}
+
+
+/* Retrieves, but does not remove, the head of this queue. */
+void* ptl_kq_peek(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+
+	void *return_elem = NULL;
+	ptl_q_element_t first = q->head->next; // get first element
+	if(first != NULL){ return_elem = first->value; }
+
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+
+	return return_elem;
+}
+
+
+/* Retrieves and removes the head of this queue. */
+void* ptl_kq_get(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	ptl_kq_index_t index = (ptl_kq_index_t)q->data;
+	void* value = NULL;
+
+	pthread_mutex_lock(&ptl_kq_mutex); // lock
+
+	ptl_q_element_t first = q->head->next;
+	if(first != NULL){ // check if we have no elements
+		ptl_q_free_element(q, q->head); // moving head ptr, free previous head
+
+		q->head = first;
+		value = first->value;
+		first->value = NULL;
+
+		q->size--;
+
+		// the key is no longer pending
+		if(index->key_func != NULL){
+			_ptl_kq_remove(index, index->key_func(value));
+		}
+	}
+
+	pthread_mutex_unlock(&ptl_kq_mutex); // unlock
+
+	return value;
+}
+
+
+/* Retrieves and removes the head of this queue, waiting up to the specified
+   wait time if necessary for an element to become available. */
+void* ptl_kq_get_wait(ptl_q_t q, long timeout){
+	if(q == NULL || timeout < 0){ return NULL; }
+
+	long long end_time = ptl_get_time_usec() + (timeout * 1000LL);
+	void *element = NULL;
+
+	// keep trying until we reach the max allowed time
+	while((element = ptl_kq_get(q)) == NULL){
+
+		if(ptl_get_time_usec() >= end_time){
+			break; // I chose to use break to get out before the sleep
+		}
+
+		ptl_timed_wait(100); // wait 100 microseconds
+	}
+
+	// this may be NULL if nothing was retrieved
+	return element;
+}
+
+
+/* Private Functions */
+
+/* spreads the bits of 'key' so sequential keys don't cluster. The mixing is
+   done in 64 bits whatever the size of a long, callers mask it down */
+uint64_t _ptl_kq_hash(unsigned long key){
+	uint64_t hash = key;
+
+	hash ^= hash >> 33;
+	hash *= UINT64_C(0xff51afd7ed558ccd);
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+/* finds the slot holding 'key', NULL if the key is not pending */
+struct ptl_kq_slot *_ptl_kq_find(ptl_kq_index_t index, unsigned long key){
+	unsigned long i = _ptl_kq_hash(key) & index->mask;
+
+	// linear probe until we hit an empty slot
+	while(index->slots[i].element != NULL){
+		if(index->slots[i].key == key){
+			return index->slots + i;
+		}
+		i = (i + 1) & index->mask;
+	}
+
+	return NULL;
+}
+
+/* records that 'key' is pending in 'element'. 'key' must not be pending */
+void _ptl_kq_insert(ptl_kq_index_t index, unsigned long key, ptl_q_element_t element){
+	// keep the index at most half full so probes stay short
+	if((index->used + 1) * 2 > (long)(index->mask + 1)){
+		_ptl_kq_grow(index);
+	}
+
+	unsigned long i = _ptl_kq_hash(key) & index->mask;
+	while(index->slots[i].element != NULL){
+		i = (i + 1) & index->mask;
+	}
+
+	index->slots[i].key = key;
+	index->slots[i].element = element;
+	index->used++;
+}
+
+/* forgets 'key', moving later entries back so no tombstones are needed */
+void _ptl_kq_remove(ptl_kq_index_t index, unsigned long key){
+	struct ptl_kq_slot *slot = _ptl_kq_find(index, key);
+	if(slot == NULL){ return; }
+
+	unsigned long hole = slot - index->slots;
+	unsigned long i = (hole + 1) & index->mask;
+
+	while(index->slots[i].element != NULL){
+		unsigned long home = _ptl_kq_hash(index->slots[i].key) & index->mask;
+
+		// move the entry back if the hole lies between its home and 'i'
+		if(((i - home) & index->mask) >= ((i - hole) & index->mask)){
+			index->slots[hole] = index->slots[i];
+			hole = i;
+		}
+		i = (i + 1) & index->mask;
+	}
+
+	index->slots[hole].key = 0;
+	index->slots[hole].element = NULL;
+	index->used--;
+}
+
+/* doubles the size of the index and rehashes every pending key */
+void _ptl_kq_grow(ptl_kq_index_t index){
+	struct ptl_kq_slot *old_slots = index->slots;
+	unsigned long old_size = index->mask + 1;
+	unsigned long new_size = old_size * 2;
+
+	index->slots = (struct ptl_kq_slot *)ptl_calloc(index->allocator, new_size, sizeof(struct ptl_kq_slot));
+	index->mask = new_size - 1;
+
+	unsigned long i = 0;
+	for(i=0; i<old_size; i++){
+		if(old_slots[i].element != NULL){
+			unsigned long j = _ptl_kq_hash(old_slots[i].key) & index->mask;
+			while(index->slots[j].element != NULL){
+				j = (j + 1) & index->mask;
+			}
+			index->slots[j] = old_slots[i];
+		}
+	}
+
+	PTL_FREE(index->allocator, old_slots, old_size * sizeof(struct ptl_kq_slot));
+}
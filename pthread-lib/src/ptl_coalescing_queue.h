@@ -0,0 +1,175 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is a keyed, coalescing FIFO queue. Each 'value' has a key
+ * (found using a key function). When a 'value' is added while another
+ * 'value' with the same key is still waiting in the queue, the two are merged
+ * using a merge function instead of adding a duplicate. The merged value
+ * keeps the position of the one that was already waiting.
+ *
+ * Pending keys are tracked by an open addressing hash index, so finding a
+ * duplicate does not walk the queue. A single lock is used to control both
+ * get and put. If capacity is greater than zero, it limits the number of
+ * distinct pending keys; merges always succeed.
+ */
+
+
+#ifndef __PTL_COALESCING_QUEUE_H__
+#define __PTL_COALESCING_QUEUE_H__
+
+/* Defines */
+#define PTL_KQ_INITIAL_INDEX_SIZE 16
+
+/* Structures */
+
+/* A single slot in the hash index */
+struct ptl_kq_slot {
+	unsigned long key;				/**< key of the pending element */
+	struct ptl_q_element *element;	/**< pending element, NULL if the slot is empty */
+};
+
+struct ptl_kq_index {
+	unsigned long (*key_func)(void *);			/**< gets the key of a 'value' */
+	void *(*merge_func)(void *, void *);		/**< merges (pending, new) values */
+	struct ptl_kq_slot *slots;					/**< the hash index */
+	unsigned long mask;							/**< number of slots - 1 */
+	long used;									/**< number of used slots */
+	long merged;								/**< number of adds that were merged */
+	ptl_allocator_t allocator;					/**< the queue's allocator */
+};
+
+/* Type Definitions */
+typedef struct ptl_kq_index *ptl_kq_index_t;
+
+
+/* Public Functions */
+
+/**
+ * Destroys the queue and frees the memory. This should be used when the queue
+ * is no longer going to be used.
+ *
+ * @param q the queue to destroy
+ */
+void ptl_kq_destroy_queue(ptl_q_t q);
+
+/**
+ * Initializes the queue, creating all memory needed to support this data
+ * structure. Until ptl_kq_set_functions() is called, no values are merged.
+ *
+ * @param q queue to be initized.
+ */
+void ptl_kq_init_queue(ptl_q_t q);
+
+/**
+ * Sets the functions used to coalesce values. This should be called before
+ * any value is added.
+ *
+ * @param q non-null queue
+ * @param key_func returns the key of a 'value'. Values with equal keys are
+ *        merged.
+ * @param merge_func called with the pending value and the new value, returns
+ *        the value that stays in the queue. The returned value must have the
+ *        same key. It is responsible for freeing whichever of the two values
+ *        is no longer needed. If NULL, the pending value is kept and the new
+ *        one is ignored. It is called while the queue is locked.
+ */
+void ptl_kq_set_functions(ptl_q_t q, unsigned long (*key_func)(void *),
+						  void *(*merge_func)(void *, void *));
+
+/**
+ * Returns the number of added values that were merged into a pending value.
+ *
+ * @param q non-null queue
+ * @return number of merges
+ */
+long ptl_kq_get_merge_count(ptl_q_t q);
+
+/**
+ * Inserts the specified element at the tail of this queue, or merges it into
+ * the pending element with the same key.
+ *
+ * @param q non-null queue
+ * @param value the value to be stored in the queue
+ * @return 1 if added or merged, 0 if the queue is at capacity
+ */
+int ptl_kq_add(ptl_q_t q, void *value);
+
+/**
+ * This is a dummy function. There is no waiting for this type of queue.
+ * It simply calls ptl_kq_add().
+ *
+ * @param q non-null queue to add the value
+ * @param value data that will be added to the queue
+ * @param timeout this parameter is ignored
+ * @return 1 if successful, 0 otherwise
+ * @see ptl_kq_add()
+ **/
+int ptl_kq_add_wait(ptl_q_t q, void *value, long timeout);
+
+/**
+ * Removes all of the elements from this queue freeing memory as it iterates
+ * through. Please note, it frees the 'values' put in the list under add.
+ *
+ * @param q non-null queue to be cleared
+ * @see ptl_kq_clear_freefunc()
+ */
+void ptl_kq_clear(ptl_q_t q);
+
+/**
+ * Removes all of the elements from this queue freeing memory as it iterates
+ * through. It frees the 'values' put in the list under add using the function
+ * provided in the free_func parameter.
+ *
+ * @param q non-null queue to be cleared
+ * @param free_func function that will be used to free the 'value' elements
+ * @see ptl_kq_clear()
+ */
+void ptl_kq_clear_freefunc(ptl_q_t q, void (*free_func)(void *));
+
+/**
+ * Retrieves, but does not remove, the head of this queue.
+ *
+ * @param q non-null queue to peek on
+ * @return pointer to the head element or NULL if no element was found
+ */
+void* ptl_kq_peek(ptl_q_t q);
+
+/**
+ * Retrieves and removes the head of this queue. Once removed, a new value
+ * with the same key is queued again instead of being merged.
+ *
+ * @param q non-null queue to get an element from
+ * @return the head element or NULL if no element was found
+ */
+void* ptl_kq_get(ptl_q_t q);
+
+/**
+ * Retrieves and removes the head of this queue, waiting up to the specified
+ * wait time if necessary for an element to become available.
+ *
+ * @param q non-null queue to get an element from
+ * @param timeout number of milliseconds to wait
+ * @return the head element or NULL if no element was found
+ */
+void* ptl_kq_get_wait(ptl_q_t q, long timeout);
+
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_queue.h"
+#include "ptl_codel_queue.h"
+#include "ptl_util.h"
+
+
+/* Private Functions */
+ptl_q_element_t _ptl_cq_do_dequeue(ptl_q_t q, long long now, int *ok_to_drop);
+long long _ptl_cq_control_law(ptl_codel_t codel, long long t);
+long _ptl_cq_isqrt(long n);
+
+
+/* Global Variables */
+pthread_mutex_t ptl_cq_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* initialize memory needed for this type of queue. */
+void ptl_cq_init_queue(ptl_q_t q){
+	assert(q);
+	q->allocator = ptl_resolve_allocator(q->allocator); // NULL in a zeroed queue set up by hand
+
+	ptl_codel_t codel = (ptl_codel_t)ptl_calloc(q->allocator, 1, sizeof(struct ptl_codel));
+
+	codel->target_usec = PTL_CQ_DEFAULT_TARGET_USEC;
+	codel->interval_usec = PTL_CQ_DEFAULT_INTERVAL_USEC;
+	codel->drop_func = NULL; // values are freed when dropped
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+
+	strncpy(q->type, "codel", PTL_Q_TYPE_LENGTH);
+	q->tail = q->head = ptl_q_alloc_element(q, NULL);
+	q->ptr = NULL; // not used
+	q->size = 0;
+	q->data = codel;
+
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+}
+
+
+/* free the memory created using this type of list. */
+void ptl_cq_destroy_queue(ptl_q_t q){
+	ptl_cq_clear(q); // clears all
+
+	ptl_q_free_element(q, q->head); // remove final piece of memory in queue
+	q->head = q->tail = NULL;
+	PTL_FREE(q->allocator, q->data, sizeof(struct ptl_codel));
+	// leave destroying of ptl_q_t to the 'interface'
+}
+
+
+/* set target, interval and the function called on each dropped value */
+void ptl_cq_set_params(ptl_q_t q, long target_usec, long interval_usec,
+					   void (*drop_func)(void *)){
+	if(q == NULL || target_usec <= 0 || interval_usec <= 0){ return; }
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+
+	ptl_codel_t codel = (ptl_codel_t)q->data;
+	codel->target_usec = target_usec;
+	codel->interval_usec = interval_usec;
+	codel->drop_func = drop_func;
+
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+}
+
+
+/* number of elements dropped since creation */
+long ptl_cq_get_drop_count(ptl_q_t q){
+	if(q == NULL){ return 0; }
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+	long drop_total = ((ptl_codel_t)q->data)->drop_total;
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+
+	return drop_total;
+}
+
+
+/* add 'value' to the tail of the queue, stamped with the current time. */
+int ptl_cq_add(ptl_q_t q, void *value){
+	if((q == NULL) || (value == NULL)){ return 0; }
+
+	// create and stamp the element/node outside of the lock
+	ptl_q_element_t element = ptl_q_alloc_element(q, value);
+	element->enqueue_usec = ptl_get_time_usec();
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+
+	q->tail = q->tail->next = element;
+	q->size++;
+
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+
+	return 1;
+}
+
+
+/* There is no waiting for this type of queue because it is unbounded. */
+int ptl_cq_add_wait(ptl_q_t q, void *value, long timeout){
+	return ptl_cq_add(q, value);
+}
+
+
+/* Removes all of the elements from this queue. */
+void ptl_cq_clear(ptl_q_t q){
+	ptl_cq_clear_freefunc(q, free);
+}
+
+
+/* Removes all of the elements from this queue using the
+   free_func to free memory. */
+void ptl_cq_clear_freefunc(ptl_q_t q, void (*free_func)(void *)){
+	if(q == NULL){ return; }
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+
+	// detach the whole chain, leaving only the dummy head
+	ptl_q_element_t element = q->head->next;
+	q->head->next = NULL;
+	q->tail = q->head;
+	q->size = 0;
+
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+
+	ptl_q_element_t next = NULL;
+	while(element != NULL){
+		next = element->next;
+		free_func(element->value);
+		ptl_q_free_element(q, element);
+		element = next;
+	}
+}
+
+
+/* Retrieves, but does not remove, the head of this queue. */
+void* ptl_cq_peek(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+
+	void *return_elem = NULL;
+	ptl_q_element_t first = q->head->next; // get first element
+	if(first != NULL){ return_elem = first->value; }
+
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+
+	return return_elem;
+}
+
+
+/* Retrieves and removes the head of this queue, dropping elements while
+   the queue is standing (see RFC 8289 for the algorithm). */
+void* ptl_cq_get(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	ptl_q_element_t dropped = NULL; // chain of dropped elements
+	ptl_q_element_t element = NULL;
+	int ok_to_drop = 0;
+	long long now = ptl_get_time_usec();
+
+	pthread_mutex_lock(&ptl_cq_mutex); // lock
+
+	ptl_codel_t codel = (ptl_codel_t)q->data;
+	element = _ptl_cq_do_dequeue(q, now, &ok_to_drop);
+
+	if(codel->dropping){
+		if(!ok_to_drop){
+			codel->dropping = 0; // sojourn time went below target
+		}
+
+		// drop as many elements as the control law says
+		while(codel->dropping && now >= codel->drop_next){
+			element->next = dropped;
+			dropped = element;
+			codel->count++;
+
+			element = _ptl_cq_do_dequeue(q, now, &ok_to_drop);
+			if(!ok_to_drop){
+				codel->dropping = 0;
+			} else {
+				codel->drop_next = _ptl_cq_control_law(codel, codel->drop_next);
+			}
+		}
+	} else if(ok_to_drop){
+		// we have been above target for a whole interval, start dropping
+		element->next = dropped;
+		dropped = element;
+
+		element = _ptl_cq_do_dequeue(q, now, &ok_to_drop);
+		codel->dropping = 1;
+
+		// if we were dropping recently, start from the previous drop rate
+		long delta = codel->count - codel->last_count;
+		if(delta > 1 && (now - codel->drop_next) < (16LL * codel->interval_usec)){
+			codel->count = delta;
+		} else {
+			codel->count = 1;
+		}
+		codel->drop_next = _ptl_cq_control_law(codel, now);
+		codel->last_count = codel->count;
+	}
+
+	void (*drop_func)(void *) = codel->drop_func;
+	pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+
+	// hand dropped values to the caller outside of the lock
+	ptl_q_element_t next = NULL;
+	long num_dropped = 0;
+	while(dropped != NULL){
+		next = dropped->next;
+		if(drop_func != NULL){
+			drop_func(dropped->value);
+		} else {
+			FREE(dropped->value);
+		}
+		ptl_q_free_element(q, dropped);
+		dropped = next;
+		num_dropped++;
+	}
+
+	if(num_dropped > 0){
+		pthread_mutex_lock(&ptl_cq_mutex); // lock
+		codel->drop_total += num_dropped;
+		pthread_mutex_unlock(&ptl_cq_mutex); // unlock
+	}
+
+	void *value = NULL;
+	if(element != NULL){
+		value = element->value;
+		ptl_q_free_element(q, element);
+	}
+
+	return value;
+}
+
+
+/* Retrieves and removes the head of this queue, waiting up to the specified
+   wait time if necessary for an element to become available. */
+void* ptl_cq_get_wait(ptl_q_t q, long timeout){
+	if(q == NULL || timeout < 0){ return NULL; }
+
+	long long end_time = ptl_get_time_usec() + (timeout * 1000LL);
+	void *element = NULL;
+
+	// keep trying until we reach the max allowed time
+	while((element = ptl_cq_get(q)) == NULL){
+
+		if(ptl_get_time_usec() >= end_time){
+			break; // I chose to use break to get out before the sleep
+		}
+
+		ptl_timed_wait(100); // wait 100 microseconds
+	}
+
+	// this may be NULL if nothing was retrieved
+	return element;
+}
+
+
+/* Private Functions */
+
+/**
+ * Removes the first element and decides if it may be dropped. The lock must
+ * be held. The returned element is detached from the queue and holds the
+ * 'value' that was at the head of the queue; the caller frees it.
+ *
+ * @param q queue to take an element from
+ * @param now current time in microseconds
+ * @param ok_to_drop set to 1 if the sojourn time has been above target for
+ *        an interval, 0 otherwise
+ * @return the detached element or NULL if the queue is empty
+ */
+ptl_q_element_t _ptl_cq_do_dequeue(ptl_q_t q, long long now, int *ok_to_drop){
+	ptl_codel_t codel = (ptl_codel_t)q->data;
+	ptl_q_element_t first = q->head->next;
+
+	*ok_to_drop = 0;
+
+	if(first == NULL){
+		codel->first_above_time = 0; // an empty queue is not standing
+		return NULL;
+	}
+
+	// the old dummy head carries the value out, 'first' becomes the dummy
+	ptl_q_element_t element = q->head;
+	q->head = first;
+	element->value = first->value;
+	element->enqueue_usec = first->enqueue_usec;
+	element->next = NULL;
+	first->value = NULL;
+	q->size--;
+
+	long long sojourn_time = now - element->enqueue_usec;
+
+	if(sojourn_time < codel->target_usec || q->size == 0){
+		// went below target (or the queue is draining), stay out of dropping
+		codel->first_above_time = 0;
+	} else if(codel->first_above_time == 0){
+		// just went above target, allow one interval before dropping
+		codel->first_above_time = now + codel->interval_usec;
+	} else if(now >= codel->first_above_time){
+		*ok_to_drop = 1;
+	}
+
+	return element;
+}
+
+/* next drop time: t + interval/sqrt(count) */
+long long _ptl_cq_control_law(ptl_codel_t codel, long long t){
+	long root = _ptl_cq_isqrt(codel->count);
+	if(root <= 0){ root = 1; }
+
+	return t + (codel->interval_usec / root);
+}
+
+/* integer square root (avoids linking libm) */
+long _ptl_cq_isqrt(long n){
+	if(n <= 0){ return 0; }
+
+	long x = n;
+	long y = (x + 1) / 2;
+	while(y < x){
+		x = y;
+		y = (x + n / x) / 2;
+	}
+
+	return x;
+}
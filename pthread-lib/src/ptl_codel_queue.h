@@ -0,0 +1,176 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is a linked FIFO queue with controlled delay (CoDel) active
+ * queue management. Every element is stamped with the time it was enqueued.
+ * When elements are taken from the queue, their sojourn time (time spent in
+ * the queue) is checked. If the sojourn time has stayed above 'target' for at
+ * least 'interval', the queue enters a dropping state and discards elements
+ * from the head, at an increasing rate, until the sojourn time falls back
+ * below 'target'. Dropped elements are handed to a drop function so the
+ * caller can reject or free them.
+ *
+ * Like the linked queue, capacity is not a concern. The length of the queue
+ * is controlled by time instead of by the number of elements.
+ */
+
+
+#ifndef __PTL_CODEL_QUEUE_H__
+#define __PTL_CODEL_QUEUE_H__
+
+/* Defines */
+#define PTL_CQ_DEFAULT_TARGET_USEC     5000   /**< 5 milliseconds */
+#define PTL_CQ_DEFAULT_INTERVAL_USEC 100000   /**< 100 milliseconds */
+
+/* Structures */
+struct ptl_codel {
+	long target_usec;			/**< acceptable standing sojourn time */
+	long interval_usec;			/**< sliding window the minimum is taken over */
+	void (*drop_func)(void *);	/**< called on each dropped 'value' */
+	long long first_above_time;	/**< when sojourn time first went over target */
+	long long drop_next;		/**< time of the next drop while dropping */
+	long count;					/**< drops since entering the dropping state */
+	long last_count;			/**< 'count' the last time we were dropping */
+	int dropping;				/**< 1 if in the dropping state */
+	long drop_total;			/**< number of elements dropped since creation */
+};
+
+/* Type Definitions */
+typedef struct ptl_codel *ptl_codel_t;
+
+
+/* Public Functions */
+
+/**
+ * Destroys the queue and frees the memory. This should be used when the queue
+ * is no longer going to be used.
+ *
+ * @param q the queue to destroy
+ */
+void ptl_cq_destroy_queue(ptl_q_t q);
+
+/**
+ * Initializes the queue, creating all memory needed to support this data
+ * structure. The queue starts with the default target and interval and with
+ * no drop function (dropped values are freed).
+ *
+ * @param q queue to be initized.
+ * @see ptl_cq_set_params()
+ */
+void ptl_cq_init_queue(ptl_q_t q);
+
+/**
+ * Sets the CoDel parameters for this queue.
+ *
+ * @param q non-null queue
+ * @param target_usec acceptable standing sojourn time in microseconds
+ * @param interval_usec time in microseconds the sojourn time must stay above
+ *        'target_usec' before elements are dropped
+ * @param drop_func function called with each dropped 'value'. If NULL, the
+ *        'value' is freed (see ptl_lq_clear()). It is called after the queue
+ *        lock is released, so it may add to this queue again.
+ */
+void ptl_cq_set_params(ptl_q_t q, long target_usec, long interval_usec,
+					   void (*drop_func)(void *));
+
+/**
+ * Returns the number of elements dropped by this queue since it was created.
+ *
+ * @param q non-null queue
+ * @return total number of dropped elements
+ */
+long ptl_cq_get_drop_count(ptl_q_t q);
+
+/**
+ * Inserts the specified element at the tail of this queue and stamps it with
+ * the current time.
+ *
+ * @param q non-null queue
+ * @param value the value to be stored in the queue
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_cq_add(ptl_q_t q, void *value);
+
+/**
+ * This is a dummy function. There is no waiting for this type of queue
+ * because it is unbounded. It simply cals ptl_cq_add().
+ *
+ * @param q non-null queue to add the value
+ * @param value data that will be added to the queue
+ * @param timeout this parameter is ignored
+ * @return 1 if successful, 0 otherwise
+ * @see ptl_cq_add()
+ **/
+int ptl_cq_add_wait(ptl_q_t q, void *value, long timeout);
+
+/**
+ * Removes all of the elements from this queue freeing memory as it iterates
+ * through. Please note, it frees the 'values' put in the list under add.
+ * Elements removed this way are not counted as dropped.
+ *
+ * @param q non-null queue to be cleared
+ * @see ptl_cq_clear_freefunc()
+ */
+void ptl_cq_clear(ptl_q_t q);
+
+/**
+ * Removes all of the elements from this queue freeing memory as it iterates
+ * through. It frees the 'values' put in the list under add using the function
+ * provided in the free_func parameter.
+ *
+ * @param q non-null queue to be cleared
+ * @param free_func function that will be used to free the 'value' elements
+ * @see ptl_cq_clear()
+ */
+void ptl_cq_clear_freefunc(ptl_q_t q, void (*free_func)(void *));
+
+/**
+ * Retrieves, but does not remove, the head of this queue. No CoDel decision
+ * is made when peeking.
+ *
+ * @param q non-null queue to peek on
+ * @return pointer to the head element or NULL if no element was found
+ */
+void* ptl_cq_peek(ptl_q_t q);
+
+/**
+ * Retrieves and removes the head of this queue. Elements whose sojourn time
+ * says the queue is standing are dropped (see ptl_cq_set_params()) and the
+ * next element is returned instead. It will return null if the queue is empty.
+ *
+ * @param q non-null queue to get an element from
+ * @return the head element or NULL if no element was found
+ */
+void* ptl_cq_get(ptl_q_t q);
+
+/**
+ * Retrieves and removes the head of this queue, waiting up to the specified
+ * wait time if necessary for an element to become available.
+ *
+ * @param q non-null queue to get an element from
+ * @param timeout number of milliseconds to wait
+ * @return the head element or NULL if no element was found
+ * @see ptl_cq_get()
+ */
+void* ptl_cq_get_wait(ptl_q_t q, long timeout);
+
+
+#endif
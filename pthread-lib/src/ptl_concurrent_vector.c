@@ -0,0 +1,245 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_allocator.h"
+#include "ptl_concurrent_vector.h"
+#include "ptl_util.h"
+
+
+/* Defines */
+#define PTL_CV_SEGMENT_SIZE(k) (PTL_CV_FIRST_SEGMENT << (k))
+#define PTL_CV_SEGMENT_START(k) (PTL_CV_FIRST_SEGMENT * ((1L << (k)) - 1))
+
+
+/* Private Functions */
+int _ptl_cv_segment_of(long index);
+void **_ptl_cv_get_segment(ptl_concurrent_vector_t vector, int k);
+
+
+/* creates an empty vector, segments are allocated when first needed */
+ptl_concurrent_vector_t ptl_cv_create_concurrent_vector(){
+	return ptl_cv_create_concurrent_vector_allocator(NULL);
+}
+
+
+/* creates an empty vector whose segments come from 'allocator' */
+ptl_concurrent_vector_t ptl_cv_create_concurrent_vector_allocator(ptl_allocator_t allocator){
+	allocator = ptl_resolve_allocator(allocator);
+
+	ptl_concurrent_vector_t vector = (ptl_concurrent_vector_t)ptl_calloc(allocator, 1, sizeof(struct ptl_concurrent_vector));
+
+	vector->allocator = allocator;
+	vector->size = 0;
+
+	return vector;
+}
+
+
+/* frees the segments, but not the elements */
+int ptl_cv_destroy_concurrent_vector(ptl_concurrent_vector_t vector){
+	return ptl_cv_destroy_concurrent_vector_freefunc(vector, NULL);
+}
+
+
+/* frees the segments, freeing the elements with 'free_func' */
+int ptl_cv_destroy_concurrent_vector_freefunc(ptl_concurrent_vector_t vector, void (*free_func)(void *)){
+	if(vector == NULL){ return 0; }
+
+	int k = 0;
+	long i = 0;
+	for(k=0; k<PTL_CV_MAX_SEGMENTS; k++){
+		if(vector->segments[k] == NULL){ continue; }
+
+		if(free_func != NULL){
+			for(i=0; i<PTL_CV_SEGMENT_SIZE(k); i++){
+				if(vector->segments[k][i] != NULL){
+					free_func(vector->segments[k][i]);
+				}
+			}
+		}
+		PTL_FREE(vector->allocator, vector->segments[k], PTL_CV_SEGMENT_SIZE(k) * sizeof(void *));
+	}
+
+	ptl_free(vector->allocator, vector, sizeof(struct ptl_concurrent_vector));
+
+	return 1;
+}
+
+
+/* take an index and store 'value' there */
+long ptl_cv_push_back(ptl_concurrent_vector_t vector, void *value){
+	if(vector == NULL || value == NULL){ return -1; }
+
+	long index = __atomic_fetch_add(&(vector->size), 1, __ATOMIC_RELAXED);
+	int k = _ptl_cv_segment_of(index);
+	void **segment = _ptl_cv_get_segment(vector, k);
+
+	__atomic_store_n(segment + (index - PTL_CV_SEGMENT_START(k)), value, __ATOMIC_RELEASE);
+
+	return index;
+}
+
+
+/* take 'num_values' indexes at once and fill them in, segment by segment */
+long ptl_cv_push_back_n(ptl_concurrent_vector_t vector, void **values, long num_values){
+	if(vector == NULL || values == NULL || num_values <= 0){ return -1; }
+
+	long first = __atomic_fetch_add(&(vector->size), num_values, __ATOMIC_RELAXED);
+	long index = first;
+	long done = 0;
+
+	while(done < num_values){
+		int k = _ptl_cv_segment_of(index);
+		void **segment = _ptl_cv_get_segment(vector, k);
+		long offset = index - PTL_CV_SEGMENT_START(k);
+		long count = PTL_CV_SEGMENT_SIZE(k) - offset;
+
+		if(count > num_values - done){
+			count = num_values - done;
+		}
+
+		long i = 0;
+		for(i=0; i<count; i++){
+			__atomic_store_n(segment + offset + i, values[done + i], __ATOMIC_RELEASE);
+		}
+
+		done += count;
+		index += count;
+	}
+
+	return first;
+}
+
+
+/* read 'index' without a lock */
+void *ptl_cv_get(ptl_concurrent_vector_t vector, long index){
+	if(vector == NULL || index < 0 || index >= ptl_cv_size(vector)){ return NULL; }
+
+	int k = _ptl_cv_segment_of(index);
+	void **segment = __atomic_load_n(&(vector->segments[k]), __ATOMIC_ACQUIRE);
+	if(segment == NULL){ return NULL; } // the add that allocates it is still running
+
+	return __atomic_load_n(segment + (index - PTL_CV_SEGMENT_START(k)), __ATOMIC_ACQUIRE);
+}
+
+
+/* number of indexes handed out */
+long ptl_cv_size(ptl_concurrent_vector_t vector){
+	if(vector == NULL){ return 0; }
+
+	return __atomic_load_n(&(vector->size), __ATOMIC_ACQUIRE);
+}
+
+
+/* hand each segment (up to 'size') to 'func' */
+long ptl_cv_for_each_segment(ptl_concurrent_vector_t vector,
+							 int (*func)(void **, long, long, void *), void *arg){
+	if(vector == NULL || func == NULL){ return 0; }
+
+	long size = ptl_cv_size(vector);
+	long index = 0;
+	int k = 0;
+
+	for(k=0; k<PTL_CV_MAX_SEGMENTS && index < size; k++){
+		long count = PTL_CV_SEGMENT_SIZE(k);
+		if(count > size - index){
+			count = size - index;
+		}
+
+		// an add may still be allocating it, fill in the hole so it reads as NULLs
+		void **segment = _ptl_cv_get_segment(vector, k);
+
+		if(func(segment, count, index, arg) == 0){
+			return index + count;
+		}
+		index += count;
+	}
+
+	return index;
+}
+
+
+/* copy a range out, segment by segment */
+long ptl_cv_copy(ptl_concurrent_vector_t vector, long index, void **values, long num_values){
+	if(vector == NULL || values == NULL || index < 0 || num_values <= 0){ return 0; }
+
+	long size = ptl_cv_size(vector);
+	long done = 0;
+
+	if(num_values > size - index){
+		num_values = size - index;
+	}
+
+	while(done < num_values){
+		int k = _ptl_cv_segment_of(index);
+		void **segment = __atomic_load_n(&(vector->segments[k]), __ATOMIC_ACQUIRE);
+		long offset = index - PTL_CV_SEGMENT_START(k);
+		long count = PTL_CV_SEGMENT_SIZE(k) - offset;
+
+		if(count > num_values - done){
+			count = num_values - done;
+		}
+
+		long i = 0;
+		for(i=0; i<count; i++){
+			values[done + i] = (segment != NULL) ? __atomic_load_n(segment + offset + i, __ATOMIC_ACQUIRE) : NULL;
+		}
+
+		done += count;
+		index += count;
+	}
+
+	return done;
+}
+
+
+/* Private Functions */
+
+/* the segment 'index' lives in. Segment 'k' starts at FIRST * (2^k - 1) */
+int _ptl_cv_segment_of(long index){
+	unsigned long n = ((unsigned long)index >> PTL_CV_FIRST_SEGMENT_BITS) + 1;
+
+	return (8 * sizeof(unsigned long) - 1) - __builtin_clzl(n);
+}
+
+/* gets segment 'k', allocating it if nobody has yet. If two threads race to
+   allocate it, the loser frees its copy and uses the winner's */
+void **_ptl_cv_get_segment(ptl_concurrent_vector_t vector, int k){
+	assert(k < PTL_CV_MAX_SEGMENTS);
+
+	void **segment = __atomic_load_n(&(vector->segments[k]), __ATOMIC_ACQUIRE);
+	if(segment != NULL){ return segment; }
+
+	void **new_segment = (void **)ptl_calloc(vector->allocator, PTL_CV_SEGMENT_SIZE(k), sizeof(void *));
+
+	if(__atomic_compare_exchange_n(&(vector->segments[k]), &segment, new_segment,
+								   0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+		return new_segment;
+	}
+
+	PTL_FREE(vector->allocator, new_segment, PTL_CV_SEGMENT_SIZE(k) * sizeof(void *));
+
+	return segment; // set to the winner's segment by the failed exchange
+}
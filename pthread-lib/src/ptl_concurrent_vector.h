@@ -0,0 +1,165 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is an append-only list that any number of threads can add to
+ * at the same time without a lock. It is the concurrent counterpart of
+ * ptl_array_list for lists that are only ever appended to.
+ *
+ * The elements are kept in segments that double in size: the first holds
+ * PTL_CV_FIRST_SEGMENT elements, the next twice that, and so on. A segment is
+ * never moved once allocated, so an element stays at the same address for
+ * the life of the vector and readers can look up any index without a lock.
+ *
+ * An add takes its index with a single atomic increment, allocates the
+ * segment if it is the first to need it, and stores its element. An index
+ * below ptl_cv_size() whose add has not finished yet reads as NULL. Once
+ * every adding thread is done (e.g. joined), the whole vector is readable.
+ */
+
+
+#ifndef __PTL_CONCURRENT_VECTOR_H__
+#define __PTL_CONCURRENT_VECTOR_H__
+
+#include "ptl_allocator.h"
+
+/* Defines */
+#define PTL_CV_FIRST_SEGMENT_BITS 3		/**< the first segment holds 2^3 elements */
+#define PTL_CV_FIRST_SEGMENT (1L << PTL_CV_FIRST_SEGMENT_BITS)
+#define PTL_CV_MAX_SEGMENTS 48			/**< more elements than can be addressed */
+
+/* Structures */
+struct ptl_concurrent_vector {
+	long size;									/**< number of indexes handed out */
+	void **segments[PTL_CV_MAX_SEGMENTS];		/**< segment 'k' holds FIRST_SEGMENT << k elements */
+	ptl_allocator_t allocator;					/**< where the vector and its segments come from */
+};
+
+/* Type Definitions */
+typedef struct ptl_concurrent_vector *ptl_concurrent_vector_t;
+
+
+/* Public Functions */
+
+/**
+ * Creates an empty concurrent vector.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @return a fully initialized concurrent vector
+ */
+ptl_concurrent_vector_t ptl_cv_create_concurrent_vector();
+
+/**
+ * Creates an empty concurrent vector that takes itself and its segments from
+ * 'allocator' (see ptl_allocator.h). Adds that need a new segment call the
+ * allocator from whatever thread they run on, so it must be thread safe.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param allocator allocator to use, NULL for the default
+ * @return a fully initialized concurrent vector
+ */
+ptl_concurrent_vector_t ptl_cv_create_concurrent_vector_allocator(ptl_allocator_t allocator);
+
+/**
+ * Destroys a concurrent vector. The elements are not freed. No thread may be
+ * using the vector.
+ *
+ * @param vector vector to be freed
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_cv_destroy_concurrent_vector(ptl_concurrent_vector_t vector);
+
+/**
+ * Destroys a concurrent vector, calling 'free_func' on each non-null
+ * element. No thread may be using the vector.
+ *
+ * @param vector vector to be freed
+ * @param free_func function that will be used to free each element
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_cv_destroy_concurrent_vector_freefunc(ptl_concurrent_vector_t vector, void (*free_func)(void *));
+
+/**
+ * Appends 'value' to the end of the vector. Never blocks.
+ *
+ * @param vector vector to add to
+ * @param value non-null value to add
+ * @return the index 'value' was stored at, -1 if it was not added
+ */
+long ptl_cv_push_back(ptl_concurrent_vector_t vector, void *value);
+
+/**
+ * Appends 'num_values' values to the end of the vector. They get consecutive
+ * indexes, with no other thread's values in between. Never blocks.
+ *
+ * @param vector vector to add to
+ * @param values non-null values to add
+ * @param num_values number of 'values'
+ * @return the index of 'values[0]', -1 if nothing was added
+ */
+long ptl_cv_push_back_n(ptl_concurrent_vector_t vector, void **values, long num_values);
+
+/**
+ * Gets the element at 'index'.
+ *
+ * @param vector vector to read
+ * @param index position of the element
+ * @return the element, NULL if 'index' is out of range or its add has not
+ *         finished
+ */
+void *ptl_cv_get(ptl_concurrent_vector_t vector, long index);
+
+/**
+ * Gets the number of indexes handed out so far. Adds that are still running
+ * are counted.
+ *
+ * @param vector vector to count
+ * @return number of elements
+ */
+long ptl_cv_size(ptl_concurrent_vector_t vector);
+
+/**
+ * Calls 'func' once for each run of elements that are next to each other in
+ * memory, in index order, covering indexes 0 to ptl_cv_size() at the time of
+ * the call. 'func' is given a pointer to the first element of the run, the
+ * number of elements in it, the index of the first one and 'arg'. Elements
+ * whose add has not finished are NULL. If 'func' returns 0, the iteration
+ * stops.
+ *
+ * @param vector vector to iterate
+ * @param func called for each run
+ * @param arg passed to 'func'
+ * @return number of elements passed to 'func'
+ */
+long ptl_cv_for_each_segment(ptl_concurrent_vector_t vector,
+							 int (*func)(void **, long, long, void *), void *arg);
+
+/**
+ * Copies 'num_values' elements, starting at 'index', into 'values'.
+ *
+ * @param vector vector to copy from
+ * @param index first index to copy
+ * @param values where the elements are copied to
+ * @param num_values most elements to copy
+ * @return number of elements copied
+ */
+long ptl_cv_copy(ptl_concurrent_vector_t vector, long index, void **values, long num_values);
+
+#endif
@@ -0,0 +1,456 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include "ptl_allocator.h"
+#include "ptl_task.h"
+#include "ptl_thread_manager.h"
+#include "ptl_future.h"
+#include "ptl_util.h"
+
+
+/* Structures */
+
+/* Where threads sleep on futures */
+struct ptl_future_lock {
+	pthread_mutex_t mutex;		/**< protects sleeping on 'cond' */
+	pthread_cond_t cond;		/**< broadcast when one of its futures finishes */
+};
+
+/* A call waiting for a future to finish */
+struct ptl_future_then {
+	ptl_future_t source;						/**< future it waits for */
+	ptl_future_t future;						/**< finished with what 'function' returns */
+	void *(*function)(ptl_future_t, void *);	/**< the call */
+	void *arg;									/**< passed to 'function' */
+};
+
+/* What when_all and when_any count with */
+struct ptl_future_join {
+	ptl_future_t future;		/**< the future being made, it holds the futures */
+	int remaining;				/**< callbacks that have not run yet */
+	int any;					/**< 1 for when_any */
+	int claimed;				/**< when_any: 1 once a future has finished it */
+};
+
+/* Marks a future's callback list as closed, it has finished */
+#define PTL_FUTURE_CLOSED ((struct ptl_future_callback *)1)
+
+
+/* Private Functions */
+ptl_future_t _ptl_future_create(ptl_thread_manager_t manager, ptl_allocator_t allocator, int refs);
+void _ptl_future_add_callback(ptl_future_t future, void (*function)(ptl_future_t, void *), void *arg);
+void _ptl_future_run_callbacks(ptl_future_t future);
+void _ptl_future_then_ready(ptl_future_t source, void *arg);
+void _ptl_future_run_then(void *arg);
+void _ptl_future_reject_then(void *arg);
+void _ptl_future_free_then(struct ptl_future_then *then, int state, void *result);
+ptl_future_t _ptl_future_join(ptl_future_t *futures, int num_futures, int any);
+void _ptl_future_join_ready(ptl_future_t source, void *arg);
+void _ptl_future_init_locks();
+struct ptl_future_lock *_ptl_future_lock(ptl_future_t future);
+void _ptl_future_run(void *arg);
+void _ptl_future_reject(void *arg);
+void _ptl_future_finish(ptl_future_t future, void *result, int state);
+void _ptl_future_release(ptl_future_t future);
+int _ptl_future_wait_until(ptl_future_t future, long long deadline);
+
+
+/* Global Variables */
+struct ptl_future_lock ptl_future_locks[PTL_FUTURE_NUM_LOCKS];
+pthread_once_t ptl_future_locks_once = PTHREAD_ONCE_INIT;
+
+
+/* wrap the function in a task that finishes the future */
+ptl_future_t submit_future(ptl_thread_manager_t manager, void *(*function)(void *), void *arg){
+	if(manager == NULL || function == NULL){
+		return NULL;
+	}
+
+	// like the manager's own tasks, from its pool's allocator
+	ptl_allocator_t allocator = ptl_resolve_allocator(
+		(manager->thread_pool != NULL) ? manager->thread_pool->allocator : NULL);
+
+	ptl_future_t future = _ptl_future_create(manager, allocator, 2); // the caller and the task
+	future->function = function;
+	future->arg = arg;
+
+	ptl_task_t task = create_task_with_arg(_ptl_future_run, future, allocator);
+	task->rejected = _ptl_future_reject;
+
+	// if the task is rejected, now or later, _ptl_future_reject finishes for it
+	submit_task(manager, task);
+
+	return future;
+}
+
+
+/* call 'function' on the manager's workers once 'future' is finished */
+ptl_future_t ptl_future_then(ptl_future_t future, void *(*function)(ptl_future_t, void *), void *arg){
+	if(future == NULL || function == NULL){
+		return NULL;
+	}
+
+	struct ptl_future_then *then = 
+		(struct ptl_future_then *)ptl_alloc(future->allocator, sizeof(struct ptl_future_then));
+	then->source = future;
+	then->future = _ptl_future_create(future->manager, future->allocator, 2); // the caller and 'then'
+	then->function = function;
+	then->arg = arg;
+
+	// keep the source for 'function', whatever the caller does
+	__atomic_add_fetch(&(future->refs), 1, __ATOMIC_RELAXED);
+
+	ptl_future_t result = then->future;
+	_ptl_future_add_callback(future, _ptl_future_then_ready, then);
+
+	return result;
+}
+
+
+/* done once all of 'futures' are */
+ptl_future_t ptl_future_when_all(ptl_future_t *futures, int num_futures){
+	return _ptl_future_join(futures, num_futures, 0);
+}
+
+
+/* done once any of 'futures' is */
+ptl_future_t ptl_future_when_any(ptl_future_t *futures, int num_futures){
+	return _ptl_future_join(futures, num_futures, 1);
+}
+
+
+/* the caller lets go */
+void ptl_future_destroy(ptl_future_t future){
+	if(future == NULL){ return; }
+
+	_ptl_future_release(future);
+}
+
+
+/* wait for as long as it takes */
+int ptl_future_wait(ptl_future_t future){
+	if(future == NULL){ return 0; }
+
+	return _ptl_future_wait_until(future, -1);
+}
+
+
+/* wait up to 'timeout' milliseconds */
+int ptl_future_wait_timeout(ptl_future_t future, long timeout){
+	if(future == NULL){ return 0; }
+
+	long long deadline = ptl_get_time_usec() + ((timeout > 0) ? timeout * 1000LL : 0);
+
+	return _ptl_future_wait_until(future, deadline);
+}
+
+
+/* wait, then the result */
+void *ptl_future_get(ptl_future_t future){
+	if(future == NULL){ return NULL; }
+
+	if(!_ptl_future_wait_until(future, -1)){
+		return NULL;
+	}
+
+	return future->result;
+}
+
+
+/* done or rejected */
+int ptl_future_is_done(ptl_future_t future){
+	if(future == NULL){ return 0; }
+
+	return __atomic_load_n(&(future->state), __ATOMIC_ACQUIRE) != PTL_FUTURE_PENDING;
+}
+
+
+/* Private Functions */
+
+/* a pending future with 'refs' holders */
+ptl_future_t _ptl_future_create(ptl_thread_manager_t manager, ptl_allocator_t allocator, int refs){
+	ptl_future_t future = (ptl_future_t)ptl_calloc(allocator, 1, sizeof(struct ptl_future));
+
+	future->state = PTL_FUTURE_PENDING;
+	future->waiters = 0;
+	future->refs = refs;
+	future->function = NULL;
+	future->arg = NULL;
+	future->result = NULL;
+	future->allocator = allocator;
+	future->manager = manager;
+	future->callbacks = NULL;
+	future->futures = NULL;
+	future->num_futures = 0;
+
+	return future;
+}
+
+/* runs 'function' once 'future' is finished, now if it already is */
+void _ptl_future_add_callback(ptl_future_t future, void (*function)(ptl_future_t, void *), void *arg){
+	struct ptl_future_callback *callback = 
+		(struct ptl_future_callback *)ptl_alloc(future->allocator, sizeof(struct ptl_future_callback));
+	callback->function = function;
+	callback->arg = arg;
+	callback->next = __atomic_load_n(&(future->callbacks), __ATOMIC_ACQUIRE);
+
+	while(callback->next != PTL_FUTURE_CLOSED){
+		if(__atomic_compare_exchange_n(&(future->callbacks), &(callback->next), callback,
+									   1, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)){
+			return;
+		}
+	}
+
+	// too late, it has finished
+	ptl_free(future->allocator, callback, sizeof(struct ptl_future_callback));
+	function(future, arg);
+}
+
+/* closes the callback list and runs what was on it, oldest first */
+void _ptl_future_run_callbacks(ptl_future_t future){
+	struct ptl_future_callback *callback = 
+		__atomic_exchange_n(&(future->callbacks), PTL_FUTURE_CLOSED, __ATOMIC_ACQ_REL);
+	struct ptl_future_callback *oldest = NULL;
+
+	while(callback != NULL){
+		struct ptl_future_callback *next = callback->next;
+		callback->next = oldest;
+		oldest = callback;
+		callback = next;
+	}
+
+	while(oldest != NULL){
+		struct ptl_future_callback *next = oldest->next;
+		oldest->function(future, oldest->arg);
+		ptl_free(future->allocator, oldest, sizeof(struct ptl_future_callback));
+		oldest = next;
+	}
+}
+
+/* the source finished, hand the call to the manager */
+void _ptl_future_then_ready(ptl_future_t source, void *arg){
+	struct ptl_future_then *then = (struct ptl_future_then *)arg;
+
+	ptl_task_t task = create_task_with_arg(_ptl_future_run_then, then, source->allocator);
+	task->rejected = _ptl_future_reject_then;
+
+	submit_task(source->manager, task);
+}
+
+/* the task: make the call, then finish the new future with its result */
+void _ptl_future_run_then(void *arg){
+	struct ptl_future_then *then = (struct ptl_future_then *)arg;
+
+	void *result = then->function(then->source, then->arg);
+
+	_ptl_future_free_then(then, PTL_FUTURE_DONE, result);
+}
+
+/* the task was rejected, the call won't be made */
+void _ptl_future_reject_then(void *arg){
+	_ptl_future_free_then((struct ptl_future_then *)arg, PTL_FUTURE_REJECTED, NULL);
+}
+
+/* finishes the new future and lets go of both */
+void _ptl_future_free_then(struct ptl_future_then *then, int state, void *result){
+	ptl_future_t source = then->source;
+	ptl_future_t future = then->future;
+
+	ptl_free(source->allocator, then, sizeof(struct ptl_future_then));
+
+	_ptl_future_finish(future, result, state);
+	_ptl_future_release(future);
+	_ptl_future_release(source);
+}
+
+/* a future finished by the callbacks it puts on 'futures' */
+ptl_future_t _ptl_future_join(ptl_future_t *futures, int num_futures, int any){
+	if(futures == NULL || num_futures <= 0){
+		return NULL;
+	}
+
+	int i = 0;
+	for(i=0; i<num_futures; i++){
+		if(futures[i] == NULL){ return NULL; }
+	}
+
+	ptl_allocator_t allocator = futures[0]->allocator;
+
+	struct ptl_future_join *join = 
+		(struct ptl_future_join *)ptl_alloc(allocator, sizeof(struct ptl_future_join));
+	join->future = _ptl_future_create(futures[0]->manager, allocator, 2); // the caller and 'join'
+	join->remaining = num_futures;
+	join->any = any;
+	join->claimed = 0;
+
+	// the new future keeps its own copy of the array and holds each future
+	// in it, so the caller may let go of both right away
+	ptl_future_t result = join->future;
+	result->futures = (ptl_future_t *)ptl_alloc(allocator, num_futures * sizeof(ptl_future_t));
+	result->num_futures = num_futures;
+	for(i=0; i<num_futures; i++){
+		result->futures[i] = futures[i];
+		__atomic_add_fetch(&(futures[i]->refs), 1, __ATOMIC_RELAXED);
+	}
+
+	// a callback may finish it before the loop is over
+
+	for(i=0; i<num_futures; i++){
+		_ptl_future_add_callback(futures[i], _ptl_future_join_ready, join);
+	}
+
+	return result;
+}
+
+/* one of the futures finished, the first (any) or last (all) one finishes the join */
+void _ptl_future_join_ready(ptl_future_t source, void *arg){
+	struct ptl_future_join *join = (struct ptl_future_join *)arg;
+	ptl_future_t future = join->future;
+	int claimed = 0;
+
+	// finish before counting down, the last one down frees 'join'
+	if(join->any && __atomic_compare_exchange_n(&(join->claimed), &claimed, 1, 0,
+												__ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+		_ptl_future_finish(future, source, PTL_FUTURE_DONE);
+	}
+
+	if(__atomic_sub_fetch(&(join->remaining), 1, __ATOMIC_ACQ_REL) == 0){
+		if(!join->any){
+			_ptl_future_finish(future, future->futures, PTL_FUTURE_DONE);
+		}
+
+		ptl_free(future->allocator, join, sizeof(struct ptl_future_join));
+		_ptl_future_release(future);
+	}
+}
+
+/* the conditions time out on the clock ptl_get_time_usec() reads */
+void _ptl_future_init_locks(){
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+	int i = 0;
+	for(i=0; i<PTL_FUTURE_NUM_LOCKS; i++){
+		pthread_mutex_init(&(ptl_future_locks[i].mutex), NULL);
+		pthread_cond_init(&(ptl_future_locks[i].cond), &cond_attr);
+	}
+
+	pthread_condattr_destroy(&cond_attr);
+}
+
+/* the shared lock for 'future' */
+struct ptl_future_lock *_ptl_future_lock(ptl_future_t future){
+	pthread_once(&ptl_future_locks_once, _ptl_future_init_locks);
+
+	return ptl_future_locks + (((uintptr_t)future >> 4) & (PTL_FUTURE_NUM_LOCKS - 1));
+}
+
+/* the task: run the function, then finish the future with its result */
+void _ptl_future_run(void *arg){
+	ptl_future_t future = (ptl_future_t)arg;
+
+	void *result = future->function(future->arg);
+
+	_ptl_future_finish(future, result, PTL_FUTURE_DONE);
+	_ptl_future_release(future);
+}
+
+/* the task was rejected, finish for it */
+void _ptl_future_reject(void *arg){
+	ptl_future_t future = (ptl_future_t)arg;
+
+	_ptl_future_finish(future, NULL, PTL_FUTURE_REJECTED);
+	_ptl_future_release(future);
+}
+
+/* sets the result, then wakes any sleepers */
+void _ptl_future_finish(ptl_future_t future, void *result, int state){
+	future->result = result;
+
+	// a sleeper counts itself before it looks at the state, so one of us
+	// always sees the other
+	__atomic_store_n(&(future->state), state, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&(future->waiters), __ATOMIC_SEQ_CST) > 0){
+		struct ptl_future_lock *lock = _ptl_future_lock(future);
+
+		pthread_mutex_lock(&(lock->mutex)); // lock
+		pthread_cond_broadcast(&(lock->cond));
+		pthread_mutex_unlock(&(lock->mutex)); // unlock
+	}
+
+	_ptl_future_run_callbacks(future);
+}
+
+/* drops a hold, the last one out frees the future */
+void _ptl_future_release(ptl_future_t future){
+	if(__atomic_sub_fetch(&(future->refs), 1, __ATOMIC_ACQ_REL) == 0){
+		// a when_all or when_any future lets go of the futures it held
+		if(future->futures != NULL){
+			int i = 0;
+			for(i=0; i<future->num_futures; i++){
+				_ptl_future_release(future->futures[i]);
+			}
+			ptl_free(future->allocator, future->futures, future->num_futures * sizeof(ptl_future_t));
+		}
+
+		ptl_free(future->allocator, future, sizeof(struct ptl_future));
+	}
+}
+
+/* sleeps until the future finishes or the monotonic 'deadline' (usec) passes,
+   a negative deadline waits forever */
+int _ptl_future_wait_until(ptl_future_t future, long long deadline){
+	int state = __atomic_load_n(&(future->state), __ATOMIC_ACQUIRE);
+
+	if(state == PTL_FUTURE_PENDING){
+		struct ptl_future_lock *lock = _ptl_future_lock(future);
+
+		__atomic_add_fetch(&(future->waiters), 1, __ATOMIC_SEQ_CST);
+
+		pthread_mutex_lock(&(lock->mutex)); // lock
+		while((state = __atomic_load_n(&(future->state), __ATOMIC_SEQ_CST)) == PTL_FUTURE_PENDING){
+			if(deadline < 0){
+				pthread_cond_wait(&(lock->cond), &(lock->mutex));
+				continue;
+			}
+
+			if(ptl_get_time_usec() >= deadline){ break; }
+
+			struct timespec ts;
+			ts.tv_sec = deadline / 1000000LL;
+			ts.tv_nsec = (deadline % 1000000LL) * 1000;
+			pthread_cond_timedwait(&(lock->cond), &(lock->mutex), &ts);
+		}
+		pthread_mutex_unlock(&(lock->mutex)); // unlock
+
+		__atomic_sub_fetch(&(future->waiters), 1, __ATOMIC_RELAXED);
+	}
+
+	return state == PTL_FUTURE_DONE;
+}
@@ -0,0 +1,195 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * A future is the result of a function run by a thread manager. It is
+ * created by submit_future() and is done once the function has returned
+ * (or the manager has rejected it).
+ *
+ * A future is a few words and has no mutex or condition of its own. Its
+ * state is read and set atomically, so checking a future, or getting the
+ * result of one that is done, never takes a lock. A thread that has to
+ * sleep on a future uses one of PTL_FUTURE_NUM_LOCKS shared mutex and
+ * condition pairs, picked by the future's address, and the thread that
+ * finishes the future only takes that mutex when someone is sleeping on it.
+ *
+ * The future is shared by the caller and the task running the function.
+ * The caller must call ptl_future_destroy() when it is done with it; the
+ * memory is freed once the task has finished too.
+ *
+ * Futures can be chained without blocking a thread: ptl_future_then()
+ * runs a function on the manager's workers once a future is finished, and
+ * ptl_future_when_all() and ptl_future_when_any() make a future that
+ * finishes once all, or the first, of a set of futures have. These register
+ * a callback on the future; the thread that finishes it runs the callbacks
+ * right after waking any sleepers, and a callback registered on a future
+ * that is already finished runs at once on the registering thread. The
+ * callbacks are internal and short: they only submit a task or count.
+ */
+
+
+#ifndef __PTL_FUTURE_H__
+#define __PTL_FUTURE_H__
+
+#include "ptl_allocator.h"
+#include "ptl_thread_manager.h"
+
+/* Defines */
+#define PTL_FUTURE_NUM_LOCKS 64		/**< shared locks sleepers use, a power of two */
+
+/* Future states */
+#define PTL_FUTURE_PENDING  0		/**< the function has not returned yet */
+#define PTL_FUTURE_DONE     1		/**< the function returned 'result' */
+#define PTL_FUTURE_REJECTED 2		/**< the manager did not take the task, it never ran */
+
+/* Structures */
+struct ptl_future;
+
+/* Something to do when a future finishes */
+struct ptl_future_callback {
+	void (*function)(struct ptl_future *, void *);	/**< called with the future and 'arg' */
+	void *arg;									/**< passed to 'function' */
+	struct ptl_future_callback *next;			/**< registered before this one */
+};
+
+struct ptl_future {
+	int state;						/**< PTL_FUTURE_PENDING, _DONE or _REJECTED */
+	int waiters;					/**< threads sleeping on the future */
+	int refs;						/**< holders: the caller and whatever will finish it */
+	void *(*function)(void *);		/**< function to run */
+	void *arg;						/**< passed to 'function' */
+	void *result;					/**< what 'function' returned, once done */
+	ptl_allocator_t allocator;		/**< where the future came from */
+	ptl_thread_manager_t manager;	/**< runs continuations of this future */
+	struct ptl_future_callback *callbacks;	/**< run when it finishes, then closed */
+	struct ptl_future **futures;	/**< when_all and when_any: the futures it holds */
+	int num_futures;				/**< number of 'futures' */
+};
+
+/* Type Definitions */
+typedef struct ptl_future *ptl_future_t;
+
+
+/* Public Functions */
+
+/**
+ * Submits 'function' to 'manager', to be called with 'arg'. Its return value
+ * becomes the future's result. If the manager rejects the task, on submit or
+ * later (see the policies in ptl_thread_manager.h), the future finishes in
+ * the PTL_FUTURE_REJECTED state.
+ * To finish using the future, be sure to call ptl_future_destroy().
+ *
+ * @param manager manager to run the function
+ * @param function function to run
+ * @param arg passed to 'function'
+ * @return the future, NULL if the parameters are bad
+ */
+ptl_future_t submit_future(ptl_thread_manager_t manager, void *(*function)(void *), void *arg);
+
+/**
+ * Makes a future for 'function' called with 'future' and 'arg' once
+ * 'future' is finished (done or rejected). The call is submitted to the
+ * manager 'future' was submitted to, so it runs on one of its workers, and
+ * no thread waits in the meantime. 'function' may get the result with
+ * ptl_future_get() without blocking. Its return value becomes the result of
+ * the new future, which is rejected if the manager rejects the call.
+ * 'future' stays valid until 'function' has returned, even if the caller
+ * destroys it first.
+ *
+ * @param future future to continue from
+ * @param function called once 'future' is finished
+ * @param arg passed to 'function'
+ * @return the new future (destroy it when done), NULL if the parameters are bad
+ */
+ptl_future_t ptl_future_then(ptl_future_t future, void *(*function)(ptl_future_t, void *), void *arg);
+
+/**
+ * Makes a future that is done once every future in 'futures' is finished.
+ * Its result is a copy of 'futures' (a ptl_future_t *), so the caller can go
+ * through the results. The new future holds each of the futures until it is
+ * destroyed, so the caller may destroy its own handles, and free the array,
+ * as soon as this returns. Nothing waits in the meantime; the future
+ * finishing last finishes this one.
+ *
+ * @param futures futures to wait for
+ * @param num_futures number of futures, at least one
+ * @return the new future (destroy it when done), NULL if the parameters are bad
+ */
+ptl_future_t ptl_future_when_all(ptl_future_t *futures, int num_futures);
+
+/**
+ * Makes a future that is done once any future in 'futures' is finished.
+ * Its result is the first future to finish (a ptl_future_t). The new future
+ * holds each of the futures until it is destroyed, so the result stays valid
+ * until then, and the caller may destroy its own handles, and free the
+ * array, as soon as this returns.
+ *
+ * @param futures futures to wait for
+ * @param num_futures number of futures, at least one
+ * @return the new future (destroy it when done), NULL if the parameters are bad
+ */
+ptl_future_t ptl_future_when_any(ptl_future_t *futures, int num_futures);
+
+/**
+ * Lets go of the caller's hold on a future. The future must not be used
+ * afterwards. It may be called before the function has run.
+ *
+ * @param future future to let go of
+ */
+void ptl_future_destroy(ptl_future_t future);
+
+/**
+ * Waits until the future is done or rejected.
+ *
+ * Waiting from inside a task on a future whose task may be queued behind
+ * it can wait forever if every worker of the manager does the same.
+ *
+ * @param future future to wait on
+ * @return 1 if the function ran, 0 if it was rejected
+ */
+int ptl_future_wait(ptl_future_t future);
+
+/**
+ * Waits until the future is done or rejected, or 'timeout' milliseconds
+ * have passed.
+ *
+ * @param future future to wait on
+ * @param timeout milliseconds to wait, 0 to only check
+ * @return 1 if the function ran, 0 if it was rejected or the time ran out
+ */
+int ptl_future_wait_timeout(ptl_future_t future, long timeout);
+
+/**
+ * Waits until the future is done and gets its result.
+ *
+ * @param future future to wait on
+ * @return what the function returned, NULL if it was rejected
+ */
+void *ptl_future_get(ptl_future_t future);
+
+/**
+ * Checks, without waiting, if the future is done or rejected.
+ *
+ * @param future future to check
+ * @return 1 if it is finished, 0 otherwise
+ */
+int ptl_future_is_done(ptl_future_t future);
+
+#endif
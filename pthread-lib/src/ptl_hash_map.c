@@ -0,0 +1,418 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_allocator.h"
+#include "ptl_hash_map.h"
+#include "ptl_util.h"
+
+
+/* Private Functions */
+uint64_t _ptl_hm_spread(ptl_hash_map_t map, void *key);
+struct ptl_hm_segment *_ptl_hm_segment_for(ptl_hash_map_t map, uint64_t hash);
+struct ptl_hm_entry *_ptl_hm_find(ptl_hash_map_t map, struct ptl_hm_segment *segment,
+								  void *key, uint64_t hash);
+void _ptl_hm_insert(ptl_hash_map_t map, struct ptl_hm_segment *segment, void *key, void *value, uint64_t hash);
+void _ptl_hm_grow(ptl_hash_map_t map, struct ptl_hm_segment *segment);
+void _ptl_hm_free_entries(ptl_hash_map_t map, struct ptl_hm_segment *segment, void (*key_free_func)(void *),
+						  void (*value_free_func)(void *));
+
+
+/* creates the map with the default sizes */
+ptl_hash_map_t ptl_hm_create_hash_map(unsigned long (*hash_func)(void *),
+									  int (*equals_func)(void *, void *)){
+	return ptl_hm_create_hash_map_size(hash_func, equals_func,
+									   PTL_HM_DEFAULT_CAPACITY, PTL_HM_DEFAULT_CONCURRENCY);
+}
+
+
+/* creates the map with about 'capacity' buckets split over 'concurrency' segments */
+ptl_hash_map_t ptl_hm_create_hash_map_size(unsigned long (*hash_func)(void *),
+										   int (*equals_func)(void *, void *),
+										   int capacity, int concurrency){
+	return ptl_hm_create_hash_map_allocator(hash_func, equals_func, capacity, concurrency, NULL);
+}
+
+
+/* creates the map like ptl_hm_create_hash_map_size, all memory from 'allocator' */
+ptl_hash_map_t ptl_hm_create_hash_map_allocator(unsigned long (*hash_func)(void *),
+												int (*equals_func)(void *, void *),
+												int capacity, int concurrency,
+												ptl_allocator_t allocator){
+	unsigned long num_segments = 1;
+	unsigned long num_buckets = 1;
+	int bits = 0;
+
+	while(num_segments < (unsigned long)concurrency){
+		num_segments <<= 1;
+		bits++;
+	}
+	// every segment gets at least a couple of buckets
+	while(num_buckets * num_segments < (unsigned long)capacity || num_buckets < 2){
+		num_buckets <<= 1;
+	}
+
+	allocator = ptl_resolve_allocator(allocator);
+
+	ptl_hash_map_t map = (ptl_hash_map_t)ptl_calloc(allocator, 1, sizeof(struct ptl_hash_map));
+
+	map->allocator = allocator;
+	map->segments = (struct ptl_hm_segment *)ptl_calloc(allocator, num_segments, sizeof(struct ptl_hm_segment));
+
+	map->hash_func = hash_func;
+	map->equals_func = equals_func;
+	map->segment_mask = num_segments - 1;
+	map->segment_shift = (8 * sizeof(uint64_t)) - bits;
+
+	unsigned long i = 0;
+	for(i=0; i<num_segments; i++){
+		struct ptl_hm_segment *segment = map->segments + i;
+
+		pthread_rwlock_init(&(segment->lock), NULL);
+		segment->buckets = (struct ptl_hm_entry **)ptl_calloc(allocator, num_buckets, sizeof(struct ptl_hm_entry *));
+		segment->mask = num_buckets - 1;
+		segment->size = 0;
+	}
+
+	return map;
+}
+
+
+/* frees the map, leaving the keys and values alone */
+int ptl_hm_destroy_hash_map(ptl_hash_map_t map){
+	return ptl_hm_destroy_hash_map_freefunc(map, NULL, NULL);
+}
+
+
+/* frees the map, calling the free functions on every key and value */
+int ptl_hm_destroy_hash_map_freefunc(ptl_hash_map_t map, void (*key_free_func)(void *),
+									 void (*value_free_func)(void *)){
+	if(map == NULL){ return 0; }
+
+	unsigned long i = 0;
+	for(i=0; i<=map->segment_mask; i++){
+		struct ptl_hm_segment *segment = map->segments + i;
+
+		_ptl_hm_free_entries(map, segment, key_free_func, value_free_func);
+		PTL_FREE(map->allocator, segment->buckets, (segment->mask + 1) * sizeof(struct ptl_hm_entry *));
+		pthread_rwlock_destroy(&(segment->lock));
+	}
+
+	PTL_FREE(map->allocator, map->segments, (map->segment_mask + 1) * sizeof(struct ptl_hm_segment));
+	ptl_free(map->allocator, map, sizeof(struct ptl_hash_map));
+
+	return 1;
+}
+
+
+/* gets the value for 'key' under a shared lock */
+void *ptl_hm_get(ptl_hash_map_t map, void *key){
+	if(map == NULL || key == NULL){ return NULL; }
+
+	uint64_t hash = _ptl_hm_spread(map, key);
+	struct ptl_hm_segment *segment = _ptl_hm_segment_for(map, hash);
+	void *value = NULL;
+
+	pthread_rwlock_rdlock(&(segment->lock)); // lock
+
+	struct ptl_hm_entry *entry = _ptl_hm_find(map, segment, key, hash);
+	if(entry != NULL){ value = entry->value; }
+
+	pthread_rwlock_unlock(&(segment->lock)); // unlock
+
+	return value;
+}
+
+
+/* values are never NULL, so a get is enough */
+int ptl_hm_contains_key(ptl_hash_map_t map, void *key){
+	return (ptl_hm_get(map, key) != NULL);
+}
+
+
+/* maps 'key' to 'value', replacing any previous value */
+void *ptl_hm_put(ptl_hash_map_t map, void *key, void *value){
+	if(map == NULL || key == NULL || value == NULL){ return NULL; }
+
+	uint64_t hash = _ptl_hm_spread(map, key);
+	struct ptl_hm_segment *segment = _ptl_hm_segment_for(map, hash);
+	void *old_value = NULL;
+
+	pthread_rwlock_wrlock(&(segment->lock)); // lock
+
+	struct ptl_hm_entry *entry = _ptl_hm_find(map, segment, key, hash);
+	if(entry != NULL){
+		old_value = entry->value;
+		entry->value = value;
+	} else {
+		_ptl_hm_insert(map, segment, key, value, hash);
+	}
+
+	pthread_rwlock_unlock(&(segment->lock)); // unlock
+
+	return old_value;
+}
+
+
+/* maps 'key' to 'value' unless it is already mapped */
+void *ptl_hm_put_if_absent(ptl_hash_map_t map, void *key, void *value){
+	if(map == NULL || key == NULL || value == NULL){ return NULL; }
+
+	uint64_t hash = _ptl_hm_spread(map, key);
+	struct ptl_hm_segment *segment = _ptl_hm_segment_for(map, hash);
+	void *old_value = NULL;
+
+	pthread_rwlock_wrlock(&(segment->lock)); // lock
+
+	struct ptl_hm_entry *entry = _ptl_hm_find(map, segment, key, hash);
+	if(entry != NULL){
+		old_value = entry->value;
+	} else {
+		_ptl_hm_insert(map, segment, key, value, hash);
+	}
+
+	pthread_rwlock_unlock(&(segment->lock)); // unlock
+
+	return old_value;
+}
+
+
+/* unlinks and frees the entry for 'key' */
+void *ptl_hm_remove(ptl_hash_map_t map, void *key){
+	if(map == NULL || key == NULL){ return NULL; }
+
+	uint64_t hash = _ptl_hm_spread(map, key);
+	struct ptl_hm_segment *segment = _ptl_hm_segment_for(map, hash);
+	struct ptl_hm_entry *entry = NULL;
+	void *value = NULL;
+
+	pthread_rwlock_wrlock(&(segment->lock)); // lock
+
+	struct ptl_hm_entry **link = segment->buckets + (hash & segment->mask);
+	while((entry = *link) != NULL){
+		if(entry->hash == hash &&
+		   (entry->key == key || (map->equals_func != NULL && map->equals_func(entry->key, key)))){
+			*link = entry->next;
+			__atomic_store_n(&(segment->size), segment->size - 1, __ATOMIC_RELAXED);
+			break;
+		}
+		link = &(entry->next);
+	}
+
+	pthread_rwlock_unlock(&(segment->lock)); // unlock
+
+	if(entry != NULL){
+		value = entry->value;
+		ptl_free(map->allocator, entry, sizeof(struct ptl_hm_entry));
+	}
+
+	return value;
+}
+
+
+/* gets the value for 'key', creating it with 'func' if there is none */
+void *ptl_hm_compute_if_absent(ptl_hash_map_t map, void *key,
+							   void *(*func)(void *, void *), void *arg){
+	if(map == NULL || key == NULL || func == NULL){ return NULL; }
+
+	// most calls find the key, so try with a shared lock first
+	void *value = ptl_hm_get(map, key);
+	if(value != NULL){ return value; }
+
+	uint64_t hash = _ptl_hm_spread(map, key);
+	struct ptl_hm_segment *segment = _ptl_hm_segment_for(map, hash);
+
+	pthread_rwlock_wrlock(&(segment->lock)); // lock
+
+	// someone may have put it while we were between locks
+	struct ptl_hm_entry *entry = _ptl_hm_find(map, segment, key, hash);
+	if(entry != NULL){
+		value = entry->value;
+	} else {
+		value = func(key, arg);
+		if(value != NULL){
+			_ptl_hm_insert(map, segment, key, value, hash);
+		}
+	}
+
+	pthread_rwlock_unlock(&(segment->lock)); // unlock
+
+	return value;
+}
+
+
+/* adds up the segment sizes without locking */
+long ptl_hm_size(ptl_hash_map_t map){
+	if(map == NULL){ return 0; }
+
+	long size = 0;
+	unsigned long i = 0;
+	for(i=0; i<=map->segment_mask; i++){
+		size += __atomic_load_n(&(map->segments[i].size), __ATOMIC_RELAXED);
+	}
+
+	return size;
+}
+
+
+/* empties every segment, one at a time */
+void ptl_hm_clear(ptl_hash_map_t map){
+	if(map == NULL){ return; }
+
+	unsigned long i = 0;
+	for(i=0; i<=map->segment_mask; i++){
+		struct ptl_hm_segment *segment = map->segments + i;
+
+		pthread_rwlock_wrlock(&(segment->lock)); // lock
+		_ptl_hm_free_entries(map, segment, NULL, NULL);
+		pthread_rwlock_unlock(&(segment->lock)); // unlock
+	}
+}
+
+
+/* djb2 */
+unsigned long ptl_hm_hash_string(void *key){
+	unsigned char *str = (unsigned char *)key;
+	unsigned long hash = 5381;
+	int c = 0;
+
+	while((c = *str++) != 0){
+		hash = (hash * 33) + c;
+	}
+
+	return hash;
+}
+
+
+/* compares two strings */
+int ptl_hm_equals_string(void *a, void *b){
+	return (strcmp((char *)a, (char *)b) == 0);
+}
+
+
+/* Private Functions */
+
+/* hashes 'key' and mixes the bits so both the top (segment) and the
+   bottom (bucket) bits depend on all of them. Done in 64 bits whatever the
+   size of a long, so the top bits are mixed on 32 bit builds too */
+uint64_t _ptl_hm_spread(ptl_hash_map_t map, void *key){
+	uint64_t hash = (map->hash_func != NULL) ? map->hash_func(key) : (uintptr_t)key;
+
+	hash ^= hash >> 33;
+	hash *= UINT64_C(0xff51afd7ed558ccd);
+	hash ^= hash >> 33;
+
+	return hash;
+}
+
+/* the segment 'hash' belongs to, picked with the top bits */
+struct ptl_hm_segment *_ptl_hm_segment_for(ptl_hash_map_t map, uint64_t hash){
+	if(map->segment_mask == 0){ return map->segments; } // a shift by the full width is undefined
+
+	return map->segments + (hash >> map->segment_shift);
+}
+
+/* finds the entry for 'key' in 'segment'. The lock must be held */
+struct ptl_hm_entry *_ptl_hm_find(ptl_hash_map_t map, struct ptl_hm_segment *segment,
+								  void *key, uint64_t hash){
+	struct ptl_hm_entry *entry = segment->buckets[hash & segment->mask];
+
+	for(; entry != NULL; entry = entry->next){
+		if(entry->hash != hash){ continue; }
+
+		if(entry->key == key || (map->equals_func != NULL && map->equals_func(entry->key, key))){
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+/* adds a new entry to 'segment'. The write lock must be held */
+void _ptl_hm_insert(ptl_hash_map_t map, struct ptl_hm_segment *segment, void *key, void *value, uint64_t hash){
+	// keep chains short, grow past 3/4 full
+	if((unsigned long)(segment->size + 1) * 4 > (segment->mask + 1) * 3){
+		_ptl_hm_grow(map, segment);
+	}
+
+	struct ptl_hm_entry *entry = (struct ptl_hm_entry *)ptl_alloc(map->allocator, sizeof(struct ptl_hm_entry));
+
+	struct ptl_hm_entry **bucket = segment->buckets + (hash & segment->mask);
+
+	entry->key = key;
+	entry->value = value;
+	entry->hash = hash;
+	entry->next = *bucket;
+	*bucket = entry;
+
+	__atomic_store_n(&(segment->size), segment->size + 1, __ATOMIC_RELAXED);
+}
+
+/* doubles the buckets of 'segment', moving each entry to its new chain.
+   The write lock must be held */
+void _ptl_hm_grow(ptl_hash_map_t map, struct ptl_hm_segment *segment){
+	struct ptl_hm_entry **old_buckets = segment->buckets;
+	unsigned long old_size = segment->mask + 1;
+	unsigned long new_size = old_size * 2;
+
+	segment->buckets = (struct ptl_hm_entry **)ptl_calloc(map->allocator, new_size, sizeof(struct ptl_hm_entry *));
+	segment->mask = new_size - 1;
+
+	// the hash is stored, so no key is hashed again
+	unsigned long i = 0;
+	for(i=0; i<old_size; i++){
+		struct ptl_hm_entry *entry = old_buckets[i];
+		struct ptl_hm_entry *next = NULL;
+
+		for(; entry != NULL; entry = next){
+			next = entry->next;
+			struct ptl_hm_entry **bucket = segment->buckets + (entry->hash & segment->mask);
+			entry->next = *bucket;
+			*bucket = entry;
+		}
+	}
+
+	PTL_FREE(map->allocator, old_buckets, old_size * sizeof(struct ptl_hm_entry *));
+}
+
+/* frees every entry in 'segment'. The write lock must be held */
+void _ptl_hm_free_entries(ptl_hash_map_t map, struct ptl_hm_segment *segment, void (*key_free_func)(void *),
+						  void (*value_free_func)(void *)){
+	unsigned long i = 0;
+	for(i=0; i<=segment->mask; i++){
+		struct ptl_hm_entry *entry = segment->buckets[i];
+		struct ptl_hm_entry *next = NULL;
+
+		for(; entry != NULL; entry = next){
+			next = entry->next;
+			if(key_free_func != NULL){ key_free_func(entry->key); }
+			if(value_free_func != NULL){ value_free_func(entry->value); }
+			ptl_free(map->allocator, entry, sizeof(struct ptl_hm_entry));
+		}
+		segment->buckets[i] = NULL;
+	}
+
+	__atomic_store_n(&(segment->size), 0, __ATOMIC_RELAXED);
+}
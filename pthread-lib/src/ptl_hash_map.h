@@ -0,0 +1,246 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is a hash map (see the ConcurrentHashMap Javadoc) that is
+ * safe to share between threads. Keys and values are pointers to any
+ * memory. Keys are compared using a hash function and an equals function;
+ * if none are given, the pointer addresses themselves are compared.
+ *
+ * The map is split into segments, each with its own read/write lock and its
+ * own table of buckets. A key always lives in the same segment, so threads
+ * working on keys in different segments never wait on each other, and any
+ * number of threads may read a segment at once. Each segment grows on its
+ * own when it gets too full.
+ *
+ * The map never copies or frees keys and values, except in
+ * ptl_hm_destroy_hash_map_freefunc().
+ */
+
+
+#ifndef __PTL_HASH_MAP_H__
+#define __PTL_HASH_MAP_H__
+
+#include <pthread.h>
+#include <stdint.h>
+#include "ptl_allocator.h"
+
+/* Defines */
+#define PTL_HM_DEFAULT_CAPACITY    64	/**< buckets in a new map */
+#define PTL_HM_DEFAULT_CONCURRENCY 16	/**< segments in a new map */
+
+/* Structures */
+
+/* A key/value pair in a bucket chain */
+struct ptl_hm_entry {
+	void *key;						/**< key, as it was first put */
+	void *value;					/**< value mapped to the key */
+	uint64_t hash;					/**< spread hash of the key */
+	struct ptl_hm_entry *next;		/**< next entry in the same bucket */
+};
+
+/* A part of the map with its own lock */
+struct ptl_hm_segment {
+	pthread_rwlock_t lock;			/**< readers share, writers are alone */
+	struct ptl_hm_entry **buckets;	/**< chains of entries */
+	unsigned long mask;				/**< number of buckets - 1 */
+	long size;						/**< number of entries in this segment */
+	char pad[64];					/**< keeps neighbouring locks on separate cache lines */
+};
+
+struct ptl_hash_map {
+	unsigned long (*hash_func)(void *);	/**< hashes a key */
+	int (*equals_func)(void *, void *);	/**< 1 if two keys are equal */
+	struct ptl_hm_segment *segments;	/**< the segments */
+	unsigned long segment_mask;			/**< number of segments - 1 */
+	int segment_shift;					/**< moves the top bits of a hash down to pick a segment */
+	ptl_allocator_t allocator;			/**< where the map, buckets and entries come from */
+};
+
+/* Type Definitions */
+typedef struct ptl_hash_map *ptl_hash_map_t;
+
+
+/* Public Functions */
+
+/**
+ * Creates a hash map with the default capacity and concurrency.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param hash_func returns the hash of a key, NULL to hash the pointer
+ * @param equals_func returns 1 if two keys are equal, NULL to compare pointers
+ * @return a fully initialized hash map
+ */
+ptl_hash_map_t ptl_hm_create_hash_map(unsigned long (*hash_func)(void *),
+									  int (*equals_func)(void *, void *));
+
+/**
+ * Creates a hash map sized for about 'capacity' keys, split into
+ * 'concurrency' segments. Both are rounded up to a power of two. More
+ * segments means fewer threads waiting on the same lock.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param hash_func returns the hash of a key, NULL to hash the pointer
+ * @param equals_func returns 1 if two keys are equal, NULL to compare pointers
+ * @param capacity number of keys expected
+ * @param concurrency number of segments
+ * @return a fully initialized hash map
+ */
+ptl_hash_map_t ptl_hm_create_hash_map_size(unsigned long (*hash_func)(void *),
+										   int (*equals_func)(void *, void *),
+										   int capacity, int concurrency);
+
+/**
+ * Creates a hash map like ptl_hm_create_hash_map_size(), taking the map, 
+ * its buckets and every entry from 'allocator' (see ptl_allocator.h).
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param hash_func returns the hash of a key, NULL to hash the pointer
+ * @param equals_func returns 1 if two keys are equal, NULL to compare pointers
+ * @param capacity number of keys expected
+ * @param concurrency number of segments
+ * @param allocator allocator to use, NULL for the default
+ * @return a fully initialized hash map
+ */
+ptl_hash_map_t ptl_hm_create_hash_map_allocator(unsigned long (*hash_func)(void *),
+												int (*equals_func)(void *, void *),
+												int capacity, int concurrency,
+												ptl_allocator_t allocator);
+
+/**
+ * Destroys a hash map that was created using a 'create' function. The keys
+ * and values are not freed. No other thread may be using the map.
+ *
+ * @param map hash map to be freed
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_hm_destroy_hash_map(ptl_hash_map_t map);
+
+/**
+ * Destroys a hash map that was created using a 'create' function, calling
+ * the free functions on every key and value. No other thread may be using
+ * the map.
+ *
+ * @param map hash map to be freed
+ * @param key_free_func called on each key, NULL to leave the keys alone
+ * @param value_free_func called on each value, NULL to leave the values alone
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_hm_destroy_hash_map_freefunc(ptl_hash_map_t map, void (*key_free_func)(void *),
+									 void (*value_free_func)(void *));
+
+/**
+ * Gets the value mapped to 'key'.
+ *
+ * @param map hash map to search
+ * @param key key to look up
+ * @return the value mapped to 'key', NULL if there is none
+ */
+void *ptl_hm_get(ptl_hash_map_t map, void *key);
+
+/**
+ * Checks if 'key' is mapped to a value.
+ *
+ * @param map hash map to search
+ * @param key key to look up
+ * @return 1 if the map contains 'key', 0 otherwise
+ */
+int ptl_hm_contains_key(ptl_hash_map_t map, void *key);
+
+/**
+ * Maps 'key' to 'value'. If 'key' was already mapped, the value is replaced
+ * and the key that was first put is kept.
+ *
+ * @param map hash map to put in
+ * @param key non-null key
+ * @param value non-null value
+ * @return the value that was replaced, NULL if there was none
+ */
+void *ptl_hm_put(ptl_hash_map_t map, void *key, void *value);
+
+/**
+ * Maps 'key' to 'value' only if 'key' is not mapped yet.
+ *
+ * @param map hash map to put in
+ * @param key non-null key
+ * @param value non-null value
+ * @return the value already mapped to 'key', NULL if 'value' was put
+ */
+void *ptl_hm_put_if_absent(ptl_hash_map_t map, void *key, void *value);
+
+/**
+ * Removes 'key' from the map.
+ *
+ * @param map hash map to remove from
+ * @param key key to remove
+ * @return the value that was mapped to 'key', NULL if there was none
+ */
+void *ptl_hm_remove(ptl_hash_map_t map, void *key);
+
+/**
+ * Gets the value mapped to 'key', or if there is none, creates one with
+ * 'func' and maps it. Other threads asking for the same key wait for 'func'
+ * to finish, so it is called at most once per key. 'func' is called while
+ * the segment of 'key' is locked; it must be quick and must not use the map.
+ *
+ * @param map hash map to search
+ * @param key non-null key
+ * @param func called with 'key' and 'arg' to create the value. If it returns
+ *        NULL, nothing is put.
+ * @param arg passed to 'func'
+ * @return the value mapped to 'key', NULL if 'func' returned NULL
+ */
+void *ptl_hm_compute_if_absent(ptl_hash_map_t map, void *key,
+							   void *(*func)(void *, void *), void *arg);
+
+/**
+ * Gets the number of keys in the map. If other threads are changing the map,
+ * this is only an estimate.
+ *
+ * @param map hash map to count
+ * @return number of keys
+ */
+long ptl_hm_size(ptl_hash_map_t map);
+
+/**
+ * Removes every key from the map. The keys and values are not freed.
+ *
+ * @param map hash map to clear
+ */
+void ptl_hm_clear(ptl_hash_map_t map);
+
+/**
+ * Hash function for keys that are null terminated strings.
+ *
+ * @param key string to hash
+ * @return hash of the string
+ */
+unsigned long ptl_hm_hash_string(void *key);
+
+/**
+ * Equals function for keys that are null terminated strings.
+ *
+ * @param a first string
+ * @param b second string
+ * @return 1 if the strings are equal, 0 otherwise
+ */
+int ptl_hm_equals_string(void *a, void *b);
+
+#endif
@@ -39,8 +39,10 @@ void ptl_lq_init_queue (ptl_q_t q){
 	pthread_mutex_lock(&ptl_lq_mutex); // lock
 
 	strncpy(q->type, "linked", PTL_Q_TYPE_LENGTH);
-	q->tail = q->head = ptl_q_create_element(NULL);
+	q->allocator = ptl_resolve_allocator(q->allocator); // NULL in a zeroed queue set up by hand
+	q->tail = q->head = ptl_q_alloc_element(q, NULL);
 	q->ptr = NULL; // not used
+	q->size = 0;
 	
 	pthread_mutex_unlock(&ptl_lq_mutex); // unlock
 }
@@ -50,9 +52,10 @@ void ptl_lq_init_queue (ptl_q_t q){
 void ptl_lq_destroy_queue(ptl_q_t q){
 	ptl_lq_clear(q); // clears all
 
-	FREE(q->head); // remove final piece of memory in queue
+	ptl_q_free_element(q, q->head); // remove final piece of memory in queue
+	q->head = q->tail = NULL;
 	
-	pthread_mutex_destroy(&ptl_lq_mutex);
+	// ptl_lq_mutex is shared by every linked queue, so it is not destroyed here
 	// leave destroying of ptl_q_t to the 'interface'
 }
 
@@ -66,7 +69,7 @@ int ptl_lq_add(ptl_q_t q, void *value){
 
 	pthread_mutex_lock(&ptl_lq_mutex); // lock
 	// create the element/node
-	ptl_q_element_t element = ptl_q_create_element (value);
+	ptl_q_element_t element = ptl_q_alloc_element(q, value);
 	
 	q->tail = q->tail->next = element;
 	q->size++;
@@ -142,7 +145,7 @@ void* ptl_lq_get(ptl_q_t q){
 	
 	void* value = NULL;
 	if(first != NULL){ // check if we have no elements
-		FREE(q->head); // moving head ptr, free previous head
+		ptl_q_free_element(q, q->head); // moving head ptr, free previous head
 		
 		q->head = first;
 		value = first->value;	
@@ -187,3 +190,74 @@ void* ptl_lq_get_wait(ptl_q_t q, long timeout){
 	// this may be NULL if nothing was retrieved
 	return element;
 }
+
+
+/* Moves every element of 'src' to the tail of 'dst'. */
+long ptl_lq_splice(ptl_q_t dst, ptl_q_t src){
+	if(dst == NULL || src == NULL || dst == src){ return 0; }
+	if(dst->allocator != src->allocator){ return 0; } // 'dst' will free the nodes
+
+	pthread_mutex_lock(&ptl_lq_mutex); // lock
+
+	long moved = src->size;
+	ptl_q_element_t first = src->head->next;
+
+	if(first != NULL){
+		// hang the whole chain off of our tail
+		dst->tail->next = first;
+		dst->tail = src->tail;
+		dst->size += moved;
+
+		// src is left with only its dummy head
+		src->head->next = NULL;
+		src->tail = src->head;
+		src->size = 0;
+	} else {
+		moved = 0;
+	}
+
+	pthread_mutex_unlock(&ptl_lq_mutex); // unlock
+
+	return moved;
+}
+
+
+/* Moves the first half of the elements of 'src' to the tail of 'dst'. */
+long ptl_lq_steal_half(ptl_q_t dst, ptl_q_t src){
+	if(dst == NULL || src == NULL || dst == src){ return 0; }
+	if(dst->allocator != src->allocator){ return 0; } // 'dst' will free the nodes
+
+	pthread_mutex_lock(&ptl_lq_mutex); // lock
+
+	long moved = (src->size + 1) / 2;
+	ptl_q_element_t first = src->head->next;
+
+	if(first != NULL && moved > 0){
+		// find the last node we are taking
+		ptl_q_element_t last = first;
+		long i = 0;
+		for(i=1; i<moved && last->next != NULL; i++){
+			last = last->next;
+		}
+		moved = i;
+
+		// cut the chain out of src
+		src->head->next = last->next;
+		if(src->tail == last){
+			src->tail = src->head;
+		}
+		src->size -= moved;
+
+		// and hang it off of dst
+		last->next = NULL;
+		dst->tail->next = first;
+		dst->tail = last;
+		dst->size += moved;
+	} else {
+		moved = 0;
+	}
+
+	pthread_mutex_unlock(&ptl_lq_mutex); // unlock
+
+	return moved;
+}
@@ -123,6 +123,29 @@ void* ptl_lq_get(ptl_q_t q);
  */
 void* ptl_lq_get_wait(ptl_q_t q, long timeout);
 
+/**
+ * Moves every element of 'src' to the tail of 'dst', keeping their order.
+ * The chain of nodes is relinked as a whole, so no memory is allocated or
+ * freed and the cost does not depend on the number of elements. Both
+ * queues must have been created with the same allocator.
+ *
+ * @param dst non-null linked queue receiving the elements
+ * @param src non-null linked queue that will be emptied
+ * @return number of elements moved, 0 if the allocators differ
+ */
+long ptl_lq_splice(ptl_q_t dst, ptl_q_t src);
+
+/**
+ * Moves the first half (rounded up) of the elements of 'src' to the tail of
+ * 'dst', keeping their order. The nodes are relinked without allocating, but
+ * the cut point is found by walking half of 'src'. Both queues must have
+ * been created with the same allocator.
+ *
+ * @param dst non-null linked queue receiving the elements
+ * @param src non-null linked queue to take elements from
+ * @return number of elements moved, 0 if the allocators differ
+ */
+long ptl_lq_steal_half(ptl_q_t dst, ptl_q_t src);
 
 
 #endif
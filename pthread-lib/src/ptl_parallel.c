@@ -0,0 +1,265 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_queue.h"
+#include "ptl_thread_pool.h"
+#include "ptl_task.h"
+#include "ptl_thread_manager.h"
+#include "ptl_array_list.h"
+#include "ptl_parallel.h"
+#include "ptl_util.h"
+
+
+/* Structures */
+
+/* What map and reduce pass to their chunk functions */
+struct ptl_parallel_list_ctx {
+	void **array;								/**< elements of the list */
+	void **results;								/**< one result per element or chunk */
+	long grain;									/**< elements per chunk */
+	void *(*map_func)(void *, void *);			/**< map only */
+	void *(*reduce_func)(void **, long, void *);	/**< reduce only */
+	void *ctx;									/**< the caller's ctx */
+};
+
+
+/* Private Functions */
+int _ptl_parallel_num_helpers(ptl_thread_manager_t manager, long num_chunks);
+long _ptl_parallel_grain(ptl_thread_manager_t manager, long length, long grain);
+void _ptl_parallel_run(ptl_parallel_job_t job);
+void _ptl_parallel_release(ptl_parallel_job_t job);
+void _ptl_parallel_helper(void *arg);
+void _ptl_parallel_reject(void *arg);
+void _ptl_parallel_map_chunk(long begin, long end, void *arg);
+void _ptl_parallel_reduce_chunk(long begin, long end, void *arg);
+
+
+/* hands chunks to the caller and the helpers, returns when all are done */
+int ptl_parallel_for(ptl_thread_manager_t manager, long begin, long end, long grain,
+					 void (*func)(long, long, void *), void *ctx){
+	if(func == NULL || end < begin){ return 0; }
+	if(end == begin){ return 1; }
+
+	grain = _ptl_parallel_grain(manager, end - begin, grain);
+	long num_chunks = ((end - begin) + grain - 1) / grain;
+	int num_helpers = _ptl_parallel_num_helpers(manager, num_chunks);
+
+	// one chunk, or nobody to help, just do it here
+	if(num_helpers == 0){
+		long b = 0;
+		for(b=begin; b<end; b += grain){
+			func(b, (b + grain < end) ? b + grain : end, ctx);
+		}
+		return 1;
+	}
+
+	ptl_parallel_job_t job = (ptl_parallel_job_t)calloc(1, sizeof(struct ptl_parallel_job));
+	assert(job);
+
+	job->begin = begin;
+	job->end = end;
+	job->grain = grain;
+	job->func = func;
+	job->ctx = ctx;
+	job->num_chunks = num_chunks;
+	job->next = 0;
+	job->completed = 0;
+	job->refs = 1 + num_helpers;
+	pthread_mutex_init(&(job->mutex), NULL);
+	pthread_cond_init(&(job->done), NULL);
+
+	int i = 0;
+	for(i=0; i<num_helpers; i++){
+		ptl_task_t task = create_task_with_arg(_ptl_parallel_helper, job, manager->thread_pool->allocator);
+		task->rejected = _ptl_parallel_reject; // the caller picks up its share
+		submit_task(manager, task);
+	}
+
+	_ptl_parallel_run(job); // the caller works too
+
+	// wait for chunks still running on helpers
+	pthread_mutex_lock(&(job->mutex)); // lock
+	while(__atomic_load_n(&(job->completed), __ATOMIC_ACQUIRE) < job->num_chunks){
+		pthread_cond_wait(&(job->done), &(job->mutex));
+	}
+	pthread_mutex_unlock(&(job->mutex)); // unlock
+
+	_ptl_parallel_release(job);
+
+	return 1;
+}
+
+
+/* maps every element into a new dense list */
+ptl_array_list_t ptl_parallel_map(ptl_thread_manager_t manager, ptl_array_list_t array_list,
+								  long grain, void *(*func)(void *, void *), void *ctx){
+	if(array_list == NULL || func == NULL){ return NULL; }
+
+	// a sparse 'size' may overstate the list
+	long length = (array_list->size < array_list->capacity) ? array_list->size : array_list->capacity;
+
+	ptl_array_list_t result = ptl_al_create_array_list_allocator((length > 0) ? length : 1, PTL_AL_MODE_DENSE,
+																	  array_list->allocator);
+
+	struct ptl_parallel_list_ctx list_ctx;
+	memset(&list_ctx, 0, sizeof(struct ptl_parallel_list_ctx));
+	list_ctx.array = array_list->array;
+	list_ctx.results = result->array;
+	list_ctx.map_func = func;
+	list_ctx.ctx = ctx;
+
+	ptl_parallel_for(manager, 0, length, grain, _ptl_parallel_map_chunk, &list_ctx);
+	result->size = length;
+
+	return result;
+}
+
+
+/* reduces each chunk in parallel, then combines the chunk results in order */
+void *ptl_parallel_reduce(ptl_thread_manager_t manager, ptl_array_list_t array_list, long grain,
+						  void *(*reduce_func)(void **, long, void *),
+						  void *(*combine_func)(void *, void *, void *), void *ctx){
+	if(array_list == NULL || reduce_func == NULL || combine_func == NULL){ return NULL; }
+
+	long length = (array_list->size < array_list->capacity) ? array_list->size : array_list->capacity;
+	if(length <= 0){ return NULL; }
+
+	// the grain has to be known here to size the results
+	grain = _ptl_parallel_grain(manager, length, grain);
+	long num_chunks = (length + grain - 1) / grain;
+
+	struct ptl_parallel_list_ctx list_ctx;
+	memset(&list_ctx, 0, sizeof(struct ptl_parallel_list_ctx));
+	list_ctx.array = array_list->array;
+	list_ctx.results = (void **)calloc(num_chunks, sizeof(void *));
+	assert(list_ctx.results);
+	list_ctx.grain = grain;
+	list_ctx.reduce_func = reduce_func;
+	list_ctx.ctx = ctx;
+
+	ptl_parallel_for(manager, 0, length, grain, _ptl_parallel_reduce_chunk, &list_ctx);
+
+	void *result = list_ctx.results[0];
+	long i = 0;
+	for(i=1; i<num_chunks; i++){
+		result = combine_func(result, list_ctx.results[i], ctx);
+	}
+
+	FREE(list_ctx.results);
+
+	return result;
+}
+
+
+/* Private Functions */
+
+/* the pool's core threads, less the caller, but no more than can be used */
+int _ptl_parallel_num_helpers(ptl_thread_manager_t manager, long num_chunks){
+	if(manager == NULL || manager->thread_pool == NULL){ return 0; }
+
+	long num_helpers = manager->thread_pool->core_pool_size - 1;
+	if(num_helpers > num_chunks - 1){
+		num_helpers = num_chunks - 1;
+	}
+	if(num_helpers > PTL_PARALLEL_MAX_HELPERS){
+		num_helpers = PTL_PARALLEL_MAX_HELPERS;
+	}
+
+	return (num_helpers > 0) ? (int)num_helpers : 0;
+}
+
+/* a grain of <= 0 means about four chunks per thread */
+long _ptl_parallel_grain(ptl_thread_manager_t manager, long length, long grain){
+	if(grain > 0){ return grain; }
+
+	long num_threads = 1;
+	if(manager != NULL && manager->thread_pool != NULL && manager->thread_pool->core_pool_size > 1){
+		num_threads = manager->thread_pool->core_pool_size;
+	}
+
+	grain = length / (4 * num_threads);
+
+	return (grain > 0) ? grain : 1;
+}
+
+/* claims and runs chunks until there are none left */
+void _ptl_parallel_run(ptl_parallel_job_t job){
+	long chunk = 0;
+
+	while((chunk = __atomic_fetch_add(&(job->next), 1, __ATOMIC_RELAXED)) < job->num_chunks){
+		long begin = job->begin + (chunk * job->grain);
+		long end = (begin + job->grain < job->end) ? begin + job->grain : job->end;
+
+		job->func(begin, end, job->ctx);
+
+		// the last chunk done wakes the caller
+		if(__atomic_add_fetch(&(job->completed), 1, __ATOMIC_RELEASE) == job->num_chunks){
+			pthread_mutex_lock(&(job->mutex)); // lock
+			pthread_cond_broadcast(&(job->done));
+			pthread_mutex_unlock(&(job->mutex)); // unlock
+		}
+	}
+}
+
+/* lets go of the job, the last one out frees it */
+void _ptl_parallel_release(ptl_parallel_job_t job){
+	if(__atomic_sub_fetch(&(job->refs), 1, __ATOMIC_ACQ_REL) == 0){
+		pthread_mutex_destroy(&(job->mutex));
+		pthread_cond_destroy(&(job->done));
+		FREE(job);
+	}
+}
+
+/* a helper task, works on the job until it runs out of chunks */
+void _ptl_parallel_helper(void *arg){
+	ptl_parallel_job_t job = (ptl_parallel_job_t)arg;
+
+	_ptl_parallel_run(job);
+	_ptl_parallel_release(job);
+}
+
+/* a helper task that was rejected, it won't help */
+void _ptl_parallel_reject(void *arg){
+	_ptl_parallel_release((ptl_parallel_job_t)arg);
+}
+
+/* maps elements [begin, end) */
+void _ptl_parallel_map_chunk(long begin, long end, void *arg){
+	struct ptl_parallel_list_ctx *list_ctx = (struct ptl_parallel_list_ctx *)arg;
+	long i = 0;
+
+	for(i=begin; i<end; i++){
+		list_ctx->results[i] = list_ctx->map_func(list_ctx->array[i], list_ctx->ctx);
+	}
+}
+
+/* reduces elements [begin, end), its result goes in the chunk's slot */
+void _ptl_parallel_reduce_chunk(long begin, long end, void *arg){
+	struct ptl_parallel_list_ctx *list_ctx = (struct ptl_parallel_list_ctx *)arg;
+
+	list_ctx->results[begin / list_ctx->grain] =
+		list_ctx->reduce_func(list_ctx->array + begin, end - begin, list_ctx->ctx);
+}
@@ -0,0 +1,120 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * Data parallel helpers. A range of indexes is cut into 'grain' sized
+ * chunks and the chunks are handed out, one at a time, to the calling
+ * thread and to as many helper tasks as the manager's pool core size
+ * allows. The helpers are submitted to the manager and run on its workers.
+ * The calling thread works on chunks too instead of only waiting, so a call
+ * always finishes even if no helper ever gets to run (every worker is busy,
+ * or the call is made from inside a task). Each call returns once every
+ * chunk is done.
+ *
+ * The job is shared by reference count, so a helper that starts late (after
+ * all the chunks are taken, or after the call has returned) finds nothing
+ * to do and just lets go of it.
+ */
+
+
+#ifndef __PTL_PARALLEL_H__
+#define __PTL_PARALLEL_H__
+
+#include "ptl_thread_manager.h"
+#include "ptl_array_list.h"
+
+/* Defines */
+#define PTL_PARALLEL_MAX_HELPERS 63		/**< most helper tasks one call will submit */
+
+/* Structures */
+struct ptl_parallel_job {
+	long begin;							/**< first index of the range */
+	long end;							/**< one past the last index */
+	long grain;							/**< indexes per chunk */
+	void (*func)(long, long, void *);	/**< called for each chunk */
+	void *ctx;							/**< passed to 'func' */
+	long num_chunks;					/**< number of chunks */
+	long next;							/**< next chunk to hand out */
+	long completed;						/**< number of chunks done */
+	int refs;							/**< caller and helper tasks holding the job */
+	pthread_mutex_t mutex;				/**< protects waiting on 'completed' */
+	pthread_cond_t done;				/**< signalled when the last chunk is done */
+};
+
+/* Type Definitions */
+typedef struct ptl_parallel_job *ptl_parallel_job_t;
+
+
+/* Public Functions */
+
+/**
+ * Calls 'func' on every 'grain' sized chunk of [begin, end), in parallel.
+ * 'func' is given the chunk's first index, one past its last index and
+ * 'ctx'. Chunks may run in any order and on any thread.
+ *
+ * @param manager runs the helper tasks, NULL to run everything on the
+ *        calling thread
+ * @param begin first index
+ * @param end one past the last index
+ * @param grain number of indexes per chunk, <= 0 to pick one that gives
+ *        every thread a few chunks
+ * @param func called for each chunk
+ * @param ctx passed to 'func'
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_parallel_for(ptl_thread_manager_t manager, long begin, long end, long grain,
+					 void (*func)(long, long, void *), void *ctx);
+
+/**
+ * Creates a new dense list where element 'i' is 'func' of element 'i' of
+ * 'array_list', computed in parallel. Empty positions are passed to 'func'
+ * as NULL.
+ *
+ * @param manager runs the helper tasks, NULL for none
+ * @param array_list list to map
+ * @param grain number of elements per chunk, <= 0 to pick one
+ * @param func called with each element and 'ctx'
+ * @param ctx passed to 'func'
+ * @return a new list of the same size (destroy it when done), NULL if the
+ *         parameters are bad
+ */
+ptl_array_list_t ptl_parallel_map(ptl_thread_manager_t manager, ptl_array_list_t array_list,
+								  long grain, void *(*func)(void *, void *), void *ctx);
+
+/**
+ * Reduces 'array_list' to one value in parallel. Each chunk is reduced by
+ * 'reduce_func', which is given a pointer to the chunk's first element, the
+ * number of elements and 'ctx', and returns the chunk's result. The chunk
+ * results are then combined from left to right with 'combine_func' on the
+ * calling thread, so 'combine_func' need not be commutative.
+ *
+ * @param manager runs the helper tasks, NULL for none
+ * @param array_list list to reduce
+ * @param grain number of elements per chunk, <= 0 to pick one
+ * @param reduce_func reduces a chunk
+ * @param combine_func combines the results of two neighbouring pieces
+ * @param ctx passed to both functions
+ * @return the result, NULL if the list is empty or the parameters are bad
+ */
+void *ptl_parallel_reduce(ptl_thread_manager_t manager, ptl_array_list_t array_list, long grain,
+						  void *(*reduce_func)(void **, long, void *),
+						  void *(*combine_func)(void *, void *, void *), void *ctx);
+
+#endif
@@ -23,6 +23,7 @@
 #include <assert.h>
 #include <malloc.h>
 #include <assert.h>
+#include "ptl_allocator.h"
 #include "ptl_queue.h"
 #include "ptl_util.h"
 
@@ -34,12 +35,22 @@ int _check_function_ptrs(ptl_q_funcs_t q_functions);
 
 /* create the queue and assign the functions */
 ptl_q_t ptl_q_create_queue(ptl_q_funcs_t q_functions, int capacity){
+	return ptl_q_create_queue_allocator(q_functions, capacity, NULL);
+}
+
+
+/* create the queue and assign the functions, all memory from 'allocator' */
+ptl_q_t ptl_q_create_queue_allocator(ptl_q_funcs_t q_functions, int capacity, ptl_allocator_t allocator){
 	_check_function_ptrs(q_functions);
 	
-	ptl_q_t q = (ptl_q_t)malloc(sizeof(struct ptl_q));
-	assert(q);
+	allocator = ptl_resolve_allocator(allocator);
+	
+	ptl_q_t q = (ptl_q_t)ptl_alloc(allocator, sizeof(struct ptl_q));
 	
+	q->allocator = allocator; // set first, init allocates with it
 	q->capacity = capacity;
+	q->size = 0;
+	q->data = NULL; // backends that need extra state set this in init
 	q->functions = q_functions; // TODO is this right?
 	
 	ptl_q_funcs_t funcs = (ptl_q_funcs_t)(q->functions);
@@ -58,11 +69,35 @@ ptl_q_element_t ptl_q_create_element(void *value){
 
 	e->next = NULL;
 	e->prev = NULL;
+	e->enqueue_usec = 0; // only stamped by queues that track sojourn time
+	
+	return e;
+}
+
+
+/* creates an element from the queue's allocator */
+ptl_q_element_t ptl_q_alloc_element(ptl_q_t q, void *value){
+	assert(q);
+	
+	ptl_q_element_t e = (ptl_q_element_t)ptl_alloc(q->allocator, sizeof(struct ptl_q_element));
+	
+	e->value = value;
+	e->next = NULL;
+	e->prev = NULL;
+	e->enqueue_usec = 0; // only stamped by queues that track sojourn time
 	
 	return e;
 }
 
 
+/* gives an element back to the queue's allocator */
+void ptl_q_free_element(ptl_q_t q, ptl_q_element_t element){
+	assert(q);
+	
+	ptl_free(q->allocator, element, sizeof(struct ptl_q_element));
+}
+
+
 /* free any memory used to create this queue. */
 void ptl_q_destroy_queue(ptl_q_t q){
 	if(q == NULL) { return; }
@@ -71,7 +106,7 @@ void ptl_q_destroy_queue(ptl_q_t q){
 	
 	funcs->ptl_q_destroy_queue(q); // call the destroy function supplied
 	
-	FREE(q); // free the entire q
+	ptl_free(q->allocator, q, sizeof(struct ptl_q)); // free the entire q
 	
 	return;
 }
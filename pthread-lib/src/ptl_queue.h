@@ -25,6 +25,8 @@
 #ifndef __PTL_QUEUE_H__
 #define __PTL_QUEUE_H__
 
+#include "ptl_allocator.h"
+
 #define PTL_Q_TYPE_LENGTH 32
 
 /* Structures */
@@ -34,6 +36,7 @@ struct ptl_q_element {
 	void *value; // value of this element
 	struct ptl_q_element *next; // next element in this list
 	struct ptl_q_element *prev; // previous element in this list
+	long long enqueue_usec; // time this element was enqueued (0 if not stamped)
 };
 	
 /* Essential Data Elements */
@@ -44,6 +47,8 @@ struct ptl_q {
 	struct ptl_q_element *head; // first element
 	struct ptl_q_element *tail; // last element
 	struct ptl_q_element *ptr; // misc ptr
+	void *data; // backend specific data (codel state, etc.)
+	ptl_allocator_t allocator; // where the queue, its elements and 'data' come from, NULL for the default
 	void *functions;
 	/*struct ptl_q_funcs *functions;*/ // functions used to operate on the queue
  };
@@ -116,6 +121,10 @@ typedef struct ptl_q_element* ptl_q_element_t;
  * All other memory shall be created in the various functions supplied in the
  * q_functions parameter.
  *
+ * A queue set up by hand, by calling a backend's init function on a struct
+ * ptl_q, must be zeroed first (calloc, not malloc): init reads 'allocator'
+ * and uses the default allocator when it is NULL.
+ *
  * @param q_functions list of functions that will be used to implement the 
  *                    operations
  * @param capacity of this queue. If a linked queue, this is ignored. For an
@@ -124,6 +133,19 @@ typedef struct ptl_q_element* ptl_q_element_t;
  */
 ptl_q_t ptl_q_create_queue(ptl_q_funcs_t q_functions, int capacity);
 
+/**
+ * Creates the queue the same way as ptl_q_create_queue(), but the queue, its
+ * elements and any backend state come from 'allocator' (see 
+ * ptl_allocator.h). ptl_q_create_queue() uses the default allocator.
+ *
+ * @param q_functions list of functions that will be used to implement the 
+ *                    operations
+ * @param capacity of this queue (see ptl_q_create_queue())
+ * @param allocator allocator to use, NULL for the default
+ * @return new memory for this queue
+ */
+ptl_q_t ptl_q_create_queue_allocator(ptl_q_funcs_t q_functions, int capacity, ptl_allocator_t allocator);
+
 /**
  * Creates an element/node that houses the 'value' given to it. This element
  * can be null to create a dummy node, however, logic may think it the end of 
@@ -133,6 +155,26 @@ ptl_q_t ptl_q_create_queue(ptl_q_funcs_t q_functions, int capacity);
  */
 ptl_q_element_t ptl_q_create_element(void *value);
 
+/**
+ * Creates an element the same way as ptl_q_create_element(), but from the
+ * queue's allocator. Queue implementations use this for their elements; it
+ * must be freed with ptl_q_free_element() on the same queue.
+ *
+ * @param q queue the element is for
+ * @param value element to be wrapped in the ptl_q_element_t
+ * @return the new element
+ */
+ptl_q_element_t ptl_q_alloc_element(ptl_q_t q, void *value);
+
+/**
+ * Gives an element made by ptl_q_alloc_element() back to the queue's 
+ * allocator. The value is not freed.
+ *
+ * @param q queue the element was allocated for
+ * @param element element to free, may be null
+ */
+void ptl_q_free_element(ptl_q_t q, ptl_q_element_t element);
+
 /**
  * Clears and destroys the queue. It calls the destroy_queue function that 
  * was supplied during creation. After that call, it destroys any other memory
@@ -0,0 +1,284 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include "ptl_queue.h"
+#include "ptl_rate_limited_queue.h"
+#include "ptl_util.h"
+
+
+/* Private Functions */
+void _ptl_rlq_refill(ptl_token_bucket_t bucket, long long now);
+void _ptl_rlq_give_back(ptl_token_bucket_t bucket);
+ptl_q_t _ptl_rlq_inner(ptl_token_bucket_t bucket);
+
+
+/* initialize the token bucket */
+void ptl_rlq_init_queue(ptl_q_t q){
+	assert(q);
+	q->allocator = ptl_resolve_allocator(q->allocator); // NULL in a zeroed queue set up by hand
+
+	ptl_token_bucket_t bucket = (ptl_token_bucket_t)ptl_calloc(q->allocator, 1, sizeof(struct ptl_token_bucket));
+
+	// sleep on the same clock ptl_get_time_usec() reads
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(bucket->cond), &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+
+	pthread_mutex_init(&(bucket->mutex), NULL);
+
+	bucket->inner_q = NULL;
+	bucket->rate = 0; // unlimited until set
+	bucket->burst = 1;
+	bucket->tokens = PTL_RLQ_TOKEN_COST;
+	bucket->last_refill = ptl_get_time_usec();
+	bucket->generation = 0;
+
+	strncpy(q->type, "rate limited", PTL_Q_TYPE_LENGTH);
+	q->size = 0; // the wrapped queue keeps its own size
+	q->head = NULL; // not used
+	q->tail = NULL; // not used
+	q->ptr = NULL; // not used
+	q->data = bucket;
+}
+
+
+/* free the token bucket, but not the wrapped queue */
+void ptl_rlq_destroy_queue(ptl_q_t q){
+	assert(q);
+
+	ptl_token_bucket_t bucket = (ptl_token_bucket_t)q->data;
+
+	pthread_mutex_destroy(&(bucket->mutex));
+	pthread_cond_destroy(&(bucket->cond));
+	PTL_FREE(q->allocator, q->data, sizeof(struct ptl_token_bucket));
+}
+
+
+/* set the wrapped queue, rate and burst. The bucket starts full */
+void ptl_rlq_set_rate(ptl_q_t q, ptl_q_t inner_q, long rate, long burst){
+	if(q == NULL || inner_q == NULL){ return; }
+
+	ptl_token_bucket_t bucket = (ptl_token_bucket_t)q->data;
+
+	pthread_mutex_lock(&(bucket->mutex)); // lock
+
+	bucket->inner_q = inner_q;
+	bucket->rate = rate;
+	bucket->burst = (burst > 0) ? burst : 1;
+	bucket->tokens = bucket->burst * PTL_RLQ_TOKEN_COST;
+	bucket->last_refill = ptl_get_time_usec();
+	bucket->generation++;
+
+	// consumers waiting for a token reserved it at the old rate
+	pthread_cond_broadcast(&(bucket->cond));
+	pthread_mutex_unlock(&(bucket->mutex)); // unlock
+}
+
+
+/* adds are not rate limited */
+int ptl_rlq_add(ptl_q_t q, void *value){
+	if(q == NULL){ return 0; }
+
+	return ptl_q_add(_ptl_rlq_inner((ptl_token_bucket_t)q->data), value);
+}
+
+
+/* adds are not rate limited */
+int ptl_rlq_add_wait(ptl_q_t q, void *value, long timeout){
+	if(q == NULL){ return 0; }
+
+	return ptl_q_add_wait(_ptl_rlq_inner((ptl_token_bucket_t)q->data), value, timeout);
+}
+
+
+/* clear the wrapped queue */
+void ptl_rlq_clear(ptl_q_t q){
+	if(q == NULL){ return; }
+
+	ptl_q_clear(_ptl_rlq_inner((ptl_token_bucket_t)q->data));
+}
+
+
+/* peeking does not cost a token */
+void* ptl_rlq_peek(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	return ptl_q_peek(_ptl_rlq_inner((ptl_token_bucket_t)q->data));
+}
+
+
+/* take an element only if a token is available now */
+void* ptl_rlq_get(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	ptl_token_bucket_t bucket = (ptl_token_bucket_t)q->data;
+	void *value = NULL;
+
+	pthread_mutex_lock(&(bucket->mutex)); // lock
+
+	if(bucket->rate <= 0){
+		ptl_q_t inner_q = bucket->inner_q;
+		pthread_mutex_unlock(&(bucket->mutex)); // unlock
+		return ptl_q_get(inner_q); // not limited
+	}
+
+	_ptl_rlq_refill(bucket, ptl_get_time_usec());
+
+	// a negative bucket means waiting consumers are in line ahead of us
+	if(bucket->tokens >= PTL_RLQ_TOKEN_COST){
+		value = ptl_q_get(bucket->inner_q);
+		if(value != NULL){
+			bucket->tokens -= PTL_RLQ_TOKEN_COST;
+		}
+	}
+
+	pthread_mutex_unlock(&(bucket->mutex)); // unlock
+
+	return value;
+}
+
+
+/* reserve a token, sleep until it is earned, then take an element */
+void* ptl_rlq_get_wait(ptl_q_t q, long timeout){
+	if(q == NULL || timeout < 0){ return NULL; }
+
+	ptl_token_bucket_t bucket = (ptl_token_bucket_t)q->data;
+	long long end_time = ptl_get_time_usec() + (timeout * 1000LL);
+	struct timespec ts;
+
+	pthread_mutex_lock(&(bucket->mutex)); // lock
+
+	while(1){
+		long long now = ptl_get_time_usec();
+
+		if(bucket->rate <= 0){
+			ptl_q_t inner_q = bucket->inner_q;
+			pthread_mutex_unlock(&(bucket->mutex)); // unlock
+
+			long remaining = (end_time > now) ? (long)((end_time - now) / 1000LL) : 0;
+			return ptl_q_get_wait(inner_q, remaining); // not limited
+		}
+
+		_ptl_rlq_refill(bucket, now);
+
+		// when will the token we are about to reserve be earned?
+		long long owed = PTL_RLQ_TOKEN_COST - bucket->tokens;
+		long long ready_time = now;
+		if(owed > 0){
+			ready_time += (owed + bucket->rate - 1) / bucket->rate;
+		}
+
+		if(ready_time > end_time){
+			pthread_mutex_unlock(&(bucket->mutex)); // unlock
+			return NULL; // we can't get a token in time, don't bother waiting
+		}
+
+		// take our place in line (this may put the bucket in debt)
+		bucket->tokens -= PTL_RLQ_TOKEN_COST;
+		unsigned long generation = bucket->generation;
+
+		ts.tv_sec = ready_time / 1000000LL;
+		ts.tv_nsec = (ready_time % 1000000LL) * 1000;
+		while(ptl_get_time_usec() < ready_time && generation == bucket->generation){
+			pthread_cond_timedwait(&(bucket->cond), &(bucket->mutex), &ts);
+		}
+
+		if(generation == bucket->generation){ break; }
+		// the rate was changed and the bucket refilled, our place in line went
+		// with the old one
+	}
+
+	ptl_q_t inner_q = bucket->inner_q;
+	pthread_mutex_unlock(&(bucket->mutex)); // unlock
+
+	// we own a token, now wait for an element for whatever time is left
+	void *value = ptl_q_get(inner_q);
+	if(value == NULL){
+		long remaining = (long)((end_time - ptl_get_time_usec()) / 1000LL);
+		if(remaining > 0){
+			value = ptl_q_get_wait(inner_q, remaining);
+		}
+	}
+
+	if(value == NULL){
+		_ptl_rlq_give_back(bucket);
+	}
+
+	return value;
+}
+
+
+/* Private Functions */
+
+/* adds the tokens earned since the last refill. The lock must be held */
+void _ptl_rlq_refill(ptl_token_bucket_t bucket, long long now){
+	long long max_tokens = bucket->burst * PTL_RLQ_TOKEN_COST;
+	long long elapsed = now - bucket->last_refill;
+
+	if(elapsed <= 0){ return; }
+	bucket->last_refill = now;
+
+	// don't let a long idle period overflow the multiply
+	if(elapsed > (max_tokens - bucket->tokens) / bucket->rate + 1){
+		bucket->tokens = max_tokens;
+		return;
+	}
+
+	// 'rate' tokens per second is 'rate' micro-tokens per microsecond
+	bucket->tokens += elapsed * bucket->rate;
+	if(bucket->tokens > max_tokens){
+		bucket->tokens = max_tokens;
+	}
+}
+
+/* returns an unused token to the bucket */
+void _ptl_rlq_give_back(ptl_token_bucket_t bucket){
+	pthread_mutex_lock(&(bucket->mutex)); // lock
+
+	// the rate may have been lifted since the token was taken
+	if(bucket->rate > 0){
+		_ptl_rlq_refill(bucket, ptl_get_time_usec());
+	}
+
+	bucket->tokens += PTL_RLQ_TOKEN_COST;
+	if(bucket->tokens > bucket->burst * PTL_RLQ_TOKEN_COST){
+		bucket->tokens = bucket->burst * PTL_RLQ_TOKEN_COST;
+	}
+
+	pthread_mutex_unlock(&(bucket->mutex)); // unlock
+}
+
+/* the wrapped queue, which ptl_rlq_set_rate() may change */
+ptl_q_t _ptl_rlq_inner(ptl_token_bucket_t bucket){
+	pthread_mutex_lock(&(bucket->mutex)); // lock
+	ptl_q_t inner_q = bucket->inner_q;
+	pthread_mutex_unlock(&(bucket->mutex)); // unlock
+
+	return inner_q;
+}
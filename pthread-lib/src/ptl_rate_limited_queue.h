@@ -0,0 +1,145 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" wraps any other ptl_q_t and paces the rate elements can be
+ * taken out of it using a token bucket. The bucket fills at 'rate' tokens
+ * per second up to 'burst' tokens, and every element taken costs one token.
+ * Adds, peeks and clears go straight to the wrapped queue.
+ *
+ * A consumer waiting in ptl_rlq_get_wait() reserves its token up front (the
+ * bucket may go into debt) and sleeps until exactly the time that token is
+ * earned, so waiting consumers are released in order, one token apart,
+ * without polling.
+ */
+
+
+#ifndef __PTL_RATE_LIMITED_QUEUE_H__
+#define __PTL_RATE_LIMITED_QUEUE_H__
+
+/* Defines */
+#define PTL_RLQ_TOKEN_COST 1000000LL	/**< one token, in micro-tokens */
+
+/* Structures */
+struct ptl_token_bucket {
+	ptl_q_t inner_q;			/**< queue that is being rate limited */
+	long rate;					/**< tokens earned per second, <= 0 is unlimited */
+	long burst;					/**< most tokens the bucket can hold */
+	long long tokens;			/**< micro-tokens in the bucket, negative is debt */
+	long long last_refill;		/**< time (usec) tokens were last added */
+	pthread_mutex_t mutex;		/**< protects the bucket */
+	unsigned long generation;	/**< bumped by each ptl_rlq_set_rate() */
+	pthread_cond_t cond;		/**< waiting consumers sleep on this, woken by ptl_rlq_set_rate() */
+};
+
+/* Type Definitions */
+typedef struct ptl_token_bucket *ptl_token_bucket_t;
+
+
+/* Public Functions */
+
+/**
+ * Destroys the rate limiter. The wrapped queue is not destroyed; it is still
+ * owned by the caller.
+ *
+ * @param q the queue to destroy
+ */
+void ptl_rlq_destroy_queue(ptl_q_t q);
+
+/**
+ * Initializes the rate limiter. Nothing can be added or taken until the
+ * wrapped queue is given using ptl_rlq_set_rate().
+ *
+ * @param q queue to be initized.
+ */
+void ptl_rlq_init_queue(ptl_q_t q);
+
+/**
+ * Sets the queue to wrap and the token bucket parameters. The bucket starts
+ * full. This may be called again while consumers are using the queue; those
+ * waiting for a token wake up and wait again at the new rate.
+ *
+ * @param q non-null rate limited queue
+ * @param inner_q non-null queue that will be rate limited
+ * @param rate number of elements per second that may be taken, <= 0 for no
+ *        limit
+ * @param burst number of elements that may be taken at once after the queue
+ *        has been idle (at least 1)
+ */
+void ptl_rlq_set_rate(ptl_q_t q, ptl_q_t inner_q, long rate, long burst);
+
+/**
+ * Adds 'value' to the wrapped queue. Adds are not rate limited.
+ *
+ * @param q non-null queue
+ * @param value the value to be stored in the queue
+ * @return the result of ptl_q_add() on the wrapped queue
+ */
+int ptl_rlq_add(ptl_q_t q, void *value);
+
+/**
+ * Adds 'value' to the wrapped queue, waiting if the wrapped queue does.
+ *
+ * @param q non-null queue to add the value
+ * @param value data that will be added to the queue
+ * @param timeout passed to ptl_q_add_wait() of the wrapped queue
+ * @return the result of ptl_q_add_wait() on the wrapped queue
+ **/
+int ptl_rlq_add_wait(ptl_q_t q, void *value, long timeout);
+
+/**
+ * Clears the wrapped queue.
+ *
+ * @param q non-null queue to be cleared
+ */
+void ptl_rlq_clear(ptl_q_t q);
+
+/**
+ * Retrieves, but does not remove, the head of the wrapped queue. Peeking
+ * does not cost a token.
+ *
+ * @param q non-null queue to peek on
+ * @return pointer to the head element or NULL if no element was found
+ */
+void* ptl_rlq_peek(ptl_q_t q);
+
+/**
+ * Retrieves and removes the head of the wrapped queue if a token is
+ * available right now. It does not wait.
+ *
+ * @param q non-null queue to get an element from
+ * @return the head element or NULL if there is no token or no element
+ */
+void* ptl_rlq_get(ptl_q_t q);
+
+/**
+ * Retrieves and removes the head of the wrapped queue, waiting up to the
+ * specified wait time for a token and then for an element. If the token
+ * cannot be earned before the timeout, it returns right away. A token that
+ * was not used because no element showed up is given back.
+ *
+ * @param q non-null queue to get an element from
+ * @param timeout number of milliseconds to wait
+ * @return the head element or NULL if no element was found
+ */
+void* ptl_rlq_get_wait(ptl_q_t q, long timeout);
+
+
+#endif
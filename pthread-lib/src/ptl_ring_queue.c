@@ -0,0 +1,408 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+ /*
+  * For a "class" description, see the header file.
+  */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_queue.h"
+#include "ptl_util.h"
+#include "ptl_ring_queue.h"
+
+
+/* Defines */
+#define PTL_RQ_READ_OK          0
+#define PTL_RQ_READ_NOT_READY   1
+#define PTL_RQ_READ_OVERWRITTEN 2
+#define PTL_RQ_SNAPSHOT_TRIES   4	/* copies before a snapshot trims what was lapped */
+
+
+/* Private Functions */
+void _ptl_rq_skip(struct ptl_rq_slot *slot, unsigned long ticket);
+int _ptl_rq_read_slot(ptl_ring_t ring, unsigned long pos, void **value);
+void* _ptl_rq_next(ptl_q_t q, int remove);
+
+
+/* initalize the ptl_q structure for a ring queue */
+void ptl_rq_init_queue(ptl_q_t q){
+	assert(q);
+	q->allocator = ptl_resolve_allocator(q->allocator); // NULL in a zeroed queue set up by hand
+
+	// round the capacity up to a power of two so a slot is a mask away
+	unsigned long capacity = 1;
+	while(capacity < (unsigned long)q->capacity){
+		capacity <<= 1;
+	}
+
+	ptl_ring_t ring = (ptl_ring_t)ptl_calloc(q->allocator, 1, sizeof(struct ptl_ring));
+
+	ring->slots = (struct ptl_rq_slot *)ptl_calloc(q->allocator, capacity, sizeof(struct ptl_rq_slot));
+
+	ring->mask = capacity - 1;
+	pthread_mutex_init(&(ring->read_mutex), NULL);
+
+	strncpy(q->type, "ring", PTL_Q_TYPE_LENGTH);
+	q->capacity = capacity;
+	q->size = 0;
+	q->head = NULL; // not used
+	q->tail = NULL; // not used
+	q->ptr = NULL; // not used
+	q->data = ring;
+
+	return;
+}
+
+
+/* free all the memory associated with a ring queue */
+void ptl_rq_destroy_queue(ptl_q_t q){
+	assert(q);
+
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+
+	strncpy(q->type, "\0", PTL_Q_TYPE_LENGTH);
+	q->capacity = 0;
+	q->size = 0;
+
+	pthread_mutex_destroy(&(ring->read_mutex));
+	PTL_FREE(q->allocator, ring->slots, (ring->mask + 1) * sizeof(struct ptl_rq_slot));
+	PTL_FREE(q->allocator, q->data, sizeof(struct ptl_ring));
+
+	return;
+}
+
+
+/* take a ticket and publish the value in its slot. Never blocks. */
+int ptl_rq_add(ptl_q_t q, void *value){
+	if(q == NULL || value == NULL){ return 0; }
+
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+
+	unsigned long ticket = __atomic_fetch_add(&(ring->write_pos), 1, __ATOMIC_RELAXED);
+	struct ptl_rq_slot *slot = ring->slots + (ticket & ring->mask);
+	unsigned long writing = (2 * ticket) + 1;
+	unsigned long seq = __atomic_load_n(&(slot->seq), __ATOMIC_RELAXED);
+
+	// mark the slot as being written, only from an older published sequence,
+	// so a producer held up for a lap can't take the slot back from a newer one
+	do {
+		if((long)(seq - writing) > 0){
+			return 1; // a later lap has it, readers see ours as overwritten
+		}
+		if(seq & 1){
+			// the lap before is still writing it, the new element is the one
+			// that is dropped
+			_ptl_rq_skip(slot, ticket);
+			__atomic_add_fetch(&(ring->dropped_newest), 1, __ATOMIC_RELAXED);
+			return 1;
+		}
+	} while(!__atomic_compare_exchange_n(&(slot->seq), &seq, writing, 1, 
+										 __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+	// the slot is ours until it is published
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&(slot->value), value, __ATOMIC_RELAXED);
+	__atomic_store_n(&(slot->seq), (2 * ticket) + 2, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+/* adding never waits */
+int ptl_rq_add_wait(ptl_q_t q, void *value, long timeout){
+	return ptl_rq_add(q, value);
+}
+
+
+/* forget everything currently in the ring. The 'value' elements aren't freed */
+void ptl_rq_clear(ptl_q_t q){
+	if(q == NULL){ return; }
+
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+
+	pthread_mutex_lock(&(ring->read_mutex)); // lock
+
+	ring->read_pos = __atomic_load_n(&(ring->write_pos), __ATOMIC_ACQUIRE);
+	q->size = 0;
+
+	pthread_mutex_unlock(&(ring->read_mutex)); // unlock
+
+	return;
+}
+
+
+/* read everything out of the ring, freeing each 'value' */
+void ptl_rq_clear_freefunc(ptl_q_t q, void (*free_func)(void *)){
+	if(q == NULL){ return; }
+
+	void *value = NULL;
+	while((value = ptl_rq_get(q)) != NULL){
+		free_func(value);
+	}
+
+	return;
+}
+
+
+/* looks at and returns the oldest element, but does not remove */
+void* ptl_rq_peek(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	return _ptl_rq_next(q, 0);
+}
+
+
+/* gets and removes the oldest element */
+void* ptl_rq_get(ptl_q_t q){
+	if(q == NULL){ return NULL; }
+
+	return _ptl_rq_next(q, 1);
+}
+
+
+/* try to get an element, if no elements exist, then keep
+   trying until 'timeout' */
+void* ptl_rq_get_wait(ptl_q_t q, long timeout){
+	if(q == NULL || timeout < 0){ return NULL; }
+
+	long long end_time = ptl_get_time_usec() + (timeout * 1000LL);
+	void* element = NULL;
+
+	while((element = ptl_rq_get(q)) == NULL){
+
+		if(ptl_get_time_usec() >= end_time){
+			break; // I chose to use break to get out before the sleep
+		}
+
+		ptl_timed_wait(100); // wait 100 microseconds
+	}
+
+	return element;
+}
+
+
+/* copy the unread elements, oldest first, without removing them. What is
+   copied was all in the ring at once, when the copy ended */
+long ptl_rq_snapshot(ptl_q_t q, void **values, long max_values){
+	if(q == NULL || values == NULL || max_values <= 0){ return 0; }
+
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+	unsigned long capacity = ring->mask + 1;
+	long num_values = 0;
+	void *value = NULL;
+	int tries = 0;
+
+	pthread_mutex_lock(&(ring->read_mutex)); // lock
+
+	for(tries=1; ; tries++){
+		unsigned long write_pos = __atomic_load_n(&(ring->write_pos), __ATOMIC_ACQUIRE);
+		unsigned long start = ring->read_pos;
+
+		// only the last 'capacity' tickets can still be in the ring
+		if(write_pos - start > capacity){
+			start = write_pos - capacity;
+		}
+		// and we only have room for the newest 'max_values'
+		if(write_pos - start > (unsigned long)max_values){
+			start = write_pos - max_values;
+		}
+
+		// values[i] is ticket start+i, NULL where there is no element: not
+		// published yet, given up on by its producer, or lapped
+		unsigned long pos = start;
+		for(; pos != write_pos; pos++){
+			if(_ptl_rq_read_slot(ring, pos, &value) == PTL_RQ_READ_OK){
+				values[pos - start] = value;
+			} else {
+				values[pos - start] = NULL;
+			}
+		}
+
+		// every ticket from 'end' - capacity on was still in the ring when
+		// 'end' was read, older ones may have been lapped during the copy
+		unsigned long end = __atomic_load_n(&(ring->write_pos), __ATOMIC_ACQUIRE);
+		unsigned long first = 0;
+		if((long)((end - capacity) - start) > 0){
+			if(tries < PTL_RQ_SNAPSHOT_TRIES){ continue; }
+
+			// out of tries, keep the part that was not lapped
+			first = (end - capacity) - start;
+			if(first > write_pos - start){
+				first = write_pos - start;
+			}
+		}
+
+		unsigned long i = first;
+		for(num_values=0; i<write_pos - start; i++){
+			if(values[i] != NULL){
+				values[num_values++] = values[i];
+			}
+		}
+		break;
+	}
+
+	pthread_mutex_unlock(&(ring->read_mutex)); // unlock
+
+	return num_values;
+}
+
+
+/* number of elements overwritten before they were read */
+unsigned long ptl_rq_get_drop_count(ptl_q_t q){
+	if(q == NULL){ return 0; }
+
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+	unsigned long capacity = ring->mask + 1;
+
+	pthread_mutex_lock(&(ring->read_mutex)); // lock
+
+	unsigned long write_pos = __atomic_load_n(&(ring->write_pos), __ATOMIC_ACQUIRE);
+	unsigned long dropped = ring->dropped;
+
+	// tickets that have already been lapped but not yet noticed by a reader
+	if(write_pos - ring->read_pos > capacity){
+		dropped += (write_pos - ring->read_pos) - capacity;
+	}
+
+	pthread_mutex_unlock(&(ring->read_mutex)); // unlock
+
+	return dropped;
+}
+
+
+/* number of new elements dropped because their slot was still being written */
+unsigned long ptl_rq_get_drop_newest_count(ptl_q_t q){
+	if(q == NULL){ return 0; }
+
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+
+	return __atomic_load_n(&(ring->dropped_newest), __ATOMIC_RELAXED);
+}
+
+
+/* Private Functions */
+
+/**
+ * Marks 'ticket' as given up on, so readers count it as dropped instead of
+ * waiting for it. Several producers may give up on the same slot, the mark
+ * only moves forward.
+ *
+ * @param slot slot of 'ticket'
+ * @param ticket ticket of the element that was dropped
+ */
+void _ptl_rq_skip(struct ptl_rq_slot *slot, unsigned long ticket){
+	unsigned long skipped = __atomic_load_n(&(slot->skipped), __ATOMIC_RELAXED);
+
+	while((long)(skipped - ((2 * ticket) + 2)) < 0){
+		if(__atomic_compare_exchange_n(&(slot->skipped), &skipped, (2 * ticket) + 2, 1,
+									   __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+			break;
+		}
+	}
+}
+
+/**
+ * Reads the slot for ticket 'pos'. The value is only valid if the sequence
+ * number of the slot says it was published for 'pos' both before and after
+ * the value was read.
+ *
+ * @param ring ring to read
+ * @param pos ticket to read
+ * @param value set to the value stored for 'pos'
+ * @return PTL_RQ_READ_OK, PTL_RQ_READ_NOT_READY if the producer for 'pos'
+ *         has not finished, or PTL_RQ_READ_OVERWRITTEN if a later producer
+ *         took the slot or the producer for 'pos' gave up on it
+ */
+int _ptl_rq_read_slot(ptl_ring_t ring, unsigned long pos, void **value){
+	struct ptl_rq_slot *slot = ring->slots + (pos & ring->mask);
+	unsigned long expected = (2 * pos) + 2;
+
+	unsigned long seq = __atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE);
+	if(seq != expected){
+		// sequence numbers only grow, a smaller one is still being written,
+		// unless its producer gave up
+		if((long)(seq - expected) > 0 || 
+		   (long)(__atomic_load_n(&(slot->skipped), __ATOMIC_ACQUIRE) - expected) >= 0){
+			return PTL_RQ_READ_OVERWRITTEN;
+		}
+		return PTL_RQ_READ_NOT_READY;
+	}
+
+	*value = __atomic_load_n(&(slot->value), __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+	if(__atomic_load_n(&(slot->seq), __ATOMIC_RELAXED) != expected){
+		return PTL_RQ_READ_OVERWRITTEN; // a producer lapped us while reading
+	}
+
+	return PTL_RQ_READ_OK;
+}
+
+/**
+ * Finds the oldest readable element, counting the overwritten ones as
+ * dropped along the way.
+ *
+ * @param q queue to read
+ * @param remove 1 to remove the element, 0 to only look at it
+ * @return the oldest element or NULL if none is readable
+ */
+void* _ptl_rq_next(ptl_q_t q, int remove){
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+	unsigned long capacity = ring->mask + 1;
+	void *value = NULL;
+	void *found = NULL;
+
+	pthread_mutex_lock(&(ring->read_mutex)); // lock
+
+	unsigned long write_pos = __atomic_load_n(&(ring->write_pos), __ATOMIC_ACQUIRE);
+
+	// skip everything the producers have already lapped
+	if(write_pos - ring->read_pos > capacity){
+		ring->dropped += (write_pos - ring->read_pos) - capacity;
+		ring->read_pos = write_pos - capacity;
+	}
+
+	while(ring->read_pos != write_pos){
+		int rc = _ptl_rq_read_slot(ring, ring->read_pos, &value);
+
+		if(rc == PTL_RQ_READ_OK){
+			found = value;
+			if(remove){
+				ring->read_pos++;
+			}
+			break;
+		} else if(rc == PTL_RQ_READ_OVERWRITTEN){
+			ring->dropped++;
+			ring->read_pos++;
+		} else {
+			break; // the oldest element is still being written
+		}
+	}
+
+	// best effort size, producers do not maintain it
+	q->size = write_pos - ring->read_pos;
+
+	pthread_mutex_unlock(&(ring->read_mutex)); // unlock
+
+	return found;
+}
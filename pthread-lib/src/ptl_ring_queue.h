@@ -0,0 +1,197 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is a lossy ring queue meant for telemetry (metrics, debug
+ * traces). It uses the same circular layout as the array queue, but when the
+ * ring is full the oldest element is overwritten instead of rejecting the
+ * new one. Adding never fails and never blocks: a producer takes a ticket
+ * with a single atomic increment and publishes its slot with a sequence
+ * number, so producers never take a lock.
+ *
+ * A producer claims its slot with a compare-and-swap that only moves the
+ * sequence number forward, so one producer writes a slot at a time. If a
+ * later lap of the ring already has the slot, or a producer from the lap
+ * before is still writing it (it was held up for a whole lap), the new
+ * element is dropped instead of waiting, and marked so readers skip it.
+ * That is the one case where the newest element is dropped rather than the
+ * oldest; it is counted by ptl_rq_get_drop_newest_count().
+ *
+ * Readers (get, peek, snapshot) are serialized by a lock of their own and
+ * use the slot sequence numbers to skip elements that were overwritten while
+ * they were being read. Overwritten elements are counted as dropped.
+ *
+ * The capacity is rounded up to a power of two. The ring does not own the
+ * 'values' put into it: an overwritten 'value' is simply forgotten, so it
+ * should not be the only pointer to allocated memory.
+ */
+
+
+#ifndef __PTL_RING_QUEUE_H__
+#define __PTL_RING_QUEUE_H__
+
+/* Structures */
+
+/* A single slot in the ring */
+struct ptl_rq_slot {
+	unsigned long seq;	/**< 2*ticket+1 while writing, 2*ticket+2 when published, only grows */
+	void *value;		/**< value stored in this slot */
+	unsigned long skipped;	/**< 2*ticket+2 of the newest ticket a producer gave up on */
+};
+
+struct ptl_ring {
+	unsigned long write_pos;	/**< next producer ticket */
+	unsigned long read_pos;		/**< next ticket to be read */
+	unsigned long mask;			/**< capacity - 1 (capacity is a power of two) */
+	unsigned long dropped;		/**< overwritten elements found by readers */
+	unsigned long dropped_newest;	/**< new elements dropped by their producer */
+	pthread_mutex_t read_mutex;	/**< serializes readers only */
+	struct ptl_rq_slot *slots;	/**< the ring itself */
+};
+
+/* Type Definitions */
+typedef struct ptl_ring *ptl_ring_t;
+
+
+/* Public Functions */
+
+/**
+ * Destroys the queue and frees the memory. This should be used when the queue
+ * is no longer going to be used.
+ *
+ * @param q the queue to destroy
+ */
+void ptl_rq_destroy_queue(ptl_q_t q);
+
+/**
+ * Initializes the queue, creating all memory needed to support this data
+ * structure. The capacity of the queue is rounded up to a power of two.
+ *
+ * @param q queue to be initized.
+ */
+void ptl_rq_init_queue(ptl_q_t q);
+
+/**
+ * Inserts the specified element at the tail of this queue. If the ring is
+ * full, the oldest element is overwritten. This never blocks.
+ *
+ * @param q non-null queue
+ * @param value the value to be stored in the queue
+ * @return 1 if successful, 0 if 'q' or 'value' is NULL
+ */
+int ptl_rq_add(ptl_q_t q, void *value);
+
+/**
+ * This is a dummy function. Adding to a ring queue never waits. It simply
+ * calls ptl_rq_add().
+ *
+ * @param q non-null queue to add the value
+ * @param value data that will be added to the queue
+ * @param timeout this parameter is ignored
+ * @return 1 if successful, 0 otherwise
+ * @see ptl_rq_add()
+ **/
+int ptl_rq_add_wait(ptl_q_t q, void *value, long timeout);
+
+/**
+ * Removes all of the elements from this queue. The 'values' are not freed.
+ * Elements removed this way are not counted as dropped.
+ *
+ * @param q non-null queue to be cleared
+ * @see ptl_rq_clear_freefunc()
+ */
+void ptl_rq_clear(ptl_q_t q);
+
+/**
+ * Removes all of the elements from this queue, calling free_func on each
+ * 'value' that is still in the ring.
+ *
+ * @param q non-null queue to be cleared
+ * @param free_func function that will be used to free the 'value' elements
+ * @see ptl_rq_clear()
+ */
+void ptl_rq_clear_freefunc(ptl_q_t q, void (*free_func)(void *));
+
+/**
+ * Retrieves, but does not remove, the oldest element in this queue.
+ *
+ * @param q non-null queue to peek on
+ * @return pointer to the head element or NULL if no element was found
+ */
+void* ptl_rq_peek(ptl_q_t q);
+
+/**
+ * Retrieves and removes the oldest element in this queue. It will return null
+ * if the queue is empty.
+ *
+ * @param q non-null queue to get an element from
+ * @return the head element or NULL if no element was found
+ */
+void* ptl_rq_get(ptl_q_t q);
+
+/**
+ * Retrieves and removes the oldest element in this queue, waiting up to the
+ * specified wait time if necessary for an element to become available.
+ *
+ * @param q non-null queue to get an element from
+ * @param timeout number of milliseconds to wait
+ * @return the head element or NULL if no element was found
+ */
+void* ptl_rq_get_wait(ptl_q_t q, long timeout);
+
+/**
+ * Copies the unread elements, oldest first, into 'values' without removing
+ * them. The copy is checked against the producers that keep adding while it
+ * is made: write_pos is read before and after, and each slot's sequence
+ * number is checked against the ticket it should hold. If a producer lapped
+ * part of the copy, it is made again, up to a few times, then the lapped
+ * (oldest) part is trimmed. Either way every copied 'value' was in the ring
+ * at the same time, when the copy ended, and there is no gap between them
+ * other than elements that were not published yet or were dropped. If
+ * there are more than 'max_values' elements, the newest 'max_values' are
+ * copied.
+ *
+ * @param q non-null queue to copy
+ * @param values array of at least 'max_values' pointers
+ * @param max_values size of 'values'
+ * @return number of values copied
+ */
+long ptl_rq_snapshot(ptl_q_t q, void **values, long max_values);
+
+/**
+ * Returns the number of elements that were overwritten before being read.
+ *
+ * @param q non-null queue
+ * @return number of dropped elements
+ */
+unsigned long ptl_rq_get_drop_count(ptl_q_t q);
+
+/**
+ * Returns the number of new elements a producer dropped because a producer
+ * from the lap before was still writing the slot. These are also counted by
+ * ptl_rq_get_drop_count() once a reader gets to them.
+ *
+ * @param q non-null queue
+ * @return number of new elements dropped
+ */
+unsigned long ptl_rq_get_drop_newest_count(ptl_q_t q);
+
+
+#endif
@@ -0,0 +1,438 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+#include "ptl_allocator.h"
+#include "ptl_task.h"
+#include "ptl_thread_manager.h"
+#include "ptl_scheduler.h"
+#include "ptl_util.h"
+
+
+/* Private Functions */
+ptl_scheduled_t _ptl_scheduled_create(ptl_thread_manager_t manager, void (*function)(void *), void *arg,
+									  long delay, long long period);
+void _ptl_scheduled_release(ptl_scheduled_t scheduled);
+ptl_scheduler_t _ptl_scheduler_get(ptl_thread_manager_t manager);
+void *_ptl_scheduler_timer(void *arg);
+void _ptl_scheduler_run(void *arg);
+void _ptl_scheduler_reject(void *arg);
+void _ptl_scheduler_push(ptl_scheduler_t scheduler, ptl_scheduled_t scheduled);
+void _ptl_scheduler_remove(ptl_scheduler_t scheduler, ptl_scheduled_t scheduled);
+void _ptl_scheduler_sift_up(ptl_scheduler_t scheduler, long i);
+void _ptl_scheduler_sift_down(ptl_scheduler_t scheduler, long i);
+void _ptl_scheduler_place(ptl_scheduler_t scheduler, long i, ptl_scheduled_t scheduled);
+
+
+/* run once, 'delay' ms from now */
+ptl_scheduled_t schedule(ptl_thread_manager_t manager, void (*function)(void *), void *arg, long delay){
+	return _ptl_scheduled_create(manager, function, arg, delay, 0);
+}
+
+
+/* run every 'period' ms, counted from when each run was due */
+ptl_scheduled_t schedule_at_fixed_rate(ptl_thread_manager_t manager, void (*function)(void *), void *arg,
+									   long initial_delay, long period){
+	if(period <= 0){ return NULL; }
+
+	return _ptl_scheduled_create(manager, function, arg, initial_delay, period * 1000LL);
+}
+
+
+/* run 'delay' ms after each run returns */
+ptl_scheduled_t schedule_with_fixed_delay(ptl_thread_manager_t manager, void (*function)(void *), void *arg,
+										  long initial_delay, long delay){
+	if(delay <= 0){ return NULL; }
+
+	return _ptl_scheduled_create(manager, function, arg, initial_delay, -(delay * 1000LL));
+}
+
+
+/* take it out of the heap, or keep a periodic one from going back in */
+int ptl_scheduled_cancel(ptl_scheduled_t scheduled){
+	if(scheduled == NULL){ return 0; }
+
+	ptl_scheduler_t scheduler = scheduled->scheduler;
+	int cancelled = 0;
+	int release = 0;
+
+	pthread_mutex_lock(&(scheduler->mutex)); // lock
+	__atomic_store_n(&(scheduled->cancelled), 1, __ATOMIC_RELEASE);
+
+	if(scheduled->state == PTL_SCHEDULED_WAITING){
+		_ptl_scheduler_remove(scheduler, scheduled);
+		__atomic_store_n(&(scheduled->state), PTL_SCHEDULED_CANCELLED, __ATOMIC_RELEASE);
+		cancelled = 1;
+		release = 1; // the heap's hold
+	} else if(scheduled->state == PTL_SCHEDULED_SUBMITTED && scheduled->period != 0){
+		cancelled = 1; // the run finishes it (see _ptl_scheduler_run)
+	}
+	pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+
+	if(release){
+		_ptl_scheduled_release(scheduled);
+	}
+
+	return cancelled;
+}
+
+
+/* runs that have returned */
+long ptl_scheduled_get_runs(ptl_scheduled_t scheduled){
+	if(scheduled == NULL){ return 0; }
+
+	return __atomic_load_n(&(scheduled->runs), __ATOMIC_ACQUIRE);
+}
+
+
+/* runs the manager rejected */
+long ptl_scheduled_get_rejections(ptl_scheduled_t scheduled){
+	if(scheduled == NULL){ return 0; }
+
+	return __atomic_load_n(&(scheduled->rejections), __ATOMIC_ACQUIRE);
+}
+
+
+/* done, cancelled or rejected */
+int ptl_scheduled_is_done(ptl_scheduled_t scheduled){
+	if(scheduled == NULL){ return 1; }
+
+	// a cancelled periodic function may still have a run going, but no more to start
+	if(scheduled->period != 0 && __atomic_load_n(&(scheduled->cancelled), __ATOMIC_ACQUIRE)){
+		return 1;
+	}
+	return __atomic_load_n(&(scheduled->state), __ATOMIC_ACQUIRE) >= PTL_SCHEDULED_DONE;
+}
+
+
+/* the caller is done with the handle */
+void ptl_scheduled_destroy(ptl_scheduled_t scheduled){
+	if(scheduled == NULL){ return; }
+
+	_ptl_scheduled_release(scheduled);
+}
+
+
+/* cancel everything waiting and let the timer thread go */
+void ptl_scheduler_stop(ptl_thread_manager_t manager){
+	if(manager == NULL){ return; }
+
+	ptl_scheduler_t scheduler = __atomic_load_n(&(manager->scheduler), __ATOMIC_ACQUIRE);
+	if(scheduler == NULL){ return; }
+
+	pthread_mutex_lock(&(scheduler->mutex)); // lock
+	scheduler->stopped = 1;
+
+	long i = 0;
+	for(i=0; i<scheduler->size; i++){
+		ptl_scheduled_t scheduled = scheduler->heap[i];
+		scheduled->index = -1;
+		__atomic_store_n(&(scheduled->state), PTL_SCHEDULED_CANCELLED, __ATOMIC_RELEASE);
+		_ptl_scheduled_release(scheduled); // the heap's hold
+	}
+	scheduler->size = 0;
+
+	ptl_free(scheduler->allocator, scheduler->heap, scheduler->capacity * sizeof(ptl_scheduled_t));
+	scheduler->heap = NULL;
+	scheduler->capacity = 0;
+
+	pthread_cond_signal(&(scheduler->cond));
+	pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+}
+
+
+/* Private Functions */
+
+/* a new handle, in the heap. 'period' is in usec */
+ptl_scheduled_t _ptl_scheduled_create(ptl_thread_manager_t manager, void (*function)(void *), void *arg,
+									  long delay, long long period){
+	if(manager == NULL || function == NULL){ return NULL; }
+
+	ptl_scheduler_t scheduler = _ptl_scheduler_get(manager);
+	if(scheduler == NULL){ return NULL; } // shut down
+
+	ptl_scheduled_t scheduled =
+		(ptl_scheduled_t)ptl_alloc(scheduler->allocator, sizeof(struct ptl_scheduled));
+
+	scheduled->function = function;
+	scheduled->arg = arg;
+	scheduled->time = ptl_get_time_usec() + ((delay > 0) ? delay * 1000LL : 0);
+	scheduled->period = period;
+	scheduled->state = PTL_SCHEDULED_WAITING;
+	scheduled->cancelled = 0;
+	scheduled->refs = 2; // the caller and the heap
+	scheduled->index = -1;
+	scheduled->runs = 0;
+	scheduled->rejections = 0;
+	scheduled->scheduler = scheduler;
+
+	pthread_mutex_lock(&(scheduler->mutex)); // lock
+	if(scheduler->stopped){
+		pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+		ptl_free(scheduler->allocator, scheduled, sizeof(struct ptl_scheduled));
+		return NULL;
+	}
+
+	_ptl_scheduler_push(scheduler, scheduled);
+
+	// the timer thread sleeps until the old first one is due
+	if(scheduled->index == 0){
+		pthread_cond_signal(&(scheduler->cond));
+	}
+	pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+
+	return scheduled;
+}
+
+/* drops a hold, the last one out frees the handle */
+void _ptl_scheduled_release(ptl_scheduled_t scheduled){
+	if(__atomic_sub_fetch(&(scheduled->refs), 1, __ATOMIC_ACQ_REL) == 0){
+		ptl_free(scheduled->scheduler->allocator, scheduled, sizeof(struct ptl_scheduled));
+	}
+}
+
+/* the manager's scheduler, started on first use. NULL once shut down */
+ptl_scheduler_t _ptl_scheduler_get(ptl_thread_manager_t manager){
+	ptl_scheduler_t scheduler = __atomic_load_n(&(manager->scheduler), __ATOMIC_ACQUIRE);
+	if(scheduler != NULL){ return scheduler; }
+
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	scheduler = manager->scheduler;
+
+	if(scheduler == NULL && manager->run_state == PTL_RUNNING){
+		ptl_allocator_t allocator = ptl_resolve_allocator(NULL);
+
+		scheduler = (ptl_scheduler_t)ptl_calloc(allocator, 1, sizeof(struct ptl_scheduler));
+		scheduler->manager = manager;
+		scheduler->allocator = allocator;
+		scheduler->capacity = PTL_SCHEDULER_INITIAL_SIZE;
+		scheduler->heap = (ptl_scheduled_t *)ptl_alloc(allocator, scheduler->capacity * sizeof(ptl_scheduled_t));
+		scheduler->size = 0;
+		scheduler->stopped = 0;
+
+		// due times are on the clock ptl_get_time_usec() reads
+		pthread_condattr_t cond_attr;
+		pthread_condattr_init(&cond_attr);
+		pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&(scheduler->cond), &cond_attr);
+		pthread_condattr_destroy(&cond_attr);
+		pthread_mutex_init(&(scheduler->mutex), NULL);
+
+		pthread_attr_t attr;
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		int rc = pthread_create(&(scheduler->thread), &attr, _ptl_scheduler_timer, scheduler);
+		pthread_attr_destroy(&attr);
+		assert(rc == 0);
+
+		__atomic_store_n(&(manager->scheduler), scheduler, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+
+	return scheduler;
+}
+
+/* the timer thread, submits each function when it is due */
+void *_ptl_scheduler_timer(void *arg){
+	ptl_scheduler_t scheduler = (ptl_scheduler_t)arg;
+	ptl_thread_manager_t manager = scheduler->manager;
+	ptl_allocator_t allocator = (manager->thread_pool != NULL) ? manager->thread_pool->allocator : NULL;
+
+	pthread_mutex_lock(&(scheduler->mutex)); // lock
+	while(!scheduler->stopped){
+		if(scheduler->size == 0){
+			pthread_cond_wait(&(scheduler->cond), &(scheduler->mutex));
+			continue;
+		}
+
+		ptl_scheduled_t scheduled = scheduler->heap[0];
+		if(scheduled->time > ptl_get_time_usec()){
+			// until it is due, or something earlier comes in
+			struct timespec ts;
+			ts.tv_sec = scheduled->time / 1000000LL;
+			ts.tv_nsec = (scheduled->time % 1000000LL) * 1000;
+			pthread_cond_timedwait(&(scheduler->cond), &(scheduler->mutex), &ts);
+			continue;
+		}
+
+		// due, the heap's hold goes with the task
+		_ptl_scheduler_remove(scheduler, scheduled);
+		__atomic_store_n(&(scheduled->state), PTL_SCHEDULED_SUBMITTED, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+
+		ptl_task_t task = create_task_with_arg(_ptl_scheduler_run, scheduled, allocator);
+		task->rejected = _ptl_scheduler_reject;
+		submit_task(manager, task);
+
+		pthread_mutex_lock(&(scheduler->mutex)); // lock
+	}
+	pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+
+	return NULL;
+}
+
+/* the task: run the function, then put a periodic one back in the heap */
+void _ptl_scheduler_run(void *arg){
+	ptl_scheduled_t scheduled = (ptl_scheduled_t)arg;
+	ptl_scheduler_t scheduler = scheduled->scheduler;
+
+	scheduled->function(scheduled->arg);
+
+	pthread_mutex_lock(&(scheduler->mutex)); // lock
+	__atomic_add_fetch(&(scheduled->runs), 1, __ATOMIC_RELEASE);
+
+	if(scheduled->period != 0 && !scheduled->cancelled && !scheduler->stopped){
+		if(scheduled->period > 0){
+			scheduled->time += scheduled->period; // fixed rate
+		} else {
+			scheduled->time = ptl_get_time_usec() - scheduled->period; // fixed delay
+		}
+		__atomic_store_n(&(scheduled->state), PTL_SCHEDULED_WAITING, __ATOMIC_RELEASE);
+		_ptl_scheduler_push(scheduler, scheduled);
+
+		if(scheduled->index == 0){
+			pthread_cond_signal(&(scheduler->cond));
+		}
+		pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+		return; // the heap has the hold again
+	}
+
+	int state = (scheduled->period == 0) ? PTL_SCHEDULED_DONE : PTL_SCHEDULED_CANCELLED;
+	__atomic_store_n(&(scheduled->state), state, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+
+	_ptl_scheduled_release(scheduled);
+}
+
+/* the manager rejected a run. An overloaded manager only loses that run of
+   a periodic function, the next one is put back in the heap */
+void _ptl_scheduler_reject(void *arg){
+	ptl_scheduled_t scheduled = (ptl_scheduled_t)arg;
+	ptl_scheduler_t scheduler = scheduled->scheduler;
+	int running = (__atomic_load_n(&(scheduler->manager->run_state), __ATOMIC_ACQUIRE) == PTL_RUNNING);
+
+	pthread_mutex_lock(&(scheduler->mutex)); // lock
+	__atomic_add_fetch(&(scheduled->rejections), 1, __ATOMIC_RELEASE);
+
+	if(scheduled->period != 0 && !scheduled->cancelled && !scheduler->stopped && running){
+		long long now = ptl_get_time_usec();
+
+		if(scheduled->period > 0){
+			// the next period still to come, retrying a missed one at once
+			// would only hit the full queue again
+			while(scheduled->time <= now){
+				scheduled->time += scheduled->period;
+			}
+		} else {
+			scheduled->time = now - scheduled->period;
+		}
+		__atomic_store_n(&(scheduled->state), PTL_SCHEDULED_WAITING, __ATOMIC_RELEASE);
+		_ptl_scheduler_push(scheduler, scheduled);
+
+		if(scheduled->index == 0){
+			pthread_cond_signal(&(scheduler->cond));
+		}
+		pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+		return; // the heap has the hold again
+	}
+
+	int state = (scheduled->period == 0) ? PTL_SCHEDULED_DONE : PTL_SCHEDULED_CANCELLED;
+	__atomic_store_n(&(scheduled->state), state, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&(scheduler->mutex)); // unlock
+
+	_ptl_scheduled_release(scheduled);
+}
+
+/* adds to the heap, growing it if full. The mutex must be held */
+void _ptl_scheduler_push(ptl_scheduler_t scheduler, ptl_scheduled_t scheduled){
+	if(scheduler->size == scheduler->capacity){
+		long capacity = scheduler->capacity * 2;
+		ptl_scheduled_t *heap = (ptl_scheduled_t *)ptl_alloc(scheduler->allocator, capacity * sizeof(ptl_scheduled_t));
+
+		memcpy(heap, scheduler->heap, scheduler->size * sizeof(ptl_scheduled_t));
+		ptl_free(scheduler->allocator, scheduler->heap, scheduler->capacity * sizeof(ptl_scheduled_t));
+
+		scheduler->heap = heap;
+		scheduler->capacity = capacity;
+	}
+
+	_ptl_scheduler_place(scheduler, scheduler->size, scheduled);
+	scheduler->size++;
+	_ptl_scheduler_sift_up(scheduler, scheduled->index);
+}
+
+/* takes it out of the heap wherever it is. The mutex must be held */
+void _ptl_scheduler_remove(ptl_scheduler_t scheduler, ptl_scheduled_t scheduled){
+	long i = scheduled->index;
+	scheduled->index = -1;
+
+	scheduler->size--;
+	if(i == scheduler->size){ return; } // it was last
+
+	// the last one fills the hole, then goes whichever way it has to
+	_ptl_scheduler_place(scheduler, i, scheduler->heap[scheduler->size]);
+	_ptl_scheduler_sift_up(scheduler, i);
+	_ptl_scheduler_sift_down(scheduler, scheduler->heap[i]->index);
+}
+
+/* moves heap[i] up past anything due later */
+void _ptl_scheduler_sift_up(ptl_scheduler_t scheduler, long i){
+	ptl_scheduled_t scheduled = scheduler->heap[i];
+
+	while(i > 0){
+		long parent = (i - 1) / 2;
+		if(scheduler->heap[parent]->time <= scheduled->time){ break; }
+
+		_ptl_scheduler_place(scheduler, i, scheduler->heap[parent]);
+		i = parent;
+	}
+	_ptl_scheduler_place(scheduler, i, scheduled);
+}
+
+/* moves heap[i] down past anything due sooner */
+void _ptl_scheduler_sift_down(ptl_scheduler_t scheduler, long i){
+	ptl_scheduled_t scheduled = scheduler->heap[i];
+
+	while(1){
+		long child = (2 * i) + 1;
+		if(child >= scheduler->size){ break; }
+
+		if(child + 1 < scheduler->size && scheduler->heap[child + 1]->time < scheduler->heap[child]->time){
+			child++;
+		}
+		if(scheduled->time <= scheduler->heap[child]->time){ break; }
+
+		_ptl_scheduler_place(scheduler, i, scheduler->heap[child]);
+		i = child;
+	}
+	_ptl_scheduler_place(scheduler, i, scheduled);
+}
+
+/* puts it in slot 'i' and remembers where */
+void _ptl_scheduler_place(ptl_scheduler_t scheduler, long i, ptl_scheduled_t scheduled){
+	scheduler->heap[i] = scheduled;
+	scheduled->index = i;
+}
@@ -0,0 +1,206 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * Runs functions on a thread manager after a delay, or periodically.
+ *
+ * Every manager that has something scheduled gets one scheduler: a timer
+ * thread and a min-heap of the scheduled functions, ordered by the time
+ * they are due. The timer thread sleeps until the earliest one is due, then
+ * submits it to the manager as a task, so it runs on the manager's workers
+ * like any other task (and goes through work_q and the rejection policy).
+ * Scheduling, cancelling and releasing a function are O(log n) in the
+ * number scheduled, and any number of them cost the one thread.
+ *
+ * A periodic function is put back in the heap when a run returns, so runs
+ * of the same function never overlap. At a fixed rate, the next run is due
+ * one period after the last one was due; if runs fall behind, the late ones
+ * are submitted right away. With a fixed delay, the next run is due one
+ * delay after the last one returned.
+ *
+ * The timer thread only submits; it never runs a function itself, whatever
+ * the manager's rejected_handler (under ptl_q_caller_runs_policy() an
+ * overloaded manager rejects the run instead). A periodic function whose
+ * run is rejected because the manager is overloaded skips that run and is
+ * due again at its next period (fixed rate) or one delay later (fixed
+ * delay); ptl_scheduled_get_rejections() counts the runs lost this way. A
+ * function that runs once is done when its run is rejected.
+ *
+ * Times are in milliseconds, on the clock ptl_get_time_usec() reads.
+ *
+ * The handle is shared by the caller and the scheduler; the caller must
+ * call ptl_scheduled_destroy() when it is done with it. Destroying the
+ * handle does not cancel the function.
+ */
+
+
+#ifndef __PTL_SCHEDULER_H__
+#define __PTL_SCHEDULER_H__
+
+#include <pthread.h>
+#include "ptl_allocator.h"
+#include "ptl_thread_manager.h"
+
+/* Defines */
+#define PTL_SCHEDULER_INITIAL_SIZE 64	/**< heap slots of a new scheduler */
+
+/* Scheduled states */
+#define PTL_SCHEDULED_WAITING   0	/**< in the heap, waiting to be due */
+#define PTL_SCHEDULED_SUBMITTED 1	/**< handed to the manager, may be running */
+#define PTL_SCHEDULED_DONE      2	/**< ran once, or its one run was rejected */
+#define PTL_SCHEDULED_CANCELLED 3	/**< cancelled, or the manager was shut down */
+
+/* Structures */
+
+/* A function that is scheduled */
+struct ptl_scheduled {
+	void (*function)(void *);		/**< function to run */
+	void *arg;						/**< passed to 'function' */
+	long long time;					/**< when the next run is due, usec */
+	long long period;				/**< usec, > 0 fixed rate, < 0 fixed delay, 0 once */
+	int state;						/**< PTL_SCHEDULED_WAITING, _SUBMITTED, ... */
+	int cancelled;					/**< set by ptl_scheduled_cancel() */
+	int refs;						/**< holders: the caller and the scheduler */
+	long index;						/**< position in the heap, -1 if not in it */
+	long runs;						/**< number of runs that returned */
+	long rejections;				/**< number of runs the manager rejected */
+	struct ptl_scheduler *scheduler;	/**< scheduler it belongs to */
+};
+
+/* The timer of a manager */
+struct ptl_scheduler {
+	ptl_thread_manager_t manager;	/**< manager the functions are submitted to */
+	struct ptl_scheduled **heap;	/**< min-heap on 'time' */
+	long size;						/**< functions in the heap */
+	long capacity;					/**< slots in the heap */
+	int stopped;					/**< set when the manager shuts down */
+	pthread_mutex_t mutex;			/**< held on any change to the heap */
+	pthread_cond_t cond;			/**< the timer thread waits here */
+	pthread_t thread;				/**< the timer thread */
+	ptl_allocator_t allocator;		/**< where the heap and handles come from */
+};
+
+/* Type Definitions */
+typedef struct ptl_scheduled *ptl_scheduled_t;
+typedef struct ptl_scheduler *ptl_scheduler_t;
+
+
+/* Public Functions */
+
+/**
+ * Submits 'function' to 'manager', to be called with 'arg', once 'delay'
+ * milliseconds have passed.
+ * To finish using the handle, be sure to call ptl_scheduled_destroy().
+ *
+ * @param manager manager to run the function
+ * @param function function to run
+ * @param arg passed to 'function'
+ * @param delay milliseconds from now, 0 or less to submit it at once
+ * @return the handle, NULL if the parameters are bad or the manager is shut down
+ */
+ptl_scheduled_t schedule(ptl_thread_manager_t manager, void (*function)(void *), void *arg, long delay);
+
+/**
+ * Submits 'function' to 'manager' after 'initial_delay' milliseconds, then
+ * every 'period' milliseconds from then on, until it is cancelled or the
+ * manager is shut down.
+ * To finish using the handle, be sure to call ptl_scheduled_destroy().
+ *
+ * @param manager manager to run the function
+ * @param function function to run
+ * @param arg passed to 'function'
+ * @param initial_delay milliseconds before the first run
+ * @param period milliseconds between the times runs are due, at least 1
+ * @return the handle, NULL if the parameters are bad or the manager is shut down
+ */
+ptl_scheduled_t schedule_at_fixed_rate(ptl_thread_manager_t manager, void (*function)(void *), void *arg,
+									   long initial_delay, long period);
+
+/**
+ * Submits 'function' to 'manager' after 'initial_delay' milliseconds, then
+ * 'delay' milliseconds after each run returns, until it is cancelled or the
+ * manager is shut down.
+ * To finish using the handle, be sure to call ptl_scheduled_destroy().
+ *
+ * @param manager manager to run the function
+ * @param function function to run
+ * @param arg passed to 'function'
+ * @param initial_delay milliseconds before the first run
+ * @param delay milliseconds between a run returning and the next one, at least 1
+ * @return the handle, NULL if the parameters are bad or the manager is shut down
+ */
+ptl_scheduled_t schedule_with_fixed_delay(ptl_thread_manager_t manager, void (*function)(void *), void *arg,
+										  long initial_delay, long delay);
+
+/**
+ * Cancels a scheduled function. A run that has already been submitted is
+ * not stopped, but a periodic function is not run again.
+ *
+ * @param scheduled handle of the function
+ * @return 1 if a run was cancelled, 0 if it had no runs left
+ */
+int ptl_scheduled_cancel(ptl_scheduled_t scheduled);
+
+/**
+ * Gets the number of runs of a scheduled function that have returned.
+ *
+ * @param scheduled handle of the function
+ * @return number of runs
+ */
+long ptl_scheduled_get_runs(ptl_scheduled_t scheduled);
+
+/**
+ * Gets the number of runs of a scheduled function that the manager rejected,
+ * because it was overloaded or shut down.
+ *
+ * @param scheduled handle of the function
+ * @return number of rejected runs
+ */
+long ptl_scheduled_get_rejections(ptl_scheduled_t scheduled);
+
+/**
+ * Checks if a scheduled function has no runs left to start: it ran once (if
+ * it is not periodic), was cancelled or rejected, or the manager shut down.
+ * A periodic function cancelled in the middle of a run is done at once,
+ * though that run may still be going.
+ *
+ * @param scheduled handle of the function
+ * @return 1 if it has no runs left, 0 otherwise
+ */
+int ptl_scheduled_is_done(ptl_scheduled_t scheduled);
+
+/**
+ * Lets go of the caller's hold on a handle. The handle must not be used
+ * afterwards. The function stays scheduled.
+ *
+ * @param scheduled handle to let go of
+ */
+void ptl_scheduled_destroy(ptl_scheduled_t scheduled);
+
+/**
+ * Stops the scheduler of a manager: the timer thread exits and every
+ * function still waiting is cancelled. Called by shutdown() and
+ * shutdown_now(); runs already submitted are up to the manager.
+ *
+ * @param manager manager whose scheduler to stop, may have none
+ */
+void ptl_scheduler_stop(ptl_thread_manager_t manager);
+
+#endif
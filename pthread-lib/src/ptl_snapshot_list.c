@@ -0,0 +1,375 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_allocator.h"
+#include "ptl_array_list.h"
+#include "ptl_snapshot_list.h"
+#include "ptl_util.h"
+
+
+/* Private Functions */
+struct ptl_sl_version *_ptl_sl_create_version(ptl_snapshot_list_t list, int size);
+struct ptl_sl_version *_ptl_sl_copy_version(ptl_snapshot_list_t list, struct ptl_sl_version *version, int size);
+void _ptl_sl_free_version(ptl_snapshot_list_t list, struct ptl_sl_version *version);
+void _ptl_sl_publish_version(ptl_snapshot_list_t list, struct ptl_sl_version *version);
+int _ptl_sl_stripe();
+
+
+/* Global Variables */
+
+/* spreads threads over the reader counters */
+unsigned int ptl_sl_next_stripe = 0;
+__thread int ptl_sl_stripe = -1;
+
+
+/* creates a list with an empty snapshot */
+ptl_snapshot_list_t ptl_sl_create_snapshot_list(){
+	return ptl_sl_create_snapshot_list_allocator(NULL);
+}
+
+
+/* creates a list with an empty snapshot, all memory from 'allocator' */
+ptl_snapshot_list_t ptl_sl_create_snapshot_list_allocator(ptl_allocator_t allocator){
+	allocator = ptl_resolve_allocator(allocator);
+
+	ptl_snapshot_list_t list = (ptl_snapshot_list_t)ptl_calloc(allocator, 1, sizeof(struct ptl_snapshot_list));
+
+	list->allocator = allocator;
+	list->current = _ptl_sl_create_version(list, 0);
+	list->epoch = 0;
+	pthread_mutex_init(&(list->write_mutex), NULL);
+
+	return list;
+}
+
+
+/* frees the list and its snapshot, but not the elements */
+int ptl_sl_destroy_snapshot_list(ptl_snapshot_list_t list){
+	return ptl_sl_destroy_snapshot_list_freefunc(list, NULL);
+}
+
+
+/* frees the list and its snapshot, freeing the elements with 'free_func' */
+int ptl_sl_destroy_snapshot_list_freefunc(ptl_snapshot_list_t list, void (*free_func)(void *)){
+	if(list == NULL){ return 0; }
+
+	int i = 0;
+	if(free_func != NULL){
+		for(i=0; i<list->current->size; i++){
+			free_func(list->current->array[i]);
+		}
+	}
+
+	pthread_mutex_destroy(&(list->write_mutex));
+	_ptl_sl_free_version(list, list->current);
+	ptl_free(list->allocator, list, sizeof(struct ptl_snapshot_list));
+
+	return 1;
+}
+
+
+/* count ourselves as a reader, then take the current snapshot */
+void ptl_sl_read_begin(ptl_snapshot_list_t list, struct ptl_sl_reader *reader){
+	assert(list && reader);
+
+	int stripe = _ptl_sl_stripe();
+	unsigned long epoch = 0;
+	long *counter = NULL;
+
+	while(1){
+		epoch = __atomic_load_n(&(list->epoch), __ATOMIC_SEQ_CST);
+		counter = &(list->counters[epoch & 1][stripe].readers);
+		__atomic_fetch_add(counter, 1, __ATOMIC_SEQ_CST);
+
+		// if a writer flipped the epoch before we were counted, it may not
+		// wait for us, so count ourselves under the new parity instead
+		if(__atomic_load_n(&(list->epoch), __ATOMIC_SEQ_CST) == epoch){
+			break;
+		}
+		__atomic_fetch_sub(counter, 1, __ATOMIC_RELEASE);
+	}
+
+	struct ptl_sl_version *version = __atomic_load_n(&(list->current), __ATOMIC_ACQUIRE);
+
+	reader->size = version->size;
+	reader->array = version->array;
+	reader->counter = counter;
+}
+
+
+/* we are done with the snapshot */
+void ptl_sl_read_end(ptl_snapshot_list_t list, struct ptl_sl_reader *reader){
+	assert(list && reader && reader->counter);
+
+	__atomic_fetch_sub(reader->counter, 1, __ATOMIC_RELEASE);
+
+	reader->size = 0;
+	reader->array = NULL;
+	reader->counter = NULL;
+}
+
+
+/* reads one element */
+void *ptl_sl_get(ptl_snapshot_list_t list, int index){
+	if(list == NULL || index < 0){ return NULL; }
+
+	struct ptl_sl_reader reader;
+	void *value = NULL;
+
+	ptl_sl_read_begin(list, &reader);
+	if(index < reader.size){
+		value = reader.array[index];
+	}
+	ptl_sl_read_end(list, &reader);
+
+	return value;
+}
+
+
+/* size of the current snapshot */
+int ptl_sl_size(ptl_snapshot_list_t list){
+	if(list == NULL){ return 0; }
+
+	struct ptl_sl_reader reader;
+
+	ptl_sl_read_begin(list, &reader);
+	int size = reader.size;
+	ptl_sl_read_end(list, &reader);
+
+	return size;
+}
+
+
+/* searches the current snapshot */
+int ptl_sl_contains(ptl_snapshot_list_t list, void *value){
+	if(list == NULL || value == NULL){ return 0; }
+
+	struct ptl_sl_reader reader;
+	int found = 0;
+	int i = 0;
+
+	ptl_sl_read_begin(list, &reader);
+	for(i=0; i<reader.size; i++){
+		if(reader.array[i] == value){
+			found = 1;
+			break;
+		}
+	}
+	ptl_sl_read_end(list, &reader);
+
+	return found;
+}
+
+
+/* publish a copy with 'value' on the end */
+int ptl_sl_add(ptl_snapshot_list_t list, void *value){
+	if(list == NULL || value == NULL){ return 0; }
+
+	pthread_mutex_lock(&(list->write_mutex)); // lock
+
+	int size = list->current->size;
+	struct ptl_sl_version *version = _ptl_sl_copy_version(list, list->current, size + 1);
+	version->array[size] = value;
+
+	_ptl_sl_publish_version(list, version);
+
+	pthread_mutex_unlock(&(list->write_mutex)); // unlock
+
+	return 1;
+}
+
+
+/* publish a copy with 'index' replaced */
+void *ptl_sl_set(ptl_snapshot_list_t list, void *value, int index){
+	if(list == NULL || value == NULL || index < 0){ return NULL; }
+
+	void *old_value = NULL;
+
+	pthread_mutex_lock(&(list->write_mutex)); // lock
+
+	if(index < list->current->size){
+		struct ptl_sl_version *version = _ptl_sl_copy_version(list, list->current, list->current->size);
+		old_value = version->array[index];
+		version->array[index] = value;
+
+		_ptl_sl_publish_version(list, version);
+	}
+
+	pthread_mutex_unlock(&(list->write_mutex)); // unlock
+
+	return old_value;
+}
+
+
+/* publish a copy without 'index' */
+void *ptl_sl_remove_index(ptl_snapshot_list_t list, int index){
+	if(list == NULL || index < 0){ return NULL; }
+
+	void *old_value = NULL;
+
+	pthread_mutex_lock(&(list->write_mutex)); // lock
+
+	struct ptl_sl_version *old_version = list->current;
+	if(index < old_version->size){
+		struct ptl_sl_version *version = _ptl_sl_create_version(list, old_version->size - 1);
+
+		memcpy(version->array, old_version->array, index * sizeof(void *));
+		memcpy(version->array + index, old_version->array + index + 1,
+			   (old_version->size - index - 1) * sizeof(void *));
+		old_value = old_version->array[index];
+
+		_ptl_sl_publish_version(list, version);
+	}
+
+	pthread_mutex_unlock(&(list->write_mutex)); // unlock
+
+	return old_value;
+}
+
+
+/* publish a copy without the first 'value' */
+void *ptl_sl_remove(ptl_snapshot_list_t list, void *value){
+	if(list == NULL || value == NULL){ return NULL; }
+
+	void *old_value = NULL;
+	int i = 0;
+
+	pthread_mutex_lock(&(list->write_mutex)); // lock
+
+	struct ptl_sl_version *old_version = list->current;
+	for(i=0; i<old_version->size; i++){
+		if(old_version->array[i] == value){ break; }
+	}
+
+	if(i < old_version->size){
+		struct ptl_sl_version *version = _ptl_sl_create_version(list, old_version->size - 1);
+
+		memcpy(version->array, old_version->array, i * sizeof(void *));
+		memcpy(version->array + i, old_version->array + i + 1,
+			   (old_version->size - i - 1) * sizeof(void *));
+		old_value = value;
+
+		_ptl_sl_publish_version(list, version);
+	}
+
+	pthread_mutex_unlock(&(list->write_mutex)); // unlock
+
+	return old_value;
+}
+
+
+/* publish the non-null elements of 'array_list' */
+int ptl_sl_publish(ptl_snapshot_list_t list, ptl_array_list_t array_list){
+	if(list == NULL || array_list == NULL){ return 0; }
+
+	// a sparse list may have holes, so count what is really there
+	int size = 0;
+	int i = 0;
+	for(i=0; i<array_list->capacity; i++){
+		if(array_list->array[i] != NULL){ size++; }
+	}
+
+	struct ptl_sl_version *version = _ptl_sl_create_version(list, size);
+
+	size = 0;
+	for(i=0; i<array_list->capacity; i++){
+		if(array_list->array[i] != NULL){
+			version->array[size++] = array_list->array[i];
+		}
+	}
+
+	pthread_mutex_lock(&(list->write_mutex)); // lock
+	_ptl_sl_publish_version(list, version);
+	pthread_mutex_unlock(&(list->write_mutex)); // unlock
+
+	return 1;
+}
+
+
+/* Private Functions */
+
+/* allocates a snapshot of 'size' elements */
+struct ptl_sl_version *_ptl_sl_create_version(ptl_snapshot_list_t list, int size){
+	struct ptl_sl_version *version = (struct ptl_sl_version *)ptl_alloc(list->allocator, 
+								sizeof(struct ptl_sl_version) + (size * sizeof(void *)));
+
+	version->size = size;
+
+	return version;
+}
+
+/* gives a snapshot back to the list's allocator */
+void _ptl_sl_free_version(ptl_snapshot_list_t list, struct ptl_sl_version *version){
+	ptl_free(list->allocator, version, sizeof(struct ptl_sl_version) + (version->size * sizeof(void *)));
+}
+
+/* copies the first 'size' elements of 'version' (or all of them, if it is
+   smaller) into a new snapshot of 'size' elements */
+struct ptl_sl_version *_ptl_sl_copy_version(ptl_snapshot_list_t list, struct ptl_sl_version *version, int size){
+	struct ptl_sl_version *copy = _ptl_sl_create_version(list, size);
+	int num_copy = (version->size < size) ? version->size : size;
+
+	memcpy(copy->array, version->array, num_copy * sizeof(void *));
+
+	return copy;
+}
+
+/**
+ * Makes 'version' the current snapshot and frees the old one once no reader
+ * can be using it. The write lock must be held.
+ *
+ * New readers see 'version' as soon as it is stored. The epoch is flipped
+ * after that, so a reader counted under the old parity may still have the
+ * old snapshot, but a reader counted under the new parity was counted after
+ * the flip and so took 'version'. Waiting for the old parity to drain is
+ * enough.
+ */
+void _ptl_sl_publish_version(ptl_snapshot_list_t list, struct ptl_sl_version *version){
+	struct ptl_sl_version *old_version = list->current;
+
+	__atomic_store_n(&(list->current), version, __ATOMIC_SEQ_CST);
+
+	unsigned long old_epoch = __atomic_fetch_add(&(list->epoch), 1, __ATOMIC_SEQ_CST);
+	struct ptl_sl_counter *counters = list->counters[old_epoch & 1];
+
+	int stripe = 0;
+	for(stripe=0; stripe<PTL_SL_STRIPES; stripe++){
+		while(__atomic_load_n(&(counters[stripe].readers), __ATOMIC_ACQUIRE) != 0){
+			ptl_timed_wait(100); // wait 100 microseconds
+		}
+	}
+
+	_ptl_sl_free_version(list, old_version);
+}
+
+/* the reader counter stripe of this thread, handed out round robin */
+int _ptl_sl_stripe(){
+	if(ptl_sl_stripe < 0){
+		ptl_sl_stripe = __atomic_fetch_add(&ptl_sl_next_stripe, 1, __ATOMIC_RELAXED) % PTL_SL_STRIPES;
+	}
+
+	return ptl_sl_stripe;
+}
@@ -0,0 +1,224 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is a read-mostly list (see the CopyOnWriteArrayList Javadoc)
+ * for data that every thread reads all the time and that rarely changes,
+ * like a routing table.
+ *
+ * Readers never take a lock. ptl_sl_read_begin() hands out the current
+ * snapshot: a plain array that nobody will change. The reader may use it for
+ * as long as it likes and gives it back with ptl_sl_read_end().
+ *
+ * Writers are serialized by a lock. Every change copies the current
+ * snapshot, changes the copy and publishes it in place of the old one. The
+ * old snapshot is freed once every reader that could still see it has
+ * called ptl_sl_read_end(); the writer waits for that before returning.
+ *
+ * Readers are counted in one of two sets of counters, picked by the parity
+ * of an epoch number that each writer flips. The counters are spread over
+ * cache lines by thread so readers on different cores don't fight over
+ * them. A writer only waits for the readers counted under the old parity.
+ */
+
+
+#ifndef __PTL_SNAPSHOT_LIST_H__
+#define __PTL_SNAPSHOT_LIST_H__
+
+#include <pthread.h>
+#include "ptl_allocator.h"
+#include "ptl_array_list.h"
+
+/* Defines */
+#define PTL_SL_STRIPES 32		/**< number of reader counters per parity */
+
+/* Structures */
+
+/* An immutable copy of the list */
+struct ptl_sl_version {
+	int size;					/**< number of elements */
+	void *array[];				/**< the elements */
+};
+
+/* A reader counter, alone on its cache line */
+struct ptl_sl_counter {
+	long readers;				/**< readers inside a read section */
+	char pad[64 - sizeof(long)];
+};
+
+struct ptl_snapshot_list {
+	struct ptl_sl_version *current;						/**< snapshot handed to new readers */
+	unsigned long epoch;								/**< parity picks the reader counters */
+	struct ptl_sl_counter counters[2][PTL_SL_STRIPES];	/**< readers per parity and stripe */
+	pthread_mutex_t write_mutex;						/**< serializes writers */
+	ptl_allocator_t allocator;							/**< where the list and its snapshots come from */
+};
+
+/* What a reader holds between ptl_sl_read_begin() and ptl_sl_read_end() */
+struct ptl_sl_reader {
+	int size;					/**< number of elements in the snapshot */
+	void **array;				/**< the snapshot, must not be changed */
+	long *counter;				/**< counter this reader is counted in */
+};
+
+/* Type Definitions */
+typedef struct ptl_snapshot_list *ptl_snapshot_list_t;
+
+
+/* Public Functions */
+
+/**
+ * Creates an empty snapshot list.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @return a fully initialized snapshot list
+ */
+ptl_snapshot_list_t ptl_sl_create_snapshot_list();
+
+/**
+ * Creates an empty snapshot list that takes itself and every snapshot from
+ * 'allocator' (see ptl_allocator.h). The allocator is called by writers
+ * only, never by readers.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param allocator allocator to use, NULL for the default
+ * @return a fully initialized snapshot list
+ */
+ptl_snapshot_list_t ptl_sl_create_snapshot_list_allocator(ptl_allocator_t allocator);
+
+/**
+ * Destroys a snapshot list. No thread may be reading or writing it.
+ *
+ * @param list snapshot list to be freed
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_sl_destroy_snapshot_list(ptl_snapshot_list_t list);
+
+/**
+ * Destroys a snapshot list, calling 'free_func' on each element. No thread
+ * may be reading or writing it.
+ *
+ * @param list snapshot list to be freed
+ * @param free_func function that will be used to free each element
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_sl_destroy_snapshot_list_freefunc(ptl_snapshot_list_t list, void (*free_func)(void *));
+
+/**
+ * Starts a read. 'reader' is filled in with the current snapshot, which
+ * stays valid and unchanged until ptl_sl_read_end() is called with the same
+ * 'reader'. This never blocks. Read sections may not be nested on the same
+ * list, and a thread must not write to the list while it is reading it.
+ *
+ * @param list snapshot list to read
+ * @param reader filled in with the snapshot
+ */
+void ptl_sl_read_begin(ptl_snapshot_list_t list, struct ptl_sl_reader *reader);
+
+/**
+ * Ends a read started with ptl_sl_read_begin(). The snapshot must not be
+ * used after this.
+ *
+ * @param list snapshot list that was read
+ * @param reader the reader given to ptl_sl_read_begin()
+ */
+void ptl_sl_read_end(ptl_snapshot_list_t list, struct ptl_sl_reader *reader);
+
+/**
+ * Gets the element at 'index' of the current snapshot.
+ *
+ * @param list snapshot list to read
+ * @param index position of the element
+ * @return the element, NULL if 'index' is out of range
+ */
+void *ptl_sl_get(ptl_snapshot_list_t list, int index);
+
+/**
+ * Gets the number of elements in the current snapshot.
+ *
+ * @param list snapshot list to read
+ * @return number of elements
+ */
+int ptl_sl_size(ptl_snapshot_list_t list);
+
+/**
+ * Checks if the current snapshot contains 'value' (pointers are compared).
+ *
+ * @param list snapshot list to search
+ * @param value value to find
+ * @return 1 if found, 0 otherwise
+ */
+int ptl_sl_contains(ptl_snapshot_list_t list, void *value);
+
+/**
+ * Publishes a new snapshot with 'value' appended. Returns once no reader
+ * can see the old snapshot.
+ *
+ * @param list snapshot list to change
+ * @param value non-null value to add
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_sl_add(ptl_snapshot_list_t list, void *value);
+
+/**
+ * Publishes a new snapshot with the element at 'index' replaced. Returns
+ * once no reader can see the old snapshot, so the old element may be freed
+ * right away.
+ *
+ * @param list snapshot list to change
+ * @param value non-null value to set
+ * @param index position to set, must be less than the size
+ * @return the element that was replaced, NULL if 'index' is out of range
+ */
+void *ptl_sl_set(ptl_snapshot_list_t list, void *value, int index);
+
+/**
+ * Publishes a new snapshot without the element at 'index'. Returns once no
+ * reader can see the old snapshot, so the element may be freed right away.
+ *
+ * @param list snapshot list to change
+ * @param index position to remove
+ * @return the element removed, NULL if 'index' is out of range
+ */
+void *ptl_sl_remove_index(ptl_snapshot_list_t list, int index);
+
+/**
+ * Publishes a new snapshot without the first element equal to 'value'.
+ * Returns once no reader can see the old snapshot, so 'value' may be freed
+ * right away.
+ *
+ * @param list snapshot list to change
+ * @param value value to remove
+ * @return 'value' if it was removed, NULL if it was not found
+ */
+void *ptl_sl_remove(ptl_snapshot_list_t list, void *value);
+
+/**
+ * Publishes a copy of the non-null elements of 'array_list' as the new
+ * snapshot, replacing everything. This is the way to make many changes at
+ * once. Returns once no reader can see the old snapshot.
+ *
+ * @param list snapshot list to change
+ * @param array_list elements of the new snapshot, in order
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_sl_publish(ptl_snapshot_list_t list, ptl_array_list_t array_list);
+
+#endif
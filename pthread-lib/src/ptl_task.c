@@ -24,18 +24,102 @@
 #include <malloc.h>
 #include <assert.h>
 #include <string.h>
+#include "ptl_allocator.h"
 #include "ptl_task.h"
 #include "ptl_util.h"
 
+
+/* Structures */
+
+/* A stack of cached tasks */
+struct ptl_task_magazine {
+	int count;							/**< tasks in it */
+	struct ptl_task_magazine *next;		/**< next one in the depot */
+	ptl_task_t tasks[PTL_TASK_MAGAZINE_SIZE];
+};
+
+/* A thread's magazines */
+struct ptl_task_cache {
+	struct ptl_task_magazine *loaded;	/**< created from and destroyed into first */
+	struct ptl_task_magazine *previous;	/**< the other one, swapped with 'loaded' */
+};
+
+
+/* Private Functions */
+ptl_task_t _ptl_task_alloc(ptl_allocator_t allocator);
+void _ptl_task_free(ptl_task_t task);
+struct ptl_task_cache *_ptl_task_get_cache();
+void _ptl_task_create_key();
+void _ptl_task_destroy_cache(void *arg);
+struct ptl_task_magazine *_ptl_task_new_magazine();
+struct ptl_task_magazine *_ptl_task_get_full(struct ptl_task_magazine *empty);
+struct ptl_task_magazine *_ptl_task_put_full(struct ptl_task_magazine *full);
+void _ptl_task_empty_magazine(struct ptl_task_magazine *magazine);
+
+
+/* Global Variables */
+__thread struct ptl_task_cache ptl_task_cache = {NULL, NULL};
+pthread_key_t ptl_task_cache_key;
+pthread_once_t ptl_task_cache_once = PTHREAD_ONCE_INIT;
+
+/* the depot, protected by ptl_task_depot_mutex */
+pthread_mutex_t ptl_task_depot_mutex = PTHREAD_MUTEX_INITIALIZER;
+struct ptl_task_magazine *ptl_task_depot_full = NULL;
+struct ptl_task_magazine *ptl_task_depot_empty = NULL;
+int ptl_task_depot_num_full = 0;
+
 /* create a task in dynamic memory */
 ptl_task_t create_task(void (*function_to_execute)(void*)){
+	return create_task_allocator(function_to_execute, NULL);
+}
+
+/* create a task from 'allocator' */
+ptl_task_t create_task_allocator(void (*function_to_execute)(void*), ptl_allocator_t allocator){
 	if(function_to_execute == NULL) { return NULL; }
 	
-	ptl_task_t task = (ptl_task_t)calloc(1, sizeof(struct ptl_task));
-	assert(task);
+	allocator = ptl_resolve_allocator(allocator);
+	
+	// not zeroed, the captures are only written when used
+	ptl_task_t task = _ptl_task_alloc(allocator);
 	
+	task->allocator = allocator;
 	task->function_to_execute = function_to_execute;
 	task->state = PTL_TASK_STATE_CREATED;
+	task->arg = NULL;
+	task->rejected = NULL;
+	task->captures_size = 0;
+	
+	return task;
+}
+
+/* create a task that is called with 'arg' */
+ptl_task_t create_task_with_arg(void (*function_to_execute)(void*), void *arg, ptl_allocator_t allocator){
+	ptl_task_t task = create_task_allocator(function_to_execute, allocator);
+	
+	if(task != NULL){
+		task->arg = arg;
+	}
+	
+	return task;
+}
+
+/* create a task with its own copy of 'captures', inside it if it fits */
+ptl_task_t create_task_inline(void (*function_to_execute)(void*), const void *captures, size_t size,
+							  ptl_allocator_t allocator){
+	if(captures == NULL && size > 0) { return NULL; }
+	
+	ptl_task_t task = create_task_allocator(function_to_execute, allocator);
+	if(task == NULL) { return NULL; }
+	
+	task->captures_size = size;
+	task->arg = task->captures;
+	
+	if(size > PTL_TASK_INLINE_SIZE){
+		task->arg = ptl_alloc(task->allocator, size);
+	}
+	if(size > 0){
+		memcpy(task->arg, captures, size);
+	}
 	
 	return task;
 }
@@ -44,5 +128,238 @@ ptl_task_t create_task(void (*function_to_execute)(void*)){
 void destroy_task(ptl_task_t task){
 	if(task == NULL) { return; }
 	   
-	FREE(task);
+	if(task->captures_size > PTL_TASK_INLINE_SIZE){
+		ptl_free(task->allocator, task->arg, task->captures_size);
+	}
+	_ptl_task_free(task);
+}
+
+/* tell the task's owner it won't run, then destroy it */
+void reject_task(ptl_task_t task){
+	if(task == NULL) { return; }
+	
+	task->state = PTL_TASK_STATE_REJECTED;
+	
+	if(task->rejected != NULL){
+		task->rejected(task->arg);
+	}
+	
+	destroy_task(task);
+}
+
+/* empty this thread's magazines and the depot */
+void ptl_task_trim_cache(){
+	struct ptl_task_cache *cache = &ptl_task_cache;
+	
+	if(cache->loaded != NULL){
+		_ptl_task_empty_magazine(cache->loaded);
+		_ptl_task_empty_magazine(cache->previous);
+	}
+	
+	pthread_mutex_lock(&ptl_task_depot_mutex); // lock
+	struct ptl_task_magazine *full = ptl_task_depot_full;
+	struct ptl_task_magazine *empty = ptl_task_depot_empty;
+	ptl_task_depot_full = NULL;
+	ptl_task_depot_empty = NULL;
+	__atomic_store_n(&ptl_task_depot_num_full, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&ptl_task_depot_mutex); // unlock
+	
+	while(full != NULL){
+		struct ptl_task_magazine *next = full->next;
+		_ptl_task_empty_magazine(full);
+		ptl_free(ptl_get_malloc_allocator(), full, sizeof(struct ptl_task_magazine));
+		full = next;
+	}
+	while(empty != NULL){
+		struct ptl_task_magazine *next = empty->next;
+		ptl_free(ptl_get_malloc_allocator(), empty, sizeof(struct ptl_task_magazine));
+		empty = next;
+	}
+}
+
+
+/* Private Functions */
+
+/* a task from this thread's magazines, the depot, or else 'allocator'.
+   Only malloc'd tasks are cached */
+ptl_task_t _ptl_task_alloc(ptl_allocator_t allocator){
+	if(allocator != ptl_get_malloc_allocator()){
+		return (ptl_task_t)ptl_alloc(allocator, sizeof(struct ptl_task));
+	}
+	
+	struct ptl_task_cache *cache = _ptl_task_get_cache();
+	struct ptl_task_magazine *loaded = cache->loaded;
+	
+	if(loaded->count > 0){
+		return loaded->tasks[--(loaded->count)];
+	}
+	
+	if(cache->previous->count > 0){
+		cache->loaded = cache->previous;
+		cache->previous = loaded;
+		return cache->loaded->tasks[--(cache->loaded->count)];
+	}
+	
+	// trade an empty magazine for a full one, no need to lock if there are none
+	if(loaded->count == 0 && __atomic_load_n(&ptl_task_depot_num_full, __ATOMIC_RELAXED) > 0){
+		struct ptl_task_magazine *full = _ptl_task_get_full(loaded);
+		if(full != NULL){
+			cache->loaded = full;
+			return full->tasks[--(full->count)];
+		}
+	}
+	
+	return (ptl_task_t)ptl_alloc(allocator, sizeof(struct ptl_task));
+}
+
+/* keeps the task in this thread's magazines, trading with the depot if they
+   are full. Tasks from any other allocator go straight back to it */
+void _ptl_task_free(ptl_task_t task){
+	if(task->allocator != ptl_get_malloc_allocator()){
+		ptl_free(task->allocator, task, sizeof(struct ptl_task));
+		return;
+	}
+	
+	struct ptl_task_cache *cache = _ptl_task_get_cache();
+	struct ptl_task_magazine *loaded = cache->loaded;
+	
+	if(loaded->count < PTL_TASK_MAGAZINE_SIZE){
+		loaded->tasks[(loaded->count)++] = task;
+		return;
+	}
+	
+	if(cache->previous->count == 0){
+		cache->loaded = cache->previous;
+		cache->previous = loaded;
+	} else {
+		// both full, one goes to the depot for an empty one
+		cache->loaded = _ptl_task_put_full(cache->previous);
+		cache->previous = loaded;
+	}
+	
+	cache->loaded->tasks[(cache->loaded->count)++] = task;
+}
+
+/* this thread's cache, set up on first use */
+struct ptl_task_cache *_ptl_task_get_cache(){
+	struct ptl_task_cache *cache = &ptl_task_cache;
+	
+	if(cache->loaded == NULL){
+		pthread_once(&ptl_task_cache_once, _ptl_task_create_key);
+		
+		cache->loaded = _ptl_task_new_magazine();
+		cache->previous = _ptl_task_new_magazine();
+		
+		// so the magazines are handed back when the thread exits
+		pthread_setspecific(ptl_task_cache_key, cache);
+	}
+	
+	return cache;
+}
+
+/* creates the key whose destructor hands back an exiting thread's cache */
+void _ptl_task_create_key(){
+	pthread_key_create(&ptl_task_cache_key, _ptl_task_destroy_cache);
+}
+
+/* the thread is exiting, its magazines go to the depot */
+void _ptl_task_destroy_cache(void *arg){
+	struct ptl_task_cache *cache = (struct ptl_task_cache *)arg;
+	struct ptl_task_magazine *magazines[2] = {cache->loaded, cache->previous};
+	int i = 0;
+	
+	cache->loaded = NULL;
+	cache->previous = NULL;
+	
+	for(i=0; i<2; i++){
+		struct ptl_task_magazine *magazine = magazines[i];
+		
+		if(magazine->count > 0){
+			magazine = _ptl_task_put_full(magazine); // an empty one back
+		}
+		
+		pthread_mutex_lock(&ptl_task_depot_mutex); // lock
+		magazine->next = ptl_task_depot_empty;
+		ptl_task_depot_empty = magazine;
+		pthread_mutex_unlock(&ptl_task_depot_mutex); // unlock
+	}
+}
+
+/* an empty magazine, from the depot if it has one */
+struct ptl_task_magazine *_ptl_task_new_magazine(){
+	pthread_mutex_lock(&ptl_task_depot_mutex); // lock
+	struct ptl_task_magazine *magazine = ptl_task_depot_empty;
+	if(magazine != NULL){
+		ptl_task_depot_empty = magazine->next;
+	}
+	pthread_mutex_unlock(&ptl_task_depot_mutex); // unlock
+	
+	if(magazine == NULL){
+		magazine = (struct ptl_task_magazine *)
+			ptl_alloc(ptl_get_malloc_allocator(), sizeof(struct ptl_task_magazine));
+	}
+	
+	magazine->count = 0;
+	magazine->next = NULL;
+	
+	return magazine;
+}
+
+/* swaps 'empty' for a full magazine, NULL if the depot has none (then
+   'empty' is kept by the caller) */
+struct ptl_task_magazine *_ptl_task_get_full(struct ptl_task_magazine *empty){
+	pthread_mutex_lock(&ptl_task_depot_mutex); // lock
+	struct ptl_task_magazine *full = ptl_task_depot_full;
+	if(full != NULL){
+		ptl_task_depot_full = full->next;
+		__atomic_store_n(&ptl_task_depot_num_full, ptl_task_depot_num_full - 1, __ATOMIC_RELAXED);
+		
+		empty->next = ptl_task_depot_empty;
+		ptl_task_depot_empty = empty;
+	}
+	pthread_mutex_unlock(&ptl_task_depot_mutex); // unlock
+	
+	return full;
+}
+
+/* gives 'full' to the depot and returns an empty magazine. If the depot has
+   enough, the tasks are freed and 'full' itself comes back empty */
+struct ptl_task_magazine *_ptl_task_put_full(struct ptl_task_magazine *full){
+	struct ptl_task_magazine *empty = NULL;
+	int kept = 0;
+	
+	pthread_mutex_lock(&ptl_task_depot_mutex); // lock
+	if(ptl_task_depot_num_full < PTL_TASK_DEPOT_SIZE){
+		full->next = ptl_task_depot_full;
+		ptl_task_depot_full = full;
+		__atomic_store_n(&ptl_task_depot_num_full, ptl_task_depot_num_full + 1, __ATOMIC_RELAXED);
+		kept = 1;
+		
+		empty = ptl_task_depot_empty;
+		if(empty != NULL){
+			ptl_task_depot_empty = empty->next;
+		}
+	}
+	pthread_mutex_unlock(&ptl_task_depot_mutex); // unlock
+	
+	if(!kept){
+		_ptl_task_empty_magazine(full);
+		return full;
+	}
+	
+	if(empty == NULL){
+		empty = (struct ptl_task_magazine *)
+			ptl_alloc(ptl_get_malloc_allocator(), sizeof(struct ptl_task_magazine));
+	}
+	empty->count = 0;
+	empty->next = NULL;
+	
+	return empty;
+}
+
+/* gives a magazine's tasks back to malloc */
+void _ptl_task_empty_magazine(struct ptl_task_magazine *magazine){
+	while(magazine->count > 0){
+		ptl_free(ptl_get_malloc_allocator(), magazine->tasks[--(magazine->count)], sizeof(struct ptl_task));
+	}
 }
@@ -20,6 +20,7 @@
 #ifndef __PTL_TASK_H__
 #define __PTL_TASK_H__
 
+#include "ptl_allocator.h"
 
 #define PTL_TASK_STATE_CREATED 0
 #define PTL_TASK_STATE_RUNNING 1
@@ -27,10 +28,37 @@
 #define PTL_TASK_STATE_CANCELLED 3
 #define PTL_TASK_STATE_REJECTED 4
 
+#define PTL_TASK_INLINE_SIZE 48		/**< bytes of captures kept in the task itself */
+
+/**
+ * Destroyed tasks are not freed right away, they are kept for the next
+ * create. Each thread keeps two magazines (stacks) of up to
+ * PTL_TASK_MAGAZINE_SIZE tasks and creates from and destroys into those
+ * without locking. Full and empty magazines are swapped with a shared depot
+ * under a lock, once per PTL_TASK_MAGAZINE_SIZE tasks at most, so tasks
+ * created on one thread and destroyed on another (a submitter and a worker)
+ * flow back a magazine at a time. The depot keeps up to PTL_TASK_DEPOT_SIZE
+ * full magazines and gives the tasks of any more back to their allocator,
+ * and a thread's magazines go to the depot when it exits.
+ *
+ * Only tasks from the malloc allocator (see ptl_get_malloc_allocator()) are
+ * cached, whether it was asked for or came as the default. A task from any
+ * other allocator goes straight back to it when destroyed, so a caller's
+ * allocator (an arena, a counting allocator) can be torn down once its
+ * tasks are destroyed, with nothing of it left in another thread's cache.
+ */
+#define PTL_TASK_MAGAZINE_SIZE 64	/**< tasks per magazine */
+#define PTL_TASK_DEPOT_SIZE 64		/**< full magazines the depot keeps */
+
 
 struct ptl_task {
 	int state;
-	void* (*function_to_execute)(void*); 
+	void (*function_to_execute)(void*); 
+	ptl_allocator_t allocator;	/**< where the task came from */
+	void *arg;					/**< passed to function_to_execute, NULL unless set */
+	void (*rejected)(void*);	/**< called with 'arg' by reject_task(), NULL unless set */
+	size_t captures_size;		/**< bytes copied by create_task_inline(), 0 otherwise */
+	char captures[PTL_TASK_INLINE_SIZE] __attribute__((aligned(16)));	/**< where small captures live */
 };
 
 
@@ -46,11 +74,64 @@ typedef struct ptl_task *ptl_task_t;
  */
 ptl_task_t create_task(void (*function_to_execute)(void*));
 
+/**
+ * Create a task the same way as create_task(), but from 'allocator' (see
+ * ptl_allocator.h). create_task() uses the default allocator.
+ *
+ * @param function that will be executed when this task is consumed
+ * @param allocator allocator to use, NULL for the default
+ * @return a non-null 'task'
+ */
+ptl_task_t create_task_allocator(void (*function_to_execute)(void*), ptl_allocator_t allocator);
+
+/**
+ * Create a task that calls 'function_to_execute' with 'arg'.
+ *
+ * @param function that will be executed when this task is consumed
+ * @param arg passed to the function
+ * @param allocator allocator to use, NULL for the default
+ * @return a non-null 'task'
+ */
+ptl_task_t create_task_with_arg(void (*function_to_execute)(void*), void *arg, ptl_allocator_t allocator);
+
+/**
+ * Create a task that carries a copy of 'size' bytes at 'captures' and calls
+ * 'function_to_execute' with a pointer to the copy. Up to
+ * PTL_TASK_INLINE_SIZE bytes are kept inside the task, so the task is the
+ * only allocation; more than that are copied into a separate allocation.
+ * The copy is aligned to 16 bytes and lives as long as the task.
+ *
+ * @param function that will be executed when this task is consumed
+ * @param captures bytes to copy, usually a struct on the caller's stack
+ * @param size number of bytes
+ * @param allocator allocator to use, NULL for the default
+ * @return a non-null 'task', NULL if the parameters are bad
+ */
+ptl_task_t create_task_inline(void (*function_to_execute)(void*), const void *captures, size_t size,
+							  ptl_allocator_t allocator);
+
 /**
  * Destroy a 'task'. This does not free any memory this 'task' may be pointing
- * to. It only frees the memory create during the 'create' function.
+ * to. It only frees the memory create during the 'create' function (the
+ * captures copied by create_task_inline() included).
  *
  * @param task task to be destroyed
  */
 void destroy_task(ptl_task_t task);
+
+/**
+ * Rejects a 'task' that will never run: calls its 'rejected' function with
+ * its 'arg', if it has one, then destroys it. Whatever is waiting on the
+ * task (a future, see ptl_future.h) learns this way that it won't run.
+ *
+ * @param task task to be rejected
+ */
+void reject_task(ptl_task_t task);
+
+/**
+ * Gives the tasks cached by the calling thread and by the depot back to
+ * malloc (see PTL_TASK_MAGAZINE_SIZE). Tasks cached by other threads stay
+ * where they are. Useful after a burst of tasks that won't come again.
+ */
+void ptl_task_trim_cache();
 #endif
@@ -23,19 +23,68 @@
 #include <malloc.h>
 #include <assert.h>
 #include <string.h>
+#include <errno.h>
+#include "ptl_allocator.h"
 #include "ptl_thread_manager.h"
+#include "ptl_linked_queue.h"
+#include "ptl_scheduler.h"
 #include "ptl_util.h"
 
+/* what _reject_overloaded() returns when it made room, the task is
+   added again */
+#define PTL_TM_ADD_AGAIN -1
+
+
+/* Structures */
+
+/* What a new worker thread is started with */
+struct ptl_tm_worker_start {
+	ptl_thread_manager_t manager;	/**< manager the worker belongs to */
+	ptl_task_t first_task;			/**< run before looking at work_q, may be NULL */
+	struct ptl_tm_ws_worker *ws_worker;	/**< its deque, work stealing only */
+};
+
+
+/* Global Variables */
+
+/* the work-stealing worker running on this thread, NULL on other threads */
+__thread struct ptl_tm_ws_worker *ptl_tm_current_worker = NULL;
+
+/* the queue shutdown_now() hands back the unrun tasks in */
+struct ptl_q_funcs ptl_tm_drain_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
 
 /* Private Functions */
 void _reject_handler(ptl_task_t task, void (*rejected_handler) (void *));
-void add_thread();
+int _reject_overloaded(ptl_thread_manager_t manager, ptl_task_t task);
+void _caller_runs_handler(void *function);
+void _discard_handler(void *function);
+void _discard_oldest_handler(void *function);
+ptl_task_t _take_oldest(ptl_thread_manager_t manager);
+void _init_workers(ptl_thread_manager_t manager);
+int _take_pending(ptl_thread_manager_t manager);
+void _remove_worker(ptl_thread_manager_t manager);
+void *_worker(void *arg);
+int _ws_submit_task(ptl_thread_manager_t manager, ptl_task_t task);
+ptl_task_t _ws_get_next_task(ptl_thread_manager_t manager);
+ptl_task_t _ws_steal(ptl_thread_manager_t manager, struct ptl_tm_ws_worker *self);
+int _ws_has_work(ptl_thread_manager_t manager);
+int _has_queued_work(ptl_thread_manager_t manager);
+void _late_submit(ptl_thread_manager_t manager);
+void _try_terminate(ptl_thread_manager_t manager);
+ptl_task_t _take_queued(ptl_thread_manager_t manager);
+void _reject_queued(ptl_thread_manager_t manager);
+int add_thread(ptl_thread_manager_t manager, ptl_task_t first_task);
+int add_if_under_max_pool_size(ptl_thread_manager_t manager, ptl_task_t first_task);
 void ensure_queued_task_handled();
 void reject();
-void run_task(void* task);
-void get_next_task();
-void interrupt_idle_threads();
-void drain_queue();
+void run_task(ptl_thread_manager_t manager, ptl_task_t task);
+ptl_task_t get_next_task(ptl_thread_manager_t manager);
+void interrupt_idle_threads(ptl_thread_manager_t manager);
+ptl_q_t drain_queue(ptl_thread_manager_t manager);
 
 
 /* Public Functions */
@@ -73,6 +122,9 @@ ptl_thread_manager_t create_thread_manager_with_functions(int core_pool_size,
 							   
 	manager->main_mutex = main_mutex;
 	manager->termination_mutex = termination_mutex;
+	
+	/* start the core threads */
+	_init_workers(manager);
 							   
 	return manager;						   
 }
@@ -121,11 +173,66 @@ ptl_thread_manager_t
 							   
 	manager->main_mutex = main_mutex;
 	manager->termination_mutex = termination_mutex;
+	
+	/* start the core threads */
+	_init_workers(manager);
 										   
 	return manager;									   
 }
 
 
+/* create a manager whose workers each have a deque and steal from each other */
+ptl_thread_manager_t create_work_stealing_thread_manager(int num_threads,
+														 ptl_q_t work_q,
+														 void (*rejected_handler)(void *)){
+	if(num_threads <= 0 || work_q == NULL){
+		return NULL;
+	}
+	
+	ptl_thread_manager_t manager = (ptl_thread_manager_t)calloc(1, sizeof(struct ptl_thread_manager));
+	assert(manager);
+	
+	/* a fixed number of threads */
+	ptl_thread_pool_t thread_pool = ptl_create_thread_pool(num_threads, num_threads, 0);
+	
+	/* initilize the manager struct */
+	manager->work_q = work_q;
+	manager->thread_pool = thread_pool;
+	manager->run_state = PTL_RUNNING;
+	manager->num_completed_tasks = 0;
+	manager->mode = PTL_TM_MODE_WORK_STEALING;
+	/* functions */
+	manager->rejected_handler = rejected_handler;
+	manager->before_execute = NULL;
+	manager->after_execute = NULL;
+	
+	/* one deque per worker */
+	manager->ws_workers = (struct ptl_tm_ws_worker *)ptl_calloc(thread_pool->allocator, num_threads,
+																sizeof(struct ptl_tm_ws_worker));
+	manager->num_ws_workers = num_threads;
+	
+	int i = 0;
+	for(i=0; i<num_threads; i++){
+		manager->ws_workers[i].manager = manager;
+		manager->ws_workers[i].deque = ptl_wd_create_work_deque(thread_pool->allocator);
+		manager->ws_workers[i].seed = 2654435761u * (unsigned int)(i + 1);
+		manager->ws_workers[i].index = i;
+	}
+	
+	/* create mutexes and conditions */
+	pthread_mutex_t main_mutex = PTHREAD_MUTEX_INITIALIZER;
+  	pthread_cond_t  termination_mutex = PTHREAD_COND_INITIALIZER;
+	
+	manager->main_mutex = main_mutex;
+	manager->termination_mutex = termination_mutex;
+	
+	/* start the threads */
+	_init_workers(manager);
+	
+	return manager;
+}
+
+
 /* put on work_q. If not able to, then call rejected handler with function */
 int submit(ptl_thread_manager_t manager, void (*function_to_execute)(void *)){
 	if(manager == NULL || function_to_execute == NULL){
@@ -139,59 +246,193 @@ int submit(ptl_thread_manager_t manager, void (*function_to_execute)(void *)){
 }
 
 
-/* put on work_q. If not able to, then call rejected handler with function */
+/* wrap the function and its argument in a 'task' */
+int submit_with_arg(ptl_thread_manager_t manager, void (*function_to_execute)(void *), void *arg){
+	if(manager == NULL || function_to_execute == NULL){
+		return 0;
+	}
+	
+	ptl_allocator_t allocator = (manager->thread_pool != NULL) ? manager->thread_pool->allocator : NULL;
+	
+	return submit_task(manager, create_task_with_arg(function_to_execute, arg, allocator));
+}
+
+
+/* wrap the function and a copy of 'captures' in a 'task' */
+int submit_inline(ptl_thread_manager_t manager, void (*function_to_execute)(void *),
+				  const void *captures, size_t size){
+	if(manager == NULL || function_to_execute == NULL){
+		return 0;
+	}
+	
+	ptl_allocator_t allocator = (manager->thread_pool != NULL) ? manager->thread_pool->allocator : NULL;
+	
+	return submit_task(manager, create_task_inline(function_to_execute, captures, size, allocator));
+}
+
+
+/* put on work_q and make sure a worker will see it. If not able to, then 
+   call rejected handler with function */
 int submit_task(ptl_thread_manager_t manager, ptl_task_t task){
 	if(manager == NULL || task == NULL){
 		return 0;
 	}
 	
+	// after a shutdown(), a work-stealing manager's own tasks can still split
+	int run_state = __atomic_load_n(&(manager->run_state), __ATOMIC_ACQUIRE);
+	if(run_state != PTL_RUNNING && 
+	   !(run_state == PTL_SHUTDOWN && ptl_tm_current_worker != NULL && 
+		 ptl_tm_current_worker->manager == manager)){
+		_reject_handler(task, manager->rejected_handler);
+		return 0;
+	}
+	
+	if(manager->mode == PTL_TM_MODE_WORK_STEALING){
+		return _ws_submit_task(manager, task);
+	}
+	
+	ptl_thread_pool_t pool = manager->thread_pool;
+	
 	// put it in the work queue
-	int successful = ptl_q_add(manager->work_q, task);
+	while(!ptl_q_add(manager->work_q, task)){
+		// the queue is full, a new thread can take it directly
+		if(add_if_under_max_pool_size(manager, task)){
+			return 1;
+		}
+		int handled = _reject_overloaded(manager, task);
+		if(handled != PTL_TM_ADD_AGAIN){
+			return handled;
+		}
+	}
 	
-	// if not successful, then call the rejected handler
-	if(!successful){
-		_reject_handler(task, manager->rejected_handler);
+	// this pairs with the worker counting itself idle before it checks
+	// 'pending', so one of us always sees the other
+	long pending = __atomic_add_fetch(&(manager->pending), 1, __ATOMIC_SEQ_CST);
+	
+	// a shutdown may have come in after the check above, and its workers
+	// may be gone already (see _late_submit)
+	if(__atomic_load_n(&(manager->run_state), __ATOMIC_SEQ_CST) != PTL_RUNNING){
+		_late_submit(manager);
+		return 1;
 	}
 	
-	return successful;
+	if(pool == NULL){ return 1; } // nobody to wake
+	int idle = __atomic_load_n(&(manager->idle_workers), __ATOMIC_SEQ_CST);
+	int pool_size = __atomic_load_n(&(pool->current_pool_size), __ATOMIC_RELAXED);
+	
+	if(idle > 0){
+		pthread_mutex_lock(&(manager->main_mutex)); // lock
+		pthread_cond_signal(&(manager->work_cond));
+		pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	}
+	
+	// more tasks waiting than idle workers to take them, and at least one
+	// per thread, they are backing up
+	if(pool_size < pool->core_pool_size || 
+	   (pending > idle && pending >= pool_size && pool_size < pool->max_pool_size)){
+		add_if_under_max_pool_size(manager, NULL);
+	}
+	
+	return 1;
 }
 
+/* stop taking tasks, the workers exit once the queued ones are done */
 void shutdown(ptl_thread_manager_t manager){
-	return; //TODO: implement
+	if(manager == NULL){ return; }
+	
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	if(manager->run_state < PTL_SHUTDOWN){
+		__atomic_store_n(&(manager->run_state), PTL_SHUTDOWN, __ATOMIC_SEQ_CST);
+	}
+	// idle workers look at the state, and exit if there is nothing left
+	interrupt_idle_threads(manager);
+	_try_terminate(manager);
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	
+	ptl_scheduler_stop(manager);
 }
 
+
+/* stop taking and running tasks, hand back the ones that never ran */
 ptl_q_t shutdown_now(ptl_thread_manager_t manager){
-	return NULL; //TODO: implement
+	if(manager == NULL){ return NULL; }
+	
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	if(manager->run_state < PTL_STOP){
+		__atomic_store_n(&(manager->run_state), PTL_STOP, __ATOMIC_SEQ_CST);
+	}
+	interrupt_idle_threads(manager);
+	ptl_q_t drained = drain_queue(manager);
+	_try_terminate(manager);
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	
+	ptl_scheduler_stop(manager);
+	
+	return drained;
+}
+
+
+/* wait for the last worker to exit */
+int await_termination(ptl_thread_manager_t manager, long timeout){
+	if(manager == NULL){ return 0; }
+	
+	// the same clock as termination_mutex (see _init_workers)
+	long long deadline = ptl_get_time_usec() + (timeout * 1000LL);
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000LL;
+	ts.tv_nsec = (deadline % 1000000LL) * 1000;
+	
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	while(manager->run_state != PTL_TERMINATED && timeout > 0){
+		if(pthread_cond_timedwait(&(manager->termination_mutex), 
+								  &(manager->main_mutex), &ts) == ETIMEDOUT){
+			break;
+		}
+	}
+	int terminated = (manager->run_state == PTL_TERMINATED);
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	
+	return terminated;
 }
 
 int is_terminated(ptl_thread_manager_t manager){
-	return manager->run_state == PTL_TERMINATED;
+	return __atomic_load_n(&(manager->run_state), __ATOMIC_ACQUIRE) == PTL_TERMINATED;
 }
 
 int is_terminating(ptl_thread_manager_t manager){
-	return manager->run_state == PTL_SHUTDOWN || manager->run_state == PTL_STOP;
+	int run_state = __atomic_load_n(&(manager->run_state), __ATOMIC_ACQUIRE);
+	return run_state == PTL_SHUTDOWN || run_state == PTL_STOP;
 }
 
 void purge_cancelled(ptl_thread_manager_t manager){
 	return; //TODO: Implement
 }
 
+/* change what happens to tasks the manager has no room for */
+void set_rejected_handler(ptl_thread_manager_t manager, void (*rejected_handler)(void *)){
+	if(manager == NULL){ return; }
+	
+	__atomic_store_n(&(manager->rejected_handler), rejected_handler, __ATOMIC_RELAXED);
+}
+
+/* no handler, the submit fails */
 void *ptl_abort_policy(){
-	return NULL; //TODO: Implement
+	return NULL;
 }
 
+/* the policies are told apart by their handler (see _reject_overloaded) */
 void *ptl_q_caller_runs_policy(){
-	return NULL; //TODO: Implement
+	return (void *)_caller_runs_handler;
 }
 
 
 void *ptl_q_discard_policy(){
-	return NULL; //TODO: Implement
+	return (void *)_discard_handler;
 }
 
 
 void *ptl_q_discard_oldest_policy(){
-	return NULL; //TODO: Implement
+	return (void *)_discard_oldest_handler;
 }
 
  
@@ -199,27 +440,496 @@ void *ptl_q_discard_oldest_policy(){
 /* Private Functions */
 
 
-//TODO: use this as a rejected function wrapper
+/* rejects the task, then tells the handler which function it was */
 void _reject_handler(ptl_task_t task, void (*rejected_handler) (void *)){
-	task->state = PTL_TASK_STATE_REJECTED;
+	void (*function_to_execute)(void *) = task->function_to_execute;
 	
-	rejected_handler(task->function_to_execute);
+	reject_task(task);
 	
-	destroy_task(task);
+	if(rejected_handler != NULL){
+		rejected_handler((void *)function_to_execute);
+	}
 }
 
-/* add a thread to the currnent thread pool */
-void add_thread(){return;}
-void add_if_under_max_pool_size(){
+/* work_q is full and the pool can't grow, the policy decides what happens
+   to the task. Returns what submit_task() should, or PTL_TM_ADD_AGAIN once
+   the oldest task made room (another submitter may take it first, so the
+   caller loops instead of this recursing) */
+int _reject_overloaded(ptl_thread_manager_t manager, ptl_task_t task){
+	void (*rejected_handler)(void *) = 
+		__atomic_load_n(&(manager->rejected_handler), __ATOMIC_RELAXED);
+	int running = (__atomic_load_n(&(manager->run_state), __ATOMIC_ACQUIRE) == PTL_RUNNING);
+	
+	// the scheduler's timer thread never runs a task, one slow function
+	// would hold up every other one scheduled (see ptl_scheduler.h)
+	ptl_scheduler_t scheduler = __atomic_load_n(&(manager->scheduler), __ATOMIC_ACQUIRE);
+	int timer = (scheduler != NULL && pthread_equal(pthread_self(), scheduler->thread));
+	
+	if(rejected_handler == _caller_runs_handler && running && !timer){
+		// the submitter is busy with it instead of submitting more
+		run_task(manager, task);
+		return 1;
+	}
+	
+	if(rejected_handler == _discard_handler){
+		reject_task(task);
+		return 1;
+	}
+	
+	if(rejected_handler == _discard_oldest_handler && running){
+		ptl_task_t oldest = _take_oldest(manager);
+		if(oldest != NULL){
+			reject_task(oldest);
+			return PTL_TM_ADD_AGAIN;
+		}
+	}
+	
+	_reject_handler(task, rejected_handler);
+	return 0;
+}
+
+/* the policy handlers only mark the policy, they are called (and do nothing)
+   for tasks rejected some other way, after a shutdown for one */
+void _caller_runs_handler(void *function){
 	return;
 }
+
+void _discard_handler(void *function){
+	return;
+}
+
+void _discard_oldest_handler(void *function){
+	return;
+}
+
+/* sets up the worker state and starts the core threads */
+void _init_workers(ptl_thread_manager_t manager){
+	// keep alive and await_termination() deadlines are on the clock
+	// ptl_get_time_usec() reads
+	pthread_condattr_t cond_attr;
+	pthread_condattr_init(&cond_attr);
+	pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&(manager->work_cond), &cond_attr);
+	pthread_cond_init(&(manager->termination_mutex), &cond_attr);
+	pthread_condattr_destroy(&cond_attr);
+	
+	manager->pending = 0;
+	manager->idle_workers = 0;
+	
+	if(manager->thread_pool == NULL){ return; }
+	
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	while(manager->thread_pool->current_pool_size < manager->thread_pool->core_pool_size){
+		if(!add_thread(manager, NULL)){ break; }
+	}
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+}
+
+/* claims one of the pending tasks, 0 if there are none */
+int _take_pending(ptl_thread_manager_t manager){
+	long pending = __atomic_load_n(&(manager->pending), __ATOMIC_SEQ_CST);
+	
+	while(pending > 0){
+		if(__atomic_compare_exchange_n(&(manager->pending), &pending, pending - 1,
+									   1, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)){
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+/* takes the calling thread out of the pool. main_mutex must be held */
+void _remove_worker(ptl_thread_manager_t manager){
+	ptl_thread_pool_t pool = manager->thread_pool;
+	pthread_t self = pthread_self();
+	
+	// keep the running threads at the front of the array
+	int i = 0;
+	for(i=0; i<pool->current_pool_size; i++){
+		if(pthread_equal(pool->threads[i], self)){
+			pool->threads[i] = pool->threads[pool->current_pool_size - 1];
+			break;
+		}
+	}
+	__atomic_store_n(&(pool->current_pool_size), pool->current_pool_size - 1, __ATOMIC_RELAXED);
+	
+	// the last one out after a shutdown terminates the manager
+	_try_terminate(manager);
+}
+
+/* a pool thread, runs tasks until told to stop or idle for too long */
+void *_worker(void *arg){
+	struct ptl_tm_worker_start *start = (struct ptl_tm_worker_start *)arg;
+	ptl_thread_manager_t manager = start->manager;
+	ptl_task_t task = start->first_task;
+	
+	ptl_tm_current_worker = start->ws_worker;
+	ptl_free(manager->thread_pool->allocator, start, sizeof(struct ptl_tm_worker_start));
+	
+	if(task == NULL){
+		task = get_next_task(manager);
+	}
+	while(task != NULL){
+		run_task(manager, task);
+		task = get_next_task(manager);
+	}
+	
+	return NULL;
+}
+
+/* add a thread to the current thread pool. main_mutex must be held */
+int add_thread(ptl_thread_manager_t manager, ptl_task_t first_task){
+	ptl_thread_pool_t pool = manager->thread_pool;
+	if(pool->current_pool_size >= pool->max_pool_size){ return 0; }
+	
+	struct ptl_tm_worker_start *start = 
+		(struct ptl_tm_worker_start *)ptl_alloc(pool->allocator, sizeof(struct ptl_tm_worker_start));
+	start->manager = manager;
+	start->first_task = first_task;
+	start->ws_worker = NULL;
+	
+	// work-stealing pools never shrink, so the index is free
+	if(manager->mode == PTL_TM_MODE_WORK_STEALING){
+		start->ws_worker = manager->ws_workers + pool->current_pool_size;
+	}
+	
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	
+	// the new thread can't look itself up in 'threads' until we unlock
+	int rc = pthread_create(pool->threads + pool->current_pool_size, &attr, _worker, start);
+	pthread_attr_destroy(&attr);
+	
+	if(rc != 0){
+		ptl_free(pool->allocator, start, sizeof(struct ptl_tm_worker_start));
+		return 0;
+	}
+	__atomic_store_n(&(pool->current_pool_size), pool->current_pool_size + 1, __ATOMIC_RELAXED);
+	
+	return 1;
+}
+
+/* add a thread if the pool is not full yet */
+int add_if_under_max_pool_size(ptl_thread_manager_t manager, ptl_task_t first_task){
+	if(manager->thread_pool == NULL){ return 0; }
+	
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	int added = 0;
+	if(manager->run_state == PTL_RUNNING){
+		added = add_thread(manager, first_task);
+	}
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	
+	return added;
+}
 	
 void ensure_queued_task_handled(){return;}
 void reject(){return;}
-void run_task(void* task){return;}
-void get_next_task(){return;}
-void interrupt_idle_threads(){return;}
-void drain_queue(){return;}
+
+/* runs one task between the before and after functions, then frees it */
+void run_task(ptl_thread_manager_t manager, ptl_task_t task){
+	if(manager->before_execute != NULL){
+		manager->before_execute(task);
+	}
+	
+	task->state = PTL_TASK_STATE_RUNNING;
+	task->function_to_execute(task->arg);
+	task->state = PTL_TASK_STATE_DONE;
+	
+	if(manager->after_execute != NULL){
+		manager->after_execute(task);
+	}
+	
+	__atomic_add_fetch(&(manager->num_completed_tasks), 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&(manager->thread_pool->completed_tasks), 1, __ATOMIC_RELAXED);
+	
+	destroy_task(task);
+}
+
+/* waits for a task. Returns NULL, with the thread already out of the pool,
+   when the worker should exit */
+ptl_task_t get_next_task(ptl_thread_manager_t manager){
+	ptl_thread_pool_t pool = manager->thread_pool;
+	ptl_task_t task = NULL;
+	
+	if(manager->mode == PTL_TM_MODE_WORK_STEALING){
+		return _ws_get_next_task(manager);
+	}
+	
+	while(1){
+		// fast path, no lock while there is work. After shutdown_now() the
+		// queued tasks are not ours to run
+		while(__atomic_load_n(&(manager->run_state), __ATOMIC_RELAXED) < PTL_STOP && 
+			  _take_pending(manager)){
+			task = (ptl_task_t)ptl_q_get(manager->work_q);
+			if(task != NULL){ return task; }
+		}
+		
+		pthread_mutex_lock(&(manager->main_mutex)); // lock
+		
+		long pending = __atomic_load_n(&(manager->pending), __ATOMIC_SEQ_CST);
+		if(manager->run_state >= PTL_STOP || (manager->run_state == PTL_SHUTDOWN && pending == 0)){
+			_remove_worker(manager);
+			pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+			return NULL;
+		}
+		
+		// count ourselves idle before looking again (see submit_task). Once
+		// shutting down, only sleep while running is possible, go back and exit
+		__atomic_add_fetch(&(manager->idle_workers), 1, __ATOMIC_SEQ_CST);
+		if(__atomic_load_n(&(manager->pending), __ATOMIC_SEQ_CST) > 0 || 
+		   manager->run_state != PTL_RUNNING){
+			__atomic_sub_fetch(&(manager->idle_workers), 1, __ATOMIC_RELAXED);
+			pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+			continue;
+		}
+		
+		int timed_out = 0;
+		if(pool->current_pool_size > pool->core_pool_size){
+			// above core size, only wait for keep_alive_time
+			long long deadline = ptl_get_time_usec() + (pool->keep_alive_time * 1000LL);
+			struct timespec ts;
+			ts.tv_sec = deadline / 1000000LL;
+			ts.tv_nsec = (deadline % 1000000LL) * 1000;
+			
+			timed_out = (pthread_cond_timedwait(&(manager->work_cond), 
+								&(manager->main_mutex), &ts) == ETIMEDOUT);
+		} else {
+			pthread_cond_wait(&(manager->work_cond), &(manager->main_mutex));
+		}
+		__atomic_sub_fetch(&(manager->idle_workers), 1, __ATOMIC_RELAXED);
+		
+		// retire if we are still extra and there is still nothing to do
+		if(timed_out && __atomic_load_n(&(manager->pending), __ATOMIC_SEQ_CST) == 0 && 
+		   pool->current_pool_size > pool->core_pool_size){
+			_remove_worker(manager);
+			pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+			return NULL;
+		}
+		
+		pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	}
+}
+
+/* a worker's own tasks go on its deque, everyone else's on work_q */
+int _ws_submit_task(ptl_thread_manager_t manager, ptl_task_t task){
+	struct ptl_tm_ws_worker *self = ptl_tm_current_worker;
+	int local = (self != NULL && self->manager == manager);
+	
+	if(local){
+		ptl_wd_push(self->deque, task);
+	} else {
+		while(!ptl_q_add(manager->work_q, task)){
+			// the pool can't grow, there is nowhere else to put it
+			int handled = _reject_overloaded(manager, task);
+			if(handled != PTL_TM_ADD_AGAIN){
+				return handled;
+			}
+		}
+		__atomic_add_fetch(&(manager->pending), 1, __ATOMIC_SEQ_CST);
+	}
+	
+	// the task has to be visible before we look for sleepers, a worker
+	// counts itself idle before it looks for tasks (see _ws_get_next_task)
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	
+	// the same goes for a shutdown that came in after submit_task() checked.
+	// This worker runs its own task after a shutdown(), but not after a
+	// shutdown_now()
+	int run_state = __atomic_load_n(&(manager->run_state), __ATOMIC_SEQ_CST);
+	if(run_state >= PTL_STOP || (run_state == PTL_SHUTDOWN && !local)){
+		_late_submit(manager);
+		return 1;
+	}
+	
+	if(__atomic_load_n(&(manager->idle_workers), __ATOMIC_SEQ_CST) > 0){
+		pthread_mutex_lock(&(manager->main_mutex)); // lock
+		pthread_cond_signal(&(manager->work_cond));
+		pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	}
+	
+	return 1;
+}
+
+/* own deque, then work_q, then the other deques, then sleep */
+ptl_task_t _ws_get_next_task(ptl_thread_manager_t manager){
+	struct ptl_tm_ws_worker *self = ptl_tm_current_worker;
+	ptl_task_t task = NULL;
+	
+	while(1){
+		// after shutdown_now() the queued tasks are not ours to run
+		if(__atomic_load_n(&(manager->run_state), __ATOMIC_RELAXED) < PTL_STOP){
+			task = (ptl_task_t)ptl_wd_pop(self->deque);
+			if(task != NULL){ return task; }
+			
+			while(_take_pending(manager)){
+				task = (ptl_task_t)ptl_q_get(manager->work_q);
+				if(task != NULL){ return task; }
+			}
+			
+			task = _ws_steal(manager, self);
+			if(task != NULL){ return task; }
+		}
+		
+		pthread_mutex_lock(&(manager->main_mutex)); // lock
+		
+		if(manager->run_state >= PTL_STOP || 
+		   (manager->run_state == PTL_SHUTDOWN && !_ws_has_work(manager))){
+			_remove_worker(manager);
+			pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+			return NULL;
+		}
+		
+		// count ourselves idle before looking again (see _ws_submit_task)
+		__atomic_add_fetch(&(manager->idle_workers), 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if(!_ws_has_work(manager) && manager->run_state == PTL_RUNNING){
+			pthread_cond_wait(&(manager->work_cond), &(manager->main_mutex));
+		}
+		__atomic_sub_fetch(&(manager->idle_workers), 1, __ATOMIC_RELAXED);
+		
+		pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+	}
+}
+
+/* tries every other worker once, starting at a random one */
+ptl_task_t _ws_steal(ptl_thread_manager_t manager, struct ptl_tm_ws_worker *self){
+	int num_workers = manager->num_ws_workers;
+	if(num_workers <= 1){ return NULL; }
+	
+	// xorshift
+	unsigned int seed = self->seed;
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	self->seed = seed;
+	
+	int start = (int)(seed % (unsigned int)num_workers);
+	int i = 0;
+	for(i=0; i<num_workers; i++){
+		struct ptl_tm_ws_worker *victim = manager->ws_workers + ((start + i) % num_workers);
+		if(victim == self){ continue; }
+		
+		ptl_task_t task = (ptl_task_t)ptl_wd_steal(victim->deque);
+		if(task != NULL){ return task; }
+	}
+	
+	return NULL;
+}
+
+/* 1 if a task is waiting anywhere */
+int _ws_has_work(ptl_thread_manager_t manager){
+	if(__atomic_load_n(&(manager->pending), __ATOMIC_SEQ_CST) > 0){ return 1; }
+	
+	int i = 0;
+	for(i=0; i<manager->num_ws_workers; i++){
+		if(ptl_wd_size(manager->ws_workers[i].deque) > 0){ return 1; }
+	}
+	
+	return 0;
+}
+
+/* 1 if a task is waiting, in either mode */
+int _has_queued_work(ptl_thread_manager_t manager){
+	if(manager->mode == PTL_TM_MODE_WORK_STEALING){
+		return _ws_has_work(manager);
+	}
+	return __atomic_load_n(&(manager->pending), __ATOMIC_SEQ_CST) > 0;
+}
+
+/* a task went in after the manager started shutting down. Either the state
+   was changed after the task was visible, and the workers (or drain_queue())
+   see it, or this takes care of it. main_mutex must not be held */
+void _late_submit(ptl_thread_manager_t manager){
+	pthread_mutex_lock(&(manager->main_mutex)); // lock
+	if(manager->run_state >= PTL_STOP){
+		// shutdown_now() has drained the queue already
+		_reject_queued(manager);
+	} else {
+		// SHUTDOWN runs it, but the workers may have left
+		_try_terminate(manager);
+	}
+	pthread_mutex_unlock(&(manager->main_mutex)); // unlock
+}
+
+/* once shut down and out of workers, the manager is terminated. A task
+   still queued after a shutdown() gets a new worker, anything queued after
+   shutdown_now() is rejected. main_mutex must be held */
+void _try_terminate(ptl_thread_manager_t manager){
+	ptl_thread_pool_t pool = manager->thread_pool;
+	
+	if(manager->run_state == PTL_RUNNING){ return; }
+	if(pool != NULL && pool->current_pool_size > 0){ return; }
+	
+	if(manager->run_state == PTL_SHUTDOWN && pool != NULL && 
+	   _has_queued_work(manager) && add_thread(manager, NULL)){
+		return;
+	}
+	
+	_reject_queued(manager);
+	
+	if(manager->run_state != PTL_TERMINATED){
+		__atomic_store_n(&(manager->run_state), PTL_TERMINATED, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&(manager->termination_mutex));
+	}
+}
+
+/* takes the task at the head of work_q, NULL if none is waiting */
+ptl_task_t _take_oldest(ptl_thread_manager_t manager){
+	ptl_task_t task = NULL;
+	
+	while(_take_pending(manager)){
+		task = (ptl_task_t)ptl_q_get(manager->work_q);
+		if(task != NULL){ return task; }
+	}
+	
+	return NULL;
+}
+
+/* takes any one queued task, NULL if there are none */
+ptl_task_t _take_queued(ptl_thread_manager_t manager){
+	ptl_task_t task = _take_oldest(manager);
+	if(task != NULL){ return task; }
+	
+	// deques are only stolen from, their owners may still be popping
+	int i = 0;
+	for(i=0; i<manager->num_ws_workers; i++){
+		task = (ptl_task_t)ptl_wd_steal(manager->ws_workers[i].deque);
+		if(task != NULL){ return task; }
+	}
+	
+	return NULL;
+}
+
+/* rejects every queued task */
+void _reject_queued(ptl_thread_manager_t manager){
+	ptl_task_t task = NULL;
+	
+	while((task = _take_queued(manager)) != NULL){
+		_reject_handler(task, manager->rejected_handler);
+	}
+}
+
+/* wakes the workers waiting for a task, so they see the new run_state.
+   main_mutex must be held */
+void interrupt_idle_threads(ptl_thread_manager_t manager){
+	pthread_cond_broadcast(&(manager->work_cond));
+}
+
+/* moves every queued task into a new linked queue. main_mutex must be held */
+ptl_q_t drain_queue(ptl_thread_manager_t manager){
+	ptl_allocator_t allocator = (manager->thread_pool != NULL) ? manager->thread_pool->allocator : NULL;
+	ptl_q_t drained = ptl_q_create_queue_allocator(&ptl_tm_drain_q_funcs, 0, allocator);
+	ptl_task_t task = NULL;
+	
+	while((task = _take_queued(manager)) != NULL){
+		ptl_q_add(drained, task);
+	}
+	
+	return drained;
+}
 
  
  
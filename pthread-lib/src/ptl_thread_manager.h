@@ -23,6 +23,7 @@
 #include "ptl_queue.h"
 #include "ptl_thread_pool.h"
 #include "ptl_task.h"
+#include "ptl_work_deque.h"
 
 /* Constants */
 /**
@@ -52,9 +53,36 @@
 #define PTL_STOP       2
 #define PTL_TERMINATED 3
 
+/* How workers find tasks */
+#define PTL_TM_MODE_SHARED        0	/**< every task goes through work_q */
+#define PTL_TM_MODE_WORK_STEALING 1	/**< per-worker deques, see below */
+
 
 /* Structures */
+struct ptl_scheduler;
+
+/* A worker of a work-stealing manager */
+struct ptl_tm_ws_worker {
+	struct ptl_thread_manager *manager;	/**< manager the worker belongs to */
+	ptl_work_deque_t deque;				/**< tasks submitted by this worker */
+	unsigned int seed;					/**< picks victims to steal from */
+	int index;							/**< position in ws_workers */
+};
 
+/**
+ * The manager runs tasks on the threads of its pool. core_pool_size threads
+ * are started when the manager is created and stay for its whole life. When
+ * tasks back up (more are waiting than there are idle workers, and at least
+ * one per thread) or work_q is full, more threads are started, one per 
+ * submit, up to max_pool_size. A thread above the core size that has
+ * been idle for keep_alive_time milliseconds exits.
+ *
+ * Workers sleep on work_cond. 'pending' counts the tasks in work_q that no
+ * worker has claimed yet; a worker claims one by decrementing it and then
+ * takes a task from work_q. A submit only takes main_mutex when a worker
+ * is idle or the pool has to grow, so submitting to a busy pool costs an
+ * add to work_q and an atomic increment.
+ */
 struct ptl_thread_manager {
 	ptl_q_t work_q;						/**< queue/list that is being used */
 	void (*rejected_handler)(void *);	/**< rejected handler function */
@@ -67,6 +95,13 @@ struct ptl_thread_manager {
 	ptl_thread_pool_t thread_pool;
 	void (*before_execute)(void *);	  	/**< executes before function pointer */
 	void (*after_execute)(void *);	  	/**< executes after function pointer */
+	pthread_cond_t work_cond;			/**< idle workers wait here for tasks */
+	long pending;						/**< tasks in work_q not yet taken by a worker */
+	int idle_workers;					/**< workers waiting on work_cond */
+	int mode;							/**< PTL_TM_MODE_SHARED or PTL_TM_MODE_WORK_STEALING */
+	struct ptl_tm_ws_worker *ws_workers;	/**< one per thread, work stealing only */
+	int num_ws_workers;					/**< number of ws_workers */
+	struct ptl_scheduler *scheduler;	/**< timer for schedule(), see ptl_scheduler.h */
 };
 
 
@@ -115,17 +150,69 @@ ptl_thread_manager_t
 						   			ptl_q_t work_q,
 						   			void (*rejected_handler) (void *));
 
+/**
+ * Create a work-stealing thread manager with 'num_threads' threads. The
+ * pool does not grow or shrink.
+ *
+ * Each worker owns a deque (see ptl_work_deque.h). A task submitted from
+ * inside one of this manager's tasks goes on the submitting worker's deque,
+ * and that worker runs the newest task on its deque first, so a task that
+ * splits its work into subtasks keeps working on data that is still in its
+ * cache, without touching a shared queue. Tasks submitted from any other
+ * thread go to 'work_q', which is used as the injection queue. A worker with
+ * an empty deque takes from 'work_q', then steals the oldest task from the
+ * deques of other workers, starting at a random one, before it sleeps.
+ *
+ * Tasks are not run in submission order. A task that waits for a task it
+ * submitted can wait forever if every worker does the same, so split work
+ * into tasks that finish (with a counter or a last-one-done task) instead.
+ *
+ * @param num_threads number of worker threads
+ * @param work_q queue for tasks submitted from outside the workers
+ * @param rejected_handler called with the function of a rejected task, may be NULL
+ * @return the manager, NULL if the parameters are bad
+ */
+ptl_thread_manager_t create_work_stealing_thread_manager(int num_threads,
+														 ptl_q_t work_q,
+														 void (*rejected_handler)(void *));
+
 /**
  * Submits the function pointer to the queue that is being watched by 
- * the pool of threads.
+ * the pool of threads. The function is called with a NULL argument.
  *
  * @return 1 if successful, 0 otherwise
  */
 int submit(ptl_thread_manager_t manager, void (*function_to_execute)(void *));
 
+/**
+ * Submits the function pointer the same way as submit(), but the function
+ * is called with 'arg'.
+ *
+ * @return 1 if successful, 0 otherwise
+ */
+int submit_with_arg(ptl_thread_manager_t manager, void (*function_to_execute)(void *), void *arg);
+
+/**
+ * Submits the function pointer with a copy of 'size' bytes at 'captures',
+ * usually a struct on the caller's stack:
+ *
+ *   submit_inline(manager, fn, &captures, sizeof captures);
+ *
+ * The function is called with a pointer to the copy, which lives until the
+ * function returns. Captures of up to PTL_TASK_INLINE_SIZE bytes are kept
+ * inside the task, so the submit allocates nothing but the task.
+ *
+ * @return 1 if successful, 0 otherwise
+ */
+int submit_inline(ptl_thread_manager_t manager, void (*function_to_execute)(void *),
+				  const void *captures, size_t size);
+
 /**
  * Submits the task (ptl_task_t) to the queue that is being watched by the
  * pool of threads. This is a different flavor of submit(manager, void*).
+ * The task's function is called with its 'arg'.
+ * The manager owns the task from now on and destroys it once it has run
+ * (or has been rejected).
  *
  * @return 1 if successful, 0 otherwise
  */
@@ -135,8 +222,14 @@ int submit_task(ptl_thread_manager_t manager, ptl_task_t task);
  * Initiates an orderly shutdown in which previously submitted
  * tasks are executed, but no new tasks will be
  * accepted. Invocation has no additional effect if already shut
- * down. Shutsdown the entire thread pool, manager, and signal handler.
- * 
+ * down. Each worker exits once there is nothing left to run, and the
+ * manager is terminated when the last one has. Does not wait, see
+ * await_termination().
+ *
+ * Functions scheduled to run later (see ptl_scheduler.h) are cancelled.
+ * A submit that races the shutdown is either rejected or run. The tasks of
+ * a work-stealing manager can still submit to it, so work that is split
+ * into subtasks is finished.
  */
 void shutdown(ptl_thread_manager_t manager);
 
@@ -146,10 +239,29 @@ void shutdown(ptl_thread_manager_t manager);
  * that were awaiting execution. These tasks are drained (removed)
  * from the task queue upon return from this method.
  *
- * @return a list of tasks that never commenced execution
+ * Idle workers are woken and exit at once. A task that is already running
+ * can't be interrupted; its worker exits once it returns. A task submitted
+ * from inside such a task, or by a submit racing this call, is rejected.
+ * Functions scheduled to run later (see ptl_scheduler.h) are cancelled.
+ * The returned tasks belong to the caller, who must either run them
+ * (task->function_to_execute(task->arg), then destroy_task()) or
+ * reject_task() them.
+ *
+ * @return a linked queue of the tasks (ptl_task_t) that never commenced
+ *         execution, to be destroyed by the caller
  */
 ptl_q_t shutdown_now(ptl_thread_manager_t manager);
 
+/**
+ * Waits until the manager has terminated after shutdown() or
+ * shutdown_now(), or 'timeout' milliseconds have passed.
+ *
+ * @param manager manager to wait on
+ * @param timeout milliseconds to wait, 0 to only check
+ * @return 1 if terminated, 0 if the time ran out
+ */
+int await_termination(ptl_thread_manager_t manager, long timeout);
+
 /**
  * Returns 1 if the thread manager is terminated.
  *
@@ -172,30 +284,65 @@ void purge_cancelled(ptl_thread_manager_t manager);
 
 
  /* Policies */
+/**
+ * A task is rejected when the manager is shut down, or when it is
+ * overloaded: work_q is full and the pool is at max_pool_size. A rejected
+ * task is given to reject_task() (see ptl_task.h), so a future waiting on
+ * it finishes as rejected, and the manager's rejected_handler is called
+ * with the task's function.
+ *
+ * What happens to a task on overload is up to the rejected_handler, which
+ * may be one of the policies below, passed as the rejected_handler when the
+ * manager is created or to set_rejected_handler():
+ *
+ *   manager = create_thread_manager(2, 4, 1000, work_q, ptl_q_caller_runs_policy());
+ *
+ * After a shutdown every task is rejected, whatever the policy.
+ */
+
+/**
+ * Changes the rejected_handler (a policy below, or a function called with
+ * the rejected task's function) of a manager that is running.
+ *
+ * @param manager manager to change
+ * @param rejected_handler new handler, may be NULL
+ */
+void set_rejected_handler(ptl_thread_manager_t manager, void (*rejected_handler)(void *));
+
 /** 
- * This policy will return NULL when the task is rejected.
+ * The task is rejected and submit returns 0.
  * This is the default policy.
  *
- * @return returns NULL if the task is rejected.
+ * @return NULL, the handler for this policy
  */
 void *ptl_abort_policy();
 
 /** 
  * The thread that submitted the task, will run the task.
  * This provides a simple feedback control mechanism that will slow down 
- * the rate that new tasks are submitted.
+ * the rate that new tasks are submitted. The task runs before submit
+ * returns 1, between the before and after functions, and is counted as
+ * completed like a task a worker ran.
+ *
+ * @return the handler for this policy
  */
 void *ptl_q_caller_runs_policy();
 
 /** 
- * A task that cannot be executed is simply dropped.
+ * A task that cannot be executed is simply dropped. It is rejected, but
+ * submit returns 1.
+ *
+ * @return the handler for this policy
  */
 void *ptl_q_discard_policy();
 
 /** 
  * If the executor is not shut down, the task at the head of the work queue 
  * is dropped, and then execution is retried (which can fail again, causing 
- * this to be repeated.) 
+ * this to be repeated, in a loop.) The dropped task is rejected. In a work-stealing
+ * manager only work_q is looked at, not the deques.
+ *
+ * @return the handler for this policy
  */
 void *ptl_q_discard_oldest_policy();
 
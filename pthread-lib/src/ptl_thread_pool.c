@@ -21,6 +21,7 @@
 #include <sys/time.h>
 #include <assert.h>
 
+#include "ptl_allocator.h"
 #include "ptl_thread_pool.h"
 
 
@@ -28,10 +29,20 @@
 ptl_thread_pool_t ptl_create_thread_pool(int core_pool_size,
 										 int max_pool_size,
 										 long keep_alive_time){
+	return ptl_create_thread_pool_allocator(core_pool_size, max_pool_size, keep_alive_time, NULL);
+}
+
 
-	ptl_thread_pool_t thread_pool = (ptl_thread_pool_t)malloc(sizeof(struct ptl_thread_pool));
-	assert(thread_pool);
+/* creates the thread pool from 'allocator' */
+ptl_thread_pool_t ptl_create_thread_pool_allocator(int core_pool_size,
+												   int max_pool_size,
+												   long keep_alive_time,
+												   ptl_allocator_t allocator){
+	allocator = ptl_resolve_allocator(allocator);
+
+	ptl_thread_pool_t thread_pool = (ptl_thread_pool_t)ptl_alloc(allocator, sizeof(struct ptl_thread_pool));
 											 
+	thread_pool->allocator = allocator;
 	thread_pool->core_pool_size = core_pool_size;
 	thread_pool->max_pool_size = max_pool_size;
 	thread_pool->keep_alive_time = keep_alive_time;
@@ -41,7 +52,19 @@ ptl_thread_pool_t ptl_create_thread_pool(int core_pool_size,
 	thread_pool->completed_tasks = 0;
 											 
 	/* create memory enough for max_pool_threads */
-	thread_pool->threads = (pthread_t *)malloc(sizeof(pthread_t) * max_pool_size);
+	thread_pool->threads = (pthread_t *)ptl_alloc(allocator, sizeof(pthread_t) * max_pool_size);
+
+	return thread_pool;
+}
+
+
+/* frees the pool and its thread array */
+void ptl_destroy_thread_pool(ptl_thread_pool_t thread_pool){
+	if(thread_pool == NULL) { return; }
+
+	PTL_FREE(thread_pool->allocator, thread_pool->threads, 
+			 sizeof(pthread_t) * thread_pool->max_pool_size);
+	ptl_free(thread_pool->allocator, thread_pool, sizeof(struct ptl_thread_pool));
 }
 											 
 										
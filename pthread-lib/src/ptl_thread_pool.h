@@ -17,14 +17,17 @@
 #ifndef __PTL_THREAD_POOL_H__
 #define __PTL_THREAD_POOL_H__
 
+#include "ptl_allocator.h"
+
 /* Structures */
 struct ptl_thread_pool {
 	int core_pool_size;			/**< core size of the pool this manager is managing*/
 	int max_pool_size;			/**< max size of the pool this manager is managing*/ 
 	int current_pool_size;		/**< current pool size (between core and max) */
-	long keep_alive_time;		/**< keep alive time of each thread in the pool */
-	pthread_t *threads;			/**< actual threads */
+	long keep_alive_time;		/**< milliseconds a thread above the core size may sit idle */
+	pthread_t *threads;			/**< actual threads, the first 'current_pool_size' are running */
 	long completed_tasks;		/**< number of tasks this thread completed */
+	ptl_allocator_t allocator;	/**< where the pool and 'threads' came from */
 };
 
 
@@ -42,5 +45,27 @@ ptl_thread_pool_t ptl_create_thread_pool(int core_pool_size,
 										 int max_pool_size,
 										 long keep_alive_time);
 
+/**
+ * Creates the thread pool the same way as ptl_create_thread_pool(), but 
+ * from 'allocator' (see ptl_allocator.h).
+ *
+ * @param core_pool_size core size of the pool
+ * @param max_pool_size max size of the pool
+ * @param keep_alive_time keep alive time of each thread in the pool
+ * @param allocator allocator to use, NULL for the default
+ * @return the new pool
+ */
+ptl_thread_pool_t ptl_create_thread_pool_allocator(int core_pool_size,
+												   int max_pool_size,
+												   long keep_alive_time,
+												   ptl_allocator_t allocator);
+
+/**
+ * Frees the memory of a thread pool. Its threads must have already exited.
+ *
+ * @param thread_pool pool to free
+ */
+void ptl_destroy_thread_pool(ptl_thread_pool_t thread_pool);
+
 
 #endif
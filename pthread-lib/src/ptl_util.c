@@ -18,7 +18,9 @@
  */
 
 #include <pthread.h>
+#include <stdlib.h>
 #include <stdio.h>
+#include <assert.h>
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
@@ -29,6 +31,11 @@
  * It also houses useful wrappers useful to the programmer using this library.
  */
 
+/* Private Functions */
+void _ptl_tw_insert(ptl_timer_wheel_t wheel, ptl_timer_t timer);
+void _ptl_tw_cascade(ptl_timer_wheel_t wheel);
+unsigned long long _ptl_tw_next_tick(ptl_timer_wheel_t wheel);
+
 /* See header file for documentation */
 
 /* Wait wait_usec microseconds. */
@@ -62,5 +69,228 @@ void ptl_get_future_time(struct timespec *ts, long usec){
   gettimeofday(&tp, NULL);
 	
   tp.tv_usec += usec; // add time
+  tp.tv_sec += tp.tv_usec / 1000000; // carry whole seconds, or the wait fails
+  tp.tv_usec %= 1000000;
   TIMEVAL_TO_TIMESPEC(&tp, ts); // defined locally
 }
+
+/* Gets the current monotonic time in microseconds. */
+long long ptl_get_time_usec(){
+  struct timespec ts;
+  memset(&ts,0,sizeof(ts));
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((long long)ts.tv_sec * 1000000LL) + (ts.tv_nsec / 1000);
+}
+
+/* Creates a timer wheel, tick 0 starts now. */
+ptl_timer_wheel_t ptl_tw_create_timer_wheel(long tick_usec){
+  if(tick_usec <= 0){ return NULL; }
+
+  ptl_timer_wheel_t wheel = (ptl_timer_wheel_t)calloc(1, sizeof(struct ptl_timer_wheel));
+  assert(wheel);
+
+  wheel->tick_usec = tick_usec;
+  wheel->start_usec = ptl_get_time_usec();
+
+  return wheel;
+}
+
+/* Frees the wheel, the timers are the caller's. */
+void ptl_tw_destroy_timer_wheel(ptl_timer_wheel_t wheel){
+  FREE(wheel);
+}
+
+/* Sets up a timer that is not pending. */
+void ptl_tw_init_timer(ptl_timer_t timer, void (*function)(ptl_timer_t, void *), void *arg){
+  memset(timer, 0, sizeof(struct ptl_timer));
+  timer->function = function;
+  timer->arg = arg;
+}
+
+/* Puts a timer in the slot for 'expires_usec', rounded up to a tick. */
+int ptl_tw_add(ptl_timer_wheel_t wheel, ptl_timer_t timer, long long expires_usec){
+  if(wheel == NULL || timer == NULL || timer->function == NULL){ return 0; }
+
+  ptl_tw_cancel(wheel, timer);
+
+  // never early: a timer for part way into a tick expires at the next one
+  long long delta = expires_usec - wheel->start_usec;
+  timer->expires = (delta > 0) ? (unsigned long long)((delta + wheel->tick_usec - 1) / wheel->tick_usec) : 0;
+
+  _ptl_tw_insert(wheel, timer);
+  wheel->size++;
+
+  return 1;
+}
+
+/* Unlinks a pending timer. */
+int ptl_tw_cancel(ptl_timer_wheel_t wheel, ptl_timer_t timer){
+  if(wheel == NULL || timer == NULL || timer->pprev == NULL){ return 0; }
+
+  *(timer->pprev) = timer->next;
+  if(timer->next){
+    timer->next->pprev = timer->pprev;
+  }
+  timer->next = NULL;
+  timer->pprev = NULL;
+  wheel->size--;
+
+  return 1;
+}
+
+/* A timer is pending while something points at it. */
+int ptl_tw_is_pending(ptl_timer_t timer){
+  return (timer != NULL && timer->pprev != NULL);
+}
+
+/* Expires every tick up to 'now_usec', skipping the empty ones. */
+long ptl_tw_advance(ptl_timer_wheel_t wheel, long long now_usec){
+  if(wheel == NULL || now_usec < wheel->start_usec){ return 0; }
+
+  unsigned long long target = (unsigned long long)((now_usec - wheel->start_usec) / wheel->tick_usec);
+  long expired = 0;
+
+  while(wheel->now <= target){
+    if(wheel->size == 0){
+      wheel->now = target + 1; // nothing to cascade either
+      break;
+    }
+
+    // no timer expires before this tick, and it is not past a cascade
+    unsigned long long tick = _ptl_tw_next_tick(wheel);
+    if(tick > target){
+      wheel->now = target + 1;
+      break;
+    }
+    wheel->now = tick;
+
+    int index = (int)(tick & PTL_TW_MASK);
+    if(index == 0){
+      _ptl_tw_cascade(wheel);
+    }
+
+    // take the slot's list, its head points back at 'list' so a function
+    // can still cancel a timer in it
+    ptl_timer_t list = wheel->slots[0][index];
+    wheel->slots[0][index] = NULL;
+    wheel->occupied[index / 64] &= ~(1ULL << (index % 64));
+    if(list){
+      list->pprev = &list;
+    }
+
+    // a timer added from a function, for now or before, goes in the next tick
+    wheel->now = tick + 1;
+
+    while(list){
+      ptl_timer_t timer = list;
+      list = timer->next;
+      if(list){
+        list->pprev = &list;
+      }
+      timer->next = NULL;
+      timer->pprev = NULL;
+      wheel->size--;
+      expired++;
+
+      timer->function(timer, timer->arg);
+    }
+  }
+
+  return expired;
+}
+
+/* Earliest time ptl_tw_advance() may have work, -1 if none. */
+long long ptl_tw_next_expiry(ptl_timer_wheel_t wheel){
+  if(wheel == NULL || wheel->size == 0){ return -1; }
+
+  return wheel->start_usec + ((long long)_ptl_tw_next_tick(wheel) * wheel->tick_usec);
+}
+
+/* Number of pending timers. */
+long ptl_tw_size(ptl_timer_wheel_t wheel){
+  return (wheel != NULL) ? wheel->size : 0;
+}
+
+
+/* Private Functions */
+
+/* Links a timer into the lowest level that reaches its tick. */
+void _ptl_tw_insert(ptl_timer_wheel_t wheel, ptl_timer_t timer){
+  unsigned long long expires = timer->expires;
+  int level = 0;
+
+  if(expires < wheel->now){
+    expires = wheel->now; // already expired, goes in the next tick
+  } else if(expires - wheel->now >= (1ULL << (PTL_TW_BITS * PTL_TW_LEVELS))){
+    // out of range, waits in the last level and is put back when it comes up
+    expires = wheel->now + (1ULL << (PTL_TW_BITS * PTL_TW_LEVELS)) - 1;
+  }
+
+  while(level < PTL_TW_LEVELS - 1 && expires - wheel->now >= (1ULL << (PTL_TW_BITS * (level + 1)))){
+    level++;
+  }
+
+  int index = (int)((expires >> (PTL_TW_BITS * level)) & PTL_TW_MASK);
+  ptl_timer_t *slot = &(wheel->slots[level][index]);
+
+  timer->next = *slot;
+  if(timer->next){
+    timer->next->pprev = &(timer->next);
+  }
+  timer->pprev = slot;
+  *slot = timer;
+
+  if(level == 0){
+    wheel->occupied[index / 64] |= (1ULL << (index % 64));
+  }
+}
+
+/* Level 0 wrapped: moves the next slot of each level down, as far up as wrapped too. */
+void _ptl_tw_cascade(ptl_timer_wheel_t wheel){
+  int level = 0;
+
+  for(level=1; level<PTL_TW_LEVELS; level++){
+    int index = (int)((wheel->now >> (PTL_TW_BITS * level)) & PTL_TW_MASK);
+    ptl_timer_t list = wheel->slots[level][index];
+    wheel->slots[level][index] = NULL;
+
+    while(list){
+      ptl_timer_t timer = list;
+      list = timer->next;
+      _ptl_tw_insert(wheel, timer); // lands in a lower level now
+    }
+
+    if(index != 0){ break; }
+  }
+}
+
+/* The next tick with timers in level 0, or the next cascade if sooner. */
+unsigned long long _ptl_tw_next_tick(ptl_timer_wheel_t wheel){
+  unsigned long long base = wheel->now & ~((unsigned long long)PTL_TW_MASK);
+  int index = (int)(wheel->now & PTL_TW_MASK);
+
+  // a cascade is due now, it may bring timers into this tick
+  if(index == 0 && wheel->now != 0){
+    return wheel->now;
+  }
+
+  // slots before 'index' hold the next time around, after the cascade
+  while(index < PTL_TW_SIZE){
+    unsigned long long bits = wheel->occupied[index / 64] >> (index % 64);
+    if(bits == 0){
+      index = (index / 64 + 1) * 64;
+      continue;
+    }
+    index += __builtin_ctzll(bits);
+
+    if(wheel->slots[0][index]){
+      return base + index;
+    }
+    wheel->occupied[index / 64] &= ~(1ULL << (index % 64)); // emptied by cancels
+    index++;
+  }
+
+  return base + PTL_TW_SIZE;
+}
@@ -46,6 +46,57 @@
 }
 
 
+/* Timer wheel */
+
+/**
+ * A hierarchical timing wheel (Varghese and Lauck) keeps a large number of
+ * timers for about the cost of a linked list. Time is cut into ticks of
+ * 'tick_usec' microseconds. Level 0 has a slot per tick for the next
+ * PTL_TW_SIZE ticks; each higher level has a slot per PTL_TW_SIZE slots of
+ * the level below. A timer goes in the slot of the lowest level whose range
+ * it falls in, so adding and cancelling one is O(1). Each time level 0 wraps
+ * around, the next slot of level 1 is emptied into level 0, and so on up
+ * (a cascade), so a timer moves down at most PTL_TW_LEVELS - 1 times.
+ *
+ * The timers belong to the caller (a struct ptl_timer, often inside a
+ * bigger struct), so the wheel allocates nothing after it is created: it is
+ * PTL_TW_LEVELS * PTL_TW_SIZE pointers, and a timer is five words. Timers
+ * are never early, and are late by less than a tick plus however late
+ * ptl_tw_advance() is called. Timers more than 2^(PTL_TW_LEVELS *
+ * PTL_TW_BITS) ticks away wait in the last level and are put back when
+ * they come up.
+ *
+ * The wheel is not locked. It is meant to be owned by one thread (a timer
+ * thread, or a thread that runs timeouts between other work); otherwise
+ * the caller has to lock around it.
+ */
+#define PTL_TW_BITS   8							/**< bits of ticks per level */
+#define PTL_TW_SIZE   (1 << PTL_TW_BITS)		/**< slots per level */
+#define PTL_TW_MASK   (PTL_TW_SIZE - 1)
+#define PTL_TW_LEVELS 4							/**< levels, the range is 2^32 ticks */
+
+/* A timer, owned by the caller */
+struct ptl_timer {
+	struct ptl_timer *next;					/**< next in its slot */
+	struct ptl_timer **pprev;				/**< what points at this one, NULL if not pending */
+	unsigned long long expires;				/**< tick it expires on */
+	void (*function)(struct ptl_timer *, void *);	/**< called when it expires */
+	void *arg;								/**< passed to 'function' */
+};
+
+struct ptl_timer_wheel {
+	long tick_usec;							/**< length of a tick */
+	long long start_usec;					/**< when tick 0 began, ptl_get_time_usec() time */
+	unsigned long long now;					/**< next tick to expire */
+	long size;								/**< pending timers */
+	unsigned long long occupied[PTL_TW_SIZE / 64];	/**< level 0 slots that may have timers */
+	struct ptl_timer *slots[PTL_TW_LEVELS][PTL_TW_SIZE];	/**< the levels */
+};
+
+typedef struct ptl_timer *ptl_timer_t;
+typedef struct ptl_timer_wheel *ptl_timer_wheel_t;
+
+
 /* Public Functions */
 
 /**
@@ -66,4 +117,98 @@ int ptl_timed_wait(long wait_usec);
  */
 void ptl_get_future_time(struct timespec *ts, long usec);
 
+/**
+ * Gets the current time in microseconds from a monotonic clock. This is only
+ * meaningful when compared with another value returned by this function
+ * (e.g. to measure how long an element has been sitting in a queue).
+ *
+ * @return current monotonic time in microseconds
+ */
+long long ptl_get_time_usec();
+
+/**
+ * Creates an empty timer wheel whose tick 0 starts now.
+ * To finish using it, be sure to call the 'destroy' function.
+ *
+ * @param tick_usec microseconds per tick, the resolution of the timers
+ * @return the wheel, NULL if 'tick_usec' is not positive
+ */
+ptl_timer_wheel_t ptl_tw_create_timer_wheel(long tick_usec);
+
+/**
+ * Destroys a timer wheel. Timers still pending are not called or freed.
+ *
+ * @param wheel wheel to be freed
+ */
+void ptl_tw_destroy_timer_wheel(ptl_timer_wheel_t wheel);
+
+/**
+ * Sets up a timer that is not pending. It must be done once before the
+ * timer is first added.
+ *
+ * @param timer timer to set up
+ * @param function called with the timer and 'arg' when it expires
+ * @param arg passed to 'function'
+ */
+void ptl_tw_init_timer(ptl_timer_t timer, void (*function)(ptl_timer_t, void *), void *arg);
+
+/**
+ * Makes a timer expire at 'expires_usec'. A timer that is already pending
+ * is moved. A time that has passed expires on the next tick that
+ * ptl_tw_advance() reaches.
+ * A timer's function may add it again. O(1).
+ *
+ * @param wheel wheel to add to
+ * @param timer timer set up with ptl_tw_init_timer()
+ * @param expires_usec when it expires, in ptl_get_time_usec() time
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_tw_add(ptl_timer_wheel_t wheel, ptl_timer_t timer, long long expires_usec);
+
+/**
+ * Takes a pending timer out of the wheel without calling it. O(1).
+ *
+ * @param wheel wheel it is in
+ * @param timer timer to cancel
+ * @return 1 if it was pending, 0 otherwise
+ */
+int ptl_tw_cancel(ptl_timer_wheel_t wheel, ptl_timer_t timer);
+
+/**
+ * Checks if a timer is in a wheel.
+ *
+ * @param timer timer to check
+ * @return 1 if it is pending, 0 otherwise
+ */
+int ptl_tw_is_pending(ptl_timer_t timer);
+
+/**
+ * Calls, in order of their ticks, every timer that has expired by
+ * 'now_usec', usually ptl_get_time_usec(). Runs of empty ticks are skipped.
+ * A function may add and cancel timers, including itself.
+ *
+ * @param wheel wheel to advance
+ * @param now_usec the time now, in ptl_get_time_usec() time
+ * @return number of timers called
+ */
+long ptl_tw_advance(ptl_timer_wheel_t wheel, long long now_usec);
+
+/**
+ * Gets a time by which ptl_tw_advance() has to be called again: the next
+ * tick with a timer in level 0, or the next cascade, whichever is sooner.
+ * No timer expires before it, so a timer thread can sleep until then.
+ *
+ * @param wheel wheel to look at
+ * @return the time in ptl_get_time_usec() time, -1 if no timer is pending
+ */
+long long ptl_tw_next_expiry(ptl_timer_wheel_t wheel);
+
+/**
+ * Gets the number of pending timers.
+ *
+ * @param wheel wheel to count
+ * @return number of timers
+ */
+long ptl_tw_size(ptl_timer_wheel_t wheel);
+
 #endif
@@ -0,0 +1,204 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/* See header file for documentation. */
+
+/*
+ * The memory orders are the ones from "Correct and Efficient Work-Stealing
+ * for Weak Memory Models" (Le, Pop, Cohen and Zappa Nardelli, 2013), except
+ * that push publishes with a release store instead of a release fence and a
+ * relaxed store, and a thief loads the buffer with acquire instead of
+ * consume. Both cost the same on x86 and thread sanitizer understands them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "ptl_work_deque.h"
+
+
+/* Private Functions */
+struct ptl_wd_array *_ptl_wd_create_array(ptl_work_deque_t deque, long size);
+struct ptl_wd_array *_ptl_wd_grow(ptl_work_deque_t deque, struct ptl_wd_array *array,
+								  long top, long bottom);
+void *_ptl_wd_load(struct ptl_wd_array *array, long i);
+void _ptl_wd_store(struct ptl_wd_array *array, long i, void *value);
+
+
+/* create an empty deque */
+ptl_work_deque_t ptl_wd_create_work_deque(ptl_allocator_t allocator){
+	allocator = ptl_resolve_allocator(allocator);
+
+	ptl_work_deque_t deque = (ptl_work_deque_t)ptl_calloc(allocator, 1, sizeof(struct ptl_work_deque));
+
+	deque->allocator = allocator;
+	deque->top = 0;
+	deque->bottom = 0;
+	deque->array = _ptl_wd_create_array(deque, PTL_WD_INITIAL_SIZE);
+
+	return deque;
+}
+
+
+/* free the deque and every buffer it has had */
+int ptl_wd_destroy_work_deque(ptl_work_deque_t deque){
+	if(deque == NULL){ return 0; }
+
+	struct ptl_wd_array *array = deque->array;
+	while(array != NULL){
+		struct ptl_wd_array *prev = array->prev;
+		ptl_free(deque->allocator, array, sizeof(struct ptl_wd_array) + (array->size * sizeof(void *)));
+		array = prev;
+	}
+
+	ptl_free(deque->allocator, deque, sizeof(struct ptl_work_deque));
+
+	return 1;
+}
+
+
+/* push on the bottom, owner only */
+int ptl_wd_push(ptl_work_deque_t deque, void *value){
+	if(deque == NULL || value == NULL){ return 0; }
+
+	long bottom = __atomic_load_n(&(deque->bottom), __ATOMIC_RELAXED);
+	long top = __atomic_load_n(&(deque->top), __ATOMIC_ACQUIRE);
+	struct ptl_wd_array *array = __atomic_load_n(&(deque->array), __ATOMIC_RELAXED);
+
+	if(bottom - top > array->size - 1){
+		array = _ptl_wd_grow(deque, array, top, bottom);
+	}
+
+	_ptl_wd_store(array, bottom, value);
+
+	// the slot has to be visible before a thief can see the new bottom
+	__atomic_store_n(&(deque->bottom), bottom + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+
+/* pop from the bottom, owner only */
+void *ptl_wd_pop(ptl_work_deque_t deque){
+	if(deque == NULL){ return NULL; }
+
+	long bottom = __atomic_load_n(&(deque->bottom), __ATOMIC_RELAXED) - 1;
+	struct ptl_wd_array *array = __atomic_load_n(&(deque->array), __ATOMIC_RELAXED);
+
+	// claim the slot before looking at top, so a thief sees the claim
+	__atomic_store_n(&(deque->bottom), bottom, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long top = __atomic_load_n(&(deque->top), __ATOMIC_RELAXED);
+
+	void *value = NULL;
+
+	if(top <= bottom){
+		value = _ptl_wd_load(array, bottom);
+
+		if(top == bottom){
+			// the last one, race the thieves for it
+			if(!__atomic_compare_exchange_n(&(deque->top), &top, top + 1,
+											0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){
+				value = NULL;
+			}
+			__atomic_store_n(&(deque->bottom), bottom + 1, __ATOMIC_RELAXED);
+		}
+	}else{
+		// it was empty
+		__atomic_store_n(&(deque->bottom), bottom + 1, __ATOMIC_RELAXED);
+	}
+
+	return value;
+}
+
+
+/* take from the top, any thread */
+void *ptl_wd_steal(ptl_work_deque_t deque){
+	if(deque == NULL){ return NULL; }
+
+	while(1){
+		long top = __atomic_load_n(&(deque->top), __ATOMIC_ACQUIRE);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		long bottom = __atomic_load_n(&(deque->bottom), __ATOMIC_ACQUIRE);
+
+		if(top >= bottom){ return NULL; }
+
+		struct ptl_wd_array *array = __atomic_load_n(&(deque->array), __ATOMIC_ACQUIRE);
+		void *value = _ptl_wd_load(array, top);
+
+		if(__atomic_compare_exchange_n(&(deque->top), &top, top + 1,
+									   0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)){
+			return value;
+		}
+
+		// lost to the owner or another thief, look again
+	}
+}
+
+
+/* number of elements */
+long ptl_wd_size(ptl_work_deque_t deque){
+	if(deque == NULL){ return 0; }
+
+	long bottom = __atomic_load_n(&(deque->bottom), __ATOMIC_ACQUIRE);
+	long top = __atomic_load_n(&(deque->top), __ATOMIC_ACQUIRE);
+
+	return (bottom > top) ? bottom - top : 0;
+}
+
+
+/* Private Functions */
+
+/* a buffer of 'size' slots */
+struct ptl_wd_array *_ptl_wd_create_array(ptl_work_deque_t deque, long size){
+	struct ptl_wd_array *array = (struct ptl_wd_array *)ptl_calloc(deque->allocator, 1,
+								  sizeof(struct ptl_wd_array) + (size * sizeof(void *)));
+
+	array->size = size;
+	array->prev = NULL;
+
+	return array;
+}
+
+/* doubles the buffer, keeping the old one for thieves still reading it */
+struct ptl_wd_array *_ptl_wd_grow(ptl_work_deque_t deque, struct ptl_wd_array *array,
+								  long top, long bottom){
+	struct ptl_wd_array *new_array = _ptl_wd_create_array(deque, array->size * 2);
+	long i = 0;
+
+	for(i=top; i<bottom; i++){
+		_ptl_wd_store(new_array, i, _ptl_wd_load(array, i));
+	}
+	new_array->prev = array;
+
+	__atomic_store_n(&(deque->array), new_array, __ATOMIC_RELEASE);
+
+	return new_array;
+}
+
+/* slot 'i', wrapped */
+void *_ptl_wd_load(struct ptl_wd_array *array, long i){
+	return __atomic_load_n(&(array->slots[i & (array->size - 1)]), __ATOMIC_RELAXED);
+}
+
+/* set slot 'i', wrapped */
+void _ptl_wd_store(struct ptl_wd_array *array, long i, void *value){
+	__atomic_store_n(&(array->slots[i & (array->size - 1)]), value, __ATOMIC_RELAXED);
+}
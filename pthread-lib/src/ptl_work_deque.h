@@ -0,0 +1,121 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+
+/**
+ * This "class" is a work-stealing deque (Chase and Lev) for one owner thread
+ * and any number of thieves. The owner pushes and pops at the bottom, like a
+ * stack, so the task it pushed last (and whose data is still in its cache)
+ * runs next. Thieves take from the top, the oldest tasks, which in a
+ * fork/join program are the biggest pieces of work.
+ *
+ * No operation takes a lock. Push and pop touch only the owner's end unless
+ * the deque is down to its last element; a steal is one compare and swap.
+ *
+ * The buffer is circular and doubles when full. Only the owner grows it. An
+ * outgrown buffer may still be read by a thief that is in the middle of a
+ * steal, so it is kept until the deque is destroyed; the buffers only double,
+ * so that at most doubles the memory used.
+ */
+
+
+#ifndef __PTL_WORK_DEQUE_H__
+#define __PTL_WORK_DEQUE_H__
+
+#include "ptl_allocator.h"
+
+/* Defines */
+#define PTL_WD_INITIAL_SIZE 256		/**< slots in a new deque, a power of two */
+
+/* Structures */
+
+/* A circular buffer of slots */
+struct ptl_wd_array {
+	long size;						/**< number of slots, a power of two */
+	struct ptl_wd_array *prev;		/**< the buffer this one replaced */
+	void *slots[];					/**< the elements */
+};
+
+struct ptl_work_deque {
+	long top;						/**< next index to steal */
+	char pad1[64 - sizeof(long)];	/**< keeps thieves off the owner's line */
+	long bottom;					/**< next index to push, owner only */
+	struct ptl_wd_array *array;		/**< current buffer */
+	ptl_allocator_t allocator;		/**< where the deque and buffers come from */
+	char pad2[64 - sizeof(long) - 2 * sizeof(void *)];
+};
+
+/* Type Definitions */
+typedef struct ptl_work_deque *ptl_work_deque_t;
+
+
+/* Public Functions */
+
+/**
+ * Creates an empty deque.
+ * To finish using this data structure, be sure to call the 'destroy' function.
+ *
+ * @param allocator allocator to use, NULL for the default
+ * @return a fully initialized deque
+ */
+ptl_work_deque_t ptl_wd_create_work_deque(ptl_allocator_t allocator);
+
+/**
+ * Destroys a deque. The elements are not freed. No thread may be using it.
+ *
+ * @param deque deque to be freed
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_wd_destroy_work_deque(ptl_work_deque_t deque);
+
+/**
+ * Pushes 'value' on the bottom. Owner only.
+ *
+ * @param deque deque to push on
+ * @param value non-null value
+ * @return 1 if successful, 0 otherwise
+ */
+int ptl_wd_push(ptl_work_deque_t deque, void *value);
+
+/**
+ * Pops the value pushed last. Owner only.
+ *
+ * @param deque deque to pop from
+ * @return the value, NULL if the deque is empty
+ */
+void *ptl_wd_pop(ptl_work_deque_t deque);
+
+/**
+ * Takes the oldest value. Any thread may steal.
+ *
+ * @param deque deque to steal from
+ * @return the value, NULL if the deque is empty
+ */
+void *ptl_wd_steal(ptl_work_deque_t deque);
+
+/**
+ * Gets the number of elements. Only exact when no other thread is using the
+ * deque.
+ *
+ * @param deque deque to count
+ * @return number of elements
+ */
+long ptl_wd_size(ptl_work_deque_t deque);
+
+#endif
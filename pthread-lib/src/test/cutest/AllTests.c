@@ -4,22 +4,58 @@
 
 CuSuite* CuGetSuite();
 CuSuite* CuStringGetSuite();
+CuSuite* PtlArrayListGetSuite();
+CuSuite* PtlFutureGetSuite();
+CuSuite* PtlRingQueueGetSuite();
+CuSuite* PtlThreadManagerGetSuite();
+CuSuite* PtlTaskGetSuite();
+CuSuite* PtlHashMapGetSuite();
+CuSuite* PtlCodelQueueGetSuite();
+CuSuite* PtlCoalescingQueueGetSuite();
+CuSuite* PtlRateLimitedQueueGetSuite();
+CuSuite* PtlSnapshotListGetSuite();
+CuSuite* PtlConcurrentVectorGetSuite();
+CuSuite* PtlParallelGetSuite();
+CuSuite* PtlAllocatorGetSuite();
+CuSuite* PtlWorkDequeGetSuite();
+CuSuite* PtlSchedulerGetSuite();
+CuSuite* PtlTimerWheelGetSuite();
+CuSuite* PtlLinkedQueueGetSuite();
 
-void RunAllTests(void)
+int RunAllTests(void)
 {
 	CuString *output = CuStringNew();
 	CuSuite* suite = CuSuiteNew();
 
 	CuSuiteAddSuite(suite, CuGetSuite());
 	CuSuiteAddSuite(suite, CuStringGetSuite());
+	CuSuiteAddSuite(suite, PtlArrayListGetSuite());
+	CuSuiteAddSuite(suite, PtlFutureGetSuite());
+	CuSuiteAddSuite(suite, PtlRingQueueGetSuite());
+	CuSuiteAddSuite(suite, PtlThreadManagerGetSuite());
+	CuSuiteAddSuite(suite, PtlTaskGetSuite());
+	CuSuiteAddSuite(suite, PtlHashMapGetSuite());
+	CuSuiteAddSuite(suite, PtlCodelQueueGetSuite());
+	CuSuiteAddSuite(suite, PtlCoalescingQueueGetSuite());
+	CuSuiteAddSuite(suite, PtlRateLimitedQueueGetSuite());
+	CuSuiteAddSuite(suite, PtlSnapshotListGetSuite());
+	CuSuiteAddSuite(suite, PtlConcurrentVectorGetSuite());
+	CuSuiteAddSuite(suite, PtlParallelGetSuite());
+	CuSuiteAddSuite(suite, PtlAllocatorGetSuite());
+	CuSuiteAddSuite(suite, PtlWorkDequeGetSuite());
+	CuSuiteAddSuite(suite, PtlSchedulerGetSuite());
+	CuSuiteAddSuite(suite, PtlTimerWheelGetSuite());
+	CuSuiteAddSuite(suite, PtlLinkedQueueGetSuite());
 
 	CuSuiteRun(suite);
 	CuSuiteSummary(suite, output);
 	CuSuiteDetails(suite, output);
 	printf("%s\n", output->buffer);
+
+	return suite->failCount;
 }
 
 int main(void)
 {
-	RunAllTests();
+	return (RunAllTests() == 0) ? 0 : 1;
 }
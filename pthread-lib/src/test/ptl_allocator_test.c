@@ -0,0 +1,153 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cutest/CuTest.h"
+#include "../ptl_allocator.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_array_list.h"
+#include "../ptl_hash_map.h"
+#include "../ptl_snapshot_list.h"
+#include "../ptl_concurrent_vector.h"
+
+/* elements only need distinct addresses */
+static int values[256];
+
+static struct ptl_q_funcs allocator_test_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+
+/* the counts follow every call, reallocations included */
+void TestAllocatorCounts(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	CuAssertPtrEquals(tc, ptl_get_default_allocator(), stats.inner);
+
+	char *a = (char *)ptl_alloc(&counting, 100);
+	char *b = (char *)ptl_calloc(&counting, 10, 30);
+	CuAssertIntEquals(tc, 400, (int)stats.bytes_in_use);
+	CuAssertIntEquals(tc, 0, b[299]);
+
+	a = (char *)ptl_realloc(&counting, a, 100, 1000);
+	CuAssertIntEquals(tc, 1300, (int)stats.bytes_in_use);
+	CuAssertIntEquals(tc, 1300, (int)stats.peak_bytes);
+
+	ptl_free(&counting, a, 1000);
+	ptl_free(&counting, b, 300);
+	ptl_free(&counting, NULL, 10);
+	CuAssertIntEquals(tc, 3, (int)stats.num_allocs);
+	CuAssertIntEquals(tc, 2, (int)stats.num_frees);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+	CuAssertIntEquals(tc, 1300, (int)stats.peak_bytes);
+}
+
+/* every container gives back all it took from its allocator */
+void TestAllocatorContainersReturnAll(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	int i = 0;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+
+	ptl_array_list_t sparse = ptl_al_create_array_list_allocator(4, PTL_AL_MODE_SPARSE, &counting);
+	ptl_array_list_t dense = ptl_al_create_array_list_allocator(4, PTL_AL_MODE_DENSE, &counting);
+	ptl_hash_map_t map = ptl_hm_create_hash_map_allocator(NULL, NULL, 16, 4, &counting);
+	ptl_snapshot_list_t snapshots = ptl_sl_create_snapshot_list_allocator(&counting);
+	ptl_concurrent_vector_t vector = ptl_cv_create_concurrent_vector_allocator(&counting);
+	ptl_q_t q = ptl_q_create_queue_allocator(&allocator_test_q_funcs, 0, &counting);
+
+	for(i=0; i<256; i++){
+		ptl_al_add(sparse, &values[i]);
+		ptl_al_add(dense, &values[i]);
+		ptl_hm_put(map, &values[i], &values[i]);
+		ptl_cv_push_back(vector, &values[i]);
+		ptl_lq_add(q, &values[i]);
+		if(i < 32){
+			ptl_sl_add(snapshots, &values[i]);
+		}
+	}
+	ptl_al_set(sparse, &values[0], 1000);
+	ptl_al_trim_to_size(dense);
+	for(i=0; i<128; i++){
+		ptl_hm_remove(map, &values[i]);
+		ptl_lq_get(q);
+		ptl_sl_remove_index(snapshots, 0);
+	}
+	CuAssertTrue(tc, stats.bytes_in_use > 0);
+
+	// the queue would free what is left in it
+	while(ptl_lq_get(q) != NULL);
+
+	ptl_al_destroy_array_list(sparse);
+	ptl_al_destroy_array_list(dense);
+	ptl_hm_destroy_hash_map(map);
+	ptl_sl_destroy_snapshot_list(snapshots);
+	ptl_cv_destroy_concurrent_vector(vector);
+	ptl_q_destroy_queue(q);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+/* changing the default only affects containers created afterwards */
+void TestAllocatorDefaultOnlyForNew(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	int i = 0;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	ptl_array_list_t before = ptl_al_create_array_list_size(4);
+
+	ptl_set_default_allocator(&counting);
+	CuAssertPtrEquals(tc, &counting, ptl_get_default_allocator());
+	CuAssertPtrEquals(tc, &counting, ptl_resolve_allocator(NULL));
+	ptl_array_list_t after = ptl_al_create_array_list_size(4);
+	ptl_set_default_allocator(NULL);
+
+	CuAssertPtrEquals(tc, ptl_get_malloc_allocator(), ptl_get_default_allocator());
+	CuAssertPtrEquals(tc, ptl_get_malloc_allocator(), before->allocator);
+	CuAssertPtrEquals(tc, &counting, after->allocator);
+
+	// growing after the default went back still uses the list's own allocator
+	long allocs = stats.num_allocs;
+	for(i=0; i<100; i++){
+		ptl_al_add(before, &values[i]);
+		ptl_al_add(after, &values[i]);
+	}
+	CuAssertTrue(tc, stats.num_allocs > allocs);
+
+	ptl_al_destroy_array_list(before);
+	ptl_al_destroy_array_list(after);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+
+CuSuite *PtlAllocatorGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestAllocatorCounts);
+	SUITE_ADD_TEST(suite, TestAllocatorContainersReturnAll);
+	SUITE_ADD_TEST(suite, TestAllocatorDefaultOnlyForNew);
+
+	return suite;
+}
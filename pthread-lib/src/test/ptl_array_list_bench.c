@@ -0,0 +1,149 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/*
+ * Times ptl_al_index_of() and ptl_al_index_of_any() scanning lists of
+ * different sizes for a value that is not there, next to the scalar and
+ * SSE2 searches the list can pick from. Prints nanoseconds per search.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../ptl_array_list.h"
+#include "../ptl_util.h"
+
+/* the list's own search functions, so they can be timed side by side */
+int _find_scalar(void **array, int length, void *value);
+#if defined(__x86_64__) && defined(__GNUC__)
+int _find_sse2(void **array, int length, void *value);
+#endif
+
+#define BENCH_MIN_USEC 200000	/* each number is timed for at least this long */
+#define BENCH_BATCH 64			/* calls between reads of the clock */
+#define BENCH_NUM_ANY 4			/* values looked for at once */
+
+static int bench_sizes[] = {16, 256, 4096, 65536, 1 << 20};
+
+/* the searches only compare pointers, they are never followed */
+static char bench_missing[BENCH_NUM_ANY];
+
+/* keeps the compiler from dropping a search whose result is unused */
+static volatile long bench_sink = 0;
+
+/* ns per call of 'find' on 'length' pointers */
+static double bench_find(int (*find)(void **, int, void *), void **array, int length){
+	long long start = ptl_get_time_usec();
+	long long elapsed = 0;
+	long calls = 0;
+	int k = 0;
+
+	do {
+		for(k=0; k<BENCH_BATCH; k++){
+			bench_sink += find(array, length, &bench_missing[0]);
+		}
+		calls += BENCH_BATCH;
+		elapsed = ptl_get_time_usec() - start;
+	} while(elapsed < BENCH_MIN_USEC);
+
+	return (elapsed * 1000.0) / calls;
+}
+
+/* ns per ptl_al_index_of() */
+static double bench_index_of(ptl_array_list_t list){
+	long long start = ptl_get_time_usec();
+	long long elapsed = 0;
+	long calls = 0;
+	int k = 0;
+
+	do {
+		for(k=0; k<BENCH_BATCH; k++){
+			bench_sink += ptl_al_index_of(list, &bench_missing[0]);
+		}
+		calls += BENCH_BATCH;
+		elapsed = ptl_get_time_usec() - start;
+	} while(elapsed < BENCH_MIN_USEC);
+
+	return (elapsed * 1000.0) / calls;
+}
+
+/* ns per search for BENCH_NUM_ANY values, in one pass or one value at a time */
+static double bench_index_of_any(ptl_array_list_t list, int one_pass){
+	void *values[BENCH_NUM_ANY];
+	int indexes[BENCH_NUM_ANY];
+	long long start = ptl_get_time_usec();
+	long long elapsed = 0;
+	long calls = 0;
+	int j = 0, k = 0;
+
+	for(j=0; j<BENCH_NUM_ANY; j++){
+		values[j] = &bench_missing[j];
+	}
+
+	do {
+		for(k=0; k<BENCH_BATCH; k++){
+			if(one_pass){
+				bench_sink += ptl_al_index_of_any(list, values, BENCH_NUM_ANY, indexes);
+			} else {
+				for(j=0; j<BENCH_NUM_ANY; j++){
+					bench_sink += ptl_al_index_of(list, values[j]);
+				}
+			}
+		}
+		calls += BENCH_BATCH;
+		elapsed = ptl_get_time_usec() - start;
+	} while(elapsed < BENCH_MIN_USEC);
+
+	return (elapsed * 1000.0) / calls;
+}
+
+
+int main(int argc, char **argv){
+	int num_sizes = sizeof(bench_sizes) / sizeof(bench_sizes[0]);
+	int s = 0, i = 0;
+
+	printf("ns per search for a missing value\n");
+	printf("%10s %12s %12s %12s %16s %16s\n", "size", "scalar", "sse2", "index_of",
+		   "4 x index_of", "index_of_any(4)");
+
+	for(s=0; s<num_sizes; s++){
+		int size = bench_sizes[s];
+		ptl_array_list_t list = ptl_al_create_array_list_size(size);
+
+		for(i=0; i<size; i++){
+			ptl_al_add(list, (void *)(long)(4096 + i));
+		}
+
+		double scalar = bench_find(_find_scalar, list->array, size);
+#if defined(__x86_64__) && defined(__GNUC__)
+		double sse2 = bench_find(_find_sse2, list->array, size);
+#else
+		double sse2 = scalar;
+#endif
+		double index_of = bench_index_of(list);
+		double separate = bench_index_of_any(list, 0);
+		double one_pass = bench_index_of_any(list, 1);
+
+		printf("%10d %12.1f %12.1f %12.1f %16.1f %16.1f\n", size, scalar, sse2, index_of,
+			   separate, one_pass);
+
+		ptl_al_destroy_array_list(list);
+	}
+
+	return 0;
+}
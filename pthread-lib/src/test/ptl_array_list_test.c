@@ -0,0 +1,490 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_array_list.h"
+
+/* elements only need distinct addresses */
+static int values[16];
+
+/* for the searches, long enough to cover every vector width and tail */
+#define AL_TEST_SEARCH_MAX 70
+static char search_values[AL_TEST_SEARCH_MAX + 8];
+
+/* past the cutoff where the parallel sort uses more than one thread */
+#define AL_TEST_SORT_MAX 50000
+
+/* sorted elements are small integers, never 0 */
+#define AL_TEST_SORT_VALUE(i) ((void *)(intptr_t)((i) + 1))
+
+/* the work queue of the sorting manager */
+static struct ptl_q_funcs al_test_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+static int al_test_cmp(const void *a, const void *b){
+	intptr_t x = (intptr_t)*(void **)a;
+	intptr_t y = (intptr_t)*(void **)b;
+	return (x > y) - (x < y);
+}
+
+/* fills a dense list with a permutation of 0 to n-1: sorted, reversed,
+   two sorted halves interleaved, or shuffled */
+static ptl_array_list_t al_test_sort_list(int n, int order){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(n + 1, PTL_AL_MODE_DENSE);
+	unsigned long seed = 12345;
+	int i = 0, j = 0;
+
+	for(i=0; i<n; i++){
+		switch(order){
+			case 1: j = n - 1 - i; break;
+			case 2: j = (i % 2) ? ((n + 1) / 2) + (i / 2) : i / 2; break;
+			default: j = i; break;
+		}
+		ptl_al_add(l, AL_TEST_SORT_VALUE(j));
+	}
+
+	if(order == 3){
+		for(i=n-1; i>0; i--){
+			seed = (seed * 6364136223846793005UL) + 1442695040888963407UL;
+			j = (int)((seed >> 33) % (unsigned long)(i + 1));
+
+			void *tmp = ptl_al_get(l, i);
+			ptl_al_set(l, ptl_al_get(l, j), i);
+			ptl_al_set(l, tmp, j);
+		}
+	}
+
+	return l;
+}
+
+/* counts the positions not holding the value that belongs there */
+static int al_test_unsorted(ptl_array_list_t l, int n){
+	int wrong = 0;
+	int i = 0;
+
+	for(i=0; i<n; i++){
+		wrong += (ptl_al_get(l, i) != AL_TEST_SORT_VALUE(i));
+	}
+	return wrong;
+}
+
+
+/* adding at an index moves what is there, and after it, to the right */
+void TestAlAddIndexShifts(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_size(4);
+
+	ptl_al_add(l, &values[0]);
+	ptl_al_add(l, &values[1]);
+	ptl_al_add(l, &values[2]);
+	CuAssertIntEquals(tc, 1, ptl_al_add_index(l, &values[3], 1));
+
+	CuAssertIntEquals(tc, 4, l->size);
+	CuAssertPtrEquals(tc, &values[0], ptl_al_get(l, 0));
+	CuAssertPtrEquals(tc, &values[3], ptl_al_get(l, 1));
+	CuAssertPtrEquals(tc, &values[1], ptl_al_get(l, 2));
+	CuAssertPtrEquals(tc, &values[2], ptl_al_get(l, 3));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* an element 'set' past 'size' moves with the rest and is not overwritten */
+void TestAlAddIndexKeepsSetPastSize(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_size(4);
+
+	ptl_al_add(l, &values[0]);
+	ptl_al_add(l, &values[1]);
+	ptl_al_set(l, &values[2], 2);
+	ptl_al_add_index(l, &values[3], 0);
+
+	CuAssertPtrEquals(tc, &values[3], ptl_al_get(l, 0));
+	CuAssertPtrEquals(tc, &values[0], ptl_al_get(l, 1));
+	CuAssertPtrEquals(tc, &values[1], ptl_al_get(l, 2));
+	CuAssertPtrEquals(tc, &values[2], ptl_al_get(l, 3));
+
+	// the same across the end of the first bitmap word and a hole
+	ptl_al_set(l, &values[4], 70);
+	ptl_al_add_index(l, &values[5], 0);
+	CuAssertPtrEquals(tc, &values[2], ptl_al_get(l, 4));
+	CuAssertPtrEquals(tc, NULL, ptl_al_get(l, 70));
+	CuAssertPtrEquals(tc, &values[4], ptl_al_get(l, 71));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* removing closes the gap, including elements 'set' past 'size' */
+void TestAlRemoveIndexShifts(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_size(4);
+
+	ptl_al_add(l, &values[0]);
+	ptl_al_add(l, &values[1]);
+	ptl_al_set(l, &values[2], 5);
+
+	CuAssertPtrEquals(tc, &values[0], ptl_al_remove_index(l, 0));
+	CuAssertPtrEquals(tc, &values[1], ptl_al_get(l, 0));
+	CuAssertPtrEquals(tc, &values[2], ptl_al_get(l, 4));
+	CuAssertPtrEquals(tc, NULL, ptl_al_get(l, 5));
+
+	CuAssertPtrEquals(tc, &values[1], ptl_al_remove(l, &values[1]));
+	CuAssertIntEquals(tc, -1, ptl_al_index_of(l, &values[1]));
+	CuAssertPtrEquals(tc, &values[2], ptl_al_get(l, 3));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* a dense list has no holes, adds and removes keep it packed */
+void TestAlDenseStaysPacked(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(2, PTL_AL_MODE_DENSE);
+	int i = 0;
+
+	for(i=0; i<16; i++){
+		CuAssertIntEquals(tc, 1, ptl_al_add(l, &values[i]));
+	}
+	CuAssertIntEquals(tc, 16, l->size);
+
+	ptl_al_remove_index(l, 0);
+	ptl_al_remove(l, &values[8]);
+	ptl_al_add_index(l, &values[0], 3);
+
+	CuAssertIntEquals(tc, 15, l->size);
+	for(i=0; i<l->size; i++){
+		CuAssertPtrNotNull(tc, ptl_al_get(l, i));
+	}
+	CuAssertPtrEquals(tc, &values[0], ptl_al_get(l, 3));
+	CuAssertIntEquals(tc, -1, ptl_al_index_of(l, &values[8]));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* a sparse add fills the first empty position at or past 'size' */
+void TestAlSparseAddFillsHoles(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_SPARSE);
+
+	ptl_al_add(l, &values[0]);
+	ptl_al_add(l, &values[1]);
+	ptl_al_set(l, &values[3], 3);
+	ptl_al_add(l, &values[2]);
+	ptl_al_add(l, &values[4]);
+
+	CuAssertPtrEquals(tc, &values[2], ptl_al_get(l, 2));
+	CuAssertPtrEquals(tc, &values[3], ptl_al_get(l, 3));
+	CuAssertPtrEquals(tc, &values[4], ptl_al_get(l, 4));
+
+	// a hole left far out is filled once the adds reach it
+	ptl_al_set(l, &values[6], 6);
+	ptl_al_add(l, &values[5]);
+	CuAssertPtrEquals(tc, &values[5], ptl_al_get(l, 5));
+	CuAssertPtrEquals(tc, &values[6], ptl_al_get(l, 6));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* a dense list has no NULL elements, setting past the end pads it */
+void TestAlDenseSetPastEnd(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_DENSE);
+
+	ptl_al_add(l, &values[0]);
+	CuAssertIntEquals(tc, 1, ptl_al_set(l, &values[6], 6));
+	CuAssertIntEquals(tc, 7, l->size);
+	CuAssertPtrEquals(tc, NULL, ptl_al_get(l, 3));
+	CuAssertPtrEquals(tc, &values[6], ptl_al_get(l, 6));
+
+	CuAssertIntEquals(tc, 0, ptl_al_add(l, NULL));
+	CuAssertIntEquals(tc, 7, l->size);
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* a cleared list is empty in either mode, and adds start over at 0 */
+void TestAlClearEmpties(CuTest *tc){
+	int modes[2] = {PTL_AL_MODE_SPARSE, PTL_AL_MODE_DENSE};
+	int m = 0, i = 0;
+
+	for(m=0; m<2; m++){
+		ptl_array_list_t l = ptl_al_create_array_list_mode(4, modes[m]);
+
+		for(i=0; i<10; i++){
+			ptl_al_add(l, &values[i]);
+		}
+		ptl_al_set(l, &values[12], 40);
+		ptl_al_clear(l);
+
+		CuAssertIntEquals(tc, 0, l->size);
+		CuAssertIntEquals(tc, 1, ptl_al_is_empty(l));
+		CuAssertPtrEquals(tc, NULL, ptl_al_get(l, 40));
+		CuAssertIntEquals(tc, -1, ptl_al_index_of(l, &values[0]));
+
+		ptl_al_add(l, &values[11]);
+		CuAssertPtrEquals(tc, &values[11], ptl_al_get(l, 0));
+		CuAssertIntEquals(tc, 1, l->size);
+
+		ptl_al_destroy_array_list(l);
+	}
+}
+
+/* trimming keeps what was 'set' past 'size' */
+void TestAlTrimKeepsSetPastSize(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_SPARSE);
+
+	ptl_al_reserve(l, 1000);
+	CuAssertTrue(tc, l->capacity >= 1000);
+	ptl_al_add(l, &values[0]);
+	ptl_al_set(l, &values[1], 40);
+
+	CuAssertIntEquals(tc, 1, ptl_al_trim_to_size(l));
+	CuAssertTrue(tc, l->capacity < 1000);
+	CuAssertPtrEquals(tc, &values[0], ptl_al_get(l, 0));
+	CuAssertPtrEquals(tc, &values[1], ptl_al_get(l, 40));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* the vectorized search finds the first match at every position and length */
+void TestAlIndexOfEveryPosition(CuTest *tc){
+	int length = 0, p = 0, i = 0;
+
+	for(length=0; length<=AL_TEST_SEARCH_MAX; length++){
+		ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_DENSE);
+
+		for(i=0; i<length; i++){
+			ptl_al_add(l, &search_values[i]);
+		}
+		for(p=0; p<length; p++){
+			CuAssertIntEquals(tc, p, ptl_al_index_of(l, &search_values[p]));
+		}
+		CuAssertIntEquals(tc, -1, ptl_al_index_of(l, &search_values[length]));
+		CuAssertIntEquals(tc, -1, ptl_al_index_of(l, NULL));
+
+		// a duplicate further on doesn't hide the first one
+		if(length > 1){
+			ptl_al_set(l, &search_values[0], length - 1);
+			CuAssertIntEquals(tc, 0, ptl_al_index_of(l, &search_values[0]));
+			CuAssertIntEquals(tc, -1, ptl_al_index_of(l, &search_values[length - 1]));
+		}
+
+		ptl_al_destroy_array_list(l);
+	}
+
+	CuAssertIntEquals(tc, -1, ptl_al_index_of(NULL, &search_values[0]));
+}
+
+/* index_of_any agrees with index_of for each value, missing ones included */
+void TestAlIndexOfAny(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_DENSE);
+	void *find[6];
+	int indexes[6];
+	int i = 0, found = 0;
+
+	for(i=0; i<AL_TEST_SEARCH_MAX; i++){
+		ptl_al_add(l, &search_values[i % 50]);
+	}
+	find[0] = &search_values[49];
+	find[1] = &search_values[0];
+	find[2] = &search_values[AL_TEST_SEARCH_MAX + 1]; // missing
+	find[3] = &search_values[3];
+	find[4] = &search_values[0];
+	find[5] = &search_values[19];
+
+	for(i=0; i<6; i++){
+		found += (ptl_al_index_of(l, find[i]) >= 0);
+	}
+	CuAssertIntEquals(tc, found, ptl_al_index_of_any(l, find, 6, indexes));
+	for(i=0; i<6; i++){
+		CuAssertIntEquals(tc, ptl_al_index_of(l, find[i]), indexes[i]);
+	}
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* sorting puts every element in its place, for every size and starting order */
+void TestAlSort(CuTest *tc){
+	int sizes[6] = {0, 1, 2, 17, 1000, AL_TEST_SORT_MAX};
+	int s = 0, order = 0;
+
+	for(s=0; s<6; s++){
+		for(order=0; order<4; order++){
+			ptl_array_list_t l = al_test_sort_list(sizes[s], order);
+
+			CuAssertIntEquals(tc, 1, ptl_al_sort(l, al_test_cmp));
+			CuAssertIntEquals(tc, sizes[s], l->size);
+			CuAssertIntEquals(tc, 0, al_test_unsorted(l, sizes[s]));
+
+			ptl_al_destroy_array_list(l);
+		}
+	}
+
+	CuAssertIntEquals(tc, 0, ptl_al_sort(NULL, al_test_cmp));
+}
+
+/* many equal elements don't throw the sort off */
+void TestAlSortDuplicates(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_DENSE);
+	int i = 0, out_of_order = 0;
+
+	for(i=0; i<AL_TEST_SORT_MAX; i++){
+		ptl_al_add(l, AL_TEST_SORT_VALUE((i * 7919) % 3));
+	}
+	ptl_al_sort(l, al_test_cmp);
+
+	for(i=1; i<AL_TEST_SORT_MAX; i++){
+		out_of_order += (al_test_cmp(&(l->array[i - 1]), &(l->array[i])) > 0);
+	}
+	CuAssertIntEquals(tc, 0, out_of_order);
+	CuAssertPtrEquals(tc, AL_TEST_SORT_VALUE(0), ptl_al_get(l, 0));
+	CuAssertPtrEquals(tc, AL_TEST_SORT_VALUE(2), ptl_al_get(l, AL_TEST_SORT_MAX - 1));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* sorting a sparse list packs the elements, and adds go after them */
+void TestAlSortPacksSparse(CuTest *tc){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(4, PTL_AL_MODE_SPARSE);
+
+	ptl_al_set(l, AL_TEST_SORT_VALUE(2), 3);
+	ptl_al_set(l, AL_TEST_SORT_VALUE(0), 90);
+	ptl_al_set(l, AL_TEST_SORT_VALUE(1), 10);
+	ptl_al_add(l, AL_TEST_SORT_VALUE(3));
+	ptl_al_sort(l, al_test_cmp);
+
+	CuAssertIntEquals(tc, 4, l->size);
+	CuAssertIntEquals(tc, 0, al_test_unsorted(l, 4));
+	CuAssertPtrEquals(tc, NULL, ptl_al_get(l, 10));
+	CuAssertPtrEquals(tc, NULL, ptl_al_get(l, 90));
+
+	ptl_al_add(l, AL_TEST_SORT_VALUE(4));
+	CuAssertIntEquals(tc, 0, al_test_unsorted(l, 5));
+
+	ptl_al_destroy_array_list(l);
+}
+
+/* the parallel sort gives the same result on the manager's threads or alone */
+void TestAlParallelSort(CuTest *tc){
+	ptl_thread_manager_t manager = create_thread_manager(4, 4, 1000, 
+														 ptl_q_create_queue(&al_test_q_funcs, 0), NULL);
+	int sizes[3] = {1000, AL_TEST_SORT_MAX, AL_TEST_SORT_MAX + 3};
+	int s = 0, order = 0;
+
+	for(s=0; s<3; s++){
+		for(order=0; order<4; order++){
+			ptl_array_list_t l = al_test_sort_list(sizes[s], order);
+			ptl_array_list_t alone = al_test_sort_list(sizes[s], order);
+
+			CuAssertIntEquals(tc, 1, ptl_al_parallel_sort(l, al_test_cmp, manager));
+			CuAssertIntEquals(tc, 1, ptl_al_parallel_sort(alone, al_test_cmp, NULL));
+			CuAssertIntEquals(tc, 0, al_test_unsorted(l, sizes[s]));
+			CuAssertIntEquals(tc, 0, al_test_unsorted(alone, sizes[s]));
+
+			ptl_al_destroy_array_list(l);
+			ptl_al_destroy_array_list(alone);
+		}
+	}
+
+	shutdown(manager);
+	await_termination(manager, 5000);
+}
+
+/* a small list keeps its elements in the struct until it grows past it */
+void TestAlInlineStorage(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	int i = 0;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	ptl_array_list_t l = ptl_al_create_array_list_allocator(PTL_AL_INLINE_CAPACITY, 
+															  PTL_AL_MODE_SPARSE, &counting);
+
+	// the struct is the only allocation
+	CuAssertIntEquals(tc, 1, (int)stats.num_allocs);
+	CuAssertPtrEquals(tc, l->inline_array, l->array);
+	for(i=0; i<PTL_AL_INLINE_CAPACITY; i++){
+		ptl_al_add(l, &values[i]);
+	}
+	CuAssertIntEquals(tc, 1, (int)stats.num_allocs);
+	CuAssertPtrEquals(tc, l->inline_array, l->array);
+
+	// one more moves everything to the heap
+	ptl_al_add(l, &values[PTL_AL_INLINE_CAPACITY]);
+	CuAssertTrue(tc, l->array != l->inline_array);
+	CuAssertTrue(tc, stats.num_allocs > 1);
+	for(i=0; i<=PTL_AL_INLINE_CAPACITY; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_al_get(l, i));
+	}
+
+	ptl_al_destroy_array_list(l);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+/* a list initialized in the caller's memory allocates nothing while small */
+void TestAlInitOnStack(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	struct ptl_array_list l;
+	int i = 0;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	CuAssertIntEquals(tc, 1, ptl_al_init_array_list_allocator(&l, 4, PTL_AL_MODE_DENSE, &counting));
+
+	for(i=0; i<PTL_AL_INLINE_CAPACITY; i++){
+		ptl_al_add(&l, &values[i]);
+	}
+	ptl_al_remove_index(&l, 0);
+	CuAssertIntEquals(tc, 0, (int)stats.num_allocs);
+	CuAssertPtrEquals(tc, &values[1], ptl_al_get(&l, 0));
+
+	// growing past the struct allocates, destroying frees only that
+	for(i=0; i<PTL_AL_INLINE_CAPACITY; i++){
+		ptl_al_add(&l, &values[i]);
+	}
+	CuAssertTrue(tc, stats.num_allocs > 0);
+	CuAssertIntEquals(tc, (2 * PTL_AL_INLINE_CAPACITY) - 1, l.size);
+
+	ptl_al_destroy_array_list(&l);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+
+CuSuite *PtlArrayListGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestAlAddIndexShifts);
+	SUITE_ADD_TEST(suite, TestAlAddIndexKeepsSetPastSize);
+	SUITE_ADD_TEST(suite, TestAlRemoveIndexShifts);
+	SUITE_ADD_TEST(suite, TestAlDenseStaysPacked);
+	SUITE_ADD_TEST(suite, TestAlSparseAddFillsHoles);
+	SUITE_ADD_TEST(suite, TestAlDenseSetPastEnd);
+	SUITE_ADD_TEST(suite, TestAlClearEmpties);
+	SUITE_ADD_TEST(suite, TestAlTrimKeepsSetPastSize);
+	SUITE_ADD_TEST(suite, TestAlIndexOfEveryPosition);
+	SUITE_ADD_TEST(suite, TestAlIndexOfAny);
+	SUITE_ADD_TEST(suite, TestAlSort);
+	SUITE_ADD_TEST(suite, TestAlSortDuplicates);
+	SUITE_ADD_TEST(suite, TestAlSortPacksSparse);
+	SUITE_ADD_TEST(suite, TestAlParallelSort);
+	SUITE_ADD_TEST(suite, TestAlInlineStorage);
+	SUITE_ADD_TEST(suite, TestAlInitOnStack);
+
+	return suite;
+}
@@ -0,0 +1,170 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_coalescing_queue.h"
+
+static struct ptl_q_funcs kq_test_q_funcs = {
+	ptl_kq_init_queue, ptl_kq_destroy_queue, ptl_kq_add, ptl_kq_add_wait,
+	ptl_kq_clear, ptl_kq_peek, ptl_kq_get, ptl_kq_get_wait
+};
+
+#define KQ_TEST_NUM 1000
+
+/* an update for 'key', merging adds up the counts */
+struct kq_test_update {
+	unsigned long key;
+	int count;
+};
+
+static struct kq_test_update updates[KQ_TEST_NUM];
+
+static unsigned long kq_test_key(void *value){
+	return ((struct kq_test_update *)value)->key;
+}
+
+static void *kq_test_merge(void *pending, void *value){
+	((struct kq_test_update *)pending)->count += ((struct kq_test_update *)value)->count;
+	return pending;
+}
+
+/* updates[i] has key 'key' and a count of 1 */
+static struct kq_test_update *kq_test_update(int i, unsigned long key){
+	updates[i].key = key;
+	updates[i].count = 1;
+	return &updates[i];
+}
+
+static ptl_q_t kq_test_queue(int capacity, void *(*merge_func)(void *, void *)){
+	ptl_q_t q = ptl_q_create_queue(&kq_test_q_funcs, capacity);
+	ptl_kq_set_functions(q, kq_test_key, merge_func);
+	return q;
+}
+
+
+/* a duplicate key is merged into the pending value, which keeps its place */
+void TestKqMergesInPlace(CuTest *tc){
+	ptl_q_t q = kq_test_queue(0, kq_test_merge);
+
+	ptl_kq_add(q, kq_test_update(0, 1));
+	ptl_kq_add(q, kq_test_update(1, 2));
+	ptl_kq_add(q, kq_test_update(2, 1));
+	ptl_kq_add(q, kq_test_update(3, 1));
+
+	CuAssertIntEquals(tc, 2, (int)ptl_kq_get_merge_count(q));
+	CuAssertPtrEquals(tc, &updates[0], ptl_kq_get(q));
+	CuAssertIntEquals(tc, 3, updates[0].count);
+	CuAssertPtrEquals(tc, &updates[1], ptl_kq_get(q));
+	CuAssertPtrEquals(tc, NULL, ptl_kq_get(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* without a merge function the pending value is kept */
+void TestKqKeepsPending(CuTest *tc){
+	ptl_q_t q = kq_test_queue(0, NULL);
+
+	ptl_kq_add(q, kq_test_update(0, 7));
+	CuAssertIntEquals(tc, 1, ptl_kq_add(q, kq_test_update(1, 7)));
+
+	CuAssertPtrEquals(tc, &updates[0], ptl_kq_get(q));
+	CuAssertIntEquals(tc, 1, updates[0].count);
+	CuAssertPtrEquals(tc, NULL, ptl_kq_get(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* once a value is taken, its key is queued again instead of merged */
+void TestKqRequeuesAfterGet(CuTest *tc){
+	ptl_q_t q = kq_test_queue(0, kq_test_merge);
+
+	ptl_kq_add(q, kq_test_update(0, 5));
+	CuAssertPtrEquals(tc, &updates[0], ptl_kq_get(q));
+	ptl_kq_add(q, kq_test_update(1, 5));
+
+	CuAssertIntEquals(tc, 0, (int)ptl_kq_get_merge_count(q));
+	CuAssertPtrEquals(tc, &updates[1], ptl_kq_peek(q));
+	CuAssertPtrEquals(tc, &updates[1], ptl_kq_get(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* capacity limits the distinct keys, merges into them still succeed */
+void TestKqCapacity(CuTest *tc){
+	ptl_q_t q = kq_test_queue(2, kq_test_merge);
+
+	CuAssertIntEquals(tc, 1, ptl_kq_add(q, kq_test_update(0, 1)));
+	CuAssertIntEquals(tc, 1, ptl_kq_add(q, kq_test_update(1, 2)));
+	CuAssertIntEquals(tc, 0, ptl_kq_add(q, kq_test_update(2, 3)));
+	CuAssertIntEquals(tc, 1, ptl_kq_add(q, kq_test_update(3, 2)));
+	CuAssertIntEquals(tc, 2, updates[1].count);
+
+	ptl_kq_get(q);
+	CuAssertIntEquals(tc, 1, ptl_kq_add(q, kq_test_update(2, 3)));
+
+	while(ptl_kq_get(q) != NULL);
+	ptl_q_destroy_queue(q);
+}
+
+/* the index grows past its first size and still finds every key, removed
+   keys included (the slots left behind by a get) */
+void TestKqIndexGrows(CuTest *tc){
+	ptl_q_t q = kq_test_queue(0, kq_test_merge);
+	int half = KQ_TEST_NUM / 2;
+	int i = 0;
+
+	for(i=0; i<half; i++){
+		ptl_kq_add(q, kq_test_update(i, i * PTL_KQ_INITIAL_INDEX_SIZE));
+	}
+	for(i=0; i<half / 2; i++){
+		CuAssertPtrEquals(tc, &updates[i], ptl_kq_get(q));
+	}
+	for(i=half; i<KQ_TEST_NUM; i++){
+		ptl_kq_add(q, kq_test_update(i, (i - half) * PTL_KQ_INITIAL_INDEX_SIZE));
+	}
+
+	// keys taken before are queued again at the end, the rest are merged
+	CuAssertIntEquals(tc, half - (half / 2), (int)ptl_kq_get_merge_count(q));
+	for(i=half / 2; i<half; i++){
+		CuAssertPtrEquals(tc, &updates[i], ptl_kq_get(q));
+		CuAssertIntEquals(tc, 2, updates[i].count);
+	}
+	for(i=half; i<half + (half / 2); i++){
+		CuAssertPtrEquals(tc, &updates[i], ptl_kq_get(q));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_kq_get(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+
+CuSuite *PtlCoalescingQueueGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestKqMergesInPlace);
+	SUITE_ADD_TEST(suite, TestKqKeepsPending);
+	SUITE_ADD_TEST(suite, TestKqRequeuesAfterGet);
+	SUITE_ADD_TEST(suite, TestKqCapacity);
+	SUITE_ADD_TEST(suite, TestKqIndexGrows);
+
+	return suite;
+}
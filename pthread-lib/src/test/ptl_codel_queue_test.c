@@ -0,0 +1,134 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_codel_queue.h"
+#include "../ptl_util.h"
+
+static struct ptl_q_funcs codel_test_q_funcs = {
+	ptl_cq_init_queue, ptl_cq_destroy_queue, ptl_cq_add, ptl_cq_add_wait,
+	ptl_cq_clear, ptl_cq_peek, ptl_cq_get, ptl_cq_get_wait
+};
+
+#define CODEL_TEST_NUM 50
+
+/* elements only need distinct addresses */
+static int values[CODEL_TEST_NUM];
+
+static int codel_test_dropped = 0;
+
+static void codel_test_drop(void *value){
+	codel_test_dropped++;
+}
+
+/* adds one element after a while, for get_wait */
+static void *codel_test_add_later(void *arg){
+	ptl_timed_wait(20000);
+	ptl_cq_add((ptl_q_t)arg, &values[0]);
+	return NULL;
+}
+
+
+/* a queue that drains quickly is a FIFO, nothing is dropped */
+void TestCqFifo(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&codel_test_q_funcs, 0);
+	int i = 0;
+
+	for(i=0; i<3; i++){
+		CuAssertIntEquals(tc, 1, ptl_cq_add(q, &values[i]));
+	}
+	CuAssertPtrEquals(tc, &values[0], ptl_cq_peek(q));
+	for(i=0; i<3; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_cq_get(q));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_cq_get(q));
+	CuAssertIntEquals(tc, 0, (int)ptl_cq_get_drop_count(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* a queue that stays above target for an interval drops from the head, and
+   every element is either got or dropped */
+void TestCqDropsStandingQueue(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&codel_test_q_funcs, 0);
+	int got = 0;
+	int i = 0;
+
+	codel_test_dropped = 0;
+	ptl_cq_set_params(q, 1000, 10000, codel_test_drop);
+
+	for(i=0; i<CODEL_TEST_NUM; i++){
+		ptl_cq_add(q, &values[i]);
+	}
+
+	// above target, the interval starts
+	ptl_timed_wait(5000);
+	CuAssertPtrEquals(tc, &values[0], ptl_cq_get(q));
+	CuAssertIntEquals(tc, 0, (int)ptl_cq_get_drop_count(q));
+	got++;
+
+	// still above target a whole interval later
+	ptl_timed_wait(15000);
+	while(ptl_cq_get(q) != NULL){
+		got++;
+	}
+
+	CuAssertTrue(tc, ptl_cq_get_drop_count(q) > 0);
+	CuAssertIntEquals(tc, (int)ptl_cq_get_drop_count(q), codel_test_dropped);
+	CuAssertIntEquals(tc, CODEL_TEST_NUM, got + codel_test_dropped);
+
+	// fresh elements are under target again, dropping stops
+	long dropped = ptl_cq_get_drop_count(q);
+	ptl_cq_add(q, &values[0]);
+	ptl_cq_add(q, &values[1]);
+	CuAssertPtrEquals(tc, &values[0], ptl_cq_get(q));
+	CuAssertPtrEquals(tc, &values[1], ptl_cq_get(q));
+	CuAssertIntEquals(tc, (int)dropped, (int)ptl_cq_get_drop_count(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* get_wait gives up on an empty queue, or takes what is added meanwhile */
+void TestCqGetWait(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&codel_test_q_funcs, 0);
+	pthread_t thread;
+
+	CuAssertPtrEquals(tc, NULL, ptl_cq_get_wait(q, 10));
+
+	pthread_create(&thread, NULL, codel_test_add_later, q);
+	CuAssertPtrEquals(tc, &values[0], ptl_cq_get_wait(q, 5000));
+	pthread_join(thread, NULL);
+
+	ptl_q_destroy_queue(q);
+}
+
+
+CuSuite *PtlCodelQueueGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestCqFifo);
+	SUITE_ADD_TEST(suite, TestCqDropsStandingQueue);
+	SUITE_ADD_TEST(suite, TestCqGetWait);
+
+	return suite;
+}
@@ -0,0 +1,150 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/*
+ * Times BENCH_TOTAL appends split between 1 to 64 threads, with every thread
+ * pushing into one ptl_concurrent_vector, against each thread filling its
+ * own ptl_array_list that is merged into one list once they are done.
+ * Prints millions of appends per second, and how long reading the whole
+ * vector back with ptl_cv_for_each_segment() takes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "../ptl_concurrent_vector.h"
+#include "../ptl_array_list.h"
+#include "../ptl_util.h"
+
+#define BENCH_TOTAL (1L << 22)	/* appends per run, split between the threads */
+#define BENCH_MAX_THREADS 64
+
+/* what every thread of a run shares */
+struct bench_run {
+	pthread_barrier_t start;		/* the threads and the timer go together */
+	ptl_concurrent_vector_t vector;	/* vector runs append here */
+	ptl_array_list_t lists[BENCH_MAX_THREADS];	/* list runs append here */
+	long per_thread;
+	int next_thread;
+};
+
+static void *bench_vector_thread(void *arg){
+	struct bench_run *run = (struct bench_run *)arg;
+	long i = 0;
+
+	pthread_barrier_wait(&(run->start));
+	for(i=0; i<run->per_thread; i++){
+		ptl_cv_push_back(run->vector, (void *)(i + 1));
+	}
+
+	return NULL;
+}
+
+static void *bench_list_thread(void *arg){
+	struct bench_run *run = (struct bench_run *)arg;
+	int t = __atomic_fetch_add(&(run->next_thread), 1, __ATOMIC_RELAXED);
+	ptl_array_list_t list = ptl_al_create_array_list();
+	long i = 0;
+
+	pthread_barrier_wait(&(run->start));
+	for(i=0; i<run->per_thread; i++){
+		ptl_al_add(list, (void *)(i + 1));
+	}
+	run->lists[t] = list;
+
+	return NULL;
+}
+
+/* sums the run of elements, so the read isn't optimized away */
+static int bench_sum(void **elements, long num_elements, long first_index, void *arg){
+	long *sum = (long *)arg;
+	long i = 0;
+
+	for(i=0; i<num_elements; i++){
+		*sum += (long)elements[i];
+	}
+
+	return 1;
+}
+
+/* starts 'num_threads' of 'body' and returns the usec from start to all joined */
+static long long bench_time(struct bench_run *run, int num_threads, void *(*body)(void *)){
+	pthread_t threads[BENCH_MAX_THREADS];
+	int i = 0;
+
+	run->per_thread = BENCH_TOTAL / num_threads;
+	run->next_thread = 0;
+	pthread_barrier_init(&(run->start), NULL, num_threads + 1);
+
+	for(i=0; i<num_threads; i++){
+		pthread_create(&threads[i], NULL, body, run);
+	}
+	pthread_barrier_wait(&(run->start));
+	long long start = ptl_get_time_usec();
+	for(i=0; i<num_threads; i++){
+		pthread_join(threads[i], NULL);
+	}
+	long long elapsed = ptl_get_time_usec() - start;
+
+	pthread_barrier_destroy(&(run->start));
+	return elapsed;
+}
+
+
+int main(int argc, char **argv){
+	struct bench_run run;
+	int num_threads = 0;
+	int i = 0;
+
+	printf("%d appends, millions per second\n", (int)BENCH_TOTAL);
+	printf("%8s %14s %14s %14s\n", "threads", "vector", "lists+merge", "read (ms)");
+
+	for(num_threads=1; num_threads<=BENCH_MAX_THREADS; num_threads*=2){
+		long total = (BENCH_TOTAL / num_threads) * num_threads;
+		long sum = 0;
+
+		run.vector = ptl_cv_create_concurrent_vector();
+		long long vector_usec = bench_time(&run, num_threads, bench_vector_thread);
+
+		long long start = ptl_get_time_usec();
+		ptl_cv_for_each_segment(run.vector, bench_sum, &sum);
+		long long read_usec = ptl_get_time_usec() - start;
+		ptl_cv_destroy_concurrent_vector(run.vector);
+
+		// the pattern the vector replaces, merging is part of the cost
+		long long list_usec = bench_time(&run, num_threads, bench_list_thread);
+		start = ptl_get_time_usec();
+		ptl_array_list_t merged = ptl_al_create_array_list_size(total);
+		for(i=0; i<num_threads; i++){
+			long j = 0;
+			for(j=0; j<run.lists[i]->size; j++){
+				ptl_al_add(merged, ptl_al_get(run.lists[i], j));
+			}
+			ptl_al_destroy_array_list(run.lists[i]);
+		}
+		list_usec += ptl_get_time_usec() - start;
+		ptl_al_destroy_array_list(merged);
+
+		printf("%8d %14.1f %14.1f %14.2f\n", num_threads, (double)total / vector_usec,
+			   (double)total / list_usec, read_usec / 1000.0);
+		if(sum == 0){ printf("nothing read\n"); }
+	}
+
+	return 0;
+}
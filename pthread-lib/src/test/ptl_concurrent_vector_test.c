@@ -0,0 +1,221 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_concurrent_vector.h"
+
+#define CV_TEST_THREADS 4
+#define CV_TEST_PER_THREAD 10000
+#define CV_TEST_BLOCK 5
+
+/* values are small integers, never 0 */
+#define CV_TEST_VALUE(i) ((void *)(intptr_t)((i) + 1))
+#define CV_TEST_INDEX(v) ((long)(intptr_t)(v) - 1)
+
+/* what the segment runs looked like */
+struct cv_test_runs {
+	int num_runs;
+	long lengths[8];
+	long firsts[8];
+	void **starts[8];
+	int stop_after;
+};
+
+static int cv_test_run(void **elements, long num_elements, long first_index, void *arg){
+	struct cv_test_runs *runs = (struct cv_test_runs *)arg;
+
+	if(runs->num_runs < 8){
+		runs->lengths[runs->num_runs] = num_elements;
+		runs->firsts[runs->num_runs] = first_index;
+		runs->starts[runs->num_runs] = elements;
+	}
+	runs->num_runs++;
+
+	return (runs->num_runs != runs->stop_after);
+}
+
+/* each thread pushes its own range of values, one at a time */
+static void *cv_test_push(void *arg){
+	static int next = 0;
+	ptl_concurrent_vector_t vector = (ptl_concurrent_vector_t)arg;
+	int t = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % CV_TEST_THREADS;
+	long i = 0;
+
+	for(i=0; i<CV_TEST_PER_THREAD; i++){
+		ptl_cv_push_back(vector, CV_TEST_VALUE((t * CV_TEST_PER_THREAD) + i));
+	}
+
+	return NULL;
+}
+
+/* each thread pushes blocks of values that must stay together */
+static void *cv_test_push_blocks(void *arg){
+	static int next = 0;
+	ptl_concurrent_vector_t vector = (ptl_concurrent_vector_t)arg;
+	int t = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % CV_TEST_THREADS;
+	void *block[CV_TEST_BLOCK];
+	long i = 0;
+	int j = 0;
+
+	for(i=0; i<CV_TEST_PER_THREAD; i+=CV_TEST_BLOCK){
+		for(j=0; j<CV_TEST_BLOCK; j++){
+			block[j] = CV_TEST_VALUE((t * CV_TEST_PER_THREAD) + i + j);
+		}
+		ptl_cv_push_back_n(vector, block, CV_TEST_BLOCK);
+	}
+
+	return NULL;
+}
+
+
+/* indexes are handed out in order, across segments */
+void TestCvPushBackAndGet(CuTest *tc){
+	ptl_concurrent_vector_t vector = ptl_cv_create_concurrent_vector();
+	long i = 0;
+
+	for(i=0; i<100; i++){
+		CuAssertIntEquals(tc, (int)i, (int)ptl_cv_push_back(vector, CV_TEST_VALUE(i)));
+	}
+	CuAssertIntEquals(tc, -1, (int)ptl_cv_push_back(vector, NULL));
+	CuAssertIntEquals(tc, 100, (int)ptl_cv_size(vector));
+
+	for(i=0; i<100; i++){
+		CuAssertPtrEquals(tc, CV_TEST_VALUE(i), ptl_cv_get(vector, i));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_cv_get(vector, 100));
+	CuAssertPtrEquals(tc, NULL, ptl_cv_get(vector, -1));
+
+	ptl_cv_destroy_concurrent_vector(vector);
+}
+
+/* the segments double, and the elements never move as the vector grows */
+void TestCvSegmentsStayPut(CuTest *tc){
+	ptl_concurrent_vector_t vector = ptl_cv_create_concurrent_vector();
+	struct cv_test_runs before = {0};
+	struct cv_test_runs after = {0};
+	void *copy[20];
+	long i = 0;
+
+	for(i=0; i<PTL_CV_FIRST_SEGMENT * 3; i++){
+		ptl_cv_push_back(vector, CV_TEST_VALUE(i));
+	}
+	ptl_cv_for_each_segment(vector, cv_test_run, &before);
+	for(; i<1000; i++){
+		ptl_cv_push_back(vector, CV_TEST_VALUE(i));
+	}
+	CuAssertIntEquals(tc, 1000, (int)ptl_cv_for_each_segment(vector, cv_test_run, &after));
+
+	CuAssertIntEquals(tc, 2, before.num_runs);
+	CuAssertIntEquals(tc, (int)PTL_CV_FIRST_SEGMENT, (int)after.lengths[0]);
+	CuAssertIntEquals(tc, (int)PTL_CV_FIRST_SEGMENT * 2, (int)after.lengths[1]);
+	CuAssertIntEquals(tc, (int)PTL_CV_FIRST_SEGMENT * 3, (int)after.firsts[2]);
+	CuAssertPtrEquals(tc, before.starts[0], after.starts[0]);
+	CuAssertPtrEquals(tc, before.starts[1], after.starts[1]);
+
+	// copies run across the segment boundaries
+	CuAssertIntEquals(tc, 20, (int)ptl_cv_copy(vector, PTL_CV_FIRST_SEGMENT - 2, copy, 20));
+	for(i=0; i<20; i++){
+		CuAssertPtrEquals(tc, CV_TEST_VALUE(PTL_CV_FIRST_SEGMENT - 2 + i), copy[i]);
+	}
+	CuAssertIntEquals(tc, 3, (int)ptl_cv_copy(vector, 997, copy, 20));
+
+	// iteration stops when asked
+	struct cv_test_runs stopped = {0};
+	stopped.stop_after = 2;
+	CuAssertIntEquals(tc, (int)PTL_CV_FIRST_SEGMENT * 3, 
+					  (int)ptl_cv_for_each_segment(vector, cv_test_run, &stopped));
+	CuAssertIntEquals(tc, 2, stopped.num_runs);
+
+	ptl_cv_destroy_concurrent_vector(vector);
+}
+
+/* threads pushing at once lose nothing and store nothing twice */
+void TestCvConcurrentPushBack(CuTest *tc){
+	ptl_concurrent_vector_t vector = ptl_cv_create_concurrent_vector();
+	pthread_t threads[CV_TEST_THREADS];
+	long total = CV_TEST_THREADS * CV_TEST_PER_THREAD;
+	char *seen = (char *)calloc(total, 1);
+	int duplicates = 0;
+	long i = 0;
+
+	for(i=0; i<CV_TEST_THREADS; i++){
+		pthread_create(&threads[i], NULL, cv_test_push, vector);
+	}
+	for(i=0; i<CV_TEST_THREADS; i++){
+		pthread_join(threads[i], NULL);
+	}
+
+	CuAssertIntEquals(tc, (int)total, (int)ptl_cv_size(vector));
+	for(i=0; i<total; i++){
+		void *value = ptl_cv_get(vector, i);
+		CuAssertPtrNotNull(tc, value);
+		duplicates += seen[CV_TEST_INDEX(value)];
+		seen[CV_TEST_INDEX(value)] = 1;
+	}
+	CuAssertIntEquals(tc, 0, duplicates);
+
+	free(seen);
+	ptl_cv_destroy_concurrent_vector(vector);
+}
+
+/* a block pushed with push_back_n is never split by another thread's */
+void TestCvPushBackNKeepsBlocks(CuTest *tc){
+	ptl_concurrent_vector_t vector = ptl_cv_create_concurrent_vector();
+	pthread_t threads[CV_TEST_THREADS];
+	long total = CV_TEST_THREADS * CV_TEST_PER_THREAD;
+	int split = 0;
+	long i = 0;
+
+	for(i=0; i<CV_TEST_THREADS; i++){
+		pthread_create(&threads[i], NULL, cv_test_push_blocks, vector);
+	}
+	for(i=0; i<CV_TEST_THREADS; i++){
+		pthread_join(threads[i], NULL);
+	}
+
+	CuAssertIntEquals(tc, (int)total, (int)ptl_cv_size(vector));
+	for(i=0; i<total; i+=CV_TEST_BLOCK){
+		long first = CV_TEST_INDEX(ptl_cv_get(vector, i));
+		int j = 0;
+
+		split += (first % CV_TEST_BLOCK != 0);
+		for(j=1; j<CV_TEST_BLOCK; j++){
+			split += (CV_TEST_INDEX(ptl_cv_get(vector, i + j)) != first + j);
+		}
+	}
+	CuAssertIntEquals(tc, 0, split);
+
+	ptl_cv_destroy_concurrent_vector(vector);
+}
+
+
+CuSuite *PtlConcurrentVectorGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestCvPushBackAndGet);
+	SUITE_ADD_TEST(suite, TestCvSegmentsStayPut);
+	SUITE_ADD_TEST(suite, TestCvConcurrentPushBack);
+	SUITE_ADD_TEST(suite, TestCvPushBackNKeepsBlocks);
+
+	return suite;
+}
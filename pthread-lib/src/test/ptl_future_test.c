@@ -0,0 +1,196 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_allocator.h"
+#include "../ptl_thread_pool.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_future.h"
+#include "../ptl_util.h"
+
+/* the work queue of the managers */
+static struct ptl_q_funcs future_test_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+static ptl_thread_manager_t future_test_manager(){
+	return create_thread_manager(2, 2, 1000, ptl_q_create_queue(&future_test_q_funcs, 0), NULL);
+}
+
+static void future_test_stop(ptl_thread_manager_t manager){
+	shutdown(manager);
+	await_termination(manager, 5000);
+}
+
+/* returns its argument plus one, after 'arg' milliseconds */
+static void *future_test_add_one(void *arg){
+	ptl_timed_wait((long)(intptr_t)arg * 1000);
+	return (void *)((intptr_t)arg + 1);
+}
+
+static void *future_test_double(ptl_future_t source, void *arg){
+	return (void *)((intptr_t)ptl_future_get(source) * 2);
+}
+
+
+/* the result of the function, after waiting */
+void TestFutureGet(CuTest *tc){
+	ptl_thread_manager_t manager = future_test_manager();
+
+	ptl_future_t f = submit_future(manager, future_test_add_one, (void *)(intptr_t)20);
+	CuAssertIntEquals(tc, 0, ptl_future_wait_timeout(f, 0));
+	CuAssertPtrEquals(tc, (void *)(intptr_t)21, ptl_future_get(f));
+	CuAssertIntEquals(tc, 1, ptl_future_is_done(f));
+	CuAssertIntEquals(tc, 1, ptl_future_wait_timeout(f, 0));
+	ptl_future_destroy(f);
+
+	future_test_stop(manager);
+}
+
+/* the future and its task come from the allocator of the manager's pool */
+void TestFuturePoolAllocator(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	ptl_thread_manager_t manager = create_thread_manager_with_pool(
+		ptl_create_thread_pool_allocator(2, 2, 1000, &counting),
+		ptl_q_create_queue(&future_test_q_funcs, 0), NULL);
+
+	long allocs = __atomic_load_n(&(stats.num_allocs), __ATOMIC_ACQUIRE);
+	ptl_future_t f = submit_future(manager, future_test_add_one, (void *)(intptr_t)0);
+	CuAssertPtrEquals(tc, &counting, f->allocator);
+	CuAssertTrue(tc, __atomic_load_n(&(stats.num_allocs), __ATOMIC_ACQUIRE) >= allocs + 2);
+
+	CuAssertPtrEquals(tc, (void *)(intptr_t)1, ptl_future_get(f));
+	ptl_future_destroy(f);
+	future_test_stop(manager);
+}
+
+/* a wait that runs out of time leaves the future to finish later */
+void TestFutureWaitTimesOut(CuTest *tc){
+	ptl_thread_manager_t manager = future_test_manager();
+
+	ptl_future_t f = submit_future(manager, future_test_add_one, (void *)(intptr_t)200);
+	long long start = ptl_get_time_usec();
+	CuAssertIntEquals(tc, 0, ptl_future_wait_timeout(f, 20));
+	CuAssertTrue(tc, ptl_get_time_usec() - start >= 20000);
+	CuAssertIntEquals(tc, 0, ptl_future_is_done(f));
+
+	CuAssertIntEquals(tc, 1, ptl_future_wait(f));
+	CuAssertIntEquals(tc, 1, ptl_future_is_done(f));
+	CuAssertPtrEquals(tc, (void *)(intptr_t)201, ptl_future_get(f));
+	ptl_future_destroy(f);
+
+	future_test_stop(manager);
+}
+
+/* a continuation runs on the result, even if the source is destroyed first */
+void TestFutureThen(CuTest *tc){
+	ptl_thread_manager_t manager = future_test_manager();
+
+	ptl_future_t f = submit_future(manager, future_test_add_one, (void *)(intptr_t)5);
+	ptl_future_t g = ptl_future_then(f, future_test_double, NULL);
+	ptl_future_destroy(f);
+
+	CuAssertPtrEquals(tc, (void *)(intptr_t)12, ptl_future_get(g));
+	ptl_future_destroy(g);
+
+	future_test_stop(manager);
+}
+
+/* the sources and the array may go as soon as when_all returns */
+void TestFutureWhenAllHoldsSources(CuTest *tc){
+	ptl_thread_manager_t manager = future_test_manager();
+	int i = 0;
+
+	ptl_future_t *futures = (ptl_future_t *)malloc(4 * sizeof(ptl_future_t));
+	for(i=0; i<4; i++){
+		futures[i] = submit_future(manager, future_test_add_one, (void *)(intptr_t)(i * 5));
+	}
+
+	ptl_future_t all = ptl_future_when_all(futures, 4);
+	for(i=0; i<4; i++){
+		ptl_future_destroy(futures[i]);
+	}
+	free(futures);
+
+	ptl_future_t *results = (ptl_future_t *)ptl_future_get(all);
+	CuAssertPtrNotNull(tc, results);
+	for(i=0; i<4; i++){
+		CuAssertIntEquals(tc, 1, ptl_future_is_done(results[i]));
+		CuAssertPtrEquals(tc, (void *)(intptr_t)(i * 5 + 1), ptl_future_get(results[i]));
+	}
+	ptl_future_destroy(all);
+
+	future_test_stop(manager);
+}
+
+/* the first future to finish stays valid until the when_any future is destroyed */
+void TestFutureWhenAnyHoldsSources(CuTest *tc){
+	ptl_thread_manager_t manager = future_test_manager();
+	ptl_future_t futures[2];
+
+	futures[0] = submit_future(manager, future_test_add_one, (void *)(intptr_t)200);
+	futures[1] = submit_future(manager, future_test_add_one, (void *)(intptr_t)1);
+
+	ptl_future_t any = ptl_future_when_any(futures, 2);
+	ptl_future_destroy(futures[0]);
+	ptl_future_destroy(futures[1]);
+
+	ptl_future_t first = (ptl_future_t)ptl_future_get(any);
+	CuAssertPtrNotNull(tc, first);
+	CuAssertPtrEquals(tc, (void *)(intptr_t)2, ptl_future_get(first));
+	ptl_future_destroy(any);
+
+	future_test_stop(manager);
+}
+
+/* a future whose task the manager won't take finishes rejected */
+void TestFutureRejected(CuTest *tc){
+	ptl_thread_manager_t manager = future_test_manager();
+	future_test_stop(manager);
+
+	ptl_future_t f = submit_future(manager, future_test_add_one, (void *)(intptr_t)0);
+	CuAssertIntEquals(tc, 0, ptl_future_wait(f));
+	CuAssertIntEquals(tc, 1, ptl_future_is_done(f));
+	CuAssertPtrEquals(tc, NULL, ptl_future_get(f));
+	ptl_future_destroy(f);
+}
+
+
+CuSuite *PtlFutureGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestFutureGet);
+	SUITE_ADD_TEST(suite, TestFutureWaitTimesOut);
+	SUITE_ADD_TEST(suite, TestFuturePoolAllocator);
+	SUITE_ADD_TEST(suite, TestFutureThen);
+	SUITE_ADD_TEST(suite, TestFutureWhenAllHoldsSources);
+	SUITE_ADD_TEST(suite, TestFutureWhenAnyHoldsSources);
+	SUITE_ADD_TEST(suite, TestFutureRejected);
+
+	return suite;
+}
@@ -0,0 +1,162 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_hash_map.h"
+
+#define HM_TEST_KEYS 4096
+#define HM_TEST_THREADS 4
+
+/* keys 1..n as pointers, hashed by their value */
+#define HM_TEST_KEY(i) ((void *)(uintptr_t)(i))
+
+static int hm_test_computed = 0;
+
+static void *hm_test_compute(void *key, void *arg){
+	__atomic_add_fetch(&hm_test_computed, 1, __ATOMIC_RELAXED);
+	return arg;
+}
+
+/* each thread puts its own quarter of the keys, mapped to themselves */
+static void *hm_test_put_range(void *arg){
+	static int next = 0;
+	ptl_hash_map_t map = (ptl_hash_map_t)arg;
+	int t = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % HM_TEST_THREADS;
+	int i = 0;
+
+	for(i=1 + t; i<=HM_TEST_KEYS; i+=HM_TEST_THREADS){
+		ptl_hm_put(map, HM_TEST_KEY(i), HM_TEST_KEY(i));
+	}
+
+	return NULL;
+}
+
+
+/* put, replace, get and remove, through the buckets growing */
+void TestHmPutGetRemove(CuTest *tc){
+	ptl_hash_map_t map = ptl_hm_create_hash_map_size(NULL, NULL, 4, 4);
+	int i = 0;
+
+	for(i=1; i<=HM_TEST_KEYS; i++){
+		CuAssertPtrEquals(tc, NULL, ptl_hm_put(map, HM_TEST_KEY(i), HM_TEST_KEY(i)));
+	}
+	CuAssertIntEquals(tc, HM_TEST_KEYS, (int)ptl_hm_size(map));
+
+	CuAssertPtrEquals(tc, HM_TEST_KEY(7), ptl_hm_put(map, HM_TEST_KEY(7), HM_TEST_KEY(70)));
+	CuAssertPtrEquals(tc, HM_TEST_KEY(70), ptl_hm_put_if_absent(map, HM_TEST_KEY(7), HM_TEST_KEY(7)));
+	CuAssertPtrEquals(tc, HM_TEST_KEY(70), ptl_hm_get(map, HM_TEST_KEY(7)));
+
+	for(i=1; i<=HM_TEST_KEYS; i+=2){
+		CuAssertPtrNotNull(tc, ptl_hm_remove(map, HM_TEST_KEY(i)));
+	}
+	CuAssertIntEquals(tc, HM_TEST_KEYS / 2, (int)ptl_hm_size(map));
+	for(i=1; i<=HM_TEST_KEYS; i++){
+		CuAssertIntEquals(tc, (i % 2 == 0), ptl_hm_contains_key(map, HM_TEST_KEY(i)));
+	}
+
+	ptl_hm_clear(map);
+	CuAssertIntEquals(tc, 0, (int)ptl_hm_size(map));
+	CuAssertPtrEquals(tc, NULL, ptl_hm_get(map, HM_TEST_KEY(2)));
+
+	ptl_hm_destroy_hash_map(map);
+}
+
+/* sequential keys spread over every segment, whatever the size of a long */
+void TestHmSpreadsOverSegments(CuTest *tc){
+	ptl_hash_map_t map = ptl_hm_create_hash_map_size(NULL, NULL, HM_TEST_KEYS, 16);
+	unsigned long i = 0;
+
+	for(i=1; i<=HM_TEST_KEYS; i++){
+		ptl_hm_put(map, HM_TEST_KEY(i), HM_TEST_KEY(i));
+	}
+
+	CuAssertIntEquals(tc, 15, (int)map->segment_mask);
+	for(i=0; i<=map->segment_mask; i++){
+		// an even spread puts 256 in each
+		CuAssertTrue(tc, map->segments[i].size > HM_TEST_KEYS / 32);
+	}
+
+	ptl_hm_destroy_hash_map(map);
+}
+
+/* strings that are equal but not the same pointer are the same key */
+void TestHmStringKeys(CuTest *tc){
+	ptl_hash_map_t map = ptl_hm_create_hash_map(ptl_hm_hash_string, ptl_hm_equals_string);
+	char key[] = "segment";
+
+	ptl_hm_put(map, "segment", HM_TEST_KEY(1));
+	CuAssertPtrEquals(tc, HM_TEST_KEY(1), ptl_hm_get(map, key));
+	CuAssertPtrEquals(tc, NULL, ptl_hm_get(map, "bucket"));
+	CuAssertPtrEquals(tc, HM_TEST_KEY(1), ptl_hm_remove(map, key));
+	CuAssertIntEquals(tc, 0, (int)ptl_hm_size(map));
+
+	ptl_hm_destroy_hash_map(map);
+}
+
+/* the function is only called for a key that is absent */
+void TestHmComputeIfAbsent(CuTest *tc){
+	ptl_hash_map_t map = ptl_hm_create_hash_map(NULL, NULL);
+	hm_test_computed = 0;
+
+	CuAssertPtrEquals(tc, HM_TEST_KEY(5), ptl_hm_compute_if_absent(map, HM_TEST_KEY(1), hm_test_compute, HM_TEST_KEY(5)));
+	CuAssertPtrEquals(tc, HM_TEST_KEY(5), ptl_hm_compute_if_absent(map, HM_TEST_KEY(1), hm_test_compute, HM_TEST_KEY(6)));
+	CuAssertPtrEquals(tc, NULL, ptl_hm_compute_if_absent(map, HM_TEST_KEY(2), hm_test_compute, NULL));
+	CuAssertIntEquals(tc, 2, hm_test_computed);
+	CuAssertIntEquals(tc, 0, ptl_hm_contains_key(map, HM_TEST_KEY(2)));
+
+	ptl_hm_destroy_hash_map(map);
+}
+
+/* threads putting at once lose nothing */
+void TestHmConcurrentPuts(CuTest *tc){
+	ptl_hash_map_t map = ptl_hm_create_hash_map_size(NULL, NULL, 16, HM_TEST_THREADS);
+	pthread_t threads[HM_TEST_THREADS];
+	int i = 0;
+
+	for(i=0; i<HM_TEST_THREADS; i++){
+		pthread_create(&threads[i], NULL, hm_test_put_range, map);
+	}
+	for(i=0; i<HM_TEST_THREADS; i++){
+		pthread_join(threads[i], NULL);
+	}
+
+	CuAssertIntEquals(tc, HM_TEST_KEYS, (int)ptl_hm_size(map));
+	for(i=1; i<=HM_TEST_KEYS; i++){
+		CuAssertPtrEquals(tc, HM_TEST_KEY(i), ptl_hm_get(map, HM_TEST_KEY(i)));
+	}
+
+	ptl_hm_destroy_hash_map(map);
+}
+
+
+CuSuite *PtlHashMapGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestHmPutGetRemove);
+	SUITE_ADD_TEST(suite, TestHmSpreadsOverSegments);
+	SUITE_ADD_TEST(suite, TestHmStringKeys);
+	SUITE_ADD_TEST(suite, TestHmComputeIfAbsent);
+	SUITE_ADD_TEST(suite, TestHmConcurrentPuts);
+
+	return suite;
+}
@@ -0,0 +1,138 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cutest/CuTest.h"
+#include "../ptl_allocator.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+
+static struct ptl_q_funcs lq_test_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+/* elements only need distinct addresses */
+static int values[16];
+
+/* adds values[from] to values[to - 1] */
+static void lq_test_fill(ptl_q_t q, int from, int to){
+	int i = 0;
+
+	for(i=from; i<to; i++){
+		ptl_lq_add(q, &values[i]);
+	}
+}
+
+/* a splice moves everything, in order, and leaves 'src' empty but usable */
+void TestLqSplice(CuTest *tc){
+	ptl_q_t dst = ptl_q_create_queue(&lq_test_q_funcs, 0);
+	ptl_q_t src = ptl_q_create_queue(&lq_test_q_funcs, 0);
+	int i = 0;
+
+	lq_test_fill(dst, 0, 2);
+	lq_test_fill(src, 2, 6);
+	CuAssertIntEquals(tc, 4, (int)ptl_lq_splice(dst, src));
+	CuAssertIntEquals(tc, 6, (int)dst->size);
+	CuAssertIntEquals(tc, 0, (int)src->size);
+	CuAssertPtrEquals(tc, NULL, ptl_lq_get(src));
+
+	// nothing to move, or a queue into itself
+	CuAssertIntEquals(tc, 0, (int)ptl_lq_splice(dst, src));
+	CuAssertIntEquals(tc, 0, (int)ptl_lq_splice(dst, dst));
+
+	// the emptied queue takes new elements, and a splice into an empty queue works
+	lq_test_fill(src, 6, 8);
+	for(i=0; i<6; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_lq_get(dst));
+	}
+	CuAssertIntEquals(tc, 2, (int)ptl_lq_splice(dst, src));
+	CuAssertPtrEquals(tc, &values[6], ptl_lq_get(dst));
+	CuAssertPtrEquals(tc, &values[7], ptl_lq_get(dst));
+	CuAssertPtrEquals(tc, NULL, ptl_lq_get(dst));
+
+	// more can be added after the spliced chain
+	lq_test_fill(dst, 8, 9);
+	CuAssertPtrEquals(tc, &values[8], ptl_lq_get(dst));
+
+	ptl_q_destroy_queue(dst);
+	ptl_q_destroy_queue(src);
+}
+
+/* stealing half takes the oldest half, rounded up, and keeps the order */
+void TestLqStealHalf(CuTest *tc){
+	ptl_q_t dst = ptl_q_create_queue(&lq_test_q_funcs, 0);
+	ptl_q_t src = ptl_q_create_queue(&lq_test_q_funcs, 0);
+	int i = 0;
+
+	lq_test_fill(src, 0, 5);
+	CuAssertIntEquals(tc, 3, (int)ptl_lq_steal_half(dst, src));
+	CuAssertIntEquals(tc, 3, (int)dst->size);
+	CuAssertIntEquals(tc, 2, (int)src->size);
+
+	// all of a single element, then nothing
+	CuAssertIntEquals(tc, 1, (int)ptl_lq_steal_half(dst, src));
+	CuAssertIntEquals(tc, 1, (int)ptl_lq_steal_half(dst, src));
+	CuAssertIntEquals(tc, 0, (int)ptl_lq_steal_half(dst, src));
+
+	// the last steal emptied 'src', its tail must be reset
+	lq_test_fill(src, 9, 10);
+	CuAssertPtrEquals(tc, &values[9], ptl_lq_get(src));
+
+	for(i=0; i<5; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_lq_get(dst));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_lq_get(dst));
+
+	ptl_q_destroy_queue(dst);
+	ptl_q_destroy_queue(src);
+}
+
+/* queues with different allocators can't share nodes, nothing is moved */
+void TestLqSpliceAllocatorsDiffer(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	ptl_q_t dst = ptl_q_create_queue(&lq_test_q_funcs, 0);
+	ptl_q_t src = ptl_q_create_queue_allocator(&lq_test_q_funcs, 0, &counting);
+
+	lq_test_fill(src, 0, 4);
+	CuAssertIntEquals(tc, 0, (int)ptl_lq_splice(dst, src));
+	CuAssertIntEquals(tc, 0, (int)ptl_lq_steal_half(dst, src));
+	CuAssertIntEquals(tc, 4, (int)src->size);
+	CuAssertIntEquals(tc, 0, (int)dst->size);
+
+	while(ptl_lq_get(src) != NULL);
+	ptl_q_destroy_queue(dst);
+	ptl_q_destroy_queue(src);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+
+CuSuite *PtlLinkedQueueGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestLqSplice);
+	SUITE_ADD_TEST(suite, TestLqStealHalf);
+	SUITE_ADD_TEST(suite, TestLqSpliceAllocatorsDiffer);
+
+	return suite;
+}
@@ -25,12 +25,17 @@
 
 int *new_int(int);
 
+/* the linked queue as a ptl_q */
+struct ptl_q_funcs ptl_lq_test_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
 int run()
 {
 	printf("Start ptl_linked_queue_test\n");
 	
-	ptl_q_t q = (ptl_q_t)malloc(sizeof(struct ptl_q));
-	ptl_lq_init_queue (q);
+	ptl_q_t q = ptl_q_create_queue(&ptl_lq_test_funcs, 0);
 	int i = 0;
 	int *i_ptr = NULL;
 	for(i=0; i<10; i++){
@@ -51,7 +56,7 @@ int run()
 	
 	printf("Number of elements %ld\n", q->size);
 	
-	FREE(q);
+	ptl_q_destroy_queue(q);
 	
 	
 	printf("Done ptl_linked_queue_test\n");
@@ -0,0 +1,109 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/*
+ * Overloads a manager with each rejection policy: one thread submits
+ * BENCH_TASKS tasks of BENCH_TASK_USEC busy work to BENCH_THREADS workers
+ * behind a work_q of BENCH_QUEUE_SIZE, faster than they can keep up. Prints
+ * how long it took until every accepted task ran, and what became of the
+ * tasks: run by a worker, run by the submitting thread, or rejected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "../ptl_queue.h"
+#include "../ptl_coalescing_queue.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_task.h"
+#include "../ptl_util.h"
+
+#define BENCH_TASKS 20000
+#define BENCH_TASK_USEC 5
+#define BENCH_THREADS 2
+#define BENCH_QUEUE_SIZE 64
+
+/* without a key function nothing is merged, it is a bounded FIFO */
+static struct ptl_q_funcs bench_q_funcs = {
+	ptl_kq_init_queue, ptl_kq_destroy_queue, ptl_kq_add, ptl_kq_add_wait,
+	ptl_kq_clear, ptl_kq_peek, ptl_kq_get, ptl_kq_get_wait
+};
+
+static pthread_t bench_submitter;
+static long bench_by_workers = 0;
+static long bench_by_submitter = 0;
+static long bench_rejected = 0;
+
+/* spins, so the task takes its time even on a busy cpu */
+static void bench_work(void *arg){
+	long long until = ptl_get_time_usec() + BENCH_TASK_USEC;
+
+	while(ptl_get_time_usec() < until);
+
+	if(pthread_equal(pthread_self(), bench_submitter)){
+		bench_by_submitter++; // only the submitter counts here
+	} else {
+		__atomic_add_fetch(&bench_by_workers, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void bench_reject(void *arg){
+	__atomic_add_fetch(&bench_rejected, 1, __ATOMIC_RELAXED);
+}
+
+static void bench_run(const char *name, void (*policy)(void *)){
+	ptl_thread_manager_t manager = create_thread_manager(BENCH_THREADS, BENCH_THREADS, 1000,
+		ptl_q_create_queue(&bench_q_funcs, BENCH_QUEUE_SIZE), policy);
+	long accepted = 0;
+	int i = 0;
+
+	bench_submitter = pthread_self();
+	bench_by_workers = 0;
+	bench_by_submitter = 0;
+	bench_rejected = 0;
+
+	long long start = ptl_get_time_usec();
+	for(i=0; i<BENCH_TASKS; i++){
+		ptl_task_t task = create_task_with_arg(bench_work, NULL, NULL);
+		task->rejected = bench_reject;
+		accepted += submit_task(manager, task);
+	}
+	long long submitted = ptl_get_time_usec() - start;
+	shutdown(manager);
+	await_termination(manager, 60000);
+	long long elapsed = ptl_get_time_usec() - start;
+
+	printf("%-16s %10.1f %10.1f %10ld %10ld %10ld %10ld\n", name, submitted / 1000.0,
+		   elapsed / 1000.0, accepted, bench_by_workers, bench_by_submitter, bench_rejected);
+}
+
+
+int main(int argc, char **argv){
+	printf("%d tasks of %d usec, %d workers, work_q of %d\n", BENCH_TASKS, BENCH_TASK_USEC,
+		   BENCH_THREADS, BENCH_QUEUE_SIZE);
+	printf("%-16s %10s %10s %10s %10s %10s %10s\n", "policy", "submit ms", "total ms",
+		   "accepted", "workers", "submitter", "rejected");
+
+	bench_run("abort", ptl_abort_policy());
+	bench_run("caller runs", ptl_q_caller_runs_policy());
+	bench_run("discard", ptl_q_discard_policy());
+	bench_run("discard oldest", ptl_q_discard_oldest_policy());
+
+	return 0;
+}
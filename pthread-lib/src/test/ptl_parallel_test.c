@@ -0,0 +1,223 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_array_list.h"
+#include "../ptl_future.h"
+#include "../ptl_parallel.h"
+
+#define PARALLEL_TEST_RANGE 10000
+
+/* list elements are small integers, never 0 */
+#define PARALLEL_TEST_VALUE(i) ((void *)(intptr_t)((i) + 1))
+#define PARALLEL_TEST_INT(v) ((long)(intptr_t)(v) - 1)
+
+/* the work queue of the managers */
+static struct ptl_q_funcs parallel_test_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+/* how many times each index was visited */
+static int parallel_test_visits[PARALLEL_TEST_RANGE];
+
+static ptl_thread_manager_t parallel_test_manager(int num_threads){
+	return create_thread_manager(num_threads, num_threads, 1000, 
+								 ptl_q_create_queue(&parallel_test_q_funcs, 0), NULL);
+}
+
+static void parallel_test_stop(ptl_thread_manager_t manager){
+	shutdown(manager);
+	await_termination(manager, 5000);
+}
+
+static void parallel_test_visit(long begin, long end, void *ctx){
+	long i = 0;
+
+	for(i=begin; i<end; i++){
+		__atomic_fetch_add(&parallel_test_visits[i], 1, __ATOMIC_RELAXED);
+	}
+}
+
+/* counts the indexes in [begin, end) not visited exactly once, and resets them */
+static int parallel_test_missed(long begin, long end){
+	int missed = 0;
+	long i = 0;
+
+	for(i=0; i<PARALLEL_TEST_RANGE; i++){
+		missed += (parallel_test_visits[i] != ((i >= begin && i < end) ? 1 : 0));
+		parallel_test_visits[i] = 0;
+	}
+	return missed;
+}
+
+/* runs a parallel_for from inside a task of the same manager */
+static void *parallel_test_nested(void *arg){
+	ptl_thread_manager_t manager = (ptl_thread_manager_t)arg;
+	return (void *)(intptr_t)ptl_parallel_for(manager, 0, PARALLEL_TEST_RANGE, 10, 
+											  parallel_test_visit, NULL);
+}
+
+static void *parallel_test_square(void *value, void *ctx){
+	long i = (value == NULL) ? -1 : PARALLEL_TEST_INT(value);
+	return PARALLEL_TEST_VALUE(i * i);
+}
+
+static void *parallel_test_sum(void **values, long num_values, void *ctx){
+	long sum = 0;
+	long i = 0;
+
+	for(i=0; i<num_values; i++){
+		sum += PARALLEL_TEST_INT(values[i]);
+	}
+	return PARALLEL_TEST_VALUE(sum);
+}
+
+static void *parallel_test_add(void *a, void *b, void *ctx){
+	return PARALLEL_TEST_VALUE(PARALLEL_TEST_INT(a) + PARALLEL_TEST_INT(b));
+}
+
+/* keeps the last element of each chunk, and of each pair of pieces */
+static void *parallel_test_last(void **values, long num_values, void *ctx){
+	return values[num_values - 1];
+}
+
+static void *parallel_test_right(void *a, void *b, void *ctx){
+	return b;
+}
+
+static ptl_array_list_t parallel_test_list(int n){
+	ptl_array_list_t l = ptl_al_create_array_list_mode(n, PTL_AL_MODE_DENSE);
+	int i = 0;
+
+	for(i=0; i<n; i++){
+		ptl_al_add(l, PARALLEL_TEST_VALUE(i));
+	}
+	return l;
+}
+
+
+/* every index is visited once, whatever the grain, with or without helpers */
+void TestParallelForVisitsOnce(CuTest *tc){
+	ptl_thread_manager_t manager = parallel_test_manager(4);
+	long grains[5] = {1, 7, 0, PARALLEL_TEST_RANGE, PARALLEL_TEST_RANGE * 2};
+	int g = 0;
+
+	for(g=0; g<5; g++){
+		CuAssertIntEquals(tc, 1, ptl_parallel_for(manager, 0, PARALLEL_TEST_RANGE, grains[g], 
+												  parallel_test_visit, NULL));
+		CuAssertIntEquals(tc, 0, parallel_test_missed(0, PARALLEL_TEST_RANGE));
+
+		CuAssertIntEquals(tc, 1, ptl_parallel_for(NULL, 3, 1003, grains[g], 
+												  parallel_test_visit, NULL));
+		CuAssertIntEquals(tc, 0, parallel_test_missed(3, 1003));
+	}
+
+	// an empty range calls nothing
+	CuAssertIntEquals(tc, 1, ptl_parallel_for(manager, 5, 5, 0, parallel_test_visit, NULL));
+	CuAssertIntEquals(tc, 0, parallel_test_missed(0, 0));
+
+	parallel_test_stop(manager);
+}
+
+/* a call made from the manager's only worker finishes on that worker */
+void TestParallelForFromTask(CuTest *tc){
+	ptl_thread_manager_t manager = parallel_test_manager(1);
+
+	ptl_future_t f = submit_future(manager, parallel_test_nested, manager);
+	CuAssertIntEquals(tc, 1, ptl_future_wait_timeout(f, 5000));
+	CuAssertPtrEquals(tc, (void *)(intptr_t)1, ptl_future_get(f));
+	CuAssertIntEquals(tc, 0, parallel_test_missed(0, PARALLEL_TEST_RANGE));
+	ptl_future_destroy(f);
+
+	parallel_test_stop(manager);
+}
+
+/* each mapped element comes from the element at the same index */
+void TestParallelMap(CuTest *tc){
+	ptl_thread_manager_t manager = parallel_test_manager(4);
+	ptl_array_list_t l = parallel_test_list(1000);
+	int wrong = 0;
+	long i = 0;
+
+	// padding past the end leaves NULLs for 'func' to see
+	ptl_al_set(l, PARALLEL_TEST_VALUE(5), 1004);
+
+	ptl_array_list_t squares = ptl_parallel_map(manager, l, 3, parallel_test_square, NULL);
+	CuAssertPtrNotNull(tc, squares);
+	CuAssertIntEquals(tc, 1005, squares->size);
+	for(i=0; i<1000; i++){
+		wrong += (PARALLEL_TEST_INT(ptl_al_get(squares, i)) != i * i);
+	}
+	CuAssertIntEquals(tc, 0, wrong);
+	CuAssertIntEquals(tc, 1, (int)PARALLEL_TEST_INT(ptl_al_get(squares, 1002)));
+	CuAssertIntEquals(tc, 25, (int)PARALLEL_TEST_INT(ptl_al_get(squares, 1004)));
+
+	CuAssertPtrEquals(tc, NULL, ptl_parallel_map(manager, NULL, 0, parallel_test_square, NULL));
+
+	ptl_al_destroy_array_list(squares);
+	ptl_al_destroy_array_list(l);
+	parallel_test_stop(manager);
+}
+
+/* chunks are reduced in parallel and combined from left to right */
+void TestParallelReduce(CuTest *tc){
+	ptl_thread_manager_t manager = parallel_test_manager(4);
+	ptl_array_list_t l = parallel_test_list(PARALLEL_TEST_RANGE);
+	ptl_array_list_t empty = ptl_al_create_array_list_mode(4, PTL_AL_MODE_DENSE);
+	long grains[4] = {1, 13, 0, PARALLEL_TEST_RANGE};
+	long sum = ((long)PARALLEL_TEST_RANGE * (PARALLEL_TEST_RANGE - 1)) / 2;
+	int g = 0;
+
+	for(g=0; g<4; g++){
+		void *total = ptl_parallel_reduce(manager, l, grains[g], parallel_test_sum, 
+										  parallel_test_add, NULL);
+		CuAssertTrue(tc, PARALLEL_TEST_INT(total) == sum);
+
+		// only holds if the pieces are combined in order
+		void *last = ptl_parallel_reduce(manager, l, grains[g], parallel_test_last, 
+										 parallel_test_right, NULL);
+		CuAssertIntEquals(tc, PARALLEL_TEST_RANGE - 1, (int)PARALLEL_TEST_INT(last));
+	}
+
+	CuAssertPtrEquals(tc, NULL, ptl_parallel_reduce(manager, empty, 0, parallel_test_sum, 
+													parallel_test_add, NULL));
+
+	ptl_al_destroy_array_list(empty);
+	ptl_al_destroy_array_list(l);
+	parallel_test_stop(manager);
+}
+
+
+CuSuite *PtlParallelGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestParallelForVisitsOnce);
+	SUITE_ADD_TEST(suite, TestParallelForFromTask);
+	SUITE_ADD_TEST(suite, TestParallelMap);
+	SUITE_ADD_TEST(suite, TestParallelReduce);
+
+	return suite;
+}
@@ -0,0 +1,166 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_rate_limited_queue.h"
+#include "../ptl_util.h"
+
+static struct ptl_q_funcs rlq_test_q_funcs = {
+	ptl_rlq_init_queue, ptl_rlq_destroy_queue, ptl_rlq_add, ptl_rlq_add_wait,
+	ptl_rlq_clear, ptl_rlq_peek, ptl_rlq_get, ptl_rlq_get_wait
+};
+
+static struct ptl_q_funcs rlq_test_inner_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+/* elements only need distinct addresses */
+static int values[16];
+
+/* a rate limited linked queue holding the first 'num_values' of values */
+static ptl_q_t rlq_test_queue(long rate, long burst, int num_values){
+	ptl_q_t q = ptl_q_create_queue(&rlq_test_q_funcs, 0);
+	int i = 0;
+
+	ptl_rlq_set_rate(q, ptl_q_create_queue(&rlq_test_inner_funcs, 0), rate, burst);
+	for(i=0; i<num_values; i++){
+		ptl_rlq_add(q, &values[i]);
+	}
+
+	return q;
+}
+
+/* destroys the wrapped queue too, which the rate limiter leaves alone */
+static void rlq_test_destroy(ptl_q_t q){
+	ptl_q_t inner_q = ((ptl_token_bucket_t)q->data)->inner_q;
+
+	while(ptl_lq_get(inner_q) != NULL);
+	ptl_q_destroy_queue(q);
+	ptl_q_destroy_queue(inner_q);
+}
+
+
+/* a full bucket lets 'burst' elements through, then none until refilled.
+   Peeking is free */
+void TestRlqBurst(CuTest *tc){
+	ptl_q_t q = rlq_test_queue(1, 3, 8);
+	int i = 0;
+
+	CuAssertPtrEquals(tc, &values[0], ptl_rlq_peek(q));
+	for(i=0; i<3; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_rlq_get(q));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_rlq_get(q));
+	CuAssertPtrEquals(tc, &values[3], ptl_rlq_peek(q));
+
+	rlq_test_destroy(q);
+}
+
+/* get_wait sleeps until the next token is earned, one token apart */
+void TestRlqGetWaitPaced(CuTest *tc){
+	ptl_q_t q = rlq_test_queue(20, 1, 4);
+
+	CuAssertPtrEquals(tc, &values[0], ptl_rlq_get(q));
+
+	long long start = ptl_get_time_usec();
+	CuAssertPtrEquals(tc, &values[1], ptl_rlq_get_wait(q, 5000));
+	CuAssertPtrEquals(tc, &values[2], ptl_rlq_get_wait(q, 5000));
+	long long elapsed = ptl_get_time_usec() - start;
+
+	// two tokens at 50 ms each
+	CuAssertTrue(tc, elapsed >= 90000);
+	CuAssertTrue(tc, elapsed < 1000000);
+
+	// a token that can't be earned in time isn't waited for
+	start = ptl_get_time_usec();
+	CuAssertPtrEquals(tc, NULL, ptl_rlq_get_wait(q, 1));
+	CuAssertTrue(tc, ptl_get_time_usec() - start < 40000);
+
+	rlq_test_destroy(q);
+}
+
+/* a token reserved for an element that never came is given back */
+void TestRlqTokenGivenBack(CuTest *tc){
+	ptl_q_t q = rlq_test_queue(1, 1, 0);
+
+	CuAssertPtrEquals(tc, NULL, ptl_rlq_get_wait(q, 20));
+	ptl_rlq_add(q, &values[0]);
+	CuAssertPtrEquals(tc, &values[0], ptl_rlq_get(q));
+
+	rlq_test_destroy(q);
+}
+
+/* takes one element with get_wait, 'arg' is the queue */
+static void *rlq_test_get_wait(void *arg){
+	return ptl_rlq_get_wait((ptl_q_t)arg, 5000);
+}
+
+/* a consumer waiting for a token at the old rate wakes up for the new one */
+void TestRlqRateChangeWakes(CuTest *tc){
+	ptl_q_t q = rlq_test_queue(1, 1, 4);
+	ptl_q_t inner_q = ((ptl_token_bucket_t)q->data)->inner_q;
+	pthread_t thread;
+	void *value = NULL;
+
+	// the bucket is empty, the next token is a second away
+	CuAssertPtrEquals(tc, &values[0], ptl_rlq_get(q));
+
+	long long start = ptl_get_time_usec();
+	pthread_create(&thread, NULL, rlq_test_get_wait, q);
+	ptl_timed_wait(20000);
+	ptl_rlq_set_rate(q, inner_q, 1000, 1);
+	pthread_join(thread, &value);
+
+	CuAssertPtrEquals(tc, &values[1], value);
+	CuAssertTrue(tc, ptl_get_time_usec() - start < 500000);
+
+	rlq_test_destroy(q);
+}
+
+/* a rate <= 0 is no limit */
+void TestRlqUnlimited(CuTest *tc){
+	ptl_q_t q = rlq_test_queue(0, 1, 16);
+	int i = 0;
+
+	for(i=0; i<16; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_rlq_get(q));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_rlq_get(q));
+
+	rlq_test_destroy(q);
+}
+
+
+CuSuite *PtlRateLimitedQueueGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestRlqBurst);
+	SUITE_ADD_TEST(suite, TestRlqGetWaitPaced);
+	SUITE_ADD_TEST(suite, TestRlqTokenGivenBack);
+	SUITE_ADD_TEST(suite, TestRlqUnlimited);
+	SUITE_ADD_TEST(suite, TestRlqRateChangeWakes);
+
+	return suite;
+}
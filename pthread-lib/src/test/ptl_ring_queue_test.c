@@ -0,0 +1,221 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_ring_queue.h"
+
+static struct ptl_q_funcs ring_test_q_funcs = {
+	ptl_rq_init_queue, ptl_rq_destroy_queue, ptl_rq_add, ptl_rq_add_wait,
+	ptl_rq_clear, ptl_rq_peek, ptl_rq_get, ptl_rq_get_wait
+};
+
+/* elements only need distinct addresses */
+static int values[64];
+
+#define RING_TEST_PRODUCERS 4
+#define RING_TEST_PER_PRODUCER 20000
+
+/* producers add the addresses of their own counters */
+static char ring_test_marks[RING_TEST_PRODUCERS * RING_TEST_PER_PRODUCER];
+
+static void *ring_test_produce(void *arg){
+	ptl_q_t q = (ptl_q_t)arg;
+	static int next = 0;
+	int p = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+	int i = 0;
+
+	for(i=0; i<RING_TEST_PER_PRODUCER; i++){
+		ptl_rq_add(q, ring_test_marks + (p * RING_TEST_PER_PRODUCER) + i);
+	}
+
+	return NULL;
+}
+
+/* one producer adds its counters in order, so there are no gaps */
+static void *ring_test_produce_in_order(void *arg){
+	ptl_q_t q = (ptl_q_t)arg;
+	int i = 0;
+
+	for(i=0; i<RING_TEST_PER_PRODUCER; i++){
+		ptl_rq_add(q, ring_test_marks + i);
+	}
+
+	return NULL;
+}
+
+
+/* the capacity is rounded up, a full ring drops its oldest element */
+void TestRqOverwritesOldest(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&ring_test_q_funcs, 3);
+	int i = 0;
+
+	CuAssertIntEquals(tc, 4, q->capacity);
+	for(i=0; i<6; i++){
+		CuAssertIntEquals(tc, 1, ptl_rq_add(q, &values[i]));
+	}
+
+	CuAssertPtrEquals(tc, &values[2], ptl_rq_peek(q));
+	for(i=2; i<6; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_rq_get(q));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_rq_get(q));
+	CuAssertIntEquals(tc, 2, (int)ptl_rq_get_drop_count(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* a snapshot leaves the elements in the ring, and keeps the newest ones */
+void TestRqSnapshot(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&ring_test_q_funcs, 8);
+	void *copy[8];
+	int i = 0;
+
+	for(i=0; i<5; i++){
+		ptl_rq_add(q, &values[i]);
+	}
+
+	CuAssertIntEquals(tc, 3, (int)ptl_rq_snapshot(q, copy, 3));
+	CuAssertPtrEquals(tc, &values[2], copy[0]);
+	CuAssertPtrEquals(tc, &values[4], copy[2]);
+	CuAssertPtrEquals(tc, &values[0], ptl_rq_get(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* a snapshot taken while a producer laps the ring many times over is
+   still a run of consecutive elements */
+void TestRqSnapshotWhileAdding(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&ring_test_q_funcs, 16);
+	void *copy[16];
+	pthread_t thread;
+	int gaps = 0;
+	int i = 0;
+	long j = 0;
+
+	pthread_create(&thread, NULL, ring_test_produce_in_order, q);
+	for(i=0; i<20000; i++){
+		long num_values = ptl_rq_snapshot(q, copy, 16);
+
+		for(j=1; j<num_values; j++){
+			gaps += ((char *)copy[j] != (char *)copy[j - 1] + 1);
+		}
+	}
+	pthread_join(thread, NULL);
+
+	CuAssertIntEquals(tc, 0, gaps);
+	CuAssertIntEquals(tc, 16, (int)ptl_rq_snapshot(q, copy, 16));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* a producer held up in the middle of writing for a whole lap keeps its
+   slot, the next lap's producer drops its element and readers skip it */
+void TestRqStalledProducer(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&ring_test_q_funcs, 4);
+	ptl_ring_t ring = (ptl_ring_t)q->data;
+	int i = 0;
+
+	// ticket 0 is taken and its slot marked as being written, then nothing
+	unsigned long ticket = __atomic_fetch_add(&(ring->write_pos), 1, __ATOMIC_RELAXED);
+	ring->slots[ticket & ring->mask].seq = (2 * ticket) + 1;
+
+	// tickets 1 to 4, ticket 4 has the stalled producer's slot
+	for(i=1; i<=4; i++){
+		ptl_rq_add(q, &values[i]);
+	}
+	CuAssertIntEquals(tc, (int)((2 * ticket) + 1), (int)ring->slots[0].seq);
+
+	// the stalled producer finishes
+	ring->slots[0].value = &values[0];
+	__atomic_store_n(&(ring->slots[0].seq), (2 * ticket) + 2, __ATOMIC_RELEASE);
+
+	// ticket 0 was lapped, ticket 4 was given up on, neither is read
+	for(i=1; i<=3; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_rq_get(q));
+	}
+	CuAssertPtrEquals(tc, NULL, ptl_rq_get(q));
+	CuAssertIntEquals(tc, 2, (int)ptl_rq_get_drop_count(q));
+	CuAssertIntEquals(tc, 1, (int)ptl_rq_get_drop_newest_count(q));
+
+	// the slot is used normally from the next lap on (ticket 8)
+	for(i=5; i<=8; i++){
+		ptl_rq_add(q, &values[i]);
+	}
+	for(i=5; i<=8; i++){
+		CuAssertPtrEquals(tc, &values[i], ptl_rq_get(q));
+	}
+	CuAssertIntEquals(tc, 2, (int)ptl_rq_get_drop_count(q));
+
+	ptl_q_destroy_queue(q);
+}
+
+/* with producers racing a reader, no element is read twice, and every
+   element is either read or counted as dropped */
+void TestRqConcurrentProducers(CuTest *tc){
+	ptl_q_t q = ptl_q_create_queue(&ring_test_q_funcs, 64);
+	pthread_t threads[RING_TEST_PRODUCERS];
+	long total = RING_TEST_PRODUCERS * RING_TEST_PER_PRODUCER;
+	long read = 0;
+	int duplicates = 0;
+	int i = 0;
+	char *mark = NULL;
+
+	for(i=0; i<RING_TEST_PRODUCERS; i++){
+		pthread_create(&threads[i], NULL, ring_test_produce, q);
+	}
+
+	// read while the producers run, then whatever is left
+	for(i=0; i<200000; i++){
+		if((mark = (char *)ptl_rq_get(q)) != NULL){
+			duplicates += (*mark != 0);
+			*mark = 1;
+			read++;
+		}
+	}
+	for(i=0; i<RING_TEST_PRODUCERS; i++){
+		pthread_join(threads[i], NULL);
+	}
+	while((mark = (char *)ptl_rq_get(q)) != NULL){
+		duplicates += (*mark != 0);
+		*mark = 1;
+		read++;
+	}
+
+	CuAssertIntEquals(tc, 0, duplicates);
+	CuAssertIntEquals(tc, (int)total, (int)(read + ptl_rq_get_drop_count(q)));
+
+	ptl_q_destroy_queue(q);
+}
+
+
+CuSuite *PtlRingQueueGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestRqOverwritesOldest);
+	SUITE_ADD_TEST(suite, TestRqSnapshot);
+	SUITE_ADD_TEST(suite, TestRqSnapshotWhileAdding);
+	SUITE_ADD_TEST(suite, TestRqStalledProducer);
+	SUITE_ADD_TEST(suite, TestRqConcurrentProducers);
+
+	return suite;
+}
@@ -0,0 +1,333 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_coalescing_queue.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_scheduler.h"
+#include "../ptl_util.h"
+
+/* the work queue of the managers */
+static struct ptl_q_funcs sched_test_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+/* what a scheduled function saw */
+struct sched_test_run {
+	long long started;			/**< when the first run started, usec */
+	long long last_returned;	/**< when the last run returned, usec */
+	long long shortest_gap;		/**< least time between a return and the next start */
+	int running;				/**< runs in progress */
+	int overlapped;				/**< runs that started while another was running */
+	long sleep;					/**< usec each run takes */
+};
+
+/* without a key function nothing is merged, it is a bounded FIFO */
+static struct ptl_q_funcs sched_test_bounded_q_funcs = {
+	ptl_kq_init_queue, ptl_kq_destroy_queue, ptl_kq_add, ptl_kq_add_wait,
+	ptl_kq_clear, ptl_kq_peek, ptl_kq_get, ptl_kq_get_wait
+};
+
+/* holds the one worker of an overloaded manager until opened */
+static int sched_test_gate_started = 0;
+static int sched_test_gate_open = 0;
+
+/* where the last run of sched_test_where() ran */
+static pthread_t sched_test_ran_on;
+
+/* the order the ordered runs happened in */
+static int sched_test_order[3];
+static int sched_test_next = 0;
+
+static ptl_thread_manager_t sched_test_manager(int num_threads){
+	return create_thread_manager(num_threads, num_threads, 1000, 
+								 ptl_q_create_queue(&sched_test_q_funcs, 0), NULL);
+}
+
+static void sched_test_stop(ptl_thread_manager_t manager){
+	shutdown(manager);
+	await_termination(manager, 5000);
+}
+
+static void sched_test_record(void *arg){
+	struct sched_test_run *run = (struct sched_test_run *)arg;
+	long long now = ptl_get_time_usec();
+
+	if(__atomic_add_fetch(&(run->running), 1, __ATOMIC_ACQ_REL) > 1){
+		__atomic_add_fetch(&(run->overlapped), 1, __ATOMIC_RELAXED);
+	}
+	if(run->started == 0){
+		run->started = now;
+	} else if(now - run->last_returned < run->shortest_gap){
+		run->shortest_gap = now - run->last_returned;
+	}
+
+	if(run->sleep > 0){
+		ptl_timed_wait(run->sleep);
+	}
+
+	run->last_returned = ptl_get_time_usec();
+	__atomic_sub_fetch(&(run->running), 1, __ATOMIC_ACQ_REL);
+}
+
+/* 'arg' is the number to put in the order */
+static void sched_test_ordered(void *arg){
+	int i = __atomic_fetch_add(&sched_test_next, 1, __ATOMIC_RELAXED);
+	sched_test_order[i] = (int)(long)arg;
+}
+
+static void sched_test_gate(void *arg){
+	__atomic_add_fetch(&sched_test_gate_started, 1, __ATOMIC_RELEASE);
+	while(!__atomic_load_n(&sched_test_gate_open, __ATOMIC_ACQUIRE)){
+		ptl_timed_wait(100);
+	}
+}
+
+static void sched_test_nothing(void *arg){
+	return;
+}
+
+static void sched_test_where(void *arg){
+	__atomic_store_n(&sched_test_ran_on, pthread_self(), __ATOMIC_RELAXED);
+}
+
+/* a manager with one worker held by the gate and a full work_q */
+static ptl_thread_manager_t sched_test_overloaded(void (*rejected_handler)(void *)){
+	ptl_thread_manager_t manager = create_thread_manager(1, 1, 1000,
+		ptl_q_create_queue(&sched_test_bounded_q_funcs, 1), rejected_handler);
+
+	sched_test_gate_started = 0;
+	sched_test_gate_open = 0;
+	submit_with_arg(manager, sched_test_gate, NULL);
+	while(!__atomic_load_n(&sched_test_gate_started, __ATOMIC_ACQUIRE)){
+		ptl_timed_wait(100);
+	}
+	submit_with_arg(manager, sched_test_nothing, NULL);
+
+	return manager;
+}
+
+/* waits up to 'timeout' milliseconds for the function to have run 'runs' times */
+static int sched_test_wait_runs(ptl_scheduled_t scheduled, long runs, long timeout){
+	long long deadline = ptl_get_time_usec() + (timeout * 1000LL);
+
+	while(ptl_scheduled_get_runs(scheduled) < runs){
+		if(ptl_get_time_usec() > deadline){ return 0; }
+		ptl_timed_wait(1000);
+	}
+	return 1;
+}
+
+
+/* a delayed function runs once, no sooner than asked */
+void TestSchedDelay(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_manager(2);
+	struct sched_test_run run = {0, 0, 0, 0, 0, 0};
+
+	long long start = ptl_get_time_usec();
+	ptl_scheduled_t scheduled = schedule(manager, sched_test_record, &run, 30);
+	CuAssertPtrNotNull(tc, scheduled);
+	CuAssertIntEquals(tc, 0, ptl_scheduled_is_done(scheduled));
+
+	CuAssertIntEquals(tc, 1, sched_test_wait_runs(scheduled, 1, 5000));
+	CuAssertTrue(tc, run.started - start >= 30000);
+	CuAssertIntEquals(tc, 1, ptl_scheduled_is_done(scheduled));
+	CuAssertIntEquals(tc, 0, ptl_scheduled_cancel(scheduled));
+	CuAssertIntEquals(tc, 1, (int)ptl_scheduled_get_runs(scheduled));
+	ptl_scheduled_destroy(scheduled);
+
+	CuAssertPtrEquals(tc, NULL, schedule(manager, NULL, NULL, 10));
+	CuAssertPtrEquals(tc, NULL, schedule_at_fixed_rate(manager, sched_test_record, &run, 0, 0));
+	CuAssertPtrEquals(tc, NULL, schedule_with_fixed_delay(manager, sched_test_record, &run, 0, 0));
+
+	sched_test_stop(manager);
+}
+
+/* functions run in the order they are due, not the order they were scheduled */
+void TestSchedDueOrder(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_manager(1);
+	ptl_scheduled_t scheduled[3];
+	long delays[3] = {60, 20, 40};
+	int i = 0;
+
+	sched_test_next = 0;
+	for(i=0; i<3; i++){
+		scheduled[i] = schedule(manager, sched_test_ordered, (void *)delays[i], delays[i]);
+	}
+	for(i=0; i<3; i++){
+		CuAssertIntEquals(tc, 1, sched_test_wait_runs(scheduled[i], 1, 5000));
+		ptl_scheduled_destroy(scheduled[i]);
+	}
+
+	CuAssertIntEquals(tc, 20, sched_test_order[0]);
+	CuAssertIntEquals(tc, 40, sched_test_order[1]);
+	CuAssertIntEquals(tc, 60, sched_test_order[2]);
+
+	sched_test_stop(manager);
+}
+
+/* a fixed rate function runs until cancelled, never two runs at once */
+void TestSchedFixedRate(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_manager(4);
+	struct sched_test_run run = {0, 0, 0, 0, 0, 0};
+
+	// each run takes longer than the period, so runs fall behind
+	run.sleep = 15000;
+	ptl_scheduled_t scheduled = schedule_at_fixed_rate(manager, sched_test_record, &run, 0, 5);
+	CuAssertIntEquals(tc, 1, sched_test_wait_runs(scheduled, 5, 5000));
+
+	CuAssertIntEquals(tc, 1, ptl_scheduled_cancel(scheduled));
+	CuAssertIntEquals(tc, 1, ptl_scheduled_is_done(scheduled));
+
+	// a run already submitted may still finish, then nothing more
+	ptl_timed_wait(50000);
+	long runs = ptl_scheduled_get_runs(scheduled);
+	ptl_timed_wait(50000);
+	CuAssertIntEquals(tc, (int)runs, (int)ptl_scheduled_get_runs(scheduled));
+	CuAssertIntEquals(tc, 0, run.overlapped);
+	ptl_scheduled_destroy(scheduled);
+
+	sched_test_stop(manager);
+}
+
+/* with a fixed delay, the next run starts at least 'delay' after the last returned */
+void TestSchedFixedDelay(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_manager(4);
+	struct sched_test_run run = {0, 0, 0, 0, 0, 0};
+
+	run.shortest_gap = 1000000000LL;
+	run.sleep = 5000;
+	ptl_scheduled_t scheduled = schedule_with_fixed_delay(manager, sched_test_record, &run, 0, 20);
+	CuAssertIntEquals(tc, 1, sched_test_wait_runs(scheduled, 4, 5000));
+	ptl_scheduled_cancel(scheduled);
+
+	CuAssertTrue(tc, run.shortest_gap >= 20000);
+	CuAssertIntEquals(tc, 0, run.overlapped);
+	ptl_scheduled_destroy(scheduled);
+
+	sched_test_stop(manager);
+}
+
+/* a cancelled function that was still waiting never runs */
+void TestSchedCancelBeforeDue(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_manager(1);
+	struct sched_test_run run = {0, 0, 0, 0, 0, 0};
+
+	ptl_scheduled_t scheduled = schedule(manager, sched_test_record, &run, 50);
+	CuAssertIntEquals(tc, 1, ptl_scheduled_cancel(scheduled));
+	CuAssertIntEquals(tc, 1, ptl_scheduled_is_done(scheduled));
+	CuAssertIntEquals(tc, 0, ptl_scheduled_cancel(scheduled));
+
+	ptl_timed_wait(100000);
+	CuAssertIntEquals(tc, 0, (int)ptl_scheduled_get_runs(scheduled));
+	CuAssertIntEquals(tc, 0, (int)(run.started != 0));
+	ptl_scheduled_destroy(scheduled);
+
+	sched_test_stop(manager);
+}
+
+/* shutting the manager down cancels what is scheduled, and nothing new is */
+void TestSchedShutdownCancels(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_manager(1);
+	struct sched_test_run once = {0, 0, 0, 0, 0, 0};
+	struct sched_test_run periodic = {0, 0, 0, 0, 0, 0};
+
+	ptl_scheduled_t later = schedule(manager, sched_test_record, &once, 10000);
+	ptl_scheduled_t every = schedule_at_fixed_rate(manager, sched_test_record, &periodic, 10000, 10);
+	sched_test_stop(manager);
+
+	CuAssertIntEquals(tc, 1, is_terminated(manager));
+	CuAssertIntEquals(tc, 1, ptl_scheduled_is_done(later));
+	CuAssertIntEquals(tc, 1, ptl_scheduled_is_done(every));
+	CuAssertIntEquals(tc, 0, (int)ptl_scheduled_get_runs(later));
+	CuAssertIntEquals(tc, 0, (int)ptl_scheduled_get_runs(every));
+	CuAssertPtrEquals(tc, NULL, schedule(manager, sched_test_record, &once, 0));
+
+	ptl_scheduled_destroy(later);
+	ptl_scheduled_destroy(every);
+}
+
+/* an overloaded manager loses runs of a periodic function, not the function */
+void TestSchedRejectedRunsAgain(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_overloaded(ptl_q_discard_policy());
+
+	ptl_scheduled_t scheduled = schedule_at_fixed_rate(manager, sched_test_where, NULL, 0, 5);
+	ptl_timed_wait(50000);
+	CuAssertTrue(tc, ptl_scheduled_get_rejections(scheduled) > 0);
+	CuAssertIntEquals(tc, 0, (int)ptl_scheduled_get_runs(scheduled));
+	CuAssertIntEquals(tc, 0, ptl_scheduled_is_done(scheduled));
+
+	__atomic_store_n(&sched_test_gate_open, 1, __ATOMIC_RELEASE);
+	CuAssertIntEquals(tc, 1, sched_test_wait_runs(scheduled, 3, 5000));
+	CuAssertIntEquals(tc, 1, ptl_scheduled_cancel(scheduled));
+	ptl_scheduled_destroy(scheduled);
+	sched_test_stop(manager);
+
+	// a function that runs once is done when its run is rejected
+	manager = sched_test_overloaded(NULL);
+	scheduled = schedule(manager, sched_test_where, NULL, 0);
+	ptl_timed_wait(50000);
+	CuAssertIntEquals(tc, 1, (int)ptl_scheduled_get_rejections(scheduled));
+	CuAssertIntEquals(tc, 1, ptl_scheduled_is_done(scheduled));
+	CuAssertIntEquals(tc, 0, (int)ptl_scheduled_get_runs(scheduled));
+	ptl_scheduled_destroy(scheduled);
+
+	__atomic_store_n(&sched_test_gate_open, 1, __ATOMIC_RELEASE);
+	sched_test_stop(manager);
+}
+
+/* under caller runs, the timer thread still never runs a function itself */
+void TestSchedCallerRunsNotOnTimer(CuTest *tc){
+	ptl_thread_manager_t manager = sched_test_overloaded(ptl_q_caller_runs_policy());
+
+	ptl_scheduled_t scheduled = schedule_at_fixed_rate(manager, sched_test_where, NULL, 0, 5);
+	ptl_timed_wait(50000);
+	CuAssertTrue(tc, ptl_scheduled_get_rejections(scheduled) > 0);
+	CuAssertIntEquals(tc, 0, (int)ptl_scheduled_get_runs(scheduled));
+
+	__atomic_store_n(&sched_test_gate_open, 1, __ATOMIC_RELEASE);
+	CuAssertIntEquals(tc, 1, sched_test_wait_runs(scheduled, 3, 5000));
+	ptl_scheduled_cancel(scheduled);
+	CuAssertIntEquals(tc, 0, pthread_equal(__atomic_load_n(&sched_test_ran_on, __ATOMIC_RELAXED), manager->scheduler->thread));
+	ptl_scheduled_destroy(scheduled);
+
+	sched_test_stop(manager);
+}
+
+
+CuSuite *PtlSchedulerGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestSchedDelay);
+	SUITE_ADD_TEST(suite, TestSchedDueOrder);
+	SUITE_ADD_TEST(suite, TestSchedFixedRate);
+	SUITE_ADD_TEST(suite, TestSchedFixedDelay);
+	SUITE_ADD_TEST(suite, TestSchedCancelBeforeDue);
+	SUITE_ADD_TEST(suite, TestSchedShutdownCancels);
+	SUITE_ADD_TEST(suite, TestSchedRejectedRunsAgain);
+	SUITE_ADD_TEST(suite, TestSchedCallerRunsNotOnTimer);
+
+	return suite;
+}
@@ -0,0 +1,184 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_array_list.h"
+#include "../ptl_snapshot_list.h"
+#include "../ptl_util.h"
+
+#define SL_TEST_SIZE 16
+#define SL_TEST_READERS 3
+#define SL_TEST_WRITES 2000
+
+/* elements only need distinct addresses */
+static int values[SL_TEST_SIZE];
+
+static int sl_test_writer_done = 0;
+static int sl_test_stop = 0;
+static long sl_test_bad_reads = 0;
+
+/* adds an element, which waits for the reader still holding the old snapshot */
+static void *sl_test_add(void *arg){
+	ptl_sl_add((ptl_snapshot_list_t)arg, &values[SL_TEST_SIZE - 1]);
+	__atomic_store_n(&sl_test_writer_done, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+/* every element of every snapshot must still hold its own index */
+static void *sl_test_read(void *arg){
+	ptl_snapshot_list_t list = (ptl_snapshot_list_t)arg;
+	struct ptl_sl_reader reader;
+	int i = 0;
+
+	while(!__atomic_load_n(&sl_test_stop, __ATOMIC_ACQUIRE)){
+		ptl_sl_read_begin(list, &reader);
+		for(i=0; i<reader.size; i++){
+			if(*(int *)reader.array[i] != i){
+				__atomic_add_fetch(&sl_test_bad_reads, 1, __ATOMIC_RELAXED);
+			}
+		}
+		ptl_sl_read_end(list, &reader);
+	}
+
+	return NULL;
+}
+
+static int *sl_test_new_int(int i){
+	int *value = (int *)malloc(sizeof(int));
+	*value = i;
+	return value;
+}
+
+
+/* the writes, each publishing a new snapshot */
+void TestSlWrites(CuTest *tc){
+	ptl_snapshot_list_t list = ptl_sl_create_snapshot_list();
+	int i = 0;
+
+	for(i=0; i<4; i++){
+		CuAssertIntEquals(tc, 1, ptl_sl_add(list, &values[i]));
+	}
+	CuAssertIntEquals(tc, 4, ptl_sl_size(list));
+	CuAssertPtrEquals(tc, &values[2], ptl_sl_get(list, 2));
+	CuAssertPtrEquals(tc, NULL, ptl_sl_get(list, 4));
+
+	CuAssertPtrEquals(tc, &values[1], ptl_sl_set(list, &values[5], 1));
+	CuAssertPtrEquals(tc, NULL, ptl_sl_set(list, &values[5], 4));
+	CuAssertIntEquals(tc, 1, ptl_sl_contains(list, &values[5]));
+	CuAssertIntEquals(tc, 0, ptl_sl_contains(list, &values[1]));
+
+	CuAssertPtrEquals(tc, &values[0], ptl_sl_remove_index(list, 0));
+	CuAssertPtrEquals(tc, &values[3], ptl_sl_remove(list, &values[3]));
+	CuAssertPtrEquals(tc, NULL, ptl_sl_remove(list, &values[3]));
+	CuAssertIntEquals(tc, 2, ptl_sl_size(list));
+	CuAssertPtrEquals(tc, &values[5], ptl_sl_get(list, 0));
+	CuAssertPtrEquals(tc, &values[2], ptl_sl_get(list, 1));
+
+	ptl_sl_destroy_snapshot_list(list);
+}
+
+/* publish replaces everything with the non-null elements of a list */
+void TestSlPublish(CuTest *tc){
+	ptl_snapshot_list_t list = ptl_sl_create_snapshot_list();
+	ptl_array_list_t changes = ptl_al_create_array_list_mode(4, PTL_AL_MODE_SPARSE);
+
+	ptl_sl_add(list, &values[0]);
+	ptl_al_set(changes, &values[7], 0);
+	ptl_al_set(changes, &values[8], 3);
+
+	CuAssertIntEquals(tc, 1, ptl_sl_publish(list, changes));
+	CuAssertIntEquals(tc, 2, ptl_sl_size(list));
+	CuAssertPtrEquals(tc, &values[7], ptl_sl_get(list, 0));
+	CuAssertPtrEquals(tc, &values[8], ptl_sl_get(list, 1));
+
+	ptl_al_destroy_array_list(changes);
+	ptl_sl_destroy_snapshot_list(list);
+}
+
+/* a reader's snapshot doesn't change, and a writer waits for it to finish */
+void TestSlReaderHoldsSnapshot(CuTest *tc){
+	ptl_snapshot_list_t list = ptl_sl_create_snapshot_list();
+	struct ptl_sl_reader reader;
+	pthread_t writer;
+
+	sl_test_writer_done = 0;
+	ptl_sl_add(list, &values[0]);
+
+	ptl_sl_read_begin(list, &reader);
+	pthread_create(&writer, NULL, sl_test_add, list);
+	ptl_timed_wait(20000);
+
+	CuAssertIntEquals(tc, 0, __atomic_load_n(&sl_test_writer_done, __ATOMIC_ACQUIRE));
+	CuAssertIntEquals(tc, 1, reader.size);
+	CuAssertPtrEquals(tc, &values[0], reader.array[0]);
+	ptl_sl_read_end(list, &reader);
+
+	pthread_join(writer, NULL);
+	CuAssertIntEquals(tc, 1, sl_test_writer_done);
+	CuAssertIntEquals(tc, 2, ptl_sl_size(list));
+
+	ptl_sl_destroy_snapshot_list(list);
+}
+
+/* an element replaced by a writer is freed as soon as the set returns, and
+   no reader ever sees it after that */
+void TestSlReplacedElementsFreed(CuTest *tc){
+	ptl_snapshot_list_t list = ptl_sl_create_snapshot_list();
+	pthread_t readers[SL_TEST_READERS];
+	int i = 0;
+
+	sl_test_stop = 0;
+	sl_test_bad_reads = 0;
+	for(i=0; i<SL_TEST_SIZE; i++){
+		ptl_sl_add(list, sl_test_new_int(i));
+	}
+	for(i=0; i<SL_TEST_READERS; i++){
+		pthread_create(&readers[i], NULL, sl_test_read, list);
+	}
+
+	for(i=0; i<SL_TEST_WRITES; i++){
+		int index = i % SL_TEST_SIZE;
+		int *old = (int *)ptl_sl_set(list, sl_test_new_int(index), index);
+		*old = -1; // a reader that still saw it would notice
+		free(old);
+	}
+
+	__atomic_store_n(&sl_test_stop, 1, __ATOMIC_RELEASE);
+	for(i=0; i<SL_TEST_READERS; i++){
+		pthread_join(readers[i], NULL);
+	}
+	CuAssertIntEquals(tc, 0, (int)sl_test_bad_reads);
+
+	ptl_sl_destroy_snapshot_list_freefunc(list, free);
+}
+
+
+CuSuite *PtlSnapshotListGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestSlWrites);
+	SUITE_ADD_TEST(suite, TestSlPublish);
+	SUITE_ADD_TEST(suite, TestSlReaderHoldsSnapshot);
+	SUITE_ADD_TEST(suite, TestSlReplacedElementsFreed);
+
+	return suite;
+}
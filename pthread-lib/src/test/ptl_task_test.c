@@ -0,0 +1,225 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_allocator.h"
+#include "../ptl_task.h"
+
+#define TASK_TEST_NUM (3 * PTL_TASK_MAGAZINE_SIZE)
+
+static void task_test_nothing(void *arg){
+	return;
+}
+
+/* captures bigger than fit in the task */
+struct task_test_big_captures {
+	char bytes[PTL_TASK_INLINE_SIZE + 16];
+};
+
+static int task_test_rejected_calls = 0;
+
+static void task_test_rejected(void *arg){
+	*(int *)arg += 1;
+	task_test_rejected_calls++;
+}
+
+/* adds the two ints it captured, into the third */
+static void task_test_add(void *arg){
+	int *ints = (int *)arg;
+	ints[2] = ints[0] + ints[1];
+}
+
+/* destroys the tasks in 'arg' on another thread, the way a worker does */
+static void *task_test_destroy_all(void *arg){
+	ptl_task_t *tasks = (ptl_task_t *)arg;
+	int i = 0;
+
+	for(i=0; i<TASK_TEST_NUM; i++){
+		destroy_task(tasks[i]);
+	}
+
+	return NULL;
+}
+
+static void task_test_destroy_elsewhere(ptl_task_t *tasks){
+	pthread_t thread;
+
+	pthread_create(&thread, NULL, task_test_destroy_all, tasks);
+	pthread_join(thread, NULL);
+}
+
+
+/* a destroyed task is created again from the thread's magazines */
+void TestTaskReused(CuTest *tc){
+	ptl_task_t task = create_task(task_test_nothing);
+	destroy_task(task);
+
+	CuAssertPtrEquals(tc, task, create_task(task_test_nothing));
+	CuAssertIntEquals(tc, PTL_TASK_STATE_CREATED, task->state);
+	CuAssertPtrEquals(tc, NULL, task->arg);
+	destroy_task(task);
+}
+
+/* tasks destroyed by a thread that exits come back through the depot. Other
+   threads may have put magazines in after ours, so the whole depot is taken */
+void TestTaskFlowsBackThroughDepot(CuTest *tc){
+	ptl_task_t tasks[TASK_TEST_NUM];
+	int num_again = (PTL_TASK_DEPOT_SIZE + 2) * PTL_TASK_MAGAZINE_SIZE;
+	ptl_task_t *again = (ptl_task_t *)malloc(num_again * sizeof(ptl_task_t));
+	int i = 0, j = 0, found = 0;
+
+	ptl_task_trim_cache();
+	for(i=0; i<TASK_TEST_NUM; i++){
+		tasks[i] = create_task(task_test_nothing);
+	}
+	task_test_destroy_elsewhere(tasks);
+
+	for(i=0; i<num_again; i++){
+		again[i] = create_task(task_test_nothing);
+		for(j=0; j<TASK_TEST_NUM; j++){
+			found += (again[i] == tasks[j]);
+		}
+	}
+	CuAssertIntEquals(tc, TASK_TEST_NUM, found);
+
+	for(i=0; i<num_again; i++){
+		destroy_task(again[i]);
+	}
+	free(again);
+	ptl_task_trim_cache();
+}
+
+/* a caller's allocator gets every task back on destroy, whichever thread
+   destroys it, so it can go away with nothing left in a cache */
+void TestTaskCallerAllocatorNotCached(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	ptl_task_t tasks[TASK_TEST_NUM];
+	char captures[PTL_TASK_INLINE_SIZE * 2];
+	int i = 0;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	memset(captures, 7, sizeof(captures));
+
+	for(i=0; i<TASK_TEST_NUM; i++){
+		if(i % 2){
+			tasks[i] = create_task_inline(task_test_nothing, captures, sizeof(captures), &counting);
+			CuAssertIntEquals(tc, 0, memcmp(tasks[i]->arg, captures, sizeof(captures)));
+		} else {
+			tasks[i] = create_task_allocator(task_test_nothing, &counting);
+		}
+	}
+	CuAssertTrue(tc, stats.bytes_in_use > 0);
+
+	task_test_destroy_elsewhere(tasks);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+	CuAssertIntEquals(tc, (int)stats.num_allocs, (int)stats.num_frees);
+
+	// and one destroyed on this thread, with its magazines in use
+	destroy_task(create_task(task_test_nothing));
+	destroy_task(create_task_allocator(task_test_nothing, &counting));
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+/* small captures are copied into the task, the function is given the copy */
+void TestTaskInlineCaptures(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	int ints[3] = {2, 3, 0};
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	ptl_task_t task = create_task_inline(task_test_add, ints, sizeof(ints), &counting);
+
+	CuAssertIntEquals(tc, 1, (int)stats.num_allocs);
+	CuAssertPtrEquals(tc, task->captures, task->arg);
+	CuAssertIntEquals(tc, 0, (int)((unsigned long)task->arg % 16));
+
+	// the caller's copy may change or go away
+	ints[0] = 100;
+	task->function_to_execute(task->arg);
+	CuAssertIntEquals(tc, 5, ((int *)task->arg)[2]);
+	CuAssertIntEquals(tc, 0, ints[2]);
+
+	destroy_task(task);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+
+	CuAssertPtrEquals(tc, NULL, create_task_inline(task_test_add, NULL, 4, &counting));
+}
+
+/* big captures get an allocation of their own, freed with the task */
+void TestTaskBigCaptures(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	struct task_test_big_captures big;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	memset(&big, 7, sizeof(big));
+	ptl_task_t task = create_task_inline(task_test_nothing, &big, sizeof(big), &counting);
+
+	CuAssertIntEquals(tc, 2, (int)stats.num_allocs);
+	CuAssertTrue(tc, task->arg != task->captures);
+	CuAssertIntEquals(tc, 0, memcmp(task->arg, &big, sizeof(big)));
+
+	destroy_task(task);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+
+	// a cached task made again has no captures left over
+	task = create_task_inline(task_test_nothing, &big, sizeof(big), NULL);
+	destroy_task(task);
+	ptl_task_t again = create_task(task_test_nothing);
+	CuAssertPtrEquals(tc, task, again);
+	CuAssertPtrEquals(tc, NULL, again->arg);
+	CuAssertIntEquals(tc, 0, (int)again->captures_size);
+	destroy_task(again);
+}
+
+/* a rejected task tells its owner through 'rejected', then is destroyed */
+void TestTaskRejected(CuTest *tc){
+	int rejected = 0;
+
+	ptl_task_t task = create_task_with_arg(task_test_nothing, &rejected, NULL);
+	CuAssertPtrEquals(tc, &rejected, task->arg);
+	task->rejected = task_test_rejected;
+	reject_task(task);
+	CuAssertIntEquals(tc, 1, rejected);
+
+	// without a 'rejected' function it is only destroyed
+	task_test_rejected_calls = 0;
+	reject_task(create_task_with_arg(task_test_nothing, &rejected, NULL));
+	CuAssertIntEquals(tc, 0, task_test_rejected_calls);
+	CuAssertIntEquals(tc, 1, rejected);
+}
+
+
+CuSuite *PtlTaskGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestTaskReused);
+	SUITE_ADD_TEST(suite, TestTaskFlowsBackThroughDepot);
+	SUITE_ADD_TEST(suite, TestTaskCallerAllocatorNotCached);
+	SUITE_ADD_TEST(suite, TestTaskInlineCaptures);
+	SUITE_ADD_TEST(suite, TestTaskBigCaptures);
+	SUITE_ADD_TEST(suite, TestTaskRejected);
+
+	return suite;
+}
@@ -0,0 +1,81 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/*
+ * Throughput of empty tasks: BENCH_TASKS tasks submitted from one thread to
+ * a manager with 1 to 8 workers, timed from the first submit until the
+ * manager has terminated after shutdown(), so every task has run. Shared
+ * managers (one work_q) are timed next to work-stealing ones. Prints
+ * thousands of tasks per second.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../ptl_queue.h"
+#include "../ptl_linked_queue.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_util.h"
+
+#define BENCH_TASKS 1000000
+#define BENCH_MAX_THREADS 8
+
+static struct ptl_q_funcs bench_q_funcs = {
+	ptl_lq_init_queue, ptl_lq_destroy_queue, ptl_lq_add, ptl_lq_add_wait,
+	ptl_lq_clear, ptl_lq_peek, ptl_lq_get, ptl_lq_get_wait
+};
+
+static void bench_empty(void *arg){
+	return;
+}
+
+/* thousands of tasks per second through 'manager', which is shut down */
+static double bench_run(ptl_thread_manager_t manager){
+	long long start = ptl_get_time_usec();
+	int i = 0;
+
+	for(i=0; i<BENCH_TASKS; i++){
+		submit(manager, bench_empty);
+	}
+	shutdown(manager);
+	await_termination(manager, 60000);
+
+	return (BENCH_TASKS * 1000.0) / (ptl_get_time_usec() - start);
+}
+
+
+int main(int argc, char **argv){
+	int num_threads = 0;
+
+	printf("%d empty tasks, thousands per second\n", BENCH_TASKS);
+	printf("%8s %14s %14s\n", "threads", "shared", "work stealing");
+
+	for(num_threads=1; num_threads<=BENCH_MAX_THREADS; num_threads*=2){
+		ptl_thread_manager_t shared = create_thread_manager(num_threads, num_threads, 1000,
+			ptl_q_create_queue(&bench_q_funcs, 0), NULL);
+		double shared_rate = bench_run(shared);
+
+		ptl_thread_manager_t stealing = create_work_stealing_thread_manager(num_threads,
+			ptl_q_create_queue(&bench_q_funcs, 0), NULL);
+		double stealing_rate = bench_run(stealing);
+
+		printf("%8d %14.1f %14.1f\n", num_threads, shared_rate, stealing_rate);
+	}
+
+	return 0;
+}
@@ -0,0 +1,460 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_queue.h"
+#include "../ptl_coalescing_queue.h"
+#include "../ptl_thread_manager.h"
+#include "../ptl_task.h"
+#include "../ptl_util.h"
+
+/* without a key function nothing is merged, it is a bounded FIFO */
+static struct ptl_q_funcs tm_test_q_funcs = {
+	ptl_kq_init_queue, ptl_kq_destroy_queue, ptl_kq_add, ptl_kq_add_wait,
+	ptl_kq_clear, ptl_kq_peek, ptl_kq_get, ptl_kq_get_wait
+};
+
+#define TM_TEST_QUEUE_SIZE 2
+
+/* each gate task holds a worker until the gate is opened */
+static int tm_test_gate_started = 0;
+static int tm_test_gate_open = 0;
+
+static int tm_test_before = 0;
+static int tm_test_after = 0;
+static int tm_test_handler_calls = 0;
+static pthread_t tm_test_ran_on;
+
+static void tm_test_gate(void *arg){
+	__atomic_add_fetch(&tm_test_gate_started, 1, __ATOMIC_RELEASE);
+	while(!__atomic_load_n(&tm_test_gate_open, __ATOMIC_ACQUIRE)){
+		ptl_timed_wait(100);
+	}
+}
+
+/* 'arg' is the counter of the task */
+static void tm_test_count(void *arg){
+	tm_test_ran_on = pthread_self();
+	__atomic_add_fetch((int *)arg, 1, __ATOMIC_RELAXED);
+}
+
+static void tm_test_before_execute(void *task){
+	__atomic_add_fetch(&tm_test_before, 1, __ATOMIC_RELAXED);
+}
+
+static void tm_test_after_execute(void *task){
+	__atomic_add_fetch(&tm_test_after, 1, __ATOMIC_RELAXED);
+}
+
+static void tm_test_handler(void *function){
+	__atomic_add_fetch(&tm_test_handler_calls, 1, __ATOMIC_RELAXED);
+}
+
+/* what happened to a task made by tm_test_task() */
+struct tm_test_counts {
+	int ran;
+	int rejected;
+};
+
+static void tm_test_run_counted(void *arg){
+	__atomic_add_fetch(&(((struct tm_test_counts *)arg)->ran), 1, __ATOMIC_RELAXED);
+}
+
+static void tm_test_reject_counted(void *arg){
+	__atomic_add_fetch(&(((struct tm_test_counts *)arg)->rejected), 1, __ATOMIC_RELAXED);
+}
+
+static ptl_task_t tm_test_task(struct tm_test_counts *counts){
+	ptl_task_t task = create_task_with_arg(tm_test_run_counted, counts, NULL);
+	task->rejected = tm_test_reject_counted;
+	return task;
+}
+
+#define TM_TEST_WS_RANGE 20000
+#define TM_TEST_WS_LEAF 16
+
+/* how many times the leaves visited each index */
+static int tm_test_ws_visits[TM_TEST_WS_RANGE];
+static int tm_test_ws_done = 0;
+
+/* a piece of the range, copied into the task by submit_inline() */
+struct tm_test_ws_range {
+	ptl_thread_manager_t manager;
+	int begin;
+	int end;
+};
+
+/* splits its range in two subtasks from inside the task, down to leaves */
+static void tm_test_ws_split(void *arg){
+	struct tm_test_ws_range *range = (struct tm_test_ws_range *)arg;
+	int i = 0;
+
+	if(range->end - range->begin > TM_TEST_WS_LEAF){
+		struct tm_test_ws_range left = *range;
+		struct tm_test_ws_range right = *range;
+
+		left.end = right.begin = range->begin + ((range->end - range->begin) / 2);
+		submit_inline(range->manager, tm_test_ws_split, &left, sizeof(left));
+		submit_inline(range->manager, tm_test_ws_split, &right, sizeof(right));
+		return;
+	}
+
+	for(i=range->begin; i<range->end; i++){
+		__atomic_add_fetch(&tm_test_ws_visits[i], 1, __ATOMIC_RELAXED);
+	}
+	__atomic_add_fetch(&tm_test_ws_done, range->end - range->begin, __ATOMIC_RELEASE);
+}
+
+/* counts the indexes not visited exactly once, and resets them */
+static int tm_test_ws_missed(){
+	int missed = 0;
+	int i = 0;
+
+	for(i=0; i<TM_TEST_WS_RANGE; i++){
+		missed += (tm_test_ws_visits[i] != 1);
+		tm_test_ws_visits[i] = 0;
+	}
+	tm_test_ws_done = 0;
+	return missed;
+}
+
+/* one worker, held by the gate, and a full work queue */
+static ptl_thread_manager_t tm_test_overloaded(void (*rejected_handler)(void *), int *queued){
+	int i = 0;
+
+	tm_test_gate_started = 0;
+	tm_test_gate_open = 0;
+	tm_test_before = 0;
+	tm_test_after = 0;
+	tm_test_handler_calls = 0;
+
+	ptl_thread_manager_t manager = create_thread_manager_with_functions(1, 1, 1000,
+		ptl_q_create_queue(&tm_test_q_funcs, TM_TEST_QUEUE_SIZE), rejected_handler,
+		tm_test_before_execute, tm_test_after_execute);
+
+	submit(manager, tm_test_gate);
+	while(!__atomic_load_n(&tm_test_gate_started, __ATOMIC_ACQUIRE)){
+		ptl_timed_wait(100);
+	}
+	for(i=0; i<TM_TEST_QUEUE_SIZE; i++){
+		submit_with_arg(manager, tm_test_count, queued);
+	}
+
+	return manager;
+}
+
+/* waits up to 'timeout' milliseconds for '*value' to reach 'expected' */
+static int tm_test_wait_for(int *value, int expected, long timeout){
+	long long deadline = ptl_get_time_usec() + (timeout * 1000LL);
+
+	while(__atomic_load_n(value, __ATOMIC_ACQUIRE) != expected){
+		if(ptl_get_time_usec() > deadline){ return 0; }
+		ptl_timed_wait(1000);
+	}
+	return 1;
+}
+
+static void tm_test_stop(CuTest *tc, ptl_thread_manager_t manager){
+	__atomic_store_n(&tm_test_gate_open, 1, __ATOMIC_RELEASE);
+	shutdown(manager);
+	CuAssertIntEquals(tc, 1, await_termination(manager, 5000));
+	CuAssertIntEquals(tc, 1, is_terminated(manager));
+}
+
+
+/* abort: the task is rejected, the handler told and submit fails */
+void TestTmAbortPolicy(CuTest *tc){
+	int queued = 0, ran = 0;
+	ptl_thread_manager_t manager = tm_test_overloaded(tm_test_handler, &queued);
+
+	CuAssertIntEquals(tc, 0, submit_with_arg(manager, tm_test_count, &ran));
+	CuAssertIntEquals(tc, 1, tm_test_handler_calls);
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE, queued);
+	CuAssertIntEquals(tc, 0, ran);
+}
+
+/* caller runs: the submitter runs it like a worker would, hooks and counts
+   included */
+void TestTmCallerRunsPolicy(CuTest *tc){
+	int queued = 0, ran = 0;
+	ptl_thread_manager_t manager = tm_test_overloaded(ptl_q_caller_runs_policy(), &queued);
+
+	int completed = __atomic_load_n(&(manager->num_completed_tasks), __ATOMIC_RELAXED);
+	int before = __atomic_load_n(&tm_test_before, __ATOMIC_RELAXED);
+	CuAssertIntEquals(tc, 1, submit_with_arg(manager, tm_test_count, &ran));
+	CuAssertIntEquals(tc, 1, ran);
+	CuAssertIntEquals(tc, 1, pthread_equal(tm_test_ran_on, pthread_self()));
+	CuAssertIntEquals(tc, completed + 1, 
+		__atomic_load_n(&(manager->num_completed_tasks), __ATOMIC_RELAXED));
+	CuAssertIntEquals(tc, before + 1, __atomic_load_n(&tm_test_before, __ATOMIC_RELAXED));
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE, queued);
+	// the gate, the queued tasks and the one the caller ran
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE + 2, manager->num_completed_tasks);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE + 2, tm_test_before);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE + 2, tm_test_after);
+}
+
+/* discard: the new task is rejected, but submit succeeds */
+void TestTmDiscardPolicy(CuTest *tc){
+	int queued = 0;
+	struct tm_test_counts counts = {0, 0};
+	ptl_thread_manager_t manager = tm_test_overloaded(ptl_q_discard_policy(), &queued);
+
+	CuAssertIntEquals(tc, 1, submit_task(manager, tm_test_task(&counts)));
+	CuAssertIntEquals(tc, 1, counts.rejected);
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE, queued);
+	CuAssertIntEquals(tc, 0, counts.ran);
+}
+
+/* discard oldest: every submit makes room, only the newest tasks run */
+void TestTmDiscardOldestPolicy(CuTest *tc){
+	int queued = 0;
+	struct tm_test_counts counts[1000] = {{0, 0}};
+	int i = 0;
+	ptl_thread_manager_t manager = tm_test_overloaded(ptl_q_discard_oldest_policy(), &queued);
+
+	for(i=0; i<1000; i++){
+		CuAssertIntEquals(tc, 1, submit_task(manager, tm_test_task(&counts[i])));
+	}
+
+	tm_test_stop(tc, manager);
+	// the tasks queued before went first, then all but the newest
+	CuAssertIntEquals(tc, 0, queued);
+	for(i=0; i<1000; i++){
+		int newest = (i >= 1000 - TM_TEST_QUEUE_SIZE);
+		CuAssertIntEquals(tc, newest, counts[i].ran);
+		CuAssertIntEquals(tc, !newest, counts[i].rejected);
+	}
+}
+
+/* shutdown runs what was queued and rejects anything new */
+void TestTmShutdown(CuTest *tc){
+	int queued = 0;
+	struct tm_test_counts counts = {0, 0};
+	ptl_thread_manager_t manager = tm_test_overloaded(tm_test_handler, &queued);
+
+	shutdown(manager);
+	CuAssertIntEquals(tc, 0, submit_task(manager, tm_test_task(&counts)));
+	CuAssertIntEquals(tc, 1, counts.rejected);
+	CuAssertIntEquals(tc, 1, tm_test_handler_calls);
+	CuAssertIntEquals(tc, 0, await_termination(manager, 0));
+	CuAssertIntEquals(tc, 0, is_terminated(manager));
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE, queued);
+	CuAssertIntEquals(tc, 0, counts.ran);
+}
+
+/* shutdown_now hands back the queued tasks without running them */
+void TestTmShutdownNow(CuTest *tc){
+	int queued = 0, drained = 0;
+	struct tm_test_counts counts = {0, 0};
+	ptl_thread_manager_t manager = tm_test_overloaded(tm_test_handler, &queued);
+	ptl_task_t task = NULL;
+
+	ptl_q_t left = shutdown_now(manager);
+	CuAssertPtrNotNull(tc, left);
+	while((task = (ptl_task_t)ptl_q_get(left)) != NULL){
+		destroy_task(task);
+		drained++;
+	}
+	ptl_q_destroy_queue(left);
+	CuAssertIntEquals(tc, TM_TEST_QUEUE_SIZE, drained);
+
+	CuAssertIntEquals(tc, 0, submit_task(manager, tm_test_task(&counts)));
+	CuAssertIntEquals(tc, 1, counts.rejected);
+
+	// the gate is still running, its worker exits once it returns
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, 0, queued);
+	CuAssertIntEquals(tc, 0, counts.ran);
+}
+
+/* the core threads start with the manager, before any task is submitted */
+void TestTmCoreThreadsStartEagerly(CuTest *tc){
+	ptl_thread_manager_t manager = create_thread_manager(3, 6, 1000,
+		ptl_q_create_queue(&tm_test_q_funcs, 16), NULL);
+
+	CuAssertIntEquals(tc, 3, __atomic_load_n(&(manager->thread_pool->current_pool_size), 
+											 __ATOMIC_RELAXED));
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, 0, manager->thread_pool->current_pool_size);
+}
+
+/* busy workers make the pool grow to its max, and the threads above the
+   core size exit once they have been idle for the keep alive time */
+void TestTmPoolGrowsAndShrinks(CuTest *tc){
+	struct tm_test_counts counts = {0, 0};
+	int i = 0;
+
+	tm_test_gate_started = 0;
+	tm_test_gate_open = 0;
+	ptl_thread_manager_t manager = create_thread_manager(1, 4, 50,
+		ptl_q_create_queue(&tm_test_q_funcs, 16), NULL);
+	ptl_thread_pool_t pool = manager->thread_pool;
+
+	// the pool grows once there are as many tasks waiting as threads
+	for(i=0; i<12; i++){
+		submit(manager, tm_test_gate);
+	}
+	CuAssertIntEquals(tc, 4, __atomic_load_n(&(pool->current_pool_size), __ATOMIC_RELAXED));
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&tm_test_gate_started, 4, 5000));
+
+	// at the max, more tasks wait in the queue
+	for(i=0; i<3; i++){
+		submit_task(manager, tm_test_task(&counts));
+	}
+	CuAssertIntEquals(tc, 4, __atomic_load_n(&(pool->current_pool_size), __ATOMIC_RELAXED));
+	CuAssertIntEquals(tc, 0, __atomic_load_n(&(counts.ran), __ATOMIC_RELAXED));
+
+	__atomic_store_n(&tm_test_gate_open, 1, __ATOMIC_RELEASE);
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&(counts.ran), 3, 5000));
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&(pool->current_pool_size), 1, 5000));
+
+	// the core thread stays and still runs tasks
+	submit_task(manager, tm_test_task(&counts));
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&(counts.ran), 4, 5000));
+	CuAssertIntEquals(tc, 1, __atomic_load_n(&(pool->current_pool_size), __ATOMIC_RELAXED));
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, 16, manager->num_completed_tasks);
+}
+
+/* subtasks submitted from inside the tasks of a work-stealing manager all
+   run once, whichever worker's deque they end up on */
+void TestTmWorkStealingSubtasks(CuTest *tc){
+	ptl_thread_manager_t manager = create_work_stealing_thread_manager(4, 
+		ptl_q_create_queue(&tm_test_q_funcs, 16), NULL);
+	struct tm_test_ws_range range = {manager, 0, TM_TEST_WS_RANGE};
+	int i = 0;
+
+	CuAssertIntEquals(tc, PTL_TM_MODE_WORK_STEALING, manager->mode);
+	CuAssertIntEquals(tc, 4, manager->num_ws_workers);
+
+	// several roots at once, from outside the workers
+	for(i=0; i<4; i++){
+		range.begin = i * (TM_TEST_WS_RANGE / 4);
+		range.end = range.begin + (TM_TEST_WS_RANGE / 4);
+		CuAssertIntEquals(tc, 1, submit_inline(manager, tm_test_ws_split, &range, sizeof(range)));
+	}
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&tm_test_ws_done, TM_TEST_WS_RANGE, 10000));
+	CuAssertIntEquals(tc, 0, tm_test_ws_missed());
+
+	tm_test_stop(tc, manager);
+}
+
+/* a work-stealing manager that is shut down still finishes work that its
+   tasks split into subtasks */
+void TestTmWorkStealingShutdownFinishesSubtasks(CuTest *tc){
+	ptl_thread_manager_t manager = create_work_stealing_thread_manager(2, 
+		ptl_q_create_queue(&tm_test_q_funcs, 16), NULL);
+	struct tm_test_ws_range range = {manager, 0, TM_TEST_WS_RANGE};
+
+	submit_inline(manager, tm_test_ws_split, &range, sizeof(range));
+	shutdown(manager);
+	CuAssertIntEquals(tc, 0, submit_inline(manager, tm_test_ws_split, &range, sizeof(range)));
+
+	CuAssertIntEquals(tc, 1, await_termination(manager, 10000));
+	CuAssertIntEquals(tc, TM_TEST_WS_RANGE, tm_test_ws_done);
+	CuAssertIntEquals(tc, 0, tm_test_ws_missed());
+}
+
+/* shutdown_now on a work-stealing manager hands back what was waiting */
+void TestTmWorkStealingShutdownNow(CuTest *tc){
+	struct tm_test_counts counts = {0, 0};
+	ptl_task_t task = NULL;
+	int i = 0, drained = 0;
+
+	tm_test_gate_started = 0;
+	tm_test_gate_open = 0;
+	ptl_thread_manager_t manager = create_work_stealing_thread_manager(1, 
+		ptl_q_create_queue(&tm_test_q_funcs, 16), NULL);
+
+	submit(manager, tm_test_gate);
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&tm_test_gate_started, 1, 5000));
+	for(i=0; i<3; i++){
+		submit_task(manager, tm_test_task(&counts));
+	}
+
+	ptl_q_t left = shutdown_now(manager);
+	while((task = (ptl_task_t)ptl_q_get(left)) != NULL){
+		reject_task(task);
+		drained++;
+	}
+	ptl_q_destroy_queue(left);
+	CuAssertIntEquals(tc, 3, drained);
+	CuAssertIntEquals(tc, 3, counts.rejected);
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, 0, counts.ran);
+}
+
+/* await_termination gives up after the timeout if the manager is busy */
+void TestTmAwaitTerminationTimesOut(CuTest *tc){
+	tm_test_gate_started = 0;
+	tm_test_gate_open = 0;
+	ptl_thread_manager_t manager = create_thread_manager(1, 1, 1000,
+		ptl_q_create_queue(&tm_test_q_funcs, 16), NULL);
+
+	// not even shut down yet
+	CuAssertIntEquals(tc, 0, await_termination(manager, 10));
+
+	submit(manager, tm_test_gate);
+	CuAssertIntEquals(tc, 1, tm_test_wait_for(&tm_test_gate_started, 1, 5000));
+	shutdown(manager);
+	CuAssertIntEquals(tc, 1, is_terminating(manager));
+
+	long long start = ptl_get_time_usec();
+	CuAssertIntEquals(tc, 0, await_termination(manager, 50));
+	CuAssertTrue(tc, ptl_get_time_usec() - start >= 50000);
+	CuAssertIntEquals(tc, 0, is_terminated(manager));
+
+	tm_test_stop(tc, manager);
+	CuAssertIntEquals(tc, 0, is_terminating(manager));
+}
+
+
+CuSuite *PtlThreadManagerGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestTmAbortPolicy);
+	SUITE_ADD_TEST(suite, TestTmCallerRunsPolicy);
+	SUITE_ADD_TEST(suite, TestTmDiscardPolicy);
+	SUITE_ADD_TEST(suite, TestTmDiscardOldestPolicy);
+	SUITE_ADD_TEST(suite, TestTmShutdown);
+	SUITE_ADD_TEST(suite, TestTmShutdownNow);
+	SUITE_ADD_TEST(suite, TestTmCoreThreadsStartEagerly);
+	SUITE_ADD_TEST(suite, TestTmPoolGrowsAndShrinks);
+	SUITE_ADD_TEST(suite, TestTmWorkStealingSubtasks);
+	SUITE_ADD_TEST(suite, TestTmWorkStealingShutdownFinishesSubtasks);
+	SUITE_ADD_TEST(suite, TestTmWorkStealingShutdownNow);
+	SUITE_ADD_TEST(suite, TestTmAwaitTerminationTimesOut);
+
+	return suite;
+}
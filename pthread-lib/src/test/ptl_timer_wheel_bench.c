@@ -0,0 +1,191 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+/*
+ * Times adding, cancelling and expiring BENCH_TIMERS timers (1M unless a
+ * count is given) on a timer wheel with 1 ms ticks, due at random in the
+ * next 10 minutes, and the same on a binary heap with back indexes, the
+ * usual way to keep cancellable deadlines. Half of the timers are
+ * cancelled, the rest expire with the wheel advanced tick by tick. Prints
+ * nanoseconds per timer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "../ptl_util.h"
+
+#define BENCH_TIMERS 1000000
+#define BENCH_TICK_USEC 1000
+#define BENCH_SPAN_USEC 600000000LL	/* timers are due within this */
+
+/* a heap entry, 'index' is where it is in the heap so it can be removed */
+struct bench_heap_entry {
+	long long due;
+	long index;
+};
+
+static struct bench_heap_entry **bench_heap;
+static long bench_heap_size = 0;
+static long bench_fired = 0;
+
+/* xorshift, so the runs are the same every time */
+static unsigned long long bench_random_state = 88172645463325252ULL;
+
+static unsigned long long bench_random(){
+	bench_random_state ^= bench_random_state << 13;
+	bench_random_state ^= bench_random_state >> 7;
+	bench_random_state ^= bench_random_state << 17;
+	return bench_random_state;
+}
+
+static void bench_fire(ptl_timer_t timer, void *arg){
+	bench_fired++;
+}
+
+static void bench_heap_swap(long a, long b){
+	struct bench_heap_entry *entry = bench_heap[a];
+
+	bench_heap[a] = bench_heap[b];
+	bench_heap[b] = entry;
+	bench_heap[a]->index = a;
+	bench_heap[b]->index = b;
+}
+
+static void bench_heap_up(long i){
+	while(i > 0 && bench_heap[(i - 1) / 2]->due > bench_heap[i]->due){
+		bench_heap_swap((i - 1) / 2, i);
+		i = (i - 1) / 2;
+	}
+}
+
+static void bench_heap_down(long i){
+	while(1){
+		long least = i;
+		long child = (2 * i) + 1;
+
+		if(child < bench_heap_size && bench_heap[child]->due < bench_heap[least]->due){
+			least = child;
+		}
+		if(child + 1 < bench_heap_size && bench_heap[child + 1]->due < bench_heap[least]->due){
+			least = child + 1;
+		}
+		if(least == i){ return; }
+
+		bench_heap_swap(i, least);
+		i = least;
+	}
+}
+
+static void bench_heap_add(struct bench_heap_entry *entry){
+	bench_heap[bench_heap_size] = entry;
+	entry->index = bench_heap_size++;
+	bench_heap_up(entry->index);
+}
+
+static void bench_heap_remove(struct bench_heap_entry *entry){
+	long i = entry->index;
+
+	bench_heap_size--;
+	if(i != bench_heap_size){
+		bench_heap[i] = bench_heap[bench_heap_size];
+		bench_heap[i]->index = i;
+		bench_heap_down(i);
+		bench_heap_up(bench_heap[i]->index);
+	}
+	entry->index = -1;
+}
+
+
+int main(int argc, char **argv){
+	int num_timers = (argc > 1) ? atoi(argv[1]) : BENCH_TIMERS;
+	struct ptl_timer *timers = (struct ptl_timer *)malloc(num_timers * sizeof(struct ptl_timer));
+	struct bench_heap_entry *entries = 
+		(struct bench_heap_entry *)malloc(num_timers * sizeof(struct bench_heap_entry));
+	long long *due = (long long *)malloc(num_timers * sizeof(long long));
+	long long t = 0;
+	int i = 0;
+
+	ptl_timer_wheel_t wheel = ptl_tw_create_timer_wheel(BENCH_TICK_USEC);
+	long long start = wheel->start_usec;
+
+	for(i=0; i<num_timers; i++){
+		ptl_tw_init_timer(&timers[i], bench_fire, NULL);
+		due[i] = start + (long long)(bench_random() % BENCH_SPAN_USEC);
+	}
+
+	printf("%d timers, %d usec ticks, ns per timer\n", num_timers, BENCH_TICK_USEC);
+	printf("%-8s %10s %10s %10s\n", "", "add", "cancel", "expire");
+
+	// the wheel, advanced one tick at a time as a timer thread would
+	long long t0 = ptl_get_time_usec();
+	for(i=0; i<num_timers; i++){
+		ptl_tw_add(wheel, &timers[i], due[i]);
+	}
+	long long t1 = ptl_get_time_usec();
+	for(i=0; i<num_timers; i+=2){
+		ptl_tw_cancel(wheel, &timers[i]);
+	}
+	long long t2 = ptl_get_time_usec();
+	for(t=start; t<=start + BENCH_SPAN_USEC + BENCH_TICK_USEC; t+=BENCH_TICK_USEC){
+		ptl_tw_advance(wheel, t);
+	}
+	long long t3 = ptl_get_time_usec();
+
+	long num_cancelled = (num_timers + 1) / 2;
+	printf("%-8s %10.1f %10.1f %10.1f\n", "wheel", (t1 - t0) * 1000.0 / num_timers,
+		   (t2 - t1) * 1000.0 / num_cancelled, (t3 - t2) * 1000.0 / bench_fired);
+	if(bench_fired != num_timers - num_cancelled || ptl_tw_size(wheel) != 0){
+		printf("expected %ld timers to fire, %ld did\n", num_timers - num_cancelled, bench_fired);
+		return 1;
+	}
+	ptl_tw_destroy_timer_wheel(wheel);
+
+	// the heap
+	bench_heap = (struct bench_heap_entry **)malloc(num_timers * sizeof(struct bench_heap_entry *));
+	for(i=0; i<num_timers; i++){
+		entries[i].due = due[i];
+	}
+	t0 = ptl_get_time_usec();
+	for(i=0; i<num_timers; i++){
+		bench_heap_add(&entries[i]);
+	}
+	t1 = ptl_get_time_usec();
+	for(i=0; i<num_timers; i+=2){
+		bench_heap_remove(&entries[i]);
+	}
+	t2 = ptl_get_time_usec();
+	long num_expired = bench_heap_size;
+	while(bench_heap_size > 0){
+		bench_heap_remove(bench_heap[0]);
+	}
+	t3 = ptl_get_time_usec();
+
+	printf("%-8s %10.1f %10.1f %10.1f\n", "heap", (t1 - t0) * 1000.0 / num_timers,
+		   (t2 - t1) * 1000.0 / num_cancelled, (t3 - t2) * 1000.0 / num_expired);
+
+	printf("a wheel is %lu bytes, a timer %lu\n", (unsigned long)sizeof(struct ptl_timer_wheel),
+		   (unsigned long)sizeof(struct ptl_timer));
+
+	free(bench_heap);
+	free(entries);
+	free(timers);
+	free(due);
+
+	return 0;
+}
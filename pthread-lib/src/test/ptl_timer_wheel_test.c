@@ -0,0 +1,228 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cutest/CuTest.h"
+#include "../ptl_util.h"
+
+#define TW_TEST_TICK 1000
+
+/* a timer and what happened to it */
+struct tw_test_timer {
+	struct ptl_timer timer;
+	long long due;				/**< when it was added to expire */
+	long long fired_at;			/**< the 'now' it was called with */
+	int fired;					/**< times called */
+	int again;					/**< times it adds itself again */
+};
+
+/* the time passed to ptl_tw_advance(), and the order timers were called in */
+static long long tw_test_now = 0;
+static struct tw_test_timer *tw_test_order[8];
+static int tw_test_num_fired = 0;
+
+static ptl_timer_wheel_t tw_test_wheel = NULL;
+
+static void tw_test_fire(ptl_timer_t timer, void *arg){
+	struct tw_test_timer *t = (struct tw_test_timer *)arg;
+
+	t->fired++;
+	t->fired_at = tw_test_now;
+	if(tw_test_num_fired < 8){
+		tw_test_order[tw_test_num_fired] = t;
+	}
+	tw_test_num_fired++;
+
+	if(t->again > 0){
+		t->again--;
+		t->due += 10 * TW_TEST_TICK;
+		ptl_tw_add(tw_test_wheel, timer, t->due);
+	}
+}
+
+static void tw_test_add(struct tw_test_timer *t, long long due){
+	t->due = due;
+	ptl_tw_add(tw_test_wheel, &(t->timer), due);
+}
+
+static long tw_test_advance(long long now){
+	tw_test_now = now;
+	return ptl_tw_advance(tw_test_wheel, now);
+}
+
+static long long tw_test_start(struct tw_test_timer *timers, int num_timers){
+	int i = 0;
+
+	tw_test_num_fired = 0;
+	tw_test_wheel = ptl_tw_create_timer_wheel(TW_TEST_TICK);
+	for(i=0; i<num_timers; i++){
+		memset(&timers[i], 0, sizeof(struct tw_test_timer));
+		ptl_tw_init_timer(&(timers[i].timer), tw_test_fire, &timers[i]);
+	}
+	return tw_test_wheel->start_usec;
+}
+
+
+/* timers are called in order of their ticks, and never early */
+void TestTwExpiresInOrder(CuTest *tc){
+	struct tw_test_timer timers[3];
+	long long start = tw_test_start(timers, 3);
+
+	tw_test_add(&timers[0], start + 5000);
+	tw_test_add(&timers[1], start + 2000);
+	tw_test_add(&timers[2], start + 2500);
+	CuAssertIntEquals(tc, 3, (int)ptl_tw_size(tw_test_wheel));
+
+	CuAssertIntEquals(tc, 0, (int)tw_test_advance(start + 1999));
+	CuAssertIntEquals(tc, 1, (int)tw_test_advance(start + 2000));
+	CuAssertIntEquals(tc, 0, (int)tw_test_advance(start + 2499));
+	CuAssertIntEquals(tc, 2, (int)tw_test_advance(start + 10000));
+
+	CuAssertPtrEquals(tc, &timers[1], tw_test_order[0]);
+	CuAssertPtrEquals(tc, &timers[2], tw_test_order[1]);
+	CuAssertPtrEquals(tc, &timers[0], tw_test_order[2]);
+	CuAssertIntEquals(tc, 0, (int)ptl_tw_size(tw_test_wheel));
+	CuAssertIntEquals(tc, 0, ptl_tw_is_pending(&(timers[0].timer)));
+
+	// a time already passed expires on the next tick
+	tw_test_add(&timers[0], start);
+	CuAssertIntEquals(tc, 0, (int)tw_test_advance(start + 10000));
+	CuAssertIntEquals(tc, 1, (int)tw_test_advance(start + 10000 + TW_TEST_TICK));
+	CuAssertIntEquals(tc, 2, timers[0].fired);
+
+	ptl_tw_destroy_timer_wheel(tw_test_wheel);
+}
+
+/* a cancelled timer is not called, and adding a pending timer moves it */
+void TestTwCancelAndMove(CuTest *tc){
+	struct tw_test_timer timers[2];
+	long long start = tw_test_start(timers, 2);
+
+	tw_test_add(&timers[0], start + 3000);
+	tw_test_add(&timers[1], start + 3000);
+	CuAssertIntEquals(tc, 1, ptl_tw_is_pending(&(timers[0].timer)));
+	CuAssertIntEquals(tc, 1, ptl_tw_cancel(tw_test_wheel, &(timers[0].timer)));
+	CuAssertIntEquals(tc, 0, ptl_tw_cancel(tw_test_wheel, &(timers[0].timer)));
+	CuAssertIntEquals(tc, 0, ptl_tw_is_pending(&(timers[0].timer)));
+	CuAssertIntEquals(tc, 1, (int)ptl_tw_size(tw_test_wheel));
+
+	// moved later, it is still only in the wheel once
+	tw_test_add(&timers[1], start + 600000);
+	CuAssertIntEquals(tc, 1, (int)ptl_tw_size(tw_test_wheel));
+	CuAssertIntEquals(tc, 0, (int)tw_test_advance(start + 599999));
+	CuAssertIntEquals(tc, 1, (int)tw_test_advance(start + 600000));
+	CuAssertIntEquals(tc, 0, timers[0].fired);
+	CuAssertIntEquals(tc, 1, timers[1].fired);
+
+	ptl_tw_destroy_timer_wheel(tw_test_wheel);
+}
+
+/* timers on every level, and past the range of the wheel, come down through
+   the cascades and expire on their tick */
+void TestTwCascades(CuTest *tc){
+	struct tw_test_timer timers[5];
+	long long start = tw_test_start(timers, 5);
+	long long ticks[5] = {
+		300LL,					// level 1
+		70000LL,				// level 2
+		20000000LL,				// level 3
+		(1LL << 32) - 5,		// the last tick in range
+		(1LL << 32) + 12345		// out of range, put back when it comes up
+	};
+	int i = 0;
+
+	for(i=0; i<5; i++){
+		tw_test_add(&timers[i], start + (ticks[i] * TW_TEST_TICK));
+	}
+
+	for(i=0; i<5; i++){
+		long long due = timers[i].due;
+
+		CuAssertIntEquals(tc, 0, (int)tw_test_advance(due - 1));
+		CuAssertIntEquals(tc, 0, timers[i].fired);
+		CuAssertIntEquals(tc, 1, (int)tw_test_advance(due + TW_TEST_TICK - 1));
+		CuAssertIntEquals(tc, 1, timers[i].fired);
+	}
+	CuAssertIntEquals(tc, 0, (int)ptl_tw_size(tw_test_wheel));
+
+	ptl_tw_destroy_timer_wheel(tw_test_wheel);
+}
+
+/* advancing only when next_expiry says to never misses a timer */
+void TestTwNextExpiry(CuTest *tc){
+	struct tw_test_timer timers[3];
+	long long start = tw_test_start(timers, 3);
+	long long next = 0;
+	int steps = 0;
+
+	CuAssertTrue(tc, ptl_tw_next_expiry(tw_test_wheel) == -1);
+
+	tw_test_add(&timers[0], start + 40000);
+	tw_test_add(&timers[1], start + 700000);
+	tw_test_add(&timers[2], start + 90000000);
+	CuAssertTrue(tc, ptl_tw_next_expiry(tw_test_wheel) <= start + 40000);
+
+	while((next = ptl_tw_next_expiry(tw_test_wheel)) != -1 && steps < 10000){
+		tw_test_advance(next);
+		steps++;
+	}
+
+	CuAssertTrue(tc, steps < 10000);
+	for(steps=0; steps<3; steps++){
+		CuAssertIntEquals(tc, 1, timers[steps].fired);
+		CuAssertTrue(tc, timers[steps].fired_at >= timers[steps].due);
+		CuAssertTrue(tc, timers[steps].fired_at < timers[steps].due + TW_TEST_TICK);
+	}
+
+	ptl_tw_destroy_timer_wheel(tw_test_wheel);
+}
+
+/* a timer's function may add it again */
+void TestTwReAddFromFunction(CuTest *tc){
+	struct tw_test_timer timers[1];
+	long long start = tw_test_start(timers, 1);
+	long long now = 0;
+
+	timers[0].again = 4;
+	tw_test_add(&timers[0], start + (10 * TW_TEST_TICK));
+	for(now=start; now<=start + (100 * TW_TEST_TICK); now+=TW_TEST_TICK){
+		tw_test_advance(now);
+	}
+
+	CuAssertIntEquals(tc, 5, timers[0].fired);
+	CuAssertIntEquals(tc, 0, ptl_tw_is_pending(&(timers[0].timer)));
+	CuAssertTrue(tc, timers[0].fired_at == start + (50 * TW_TEST_TICK));
+
+	ptl_tw_destroy_timer_wheel(tw_test_wheel);
+}
+
+
+CuSuite *PtlTimerWheelGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestTwExpiresInOrder);
+	SUITE_ADD_TEST(suite, TestTwCancelAndMove);
+	SUITE_ADD_TEST(suite, TestTwCascades);
+	SUITE_ADD_TEST(suite, TestTwNextExpiry);
+	SUITE_ADD_TEST(suite, TestTwReAddFromFunction);
+
+	return suite;
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of the pthread-lib Library.
+ * Copyright (C) 2008-2009 Nick Powers.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor Boston, MA 02110-1301,  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "cutest/CuTest.h"
+#include "../ptl_allocator.h"
+#include "../ptl_work_deque.h"
+
+#define WD_TEST_THIEVES 3
+#define WD_TEST_ELEMENTS 100000
+
+/* the elements are the addresses of their marks */
+static char wd_test_marks[WD_TEST_ELEMENTS];
+static int wd_test_owner_done = 0;
+static int wd_test_duplicates = 0;
+
+/* marks what it was given, counting anything taken twice */
+static void wd_test_take(char *mark){
+	if(__atomic_exchange_n(mark, 1, __ATOMIC_RELAXED) != 0){
+		__atomic_add_fetch(&wd_test_duplicates, 1, __ATOMIC_RELAXED);
+	}
+}
+
+static void *wd_test_thief(void *arg){
+	ptl_work_deque_t deque = (ptl_work_deque_t)arg;
+	char *mark = NULL;
+
+	for(;;){
+		if((mark = (char *)ptl_wd_steal(deque)) != NULL){
+			wd_test_take(mark);
+		} else if(__atomic_load_n(&wd_test_owner_done, __ATOMIC_ACQUIRE)){
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+
+/* the owner gets the newest element, thieves the oldest */
+void TestWdPushPopSteal(CuTest *tc){
+	ptl_work_deque_t deque = ptl_wd_create_work_deque(NULL);
+	int i = 0;
+
+	CuAssertPtrEquals(tc, NULL, ptl_wd_pop(deque));
+	CuAssertPtrEquals(tc, NULL, ptl_wd_steal(deque));
+	CuAssertIntEquals(tc, 0, ptl_wd_push(deque, NULL));
+
+	for(i=0; i<4; i++){
+		CuAssertIntEquals(tc, 1, ptl_wd_push(deque, &wd_test_marks[i]));
+	}
+	CuAssertIntEquals(tc, 4, (int)ptl_wd_size(deque));
+
+	CuAssertPtrEquals(tc, &wd_test_marks[3], ptl_wd_pop(deque));
+	CuAssertPtrEquals(tc, &wd_test_marks[0], ptl_wd_steal(deque));
+	CuAssertPtrEquals(tc, &wd_test_marks[2], ptl_wd_pop(deque));
+	CuAssertPtrEquals(tc, &wd_test_marks[1], ptl_wd_steal(deque));
+	CuAssertPtrEquals(tc, NULL, ptl_wd_pop(deque));
+	CuAssertIntEquals(tc, 0, (int)ptl_wd_size(deque));
+
+	ptl_wd_destroy_work_deque(deque);
+}
+
+/* the buffer doubles with the elements in order, even once the indexes
+   have wrapped around it, and every buffer is freed on destroy */
+void TestWdGrows(CuTest *tc){
+	struct ptl_allocator counting;
+	struct ptl_allocator_stats stats;
+	int i = 0, wrong = 0;
+
+	ptl_init_counting_allocator(&counting, &stats, NULL);
+	ptl_work_deque_t deque = ptl_wd_create_work_deque(&counting);
+
+	// move the indexes part of the way around the first buffer
+	for(i=0; i<PTL_WD_INITIAL_SIZE / 2; i++){
+		ptl_wd_push(deque, &wd_test_marks[i]);
+		ptl_wd_steal(deque);
+	}
+
+	for(i=0; i<PTL_WD_INITIAL_SIZE * 4; i++){
+		ptl_wd_push(deque, &wd_test_marks[i]);
+	}
+	CuAssertIntEquals(tc, PTL_WD_INITIAL_SIZE * 4, (int)ptl_wd_size(deque));
+	CuAssertTrue(tc, deque->array->size >= PTL_WD_INITIAL_SIZE * 4);
+
+	for(i=0; i<PTL_WD_INITIAL_SIZE * 2; i++){
+		wrong += (ptl_wd_steal(deque) != &wd_test_marks[i]);
+	}
+	for(i=(PTL_WD_INITIAL_SIZE * 4) - 1; i>=PTL_WD_INITIAL_SIZE * 2; i--){
+		wrong += (ptl_wd_pop(deque) != &wd_test_marks[i]);
+	}
+	CuAssertIntEquals(tc, 0, wrong);
+	CuAssertPtrEquals(tc, NULL, ptl_wd_pop(deque));
+
+	ptl_wd_destroy_work_deque(deque);
+	CuAssertIntEquals(tc, 0, (int)stats.bytes_in_use);
+}
+
+/* with thieves racing the owner, every element is taken exactly once */
+void TestWdConcurrentSteal(CuTest *tc){
+	ptl_work_deque_t deque = ptl_wd_create_work_deque(NULL);
+	pthread_t threads[WD_TEST_THIEVES];
+	char *mark = NULL;
+	int i = 0, missing = 0;
+
+	wd_test_owner_done = 0;
+	wd_test_duplicates = 0;
+	for(i=0; i<WD_TEST_THIEVES; i++){
+		pthread_create(&threads[i], NULL, wd_test_thief, deque);
+	}
+
+	// the owner pops now and then, so both ends are contended
+	for(i=0; i<WD_TEST_ELEMENTS; i++){
+		ptl_wd_push(deque, &wd_test_marks[i]);
+		if(i % 3 == 0 && (mark = (char *)ptl_wd_pop(deque)) != NULL){
+			wd_test_take(mark);
+		}
+	}
+	while((mark = (char *)ptl_wd_pop(deque)) != NULL){
+		wd_test_take(mark);
+	}
+
+	__atomic_store_n(&wd_test_owner_done, 1, __ATOMIC_RELEASE);
+	for(i=0; i<WD_TEST_THIEVES; i++){
+		pthread_join(threads[i], NULL);
+	}
+
+	for(i=0; i<WD_TEST_ELEMENTS; i++){
+		missing += (wd_test_marks[i] == 0);
+		wd_test_marks[i] = 0;
+	}
+	CuAssertIntEquals(tc, 0, wd_test_duplicates);
+	CuAssertIntEquals(tc, 0, missing);
+
+	ptl_wd_destroy_work_deque(deque);
+}
+
+
+CuSuite *PtlWorkDequeGetSuite(){
+	CuSuite *suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, TestWdPushPopSteal);
+	SUITE_ADD_TEST(suite, TestWdGrows);
+	SUITE_ADD_TEST(suite, TestWdConcurrentSteal);
+
+	return suite;
+}